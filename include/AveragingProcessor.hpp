@@ -41,6 +41,7 @@ namespace libspeedwire {
         std::vector<AveragingState> states;                     //!< Array holding averaging states for alle knowne speedwire devices
         std::vector<ObisConsumer*> obisConsumerTable;           //!< Table of registered ObisConsumer
         std::vector<SpeedwireConsumer*> speedwireConsumerTable; //!< Table of registered SpeedwireConsumer
+        std::vector<ObisData*> obisPacketElements;              //!< Obis data of the current emeter packet to be passed on; kept to avoid reallocations
 
         int initializeState(const uint32_t serial_number, const DeviceType& device_type);
         int findStateIndex(const uint32_t serial_number);
@@ -57,6 +58,7 @@ namespace libspeedwire {
         virtual void consume(const SpeedwireDevice& device, ObisData& element);
         virtual void consume(const SpeedwireDevice& device, SpeedwireData& element);
         virtual void endOfObisData(const SpeedwireDevice& device, const uint32_t time);
+        virtual void consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time);
         virtual void endOfSpeedwireData(const SpeedwireDevice& device, const uint32_t time);
     };
 
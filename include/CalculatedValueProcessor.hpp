@@ -5,6 +5,7 @@
 #include <Consumer.hpp>
 #include <Producer.hpp>
 #include <ObisData.hpp>
+#include <ObisFilter.hpp>
 #include <SpeedwireData.hpp>
 
 namespace libspeedwire {
@@ -15,24 +16,43 @@ namespace libspeedwire {
      *
      *  The class is implemented as an ObisConsumer and SpeedwireConsumer. Values are passed on the obis_consumer and
      *  speedwire_consumer configured
+     *
+     *  Obis values are looked up in the ObisData instances the ObisFilter holds for the originating device; household values
+     *  derived from inverter data use the obis values of the emeter device set by setHouseholdEmeter(), or of the most recent
+     *  emeter device if none is set. Instances constructed from an ObisDataMap look up all obis values in this map, i.e. they
+     *  support a single emeter device. Measurements in raw storage mode are converted to floating point measurements where
+     *  all measurements are needed.
      */
     class CalculatedValueProcessor : public ObisConsumer, SpeedwireConsumer {
 
     protected:
 
-        ObisDataMap& obis_data_map;       //!< Reference to the data map, where all received obis values reside
+        ObisFilter* obis_filter;          //!< Pointer to the obis filter, where the received obis values of each device reside, or NULL
+        ObisDataMap* obis_data_map;       //!< Pointer to the data map, where the received obis values of a single device reside, or NULL
+        SpeedwireAddress emeter_address;  //!< Address of the most recent emeter device
+        SpeedwireAddress household_emeter_address;  //!< Address of the emeter device used for household values; 0:0 for the most recent emeter device
         SpeedwireDataMap& speedwire_data_map;  //!< Reference to the data map, where all received inverter values reside
         Producer& producer;            //!< Reference to producer to receive the consumed and calculated values
+        MeasurementValues pos_values;  //!< Converted positive power measurements; kept to avoid reallocations
+        MeasurementValues neg_values;  //!< Converted negative power measurements; kept to avoid reallocations
+        MeasurementValues sig_values;  //!< Converted signed power measurements; kept to avoid reallocations
+        MeasurementValues bat_values;  //!< Converted battery power measurements; kept to avoid reallocations
+
+        ObisData* getObisData(const SpeedwireAddress& address, const ObisType& element);
 
     public:
 
+        CalculatedValueProcessor(ObisFilter& obis_filter, SpeedwireDataMap& speedwire_map, Producer& producer);
         CalculatedValueProcessor(ObisDataMap& obis_map, SpeedwireDataMap& speedwire_map, Producer& producer);
         ~CalculatedValueProcessor(void);
 
+        void setHouseholdEmeter(const SpeedwireAddress& address);
+
         virtual void consume(const SpeedwireDevice& device, ObisData& element);
         virtual void consume(const SpeedwireDevice& device, SpeedwireData& element);
 
         virtual void endOfObisData(const SpeedwireDevice& device, const uint32_t time);
+        virtual void consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time);
         virtual void endOfSpeedwireData(const SpeedwireDevice& device, const uint32_t time);
     };
 
@@ -28,6 +28,22 @@ namespace libspeedwire {
          * @param timestamp The timestamp associated with the just finished emeter packet.
          */
         virtual void endOfObisData(const SpeedwireDevice& device, const uint32_t timestamp) {}
+
+        /**
+         * Callback to consume all obis data updated by an emeter packet at once, followed by the end of the packet.
+         * The default implementation adapts to the per-element interface by calling consume() for each element and
+         * endOfObisData() thereafter; consumers can override it to process a packet in a single loop.
+         * @param device The originating emeter device.
+         * @param elements An array of pointers to the ObisData instances updated by the emeter packet, in packet order.
+         * @param num_elements The number of elements in the array.
+         * @param timestamp The timestamp associated with the just finished emeter packet.
+         */
+        virtual void consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t timestamp) {
+            for (size_t i = 0; i < num_elements; ++i) {
+                consume(device, *elements[i]);
+            }
+            endOfObisData(device, timestamp);
+        }
     };
 
 
@@ -54,6 +70,40 @@ namespace libspeedwire {
         virtual void endOfSpeedwireData(const SpeedwireDevice&device, const uint32_t timestamp) {}
     };
 
+
+    /**
+     *  Interface to be implemented by the consumer of speedwire inverter history data, see class SpeedwireHistoryReader.
+     */
+    class SpeedwireHistoryConsumer {
+    public:
+        /** Virtual destructor */
+        virtual ~SpeedwireHistoryConsumer(void) {}
+
+        /**
+         * Consume a yield record.
+         * @param device The originating inverter device.
+         * @param command The history command, i.e. Command::YIELD_BY_MINUTE_QUERY or Command::YIELD_BY_DAY_QUERY.
+         * @param value A reference to the yield record.
+         */
+        virtual void consume(const SpeedwireDevice& device, const Command command, const SpeedwireRawDataYield::YieldValue& value) {}
+
+        /**
+         * Consume an event record.
+         * @param device The originating inverter device.
+         * @param value A reference to the event record.
+         */
+        virtual void consume(const SpeedwireDevice& device, const SpeedwireRawDataEvent::EventValue& value) {}
+
+        /**
+         * Callback to notify that a history download has finished.
+         * @param device The originating inverter device.
+         * @param command The history command.
+         * @param synced_time The inverter time up to and including which all records have been delivered.
+         * @param complete True if the entire requested time range has been delivered, false if the download failed.
+         */
+        virtual void endOfHistory(const SpeedwireDevice& device, const Command command, const uint32_t synced_time, const bool complete) {}
+    };
+
 }   // namespace libspeedwire
 
 #endif
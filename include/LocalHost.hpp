@@ -78,6 +78,9 @@ namespace libspeedwire {
         // platform neutral get unix epoch time in ms
         static uint64_t getUnixEpochTimeInMs(void);
 
+        // platform neutral get unix epoch time in ns
+        static uint64_t getUnixEpochTimeInNs(void);
+
         // platform neutral conversion of unix epoch time in ms to a formatted string
         static std::string unixEpochTimeInMsToString(uint64_t epoch);
 
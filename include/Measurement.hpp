@@ -9,13 +9,19 @@ namespace libspeedwire {
 
     /**
      *  Class holding measurement values together with their corresponding measurement type definition.
+     *
+     *  By default, raw values are divided by the divisor of the measurement type and stored in measurementValues. If raw
+     *  storage is enabled by setRawStorage(), raw values are stored in rawMeasurementValues instead and measurementValues
+     *  stays empty; getNewestMeasurement() and estimateMean() work for both storage modes.
      */
     class Measurement {
     public:
-        MeasurementType   measurementType;
-        MeasurementValues measurementValues;
-        Wire              wire;
-        std::string       description;
+        MeasurementType      measurementType;
+        MeasurementValues    measurementValues;
+        RawMeasurementValues rawMeasurementValues;
+        Wire                 wire;
+        std::string          description;
+        bool                 rawStorage;
 
         /**
          *  Constructor.
@@ -25,8 +31,40 @@ namespace libspeedwire {
         Measurement(const MeasurementType& mType, const Wire& mWire) :
             measurementType(mType),
             measurementValues(0),
+            rawMeasurementValues(0, mType.divisor),
             wire(mWire),
-            description(mType.getFullName(mWire)) {
+            description(mType.getFullName(mWire)),
+            rawStorage(false) {
+        }
+
+        /**
+         *  Switch to raw storage; raw values are kept as integers and scaled by the divisor only when they are read.
+         *  The floating point ring buffer is released. Readers must therefore use getNewestMeasurement() and estimateMean(),
+         *  or convert the raw values by rawMeasurementValues.toMeasurementValues() if they need all measurements, e.g. for
+         *  LineSegmentEstimator; reading measurementValues directly yields no measurements in raw storage mode.
+         *  @param capacity maximum number of raw measurements
+         */
+        void setRawStorage(const size_t capacity) {
+            rawStorage = true;
+            rawMeasurementValues.setDivisor(measurementType.divisor);
+            rawMeasurementValues.setMaximumNumberOfElements(capacity);
+            measurementValues = MeasurementValues(0);   // setMaximumNumberOfElements() cannot shrink the buffer
+        }
+
+        /**
+         *  Get the newest measurement value and time, regardless of the storage mode.
+         *  @return the newest measurement scaled by the divisor
+         */
+        TimestampDoublePair getNewestMeasurement(void) const {
+            return (rawStorage ? rawMeasurementValues.getNewestMeasurement() : measurementValues.getNewestElement());
+        }
+
+        /**
+         *  Estimate the sample mean of all measurements, regardless of the storage mode.
+         *  @return average value
+         */
+        double estimateMean(void) const {
+            return (rawStorage ? rawMeasurementValues.estimateMean() : measurementValues.estimateMean());
         }
 
         /**
@@ -35,13 +73,28 @@ namespace libspeedwire {
          *  @param time the measurement time
          */
         void addMeasurement(const int32_t  raw_value, const uint32_t time) {
-            measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            if (rawStorage) {
+                rawMeasurementValues.addMeasurement(raw_value, time);
+            }
+            else {
+                measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            }
         }
         void addMeasurement(const uint32_t raw_value, const uint32_t time) {
-            measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            if (rawStorage) {
+                rawMeasurementValues.addMeasurement(raw_value, time);
+            }
+            else {
+                measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            }
         }
         void addMeasurement(const uint64_t raw_value, const uint32_t time) {
-            measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            if (rawStorage) {
+                rawMeasurementValues.addMeasurement((int64_t)raw_value, time);
+            }
+            else {
+                measurementValues.addMeasurement((double)raw_value / (double)measurementType.divisor, time);
+            }
         }
     };
 
@@ -207,6 +207,182 @@ namespace libspeedwire {
         }
     };
 
+
+    /**
+     *  Class encapsulating a value-timestamp pair, where the value is a raw integer value relative to the base value of
+     *  the enclosing RawMeasurementValues instance. It takes half the memory of a TimestampDoublePair.
+     */
+    class TimestampRawPair {
+    public:
+        int32_t     value;      //!< Raw measurement value minus the base value
+        uint32_t    time;       //!< Measurement time
+
+        TimestampRawPair(void) : value(0), time(0) {}
+        TimestampRawPair(const int32_t v, const uint32_t t) : value(v), time(t) {}
+    };
+
+    /**
+     *  Class encapsulating a ring buffer of raw integer measurement values together with their timestamps.
+     *  Values are stored as 32-bit offsets to a common 64-bit base value, such that int32, uint32 and uint64 obis and
+     *  inverter values can be stored without conversion. Values are scaled by the divisor only when they are read;
+     *  sums are calculated in integer arithmetics, hence mean values are exact up to the final division.
+     *  If a new value does not fit, the base value is moved; if the range of stored values then exceeds 32 bits, the buffer is cleared.
+     */
+    class RawMeasurementValues : public RingBuffer<TimestampRawPair> {
+    protected:
+        int64_t base;                               //!< Base value of all stored values
+        double  divisor;                            //!< Divisor to obtain floating point measurements
+
+    public:
+        /**
+         * Constructor.
+         * @param capacity Maximum number of measurements
+         * @param divisor Divisor to obtain floating point measurements
+         */
+        RawMeasurementValues(const size_t capacity, const unsigned long divisor = 1) : RingBuffer(capacity), base(0), divisor(divisor != 0 ? (double)divisor : 1.0) {}
+
+        void setDivisor(const unsigned long divisor) { this->divisor = (divisor != 0 ? (double)divisor : 1.0); }
+        double getDivisor(void) const { return divisor; }
+
+        /**
+         *  Add a new raw measurement to the ring buffer. If the buffer is full, the oldest measurement is replaced.
+         *  @param raw_value the raw measurement value
+         *  @param time the measurement time
+         */
+        void addMeasurement(const int64_t raw_value, const uint32_t time) {
+            if (getNumberOfElements() == 0) {
+                base = raw_value;
+            }
+            int64_t offset = raw_value - base;
+            if (offset < INT32_MIN || offset > INT32_MAX) {
+                rebase(raw_value);
+                offset = raw_value - base;
+            }
+            addNewElement(TimestampRawPair((int32_t)offset, time));
+        }
+
+        /**
+         *  Get the raw measurement value at the given ring buffer index; the index boundaries are not checked.
+         *  @param i ring buffer index, where i = 0 gets the oldest element and i = (getNumberOfElements()-1) gets the newest element.
+         *  @return the raw value
+         */
+        int64_t getRawValue(const size_t i) const {
+            return base + at(i).value;
+        }
+
+        /**
+         *  Get the measurement value at the given ring buffer index scaled by the divisor; the index boundaries are not checked.
+         *  @param i ring buffer index
+         *  @return the measurement value
+         */
+        double getValue(const size_t i) const {
+            return (double)getRawValue(i) / divisor;
+        }
+
+        /**
+         *  Get the newest measurement scaled by the divisor.
+         *  @return the newest measurement, or TimestampDoublePair::defaultPair if the buffer is empty
+         */
+        TimestampDoublePair getNewestMeasurement(void) const {
+            const size_t n = getNumberOfElements();
+            if (n > 0) {
+                return TimestampDoublePair(getValue(n - 1), at(n - 1).time);
+            }
+            return TimestampDoublePair::defaultPair;
+        }
+
+        /**
+         *  Estimate the sample mean, aka average value, of all measurements in the ring buffer.
+         *  @return average value, or 0 if the ring buffer is empty
+         */
+        double estimateMean(void) const {
+            if (data_vector.size() == 0) {
+                return 0.0;
+            }
+            int64_t sum = 0;
+            for (const auto& m : data_vector) {
+                sum += m.value;
+            }
+            return ((double)base + (double)sum / data_vector.size()) / divisor;
+        }
+
+        /**
+         *  Estimate the sample mean, aka average value, over the given subset of measurements in the ring buffer.
+         *  @param from start index
+         *  @param to end index; the measurement with index end is included
+         *  @return average value
+         */
+        double estimateMean(const size_t from, const size_t to) const {
+            int64_t sum = 0;
+            for (size_t index = from; index <= to; ++index) {
+                sum += at(index).value;
+            }
+            return ((double)base + (double)sum / (to - from + 1)) / divisor;
+        }
+
+        /**
+         *  Estimate sample mean and sample variance values over the given subset of measurements in the ring buffer.
+         *  The values are centered at the first value, such that the sums do not lose precision for large raw values.
+         *  @param from start index
+         *  @param to end index; the measurement with index end is included
+         *  @param the sample mean result
+         *  @param the sample variance result
+         */
+        void estimateMeanAndVariance(const size_t start_index, const size_t end_index, double& mean, double& var) const {
+            const size_t n_values = end_index - start_index + 1;
+            const int64_t center = at(start_index).value;
+
+            int64_t y_sum = 0;
+            double y_sq_sum = 0.0;
+            for (size_t index = start_index; index <= end_index; ++index) {
+                const int64_t value = at(index).value - center;
+                y_sum    += value;
+                y_sq_sum += (double)value * (double)value;
+            }
+            const double centered_mean = (double)y_sum / n_values;
+            mean = ((double)(base + center) + centered_mean) / divisor;
+            var  = (n_values <= 1 ? FLT_MAX : (y_sq_sum - centered_mean * y_sum) / (n_values - 1) / (divisor * divisor));
+        }
+
+        /**
+         *  Convert all measurements to floating point measurements, e.g. to use the algorithms implemented for MeasurementValues.
+         *  @param values the measurement values to replace; its capacity is set to the capacity of this ring buffer
+         */
+        void toMeasurementValues(MeasurementValues& values) const {
+            const size_t n = getNumberOfElements();
+            values.setMaximumNumberOfElements(getMaximumNumberOfElements());
+            for (size_t i = 0; i < n; ++i) {
+                values.addMeasurement(getValue(i), at(i).time);
+            }
+        }
+
+    protected:
+        /**
+         *  Rebase the stored values such that they and the given raw value fit into 32-bit offsets; if the range of
+         *  values is too large, all stored values are dropped and the given raw value becomes the new base value.
+         *  @param raw_value the raw value to be added next
+         */
+        void rebase(const int64_t raw_value) {
+            int64_t min_value = raw_value, max_value = raw_value;
+            for (const auto& m : data_vector) {
+                const int64_t value = base + m.value;
+                min_value = (value < min_value ? value : min_value);
+                max_value = (value > max_value ? value : max_value);
+            }
+            if ((uint64_t)(max_value - min_value) > UINT32_MAX) {
+                clear();
+                base = raw_value;
+                return;
+            }
+            const int64_t new_base = min_value - INT32_MIN;     // offsets range from INT32_MIN to INT32_MAX
+            const int64_t diff = base - new_base;
+            for (auto& m : data_vector) {
+                m.value = (int32_t)(m.value + diff);
+            }
+            base = new_base;
+        }
+    };
+
 }   // namespace libspeedwire
 
 #endif
@@ -0,0 +1,128 @@
+#ifndef __LIBSPEEDWIRE_MPMCQUEUE_HPP__
+#define __LIBSPEEDWIRE_MPMCQUEUE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace libspeedwire {
+
+    /**
+     *  Class encapsulating a bounded lock-free multi-producer multi-consumer queue for elements of type T.
+     *  Any number of threads may call push() and pop() concurrently; neither call ever blocks. Each cell carries a
+     *  sequence number telling producers and consumers whether the cell is free or holds an element for the current lap.
+     *  The capacity is rounded up to the next power of two.
+     */
+    template<class T> class MpmcQueue {
+    protected:
+        //! Queue cell holding a single element.
+        struct Cell {
+            std::atomic<size_t> sequence;           //!< Sequence number of the cell
+            T                   data;               //!< Element
+        };
+
+        std::unique_ptr<Cell[]> cells;              //!< Array of queue cells
+        size_t                  mask;               //!< Capacity - 1, used to wrap the positions
+        char                    padding1[64];       //!< Keep enqueue and dequeue position on separate cache lines
+        std::atomic<size_t>     enqueue_pos;        //!< Position of the next element to push
+        char                    padding2[64];       //!< Keep enqueue and dequeue position on separate cache lines
+        std::atomic<size_t>     dequeue_pos;        //!< Position of the next element to pop
+
+    public:
+
+        /**
+         * Constructor.
+         * @param capacity Minimum number of elements the queue can hold
+         */
+        MpmcQueue(const size_t capacity) : enqueue_pos(0), dequeue_pos(0) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            cells.reset(new Cell[size]);
+            mask = size - 1;
+            for (size_t i = 0; i < size; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         *  Push an element to the tail of the queue.
+         *  @param element the element to push
+         *  @return true if successful, false if the queue is full
+         */
+        bool push(const T& element) {
+            Cell* cell;
+            size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &cells[pos & mask];
+                intptr_t diff = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+                if (diff == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            cell->data = element;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         *  Pop an element from the head of the queue.
+         *  @param element reference to the element receiving the popped value
+         *  @return true if successful, false if the queue is empty
+         */
+        bool pop(T& element) {
+            Cell* cell;
+            size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                cell = &cells[pos & mask];
+                intptr_t diff = (intptr_t)cell->sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+                if (diff == 0) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+            element = std::move(cell->data);
+            cell->sequence.store(pos + mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         *  Get the number of elements that are currently stored in the queue. The result is a snapshot, if the queue is in use.
+         *  @return the number of elements
+         */
+        size_t getNumberOfElements(void) const {
+            size_t enq = enqueue_pos.load(std::memory_order_acquire);
+            size_t deq = dequeue_pos.load(std::memory_order_acquire);
+            return (enq > deq ? enq - deq : 0);
+        }
+
+        /**
+         *  Get the maximum number of elements that can be stored in the queue.
+         *  @return the maximum number
+         */
+        size_t getMaximumNumberOfElements(void) const {
+            return mask + 1;
+        }
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -172,6 +172,41 @@ namespace libspeedwire {
         static const ObisDataMap& getAllPredefined(void);
     };
 
+
+    /**
+     *  Class implementing a perfect hash table for a set of obis keys, as given by ObisType::toKey().
+     *  The table is built once for the given set of keys; it then maps each key to its position in the key vector, which can be used
+     *  to index a contiguous array of entries. A lookup is a multiplication, a shift and a single comparison of the key.
+     */
+    class ObisKeyTable {
+    protected:
+        std::vector<uint32_t> keys;     //!< Keys in the order given to build()
+        std::vector<int16_t>  slots;    //!< Hash table holding indexes into keys, or -1 for empty slots
+        uint32_t multiplier;            //!< Multiplier of the hash function
+        uint32_t shift;                 //!< Shift of the hash function, i.e. 32 minus the number of hash bits
+
+    public:
+        ObisKeyTable(void);
+
+        bool build(const std::vector<uint32_t>& keys);
+
+        /**
+         *  Find the given key.
+         *  @param key The obis key
+         *  @return the index of the key in the vector of keys given to build(), or -1 if the key is not in the table
+         */
+        int find(const uint32_t key) const {
+            const int16_t index = slots[(uint32_t)(key * multiplier) >> shift];
+            return (index >= 0 && keys[index] == key ? index : -1);
+        }
+
+        /** Get the keys in the order given to build(). */
+        const std::vector<uint32_t>& getKeys(void) const { return keys; }
+
+        /** Get the number of keys. */
+        size_t size(void) const { return keys.size(); }
+    };
+
 }   // namespace libspeedwire
 
 #endif
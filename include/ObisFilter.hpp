@@ -6,6 +6,7 @@
 #include <Consumer.hpp>
 #include <ObisData.hpp>
 #include <SpeedwireDevice.hpp>
+#include <SpeedwireEmeterProtocol.hpp>
 
 namespace libspeedwire {
 
@@ -17,12 +18,40 @@ namespace libspeedwire {
      *  The general idea is that the ObisData instances held by the filter will hold the most recent obis data
      *  values. Also aggregation of consecutively received obis data is done inside the ObisData instances held
      *  by the filter. Registered onsumers will recieve a reference to the ObisData instance held by the filter.
+     *
+     *  The filter keeps separate ObisData instances for each device, such that measurements of different emeters do not
+     *  interleave. They are copied from the registered ObisData instances when the first packet of a device is consumed and
+     *  are found through an open addressing hash index keyed on susy id and serial number.
+     *
+     *  The ObisData instances of each device are kept in a contiguous array in the order of the registered obis keys; an obis
+     *  key is mapped to its array index by a perfect hash table that is rebuilt whenever elements are added or removed.
+     *  Changes to the registered ObisData instances must therefore be made through addFilter() and removeFilter().
+     *
+     *  When a whole emeter packet is consumed, the updated ObisData instances are collected and delivered to each consumer
+     *  by a single ObisConsumer::consumePacket() call instead of one consume() call per element and consumer.
      */
     class ObisFilter {
 
     protected:
+        //! Filter state of a single device.
+        struct DeviceFilter {
+            SpeedwireAddress      address;          //!< Device address
+            std::vector<ObisData> entries;          //!< Copies of the registered ObisData instances holding the measurements of this device, indexed by keyTable
+        };
+
         std::vector<ObisConsumer*> consumerTable;   //!< Table of registered ObisConsumers
-        ObisDataMap                filterMap;       //!< Map of registered ObisData instance
+        ObisDataMap                filterMap;       //!< Map of registered ObisData instance; the template for all devices
+        ObisKeyTable               keyTable;        //!< Perfect hash table mapping the obis keys of filterMap to entry indexes
+        std::vector<DeviceFilter>  deviceFilters;   //!< Filter state of all devices in order of appearance
+        std::vector<int32_t>       deviceIndex;     //!< Open addressing hash index holding indexes into deviceFilters, or -1 for empty entries
+        std::vector<ObisData*>     packetElements;  //!< ObisData instances updated by the emeter packet currently consumed; kept to avoid reallocations
+
+        void rebuild(void);
+        void assignEntry(ObisData& entry, const ObisData& registered);
+        DeviceFilter& getDeviceFilter(const SpeedwireAddress& address);
+        ObisData* consumeElement(DeviceFilter& device_filter, const SpeedwireEmeterProtocol::ObisElement& obis, const uint32_t time);
+        void insertHash(const int32_t index);
+        static size_t hash(const SpeedwireAddress& address);
 
     public:
         ObisFilter(void);
@@ -33,12 +62,18 @@ namespace libspeedwire {
         void addFilter(const ObisDataMap& entries);
         void removeFilter(const ObisData& entry);
         ObisDataMap& getFilter(void);
+        std::vector<ObisData>* getFilter(const SpeedwireAddress& address);
+        ObisData* const getFilter(const SpeedwireAddress& address, const ObisType& element);
+        size_t getNumberOfDevices(void) const { return deviceFilters.size(); }
 
         void addConsumer(ObisConsumer& obisConsumer);
 
         bool consume(const SpeedwireDevice&device, const void* const obis, const uint32_t time);
+        bool consume(const SpeedwireDevice& device, const SpeedwireEmeterProtocol::ObisElement& obis, const uint32_t time);
+        int  consume(const SpeedwireDevice& device, const SpeedwireEmeterProtocol& packet, const uint32_t time);
         ObisData* const filter(const SpeedwireDevice& device, const ObisType& element);
         void produce(const SpeedwireDevice& device, ObisData& element);
+        void produce(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time);
 
         void endOfObisData(const SpeedwireDevice& device, const uint32_t time);
     };
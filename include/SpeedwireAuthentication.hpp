@@ -72,6 +72,32 @@ namespace libspeedwire {
      */
     class SpeedwireAuthentication : public SpeedwireCommand {
 
+    public:
+        static const uint32_t session_timeout_in_s = 900;   //!< Session timeout requested by login commands
+
+        //! Enumeration of login session states.
+        enum class SessionState {
+            NONE,               //!< Not logged in, or the session lapsed
+            PENDING,            //!< Login request sent, waiting for the reply
+            AUTHENTICATED,      //!< Logged in, until the expiry time
+            FAILED              //!< Login failed, either by an error code or by a timeout
+        };
+
+        //! Login session of a single device.
+        struct LoginSession {
+            SpeedwireAddress address;   //!< Susy id and serial number of the device
+            SessionState state;         //!< Session state
+            uint16_t packet_id;         //!< Packet id of the pending login request
+            uint64_t request_time;      //!< Time when the most recent login request was sent in ms
+            uint64_t expiry_time;       //!< Time when the session expires in ms
+            uint16_t error_code;        //!< Error code of the most recent login reply
+        };
+
+    protected:
+        std::vector<LoginSession> sessions;     //!< Login sessions, one for each device
+
+        LoginSession& getSession(const SpeedwireAddress& address);
+
     public:
         SpeedwireAuthentication(const LocalHost& localhost, const std::vector<SpeedwireDevice>& devices) : SpeedwireCommand(localhost, devices) {}
         ~SpeedwireAuthentication(void) {}
@@ -91,6 +117,17 @@ namespace libspeedwire {
         // asynchronous send command methods - send command requests and return immediately
         SpeedwireCommandTokenIndex sendLoginRequest(const std::string& if_address, const SpeedwireAddress& dst, const SpeedwireAddress& src, const Credentials& credentials);
         bool sendLogoffRequest(const std::string& if_address, const SpeedwireAddress& dst, const SpeedwireAddress& src);
+
+        // concurrent login methods - send login requests to all devices at once and collect the replies through the command tokens
+        int  loginConcurrently(const Credentials& credentials, const int timeout_in_ms = 1000, const int renew_margin_in_ms = 60000);
+        int  sendLoginRequests(const Credentials& credentials, const int renew_margin_in_ms = 60000);
+        bool handleLoginReply(const SpeedwireHeader& packet, const struct sockaddr& src);
+        int  expireLoginRequests(const int timeout_in_ms);
+
+        // login session state
+        const std::vector<LoginSession>& getSessions(void) const { return sessions; }
+        bool isAuthenticated(const SpeedwireAddress& address) const;
+        void invalidateSession(const SpeedwireAddress& address);
     };
 
 }   // namespace libspeedwire
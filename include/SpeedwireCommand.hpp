@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <SpeedwireDiscovery.hpp>
 #include <SpeedwireHeader.hpp>
 #include <SpeedwireSocket.hpp>
@@ -79,7 +80,11 @@ namespace libspeedwire {
         uint16_t    susyid;             //!< Susyid of the speedwire device the query was send to
         uint32_t    serialnumber;       //!< Serial number of the speedwire device the query was send to
         uint16_t    packetid;           //!< Packet identifier of the query packet
-        std::string peer_ip_address;    //!< IP address of the speedwire device the query was send to
+        uint16_t    peer_family;        //!< Address family of the speedwire device ip address, AF_INET or AF_INET6
+        union {
+            struct in_addr  v4;         //!< IPv4 address of the speedwire device the query was send to
+            struct in6_addr v6;         //!< IPv6 address of the speedwire device the query was send to
+        }           peer_ip;            //!< IP address of the speedwire device the query was send to
         Command     command;            //!< Command identifier of the query
         uint32_t    create_time;        //!< Creation time of the query as lower 32-bit of unix epoch timestamp
     } SpeedwireCommandToken;
@@ -88,24 +93,64 @@ namespace libspeedwire {
     /**
      *  Class SpeedwireCommandTokenRepository holds SpeedwireCommandTokens from when the command is send
      *  to the peer until the corresponding reply is received.
+     *  Tokens are kept in a pool of slots; a token index is the slot index and remains valid until the token is removed.
+     *  Tokens are found through an open addressing hash index keyed on susy id, serial number and packet id, and
+     *  are expired by a hierarchical timer wheel with 1 ms ticks, such that add, find and remove take constant time
+     *  and the cost of expire is proportional to the number of expired tokens.
      */
     typedef int SpeedwireCommandTokenIndex;
 
     class SpeedwireCommandTokenRepository {
     public:
         SpeedwireCommandTokenIndex add(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid, const std::string& peer_ip_address, const Command command);
+        SpeedwireCommandTokenIndex add(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid, const struct sockaddr& peer_address, const Command command);
         int  find(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid) const;
         void remove(const SpeedwireCommandTokenIndex index);
         void clear(void);
         int  expire(const int timeout_in_ms);
         const SpeedwireCommandToken& at(const SpeedwireCommandTokenIndex index) const;
+        bool isValid(const SpeedwireCommandTokenIndex index) const;
         int  size(void) const;
-        bool needs_login;
+        void setNeedsLogin(const SpeedwireAddress& device);
+        bool needs_login;                                   //!< True if any device replied with error code 0x0017, i.e. not authenticated
+        std::vector<SpeedwireAddress> needs_login_devices;  //!< Devices that replied with error code 0x0017 since the flag was last cleared
 
-        SpeedwireCommandTokenRepository(void) { needs_login = false; }
+        SpeedwireCommandTokenRepository(void);
 
     protected:
-        std::vector<SpeedwireCommandToken> token;
+        static const int wheel_level0_bits = 8;     //!< Number of bits of the level 0 timer wheel, i.e. 256 ticks of 1 ms
+        static const int wheel_level_bits  = 6;     //!< Number of bits of each higher level timer wheel, i.e. 64 ticks
+        static const int wheel_levels      = 4;     //!< Number of timer wheel levels; they cover 2^26 ms, i.e. about 18 hours
+        static const int wheel_buckets     = (1 << wheel_level0_bits) + (wheel_levels - 1) * (1 << wheel_level_bits);
+
+        //! Token slot, holding a token together with its timer wheel links.
+        struct Slot {
+            SpeedwireCommandToken token;    //!< Token
+            uint64_t time;                  //!< Creation time in ms since the unix epoch
+            int32_t  prev;                  //!< Previous slot in the same timer wheel bucket, or -1
+            int32_t  next;                  //!< Next slot in the same timer wheel bucket or in the free list, or -1
+            int16_t  bucket;                //!< Timer wheel bucket holding this slot, or -1 if the slot is free
+        };
+
+        std::vector<Slot> slots;            //!< Token slots
+        int32_t free_slots;                 //!< First slot of the free list, or -1
+        int     num_tokens;                 //!< Number of tokens in use
+        std::vector<int32_t> hash_index;    //!< Open addressing hash index holding slot indexes, or -1 for empty entries
+        int32_t wheel[wheel_buckets];       //!< First slot of each timer wheel bucket, or -1
+        int     wheel_count[wheel_levels];  //!< Number of tokens in each timer wheel level
+        uint64_t wheel_time;                //!< Current time of the timer wheel in ms since the unix epoch
+
+        SpeedwireCommandTokenIndex add(const SpeedwireCommandToken& token, const uint64_t time);
+        int  expire(const int timeout_in_ms, const uint64_t now);
+        void grow(void);
+        static size_t hash(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid);
+        void insertHash(const int32_t slot);
+        void removeHash(const int32_t slot);
+        int  getBucket(uint64_t time) const;
+        void insertWheel(const int32_t slot);
+        void removeWheel(const int32_t slot);
+        void cascade(const int bucket);
+        void release(const int32_t slot);
     };
 
 
@@ -116,16 +161,66 @@ namespace libspeedwire {
     class SpeedwireCommand {
     public:
         typedef int SocketIndex;
-        typedef std::map<std::string, SocketIndex> SocketMap;
+
+        //! Socket opened on a local interface.
+        struct InterfaceSocket {
+            SpeedwireInterfaceID interface_id;  //!< Binary identifier of the local interface
+            std::string interface_address;      //!< IP address of the local interface
+            SocketIndex socket_index;           //!< Index of the socket, or -1 if no socket could be opened
+        };
+        typedef std::vector<InterfaceSocket> SocketMap;
+
+        //! Route to a device, resolved when the device is registered and again whenever its binary device address or interface identifier changes.
+        struct DeviceRoute {
+            SocketIndex socket_index;               //!< Index of the socket used to reach the device
+            struct sockaddr_storage dest;           //!< Socket address of the device
+            struct sockaddr_storage device_address; //!< Binary device socket address the route was resolved from
+            SpeedwireInterfaceID interface_id;      //!< Interface identifier the route was resolved from
+
+            /** Check if the route was resolved from the current binary addresses of the given peer; there are no string operations. */
+            bool matches(const SpeedwireDevice& peer) const {
+                return (peer.interfaceID == interface_id && memcmp(&peer.deviceSockAddress, &device_address, sizeof(struct sockaddr_in6)) == 0);
+            }
+        };
+
+        //! Query request parameters for batched transmission, see sendQueryRequests().
+        struct QueryRequest {
+            const SpeedwireDevice* peer;    //!< Speedwire device the query is sent to
+            Command  command;               //!< Command identifier of the query
+            uint32_t first_register;        //!< First register id of the query
+            uint32_t last_register;         //!< Last register id of the query
+        };
+
+        static const size_t query_request_size = 24 + 8 + 8 + 6 + 4 + 4 + 4;    //!< Size of a query request packet
 
     protected:
         const LocalHost& localhost;
         const std::vector<SpeedwireDevice>& devices;
         std::vector<SpeedwireSocket> sockets;
         SocketMap socket_map;
+        std::unordered_map<uint64_t, DeviceRoute> routes;   // cached routes by susy id and serial number
+        DeviceRoute uncached_route;                         // route of a device without a complete device address
 
         static uint16_t packet_id;
 
+        // buffer arena and per packet arrays used by batched query transmission; they are kept to avoid reallocations
+        std::vector<uint8_t> request_arena;
+        std::vector<struct sockaddr_storage> request_dests;
+        std::vector<SocketIndex> request_sockets;
+        std::vector<uint16_t> request_packet_ids;
+        std::vector<const void*> batch_buffs;
+        std::vector<unsigned long> batch_sizes;
+        std::vector<const struct sockaddr_storage*> batch_dests;
+        std::vector<size_t> batch_requests;
+
+        SocketIndex getSocketIndex(const SpeedwireInterfaceID& if_id) const;
+        SocketIndex getSocketIndex(const std::string& if_address) const;
+        SocketIndex openInterfaceSocket(const SpeedwireInterfaceID& if_id);
+        bool resolveRoute(const SpeedwireDevice& peer, DeviceRoute& route);
+        const DeviceRoute* getRoute(const SpeedwireDevice& peer);
+
+        static void assembleQueryRequest(uint8_t* buffer, const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, const uint16_t packet_id);
+
         // query tokens are used to match inverter command requests with their responses
         SpeedwireCommandTokenRepository token_repository;
 
@@ -133,6 +228,10 @@ namespace libspeedwire {
         SpeedwireCommand(const LocalHost& localhost, const std::vector<SpeedwireDevice>& devices);
         ~SpeedwireCommand(void);
 
+        // resolve and cache the socket and the destination address of the given peer; changes of its binary addresses are picked up by each send,
+        // call it again whenever the ip address strings of a peer without resolved binary addresses change
+        bool registerDevice(const SpeedwireDevice& peer);
+
         // synchronous command methods - send command requests and wait for the response
         int32_t query(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, void* udp_buffer, const size_t udp_buffer_size, const int timeout_in_ms = 1000);
         SpeedwireDevice queryDeviceType(const SpeedwireDevice& peer, const int timeout_in_ms = 1000);
@@ -140,6 +239,9 @@ namespace libspeedwire {
         // asynchronous send command method - send command requests and return immediately
         SpeedwireCommandTokenIndex sendQueryRequest(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register);
 
+        // asynchronous batched send command method - send all command requests with a single sendmmsg call per socket and return immediately
+        std::vector<SpeedwireCommandTokenIndex> sendQueryRequests(const std::vector<QueryRequest>& requests);
+
         // synchronous receive method - receive command reply packet for the given command token; this method will block until the packet is received or it times out
         // (for asynchronous receive handling, see class SpeedwireReceiveDispatcher)
         int32_t receiveResponse(const SpeedwireCommandTokenIndex index, SpeedwireSocket& socket, void* udp_buffer, const size_t udp_buffer_size, const int poll_timeout_in_ms);
@@ -2,9 +2,11 @@
 #define __LIBSPEEDWIRE_SPEEDWIREDEVICE_HPP__
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <AddressConversion.hpp>
 #include <LocalHost.hpp>
+#include <SpeedwireSocket.hpp>
 
 namespace libspeedwire {
 
@@ -96,6 +98,60 @@ namespace libspeedwire {
     };
 
 
+    /**
+     *  Class holding a binary identifier of a local interface, i.e. its interface index and its ip address.
+     *  It is resolved once from the interface ip address string; comparisons are binary and do not involve any string operations.
+     */
+    class SpeedwireInterfaceID {
+    public:
+        uint32_t ifIndex;                   //!< Interface index, or (uint32_t)-1 if unknown
+        uint16_t family;                    //!< Address family AF_INET or AF_INET6, or AF_UNSPEC if unresolved
+        union {
+            struct in_addr  v4;             //!< IPv4 interface address
+            struct in6_addr v6;             //!< IPv6 interface address
+        } address;                          //!< Interface ip address
+
+        /** Default constructor. Initialize to an unresolved interface identifier. */
+        SpeedwireInterfaceID(void) : ifIndex((uint32_t)-1), family(AF_UNSPEC) { memset(&address, 0, sizeof(address)); }
+
+        /** Constructor. Resolve the interface identifier from the given local interface ip address; "0.0.0.0" resolves to the ipv4 any interface. */
+        SpeedwireInterfaceID(const LocalHost& localhost, const std::string& if_address) : SpeedwireInterfaceID() {
+            if (AddressConversion::isIpv4(if_address)) {
+                family = AF_INET;
+                address.v4 = AddressConversion::toInAddress(if_address);
+            }
+            else if (AddressConversion::isIpv6(if_address)) {
+                family = AF_INET6;
+                address.v6 = AddressConversion::toIn6Address(if_address);
+            }
+            if (family != AF_UNSPEC) {
+                ifIndex = localhost.getInterfaceIndex(if_address);
+            }
+        }
+
+        /** Check if this instance is resolved. */
+        bool isValid(void) const { return (family != AF_UNSPEC); }
+
+        /** Check if this instance denotes the ipv4 any interface, i.e. 0.0.0.0. */
+        bool isAny(void) const { return (family == AF_INET && address.v4.s_addr == 0); }
+
+        /** Compare two instances. */
+        bool operator==(const SpeedwireInterfaceID& rhs) const {
+            if (family != rhs.family || ifIndex != rhs.ifIndex) return false;
+            if (family == AF_INET)  return (address.v4.s_addr == rhs.address.v4.s_addr);
+            if (family == AF_INET6) return (memcmp(&address.v6, &rhs.address.v6, sizeof(address.v6)) == 0);
+            return true;
+        }
+
+        /** Convert the interface ip address to a string. */
+        std::string toString(void) const {
+            if (family == AF_INET)  return AddressConversion::toString(address.v4);
+            if (family == AF_INET6) return AddressConversion::toString(address.v6);
+            return std::string();
+        }
+    };
+
+
     /**
      *  Class encapsulating information about a speedwire device instance.
      */
@@ -106,10 +162,20 @@ namespace libspeedwire {
         std::string      deviceModel;           //!< Device model of the speedwire device, i.e. emeter or inverter.
         std::string      deviceIpAddress;       //!< IP address of the device, either on the local subnet or somewhere else.
         std::string      interfaceIpAddress;    //!< IP address of the local interface through which the device is reachable.
+        SpeedwireInterfaceID interfaceID;       //!< Binary identifier of the local interface through which the device is reachable; resolved from interfaceIpAddress.
+        struct sockaddr_storage deviceSockAddress;  //!< Binary socket address of the device, i.e. its ip address and the speedwire port; resolved from deviceIpAddress.
 
         /** Default constructor.
          *  Just initialize all member variables to a defined state; set susyId and serialNumber to 0. */
-        SpeedwireDevice(void) : deviceAddress(), deviceClass(), deviceModel(), deviceIpAddress(), interfaceIpAddress() {}
+        SpeedwireDevice(void) : deviceAddress(), deviceClass(), deviceModel(), deviceIpAddress(), interfaceIpAddress(), interfaceID() {
+            memset(&deviceSockAddress, 0, sizeof(deviceSockAddress));
+        }
+
+        /** Resolve interfaceID and deviceSockAddress from the ip address strings; call it whenever deviceIpAddress or interfaceIpAddress changes. */
+        void resolveAddresses(const LocalHost& localhost) {
+            interfaceID = SpeedwireInterfaceID(localhost, interfaceIpAddress);
+            deviceSockAddress = AddressConversion::toSockAddr(deviceIpAddress, SpeedwireSocket::speedwire_port_9522);
+        }
 
         /** Convert speedwire information to a single line string. */
         std::string toString(void) const {
@@ -26,7 +26,7 @@ namespace libspeedwire {
         std::vector<SpeedwireDevice> speedwireDevices;
 
         bool sendNextDiscoveryPacket(size_t& broadcast_counter, size_t& prereg_counter, size_t& subnet_counter, size_t& socket_counter);
-        bool recvDiscoveryPackets(const SpeedwireSocket& socket);
+        int  recvDiscoveryPackets(const SpeedwireSocket& socket);
         bool sendMulticastDiscoveryRequestToSockets(void);
         bool sendMulticastDiscoveryRequestToDevices(void);
         bool sendUnicastDiscoveryRequestToDevices(void);
@@ -1,7 +1,9 @@
 #ifndef __LIBSPEEDWIRE_SPEEDWIREEMETER_HPP__
 #define __LIBSPEEDWIRE_SPEEDWIREEMETER_HPP__
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <string>
 #include <SpeedwireHeader.hpp>
 #include <SpeedwireData2Packet.hpp>
@@ -31,6 +33,100 @@ namespace libspeedwire {
         unsigned long size;
 
     public:
+
+        /**
+         * Obis element of an emeter packet with its header fields and its value decoded once.
+         */
+        struct ObisElement {
+            const uint8_t* data;    //!< Pointer to the first byte of the obis element inside the packet
+            uint32_t key;           //!< Obis key channel << 24 | index << 16 | type << 8 | tariff, i.e. the same as ObisType::toKey()
+            uint64_t value;         //!< Raw value; 4-byte values are zero-extended, elements without a value hold 0
+            uint16_t length;        //!< Length of the obis element including its 4-byte header
+
+            uint8_t getChannel(void) const { return (uint8_t)(key >> 24); }
+            uint8_t getIndex(void)   const { return (uint8_t)(key >> 16); }
+            uint8_t getType(void)    const { return (uint8_t)(key >> 8); }
+            uint8_t getTariff(void)  const { return (uint8_t)key; }
+
+            /**
+             * Decode the obis element at the given position.
+             * @param element Pointer to the first byte of the obis element
+             * @param remaining Number of packet bytes from the given position to the end of the packet
+             * @return true if the entire obis element is inside the packet, false otherwise
+             */
+            bool decode(const uint8_t* const element, const unsigned long remaining) {
+                if (remaining < 4) {
+                    return false;
+                }
+                const uint8_t type = element[2];
+                const unsigned long len = (element[0] == sma_firmware_version_channel ? 8 : 4 + type);
+                if (len > remaining) {
+                    return false;
+                }
+                data   = element;
+                key    = ((uint32_t)element[0] << 24) | ((uint32_t)element[1] << 16) | ((uint32_t)type << 8) | (uint32_t)element[3];
+                length = (uint16_t)len;
+                if (type == 8 && len >= 12) {
+                    value = ((uint64_t)element[4] << 56) | ((uint64_t)element[5] << 48) | ((uint64_t)element[6] << 40) | ((uint64_t)element[7] << 32) |
+                            ((uint64_t)element[8] << 24) | ((uint64_t)element[9] << 16) | ((uint64_t)element[10] << 8) | (uint64_t)element[11];
+                }
+                else if (len >= 8) {
+                    value = ((uint32_t)element[4] << 24) | ((uint32_t)element[5] << 16) | ((uint32_t)element[6] << 8) | (uint32_t)element[7];
+                }
+                else {
+                    value = 0;
+                }
+                return true;
+            }
+        };
+
+        /**
+         * Bounds checked forward iterator over the obis elements of an emeter packet.
+         * Iteration ends before the first obis element that does not entirely fit into the packet.
+         */
+        class ObisElementIterator {
+        protected:
+            const uint8_t* current;         //!< Pointer to the current obis element, or NULL at the end
+            const uint8_t* end_of_packet;   //!< Pointer to the first byte after the packet
+            ObisElement    element;         //!< Decoded current obis element
+
+            void decode(void) {
+                if (current == NULL || element.decode(current, (unsigned long)(end_of_packet - current)) == false) {
+                    current = NULL;
+                }
+            }
+
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef ObisElement               value_type;
+            typedef std::ptrdiff_t            difference_type;
+            typedef const ObisElement*        pointer;
+            typedef const ObisElement&        reference;
+
+            /** Construct an end iterator. */
+            ObisElementIterator(void) : current(NULL), end_of_packet(NULL) {}
+
+            /** Construct an iterator pointing to the given obis element; the packet ends at the given end pointer. */
+            ObisElementIterator(const uint8_t* const first, const uint8_t* const end) : current(first), end_of_packet(end) {
+                decode();
+            }
+
+            reference operator*(void)  const { return element; }
+            pointer   operator->(void) const { return &element; }
+
+            ObisElementIterator& operator++(void) {
+                current += element.length;
+                decode();
+                return *this;
+            }
+            ObisElementIterator operator++(int) {
+                ObisElementIterator previous(*this);
+                ++(*this);
+                return previous;
+            }
+            bool operator==(const ObisElementIterator& rhs) const { return current == rhs.current; }
+            bool operator!=(const ObisElementIterator& rhs) const { return current != rhs.current; }
+        };
         //SpeedwireEmeterProtocol(const void* const udp_packet, const unsigned long udp_packet_size);
         SpeedwireEmeterProtocol(const SpeedwireHeader& protocol);
         SpeedwireEmeterProtocol(const SpeedwireData2Packet& data2_packet);
@@ -47,6 +143,32 @@ namespace libspeedwire {
         const void* getNextObisElement(const void* const current_element) const;
         void* setObisElement(void* const current_element, const void* const obis);
 
+        // iterate over the decoded obis elements, e.g. for (const auto& element : emeter_packet) { ... }
+        ObisElementIterator begin(void) const;
+        ObisElementIterator end(void) const;
+
+        /**
+         * Call the given visitor for each obis element of the packet; the visitor is called with a const ObisElement&.
+         * As the visitor type is a template parameter, the compiler can inline lambdas and function objects.
+         * @param visitor Function object called for each obis element
+         * @return the number of visited obis elements
+         */
+        template <class Visitor> unsigned long visitObisElements(Visitor&& visitor) const {
+            if (size < sma_first_obis_offset) {
+                return 0;
+            }
+            const uint8_t* current = udp + sma_first_obis_offset;
+            const uint8_t* const end_of_packet = udp + size;
+            unsigned long count = 0;
+            ObisElement element;
+            while (element.decode(current, (unsigned long)(end_of_packet - current))) {
+                visitor((const ObisElement&)element);
+                current += element.length;
+                ++count;
+            }
+            return count;
+        }
+
         // methods to get obis information with current_element pointing to the first byte of the given obis field
         static uint8_t getObisChannel(const void* const current_element);
         static uint8_t getObisIndex(const void* const current_element);
@@ -0,0 +1,92 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREEMETERSIMULATOR_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREEMETERSIMULATOR_HPP__
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include <LocalHost.hpp>
+#include <ObisData.hpp>
+#include <SpeedwireSocket.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a traffic generator for speedwire emeter packets, e.g. to measure the number of emeter and home manager
+     * devices that SpeedwireReceiveDispatcher and ObisFilter can sustain without SMA hardware.
+     * Each virtual emeter sends packets carrying all obis elements of ObisData::getAllPredefined() that are part of an emeter packet,
+     * i.e. all elements up to and including EndOfData, at the configured rate to a multicast or unicast destination address.
+     *
+     * The measurement values follow a household load curve with randomly switched appliances and a pv generation curve on
+     * each line; voltages and the grid frequency drift slowly. Reactive, apparent power, currents and power factors are derived
+     * from active power and voltage, and energy counters are integrated from the corresponding power values.
+     */
+    class SpeedwireEmeterSimulator {
+    public:
+        static const size_t max_packet_size = 1024;     //!< Maximum size of an emeter packet
+        static const size_t obis_index_range = 80;      //!< Obis indexes of emeter measurements are in the range 0 to 79
+
+    protected:
+        //! Obis element inside the emeter packet template.
+        struct ObisSlot {
+            unsigned long offset;               //!< Offset of the obis element in the packet
+            uint8_t  index;                     //!< Obis measurement index
+            uint8_t  type;                      //!< Obis measurement type, i.e. the value size in bytes
+            double   divisor;                   //!< Divisor of the measurement type
+        };
+
+        //! Virtual emeter device.
+        struct VirtualEmeter {
+            uint32_t serial_number;             //!< Serial number
+            uint64_t next_send_time;            //!< Time of the next packet in ns since the unix epoch
+            uint64_t last_update_time;          //!< Time of the last measurement update in ns since the unix epoch
+            double   base_load;                 //!< Base load per line in W
+            double   pv_peak;                   //!< Peak pv generation in W, evenly split across lines
+            double   phase;                     //!< Phase offset of the slow waveforms in rad
+            double   appliance_power[3];        //!< Power of the appliance switched on at each line in W, or 0
+            double   appliance_until[3];        //!< Time when the appliance state at each line changes in s since the unix epoch
+            double   values[obis_index_range];  //!< Current measurement values by obis index, in the units of their measurement types
+            double   energy[obis_index_range];  //!< Energy counters by obis index in kWh
+            std::vector<uint8_t> packet;        //!< Emeter packet, updated in place before each transmission
+        };
+
+        const LocalHost& localhost;
+        SpeedwireSocket socket;
+        struct sockaddr_storage destination;
+        std::vector<VirtualEmeter> emeters;
+        std::vector<ObisSlot> slots;            // obis elements of the packet template
+        unsigned long packet_size;
+        uint16_t susy_id;
+        uint64_t period_in_ns;
+        std::mt19937 random;
+
+        // buffers used for sending; they are kept to avoid reallocations
+        std::vector<const void*> send_buffs;
+        std::vector<unsigned long> send_sizes;
+        std::vector<const struct sockaddr_storage*> send_dests;
+
+        uint64_t num_packets;
+        uint64_t num_send_errors;
+
+        void assembleTemplate(VirtualEmeter& emeter);
+        void updateMeasurements(VirtualEmeter& emeter, const uint64_t time_in_ns);
+        void encodeMeasurements(VirtualEmeter& emeter, const uint64_t time_in_ns);
+
+    public:
+        SpeedwireEmeterSimulator(const LocalHost& localhost, const uint32_t seed = 1);
+        ~SpeedwireEmeterSimulator(void);
+
+        int  open(const std::string& local_ip_address, const std::string& destination_address, const size_t num_devices, const uint16_t susy_id, const uint32_t first_serial_number);
+        void close(void);
+
+        void setRate(const double packets_per_second);
+
+        int  run(const int timeout_in_ms);
+
+        uint64_t getNumberOfPackets(void) const { return num_packets; }
+        uint64_t getNumberOfSendErrors(void) const { return num_send_errors; }
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREEVENTLOOP_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREEVENTLOOP_HPP__
+
+#ifdef _WIN32
+#include <Winsock2.h>
+#include <Ws2tcpip.h>
+#elif defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include <cstdint>
+#include <vector>
+#include <SpeedwireSocket.hpp>
+
+namespace libspeedwire {
+
+    /**
+     *  Class implementing a long-lived event loop for speedwire sockets.
+     *  Sockets are registered once, either explicitly or lazily on their first wait call. On linux hosts the
+     *  implementation uses an edge-triggered epoll instance; readiness reported by epoll is remembered per socket
+     *  until the user of the socket has drained it, i.e. a receive call returned no further packet, and then
+     *  calls clearReady(). Registered sockets are therefore switched to non-blocking mode.
+     *  Ready sockets are kept in a list, such that waiting on a vector of sockets costs time proportional to the number
+     *  of ready sockets, not to the number of sockets. The mapping from socket fds to vector indexes is rebuilt whenever
+     *  wait() is called with a different socket vector, i.e. a vector at another address or of another size; a socket
+     *  replaced in place inside an unchanged vector must therefore be registered explicitly.
+     *  On other hosts the implementation falls back to level-triggered poll() calls.
+     */
+    class SpeedwireEventLoop {
+
+    protected:
+
+        //! Per socket state flags, indexed by socket fd.
+        enum SocketState : uint8_t {
+            UNREGISTERED = 0x00,    //!< The socket is not registered with the event loop.
+            REGISTERED   = 0x01,    //!< The socket is registered with the event loop.
+            READY        = 0x02,    //!< The socket has been reported readable and has not yet been drained.
+            LISTED       = 0x04     //!< The socket fd is contained in the list of ready socket fds.
+        };
+
+        std::vector<uint8_t> socket_states;     //!< SocketState flags indexed by socket fd.
+#if defined(__linux__) && !defined(_WIN32)
+        int epoll_fd;                           //!< The epoll instance.
+        std::vector<struct epoll_event> events; //!< Event array used by epoll_wait().
+        std::vector<int> ready_fds;             //!< Fds of sockets marked ready; entries drained or unregistered since are removed lazily.
+        std::vector<int> socket_indexes;        //!< Index of each socket fd in the indexed socket vector, or -1, indexed by socket fd.
+        const SpeedwireSocket* indexed_sockets; //!< Address of the socket vector socket_indexes refers to.
+        size_t num_indexed_sockets;             //!< Size of the socket vector socket_indexes refers to.
+        int harvestEvents(const int timeout_in_ms);
+        void markReady(const int fd);
+        void indexSockets(const std::vector<SpeedwireSocket>& sockets);
+#else
+        std::vector<struct pollfd> pollfds;     //!< Pollfd array used by poll().
+#endif
+
+    public:
+
+        SpeedwireEventLoop(void);
+        ~SpeedwireEventLoop(void);
+
+        bool registerSocket(const SpeedwireSocket& socket);
+        void unregisterSocket(const SpeedwireSocket& socket);
+        bool isRegistered(const SpeedwireSocket& socket) const;
+
+        // wait until at least one of the given sockets is readable; return the indexes of all readable sockets
+        int  wait(const std::vector<SpeedwireSocket>& sockets, std::vector<int>& ready_indexes, const int timeout_in_ms);
+        int  wait(const SpeedwireSocket& socket, const int timeout_in_ms);
+
+        bool isReady(const SpeedwireSocket& socket) const;
+        void clearReady(const SpeedwireSocket& socket);
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREHISTORYREADER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREHISTORYREADER_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <Consumer.hpp>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireDevice.hpp>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a streaming reader for the yield and event history of inverters.
+     * A history download covers a time range given in inverter time, i.e. seconds since the unix epoch. The reader splits the
+     * time range into pages and sends a YIELD_BY_MINUTE_QUERY, YIELD_BY_DAY_QUERY or EVENT_QUERY for each page, keeping up to
+     * pipeline depth pages in flight per download; the next page is requested as soon as a page is complete, before its records
+     * are decoded. Each record is decoded directly from the reply packet and passed to a SpeedwireHistoryConsumer, without
+     * intermediate SpeedwireRawData vectors. Replies split into several fragments are handled.
+     *
+     * The reader tracks the synced time of each download, i.e. the time up to and including which all records have been
+     * delivered. A download that was interrupted can be resumed by starting a new download at the synced time + 1.
+     * Records of different pages are delivered in the order of their arrival; records outside the requested page are skipped,
+     * such that each record is delivered once. A timed out yield page is retried for the records following the most recent
+     * delivered record; a timed out event page is retried in full, and event records already delivered are recognized by their
+     * time and entry id.
+     *
+     * The reader must be registered as inverter packet receiver with a SpeedwireReceiveDispatcher, and its poll() method must be
+     * called periodically, e.g. after each call to SpeedwireReceiveDispatcher::dispatch(). Token expiry must be left to the reader.
+     * Consumer callbacks must not call stop() or clear(); endOfHistory() may call start(), e.g. to resume a failed download.
+     */
+    class SpeedwireHistoryReader : public InverterPacketReceiverBase {
+    protected:
+        //! Page of a history download.
+        struct HistoryPage {
+            uint32_t first_time;            //!< First inverter time of the page
+            uint32_t last_time;             //!< Last inverter time of the page
+            uint32_t delivered_time;        //!< Time of the most recent delivered record of the page, or first time - 1
+            std::vector<uint64_t> delivered_events; //!< Time and entry id of each delivered event record of the page
+            uint16_t packet_id;             //!< Packet id of the query
+            uint64_t sent_time;             //!< Time when the query was sent or the most recent fragment was received in ms
+            int      retries;               //!< Number of retries after timeouts
+            bool     complete;              //!< True if the last fragment of the reply has been received
+        };
+
+        //! State of a history download.
+        struct HistoryJob {
+            SpeedwireDevice peer;           //!< Speedwire device
+            Command  command;               //!< History command
+            uint64_t next_time;             //!< First inverter time of the next page to be requested
+            uint32_t end_time;              //!< Last inverter time of the download
+            uint32_t page_span_in_s;        //!< Time span of each page in seconds
+            uint32_t synced_time;           //!< Inverter time up to and including which all records have been delivered
+            std::deque<HistoryPage> pages;  //!< Requested pages in time order, up to the first incomplete page
+            bool     finished;              //!< True if the download is complete or failed
+        };
+
+        SpeedwireCommand& command;              //!< Command instance used to send queries
+        SpeedwireHistoryConsumer& consumer;     //!< Consumer of the decoded records
+        size_t   pipeline_depth;                //!< Maximum number of pages in flight per download
+        int      timeout_in_ms;                 //!< Timeout of each page in ms
+        int      max_retries;                   //!< Maximum number of retries of each page
+        std::vector<HistoryJob> jobs;           //!< History downloads
+
+        HistoryJob* findJob(const SpeedwireAddress& address, const Command command);
+        const HistoryJob* findJob(const SpeedwireAddress& address, const Command command) const;
+        bool sendPage(HistoryJob& job, HistoryPage& page, const uint64_t now);
+        int  fill(HistoryJob& job, const uint64_t now);
+        void advance(HistoryJob& job);
+        void cancel(HistoryJob& job);
+        void finish(HistoryJob& job, const bool complete);
+        void deliver(const HistoryJob& job, HistoryPage& page, const SpeedwireInverterProtocol& inverter);
+        int  poll(const uint64_t now);
+        virtual SpeedwireCommandTokenIndex sendQueryRequest(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register);
+
+    public:
+        static const uint32_t yield_record_size = 4 + SpeedwireRawDataYield::value_size;   //!< Size of a yield record in a reply packet
+        static const uint32_t event_record_size = 4 + SpeedwireRawDataEvent::value_size;   //!< Size of an event record in a reply packet
+
+        SpeedwireHistoryReader(LocalHost& host, SpeedwireCommand& command, SpeedwireHistoryConsumer& consumer, const size_t pipeline_depth = 2, const int timeout_in_ms = 2000, const int max_retries = 2);
+        virtual ~SpeedwireHistoryReader(void) {}
+
+        bool start(const SpeedwireDevice& peer, const Command command, const uint32_t from_time, const uint32_t to_time, const uint32_t page_span_in_s = 0);
+        void stop(const SpeedwireDevice& peer, const Command command);
+        void clear(void);
+
+        int  poll(void);
+        bool isFinished(void) const;
+        bool isFinished(const SpeedwireDevice& peer, const Command command) const;
+        uint32_t getSyncedTime(const SpeedwireDevice& peer, const Command command) const;
+
+        virtual void receive(SpeedwireHeader& packet, struct sockaddr& src);
+
+        static uint32_t getDefaultPageSpan(const Command command);
+    };
+
+}   // namespace libspeedwire
+
+#endif
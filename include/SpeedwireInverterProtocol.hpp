@@ -89,6 +89,7 @@ namespace libspeedwire {
         uint32_t getDataUint32(unsigned long byte_offset) const;   // offset 0 is the first byte after last register index
         uint64_t getDataUint64(unsigned long byte_offset) const;
         void getDataUint8Array(const unsigned long byte_offset, uint8_t* buff, const size_t buff_size) const;
+        uint32_t getDataSize(void) const;
         uint32_t getRawDataLength(void) const;
         const void* getFirstRawDataElement(void) const;
         const void* getNextRawDataElement(const void* const current, uint32_t length) const;
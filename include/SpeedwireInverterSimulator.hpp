@@ -0,0 +1,138 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREINVERTERSIMULATOR_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREINVERTERSIMULATOR_HPP__
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <LocalHost.hpp>
+#include <SpeedwireAuthentication.hpp>
+#include <SpeedwireData.hpp>
+#include <SpeedwireDevice.hpp>
+#include <SpeedwireEventLoop.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireSocket.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a simulator for speedwire inverters, e.g. to test throughput and latency of SpeedwireCommand without SMA hardware.
+     * The simulator opens a unicast socket on port 9522 for each given local ip address, e.g. 127.0.0.2, 127.0.0.3, ... on the loopback
+     * interface or addresses inside a network namespace, and distributes its virtual devices evenly across these sockets.
+     * Each virtual device is a pv inverter with its own susy id and serial number.
+     *
+     * The simulator answers:
+     * - multicast and unicast discovery requests,
+     * - LOGIN and LOGOFF commands; the password is checked against the configured credentials,
+     * - queries for all registers of SpeedwireData::getAllPredefined() of a pv inverter, e.g. AC_QUERY, DC_QUERY, ENERGY_QUERY,
+     *   STATUS_QUERY and DEVICE_QUERY; the measurement values follow a daylight curve, energies are consistent with power,
+     * - YIELD_BY_MINUTE_QUERY, YIELD_BY_DAY_QUERY and EVENT_QUERY for any time range.
+     *
+     * Replies are delayed by the configured latency plus a random jitter, requests are dropped at the configured loss rate, and replies
+     * with more elements than configured per fragment are split into fragments. Queries to devices that are not logged in are answered
+     * with error code 0x0017, unless login is not required.
+     */
+    class SpeedwireInverterSimulator {
+    public:
+        static const size_t max_reply_size = 1472;     //!< Maximum size of a reply packet, i.e. the udp payload of an ethernet frame
+
+    protected:
+        //! Virtual inverter device.
+        struct VirtualDevice {
+            SpeedwireAddress address;           //!< Susy id and serial number
+            size_t   socket_index;              //!< Index of the socket the device is reachable at
+            uint32_t rated_power;               //!< Rated ac power in W
+            uint64_t session_expiry_time;       //!< Time when the login session expires in ms, or 0 if not logged in
+        };
+
+        //! Reply packet waiting for its due time.
+        struct PendingReply {
+            size_t   socket_index;              //!< Index of the socket the reply is sent from
+            struct sockaddr_storage dest;       //!< Destination address
+            unsigned long size;                 //!< Size of the reply packet
+            uint8_t  packet[max_reply_size];    //!< Reply packet
+        };
+
+        const LocalHost& localhost;
+        SpeedwireEventLoop event_loop;
+        std::vector<SpeedwireSocket> sockets;
+        std::vector<std::vector<size_t>> socket_devices;        // device indexes by socket index
+        std::vector<VirtualDevice> devices;
+        std::unordered_map<uint64_t, size_t> device_map;         // device indexes by susy id and serial number
+        std::vector<SpeedwireData> registers;                   // register definitions answered by each device
+        CredentialsMap credentials;
+        bool     require_login;
+        uint32_t latency_in_ms;
+        uint32_t jitter_in_ms;
+        double   loss_rate;
+        size_t   max_elements_per_fragment;
+        std::mt19937 random;
+
+        //! Heap entry of a pending reply; replies with equal due times are sent in the order they were queued.
+        struct ReplyEntry {
+            uint64_t due_time;                  //!< Time when the reply is sent in ms
+            uint64_t sequence;                  //!< Sequence number of the reply
+            size_t   slot;                      //!< Index of the reply in the reply pool
+            bool operator>(const ReplyEntry& rhs) const { return (due_time != rhs.due_time ? due_time > rhs.due_time : sequence > rhs.sequence); }
+        };
+
+        // pending replies are kept in a pool of slots; a binary min heap of due times orders them
+        std::vector<PendingReply> reply_pool;
+        std::vector<size_t> free_replies;
+        std::vector<ReplyEntry> reply_heap;
+        uint64_t reply_sequence;
+
+        // buffers used for receiving, assembling and sending; they are kept to avoid reallocations
+        std::vector<uint8_t> recv_buffer;
+        std::vector<uint8_t> elements;
+        std::vector<const void*> send_buffs;
+        std::vector<unsigned long> send_sizes;
+        std::vector<const struct sockaddr_storage*> send_dests;
+        std::vector<size_t> due_replies;
+
+        uint64_t num_requests;
+        uint64_t num_replies;
+        uint64_t num_dropped;
+
+        void handleRequest(const size_t socket_index, uint8_t* const packet, const unsigned long size, const struct sockaddr_storage& src, const uint64_t now);
+        void handleCommand(VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t now, const uint64_t due_time);
+        void handleLogin(VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t now, const uint64_t due_time);
+        uint32_t assembleQueryElements(const VirtualDevice& device, const Command command, const uint32_t first_register, const uint32_t last_register, const uint32_t time);
+        uint32_t assembleTimelineElements(const VirtualDevice& device, const Command command, const uint32_t first_time, const uint32_t last_time);
+        void encodeRegister(const VirtualDevice& device, const SpeedwireData& reg, const uint32_t time, uint8_t* const element, const uint32_t element_size) const;
+        int64_t getRegisterValue(const VirtualDevice& device, const SpeedwireData& reg, const uint32_t time) const;
+        uint64_t getEnergy(const VirtualDevice& device, const uint32_t time) const;
+        static double getDaylight(const uint32_t time);
+
+        PendingReply& allocateReply(const size_t socket_index, const struct sockaddr_storage& dest, const uint64_t due_time);
+        SpeedwireInverterProtocol assembleReplyHeader(PendingReply& reply, const VirtualDevice& device, const SpeedwireInverterProtocol& request, const uint32_t data_size);
+        void queueReplies(const VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint32_t element_size, const uint64_t due_time);
+        void queueDiscoveryResponse(const size_t socket_index, const struct sockaddr_storage& src, const uint64_t due_time);
+        void queueUnicastDiscoveryResponse(const VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t due_time);
+        int  sendDueReplies(const uint64_t now);
+
+    public:
+        SpeedwireInverterSimulator(const LocalHost& localhost, const uint32_t seed = 1);
+        ~SpeedwireInverterSimulator(void);
+
+        int  open(const std::vector<std::string>& local_ip_addresses, const size_t num_devices, const uint16_t susy_id, const uint32_t first_serial_number);
+        void close(void);
+
+        void setCredentials(const CredentialsMap& credentials) { this->credentials = credentials; }
+        void setRequireLogin(const bool require_login) { this->require_login = require_login; }
+        void setLatency(const uint32_t latency_in_ms, const uint32_t jitter_in_ms) { this->latency_in_ms = latency_in_ms; this->jitter_in_ms = jitter_in_ms; }
+        void setLossRate(const double loss_rate) { this->loss_rate = loss_rate; }
+        void setMaxElementsPerFragment(const size_t max_elements) { this->max_elements_per_fragment = max_elements; }
+
+        int  run(const int timeout_in_ms);
+
+        std::vector<SpeedwireDevice> getDevices(void) const;
+        uint64_t getNumberOfRequests(void) const { return num_requests; }
+        uint64_t getNumberOfReplies(void) const { return num_replies; }
+        uint64_t getNumberOfDroppedRequests(void) const { return num_dropped; }
+    };
+
+}   // namespace libspeedwire
+
+#endif
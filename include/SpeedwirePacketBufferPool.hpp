@@ -0,0 +1,159 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREPACKETBUFFERPOOL_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREPACKETBUFFERPOOL_HPP__
+
+#ifdef _WIN32
+#include <Winsock2.h>
+#include <Ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <MpmcQueue.hpp>
+#include <SpeedwireHeader.hpp>
+
+namespace libspeedwire {
+
+    class SpeedwirePacketBufferPool;
+
+    /**
+     *  Class holding a single received udp packet together with its sender address. Packet buffers are owned by a
+     *  SpeedwirePacketBufferPool and are reference counted by SpeedwirePacketHandle instances.
+     */
+    class SpeedwirePacketBuffer {
+    public:
+        static const size_t max_packet_size = 2048;     //!< Size of the packet data array
+
+        uint8_t data[max_packet_size];                  //!< Packet data
+        int nbytes;                                     //!< Number of bytes in the packet
+        struct sockaddr_storage src;                    //!< Sender address of the packet
+        uint64_t arrival_time_ns;                       //!< Arrival time of the packet in ns since the unix epoch
+
+    protected:
+        friend class SpeedwirePacketHandle;
+        friend class SpeedwirePacketBufferPool;
+
+        std::atomic<int> ref_count;                     //!< Number of handles referencing this buffer
+        SpeedwirePacketBufferPool* pool;                //!< Pool owning this buffer
+
+    public:
+        SpeedwirePacketBuffer(void) : nbytes(0), arrival_time_ns(0), ref_count(0), pool(NULL) {}
+    };
+
+
+    /**
+     *  Class implementing a reference counted handle to a SpeedwirePacketBuffer. Handles can be copied and retained
+     *  by packet receivers beyond their receive callback and passed to other threads; the buffer is returned to its
+     *  pool when the last handle referencing it is destroyed or reset. Handles must not outlive their pool.
+     */
+    class SpeedwirePacketHandle {
+    protected:
+        SpeedwirePacketBuffer* buffer;                  //!< Referenced packet buffer, or NULL
+
+        void addReference(void) { if (buffer != NULL) buffer->ref_count.fetch_add(1, std::memory_order_relaxed); }
+        void releaseReference(void);
+
+    public:
+        SpeedwirePacketHandle(void) : buffer(NULL) {}
+        explicit SpeedwirePacketHandle(SpeedwirePacketBuffer* buffer) : buffer(buffer) { addReference(); }
+        SpeedwirePacketHandle(const SpeedwirePacketHandle& rhs) : buffer(rhs.buffer) { addReference(); }
+        SpeedwirePacketHandle(SpeedwirePacketHandle&& rhs) : buffer(rhs.buffer) { rhs.buffer = NULL; }
+        ~SpeedwirePacketHandle(void) { releaseReference(); }
+
+        SpeedwirePacketHandle& operator=(const SpeedwirePacketHandle& rhs) {
+            if (buffer != rhs.buffer) {
+                releaseReference();
+                buffer = rhs.buffer;
+                addReference();
+            }
+            return *this;
+        }
+
+        SpeedwirePacketHandle& operator=(SpeedwirePacketHandle&& rhs) {
+            if (this != &rhs) {
+                releaseReference();
+                buffer = rhs.buffer;
+                rhs.buffer = NULL;
+            }
+            return *this;
+        }
+
+        //! Release the reference to the packet buffer; the handle is invalid afterwards.
+        void reset(void) { releaseReference(); buffer = NULL; }
+
+        //! Check if the handle references a packet buffer.
+        bool isValid(void) const { return (buffer != NULL); }
+
+        //! Get the number of handles referencing the packet buffer.
+        int getReferenceCount(void) const { return (buffer != NULL ? buffer->ref_count.load(std::memory_order_relaxed) : 0); }
+
+        //! Get a pointer to the packet data.
+        uint8_t* getData(void) const { return buffer->data; }
+
+        //! Get the size of the packet data array.
+        size_t getCapacity(void) const { return SpeedwirePacketBuffer::max_packet_size; }
+
+        //! Get the number of bytes in the packet.
+        int getSize(void) const { return buffer->nbytes; }
+
+        //! Set the number of bytes in the packet.
+        void setSize(const int nbytes) { buffer->nbytes = nbytes; }
+
+        //! Get the sender address of the packet.
+        struct sockaddr& getSrc(void) const { return (struct sockaddr&)buffer->src; }
+
+        //! Get the sender address storage of the packet.
+        struct sockaddr_storage& getSrcStorage(void) const { return buffer->src; }
+
+        //! Get the arrival time of the packet in ns since the unix epoch; this is the kernel receive timestamp where available.
+        uint64_t getArrivalTimeInNs(void) const { return buffer->arrival_time_ns; }
+
+        //! Set the arrival time of the packet in ns since the unix epoch.
+        void setArrivalTimeInNs(const uint64_t time_in_ns) { buffer->arrival_time_ns = time_in_ns; }
+
+        //! Get a SpeedwireHeader view on the packet data; the view is valid as long as the handle references the buffer.
+        SpeedwireHeader getHeader(void) const { return SpeedwireHeader(buffer->data, (unsigned long)buffer->nbytes); }
+    };
+
+
+    /**
+     *  Class implementing a fixed size pool of packet buffers. All buffers are allocated as a single slab by the
+     *  constructor; free buffers are kept in a lock-free queue, such that handles can be allocated and released from
+     *  any thread without heap allocations or locks.
+     */
+    class SpeedwirePacketBufferPool {
+    protected:
+        friend class SpeedwirePacketHandle;
+
+        std::unique_ptr<SpeedwirePacketBuffer[]> buffers;   //!< Slab of packet buffers
+        size_t num_buffers;                                 //!< Number of packet buffers in the slab
+        MpmcQueue<SpeedwirePacketBuffer*> free_buffers;     //!< Queue of free packet buffers
+
+        void release(SpeedwirePacketBuffer* buffer);
+
+    public:
+        SpeedwirePacketBufferPool(const size_t num_buffers);
+        ~SpeedwirePacketBufferPool(void);
+
+        SpeedwirePacketHandle allocate(void);
+
+        size_t getNumberOfBuffers(void) const { return num_buffers; }
+        size_t getNumberOfFreeBuffers(void) const { return free_buffers.getNumberOfElements(); }
+    };
+
+
+    /**
+     *  Release the reference to the packet buffer and return it to its pool, if this was the last reference.
+     */
+    inline void SpeedwirePacketHandle::releaseReference(void) {
+        if (buffer != NULL && buffer->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            buffer->pool->release(buffer);
+        }
+    }
+
+}   // namespace libspeedwire
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREPACKETRECORDER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREPACKETRECORDER_HPP__
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a packet recorder. The recorder is registered as a receiver for all packets with a
+     * SpeedwireReceiveDispatcher and appends each dispatched packet together with its arrival time and sender address
+     * to a capture file. Capture files can be replayed by SpeedwireReplayDispatcher.
+     *
+     * The capture file starts with an 8 byte file header holding the magic "SWCAP" and a version byte, followed by
+     * one record for each packet. Each record consists of a 32 byte little-endian record header followed by the packet data:
+     *   uint64_t arrival time in ns since the unix epoch
+     *   uint16_t packet length in bytes
+     *   uint8_t  address family of the sender, 4 or 6
+     *   uint8_t  reserved
+     *   uint16_t sender port
+     *   uint16_t reserved
+     *   uint8_t  sender ip address[16], ipv4 addresses occupy the first 4 bytes in network byte order
+     *
+     * A single recorder may be registered with several dispatchers running in different threads, e.g. with each shard of
+     * a SpeedwireShardedReceiveDispatcher; records are appended under a mutex, such that they are never interleaved.
+     */
+    class SpeedwirePacketRecorder : public SpeedwirePacketReceiverBase {
+    public:
+        static const uint8_t file_header[8];                //!< Capture file header
+        static const size_t  record_header_size = 32;      //!< Size of the record header preceding each packet
+
+    protected:
+        mutable std::mutex mutex;   //!< Mutex serializing access to the capture file and the counters
+        FILE* file;                 //!< Capture file, or NULL
+        uint64_t num_records;       //!< Number of records written to the capture file
+        uint64_t num_bytes;         //!< Number of packet data bytes written to the capture file
+        uint64_t num_errors;        //!< Number of records that could not be written
+
+    public:
+        SpeedwirePacketRecorder(LocalHost& host);
+        ~SpeedwirePacketRecorder(void);
+
+        bool open(const std::string& filename);
+        void flush(void);
+        void close(void);
+        bool isOpen(void) const { std::lock_guard<std::mutex> lock(mutex); return (file != NULL); }
+
+        virtual void receive(SpeedwireHeader& packet, struct sockaddr& src);
+        virtual void receivePacket(SpeedwirePacketHandle& packet);
+
+        uint64_t getNumberOfRecords(void) const { std::lock_guard<std::mutex> lock(mutex); return num_records; }
+        uint64_t getNumberOfBytes(void) const { std::lock_guard<std::mutex> lock(mutex); return num_bytes; }
+        uint64_t getNumberOfErrors(void) const { std::lock_guard<std::mutex> lock(mutex); return num_errors; }
+
+        static bool writeFileHeader(FILE* file);
+        static bool readFileHeader(FILE* file);
+        static bool writeRecord(FILE* file, const uint8_t* data, const int nbytes, const struct sockaddr& src, const uint64_t arrival_time_in_ns);
+        static int  readRecord(FILE* file, SpeedwirePacketHandle& packet);
+    };
+
+}   // namespace libspeedwire
+
+#endif
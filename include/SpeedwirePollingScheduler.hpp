@@ -0,0 +1,88 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREPOLLINGSCHEDULER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREPOLLINGSCHEDULER_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireDevice.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a per-device polling scheduler on top of SpeedwireCommand.
+     * Each device has a polling plan, i.e. a list of queries together with their polling interval, e.g. AC_QUERY every second
+     * and ENERGY_QUERY every minute. Due queries are sent in earliest deadline order, while each device is limited to a
+     * maximum number of in-flight queries and a minimum gap between two consecutive queries.
+     *
+     * Queries are sent by SpeedwireCommand::sendQueryRequest(). A query is considered complete once its token has been removed
+     * from the token repository, i.e. when the reply has been received and checked by the application. If the token is still
+     * present after the timeout, the scheduler removes it and backs off: the next query of this plan entry is delayed by the
+     * interval times 2^n after n consecutive timeouts, limited to the maximum backoff. Token expiry must therefore be left to
+     * the scheduler. The poll() method must be called periodically, e.g. after each call to SpeedwireReceiveDispatcher::dispatch().
+     */
+    class SpeedwirePollingScheduler {
+    public:
+        //! Entry of a polling plan.
+        struct PollingTask {
+            Command  command;               //!< Command identifier of the query
+            uint32_t first_register;        //!< First register id of the query
+            uint32_t last_register;         //!< Last register id of the query
+            uint32_t interval_in_ms;        //!< Polling interval in ms
+        };
+
+    protected:
+        //! Polling plan entry together with its scheduling state.
+        struct ScheduledTask {
+            PollingTask task;               //!< Plan entry
+            uint64_t deadline;              //!< Time when the next query is due in ms
+            uint64_t sent_time;             //!< Time when the in-flight query was sent in ms
+            uint16_t packet_id;             //!< Packet id of the in-flight query
+            bool     in_flight;             //!< True if a query is waiting for its reply
+            int      backoff;               //!< Number of consecutive timeouts
+        };
+
+        //! Polling plan and limits of a single device.
+        struct DeviceSchedule {
+            SpeedwireDevice peer;               //!< Speedwire device
+            std::vector<ScheduledTask> tasks;   //!< Polling plan
+            size_t   max_in_flight;             //!< Maximum number of in-flight queries
+            uint32_t min_gap_in_ms;             //!< Minimum time between two consecutive queries in ms
+            uint64_t last_send_time;            //!< Time when the most recent query was sent in ms
+            size_t   num_in_flight;             //!< Number of in-flight queries
+        };
+
+        SpeedwireCommand& command;              //!< Command instance used to send queries
+        int      timeout_in_ms;                 //!< Timeout of each query
+        uint32_t max_backoff_in_ms;             //!< Maximum delay after consecutive timeouts
+        std::vector<DeviceSchedule> devices;    //!< Polling plans, one for each device
+        std::vector<std::pair<uint64_t, std::pair<size_t, size_t>>> due_tasks;  //!< Due tasks of the current poll call with their deadline, device index and task index
+        uint64_t num_sent;                      //!< Number of sent queries
+        uint64_t num_completed;                 //!< Number of completed queries
+        uint64_t num_timeouts;                  //!< Number of timed out queries
+
+        DeviceSchedule* findDevice(const SpeedwireAddress& address);
+        void backoff(ScheduledTask& task, const uint64_t now);
+        void update(const uint64_t now);
+        int  poll(const uint64_t now);
+        virtual SpeedwireCommandTokenIndex sendQueryRequest(const SpeedwireDevice& peer, const PollingTask& task);
+
+    public:
+        SpeedwirePollingScheduler(SpeedwireCommand& command, const int timeout_in_ms = 1000, const uint32_t max_backoff_in_ms = 300000);
+        virtual ~SpeedwirePollingScheduler(void) {}
+
+        void addDevice(const SpeedwireDevice& peer, const size_t max_in_flight = 1, const uint32_t min_gap_in_ms = 0);
+        void addTask(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, const uint32_t interval_in_ms);
+        void removeDevice(const SpeedwireDevice& peer);
+        void clear(void);
+
+        int      poll(void);
+        uint64_t getNextDeadline(void) const;
+
+        uint64_t getNumberOfSentQueries(void) const { return num_sent; }
+        uint64_t getNumberOfCompletedQueries(void) const { return num_completed; }
+        uint64_t getNumberOfTimeouts(void) const { return num_timeouts; }
+    };
+
+}   // namespace libspeedwire
+
+#endif
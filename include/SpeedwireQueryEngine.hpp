@@ -0,0 +1,111 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREQUERYENGINE_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREQUERYENGINE_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Interface to be implemented by receivers of query completions from SpeedwireQueryEngine.
+     */
+    class SpeedwireQueryHandler {
+    public:
+        //! Enumeration of the reasons for a failed query.
+        enum class Failure {
+            TIMEOUT,        //!< No reply was received within the timeout, including all retries.
+            ERROR_CODE,     //!< The device replied with a non-zero error code.
+            SEND_ERROR      //!< The query could not be sent, including all retries, e.g. because the device address does not resolve.
+        };
+
+        /** Virtual destructor. */
+        virtual ~SpeedwireQueryHandler(void) {}
+
+        /**
+         * Callback to deliver the reply to a completed query.
+         * @param query Reference to the query parameters.
+         * @param reply Reference to the reply packet; it is only valid during the callback.
+         * @param src Reference to the sender address of the reply packet.
+         */
+        virtual void queryCompleted(const SpeedwireCommand::QueryRequest& query, SpeedwireHeader& reply, struct sockaddr& src) = 0;
+
+        /**
+         * Callback to notify a failed query.
+         * @param query Reference to the query parameters.
+         * @param failure The reason of the failure.
+         * @param error_code The error code of the reply packet, or 0 in case of a timeout or send error.
+         */
+        virtual void queryFailed(const SpeedwireCommand::QueryRequest& query, const Failure failure, const uint16_t error_code) {}
+    };
+
+
+    /**
+     * Class implementing a pipelined asynchronous query engine on top of SpeedwireCommand.
+     * Queries are submitted to a queue for each device; up to window size queries are kept in flight for each device.
+     * The engine is registered as an inverter packet receiver with a SpeedwireReceiveDispatcher, matches replies to
+     * in-flight queries by device address and packet id as they are dispatched, and delivers completions through a
+     * SpeedwireQueryHandler. Each query has its own timeout and is resent up to a configurable number of retries.
+     * The poll() method must be called periodically, e.g. after each call to SpeedwireReceiveDispatcher::dispatch(),
+     * to expire timed out queries and to send queued queries. All methods must be called from the dispatching thread.
+     * Handlers may submit or cancel queries from within their callbacks.
+     */
+    class SpeedwireQueryEngine : public InverterPacketReceiverBase {
+    protected:
+
+        //! Query waiting for its reply.
+        struct InFlightQuery {
+            SpeedwireCommand::QueryRequest request;     //!< Query parameters
+            uint16_t packet_id;                         //!< Packet id of the query packet
+            uint64_t deadline;                          //!< Time when the query times out in ms since the unix epoch
+            int      retries;                           //!< Number of retries so far
+        };
+
+        //! Queue of the queries of a single device.
+        struct DeviceQueue {
+            SpeedwireAddress address;                                   //!< Susy id and serial number of the device
+            std::deque<std::pair<SpeedwireCommand::QueryRequest, int>> pending;   //!< Queued queries with their number of retries so far
+            std::vector<InFlightQuery> in_flight;                       //!< Queries waiting for their reply
+        };
+
+        SpeedwireCommand& command;          //!< Command instance used to send queries
+        SpeedwireQueryHandler& handler;     //!< Handler receiving completions
+        size_t   window_size;               //!< Maximum number of in-flight queries per device
+        int      timeout_in_ms;             //!< Timeout of each query transmission
+        int      max_retries;               //!< Maximum number of retransmissions of each query
+        std::vector<DeviceQueue> devices;   //!< Query queues, one for each device
+        std::vector<SpeedwireCommand::QueryRequest> send_requests;  //!< Queries sent by the current poll call
+        std::vector<std::pair<size_t, int>> send_slots;             //!< Device queue index and number of retries of each sent query
+        std::vector<SpeedwireCommand::QueryRequest> failed_requests; //!< Queries timed out or not sent by the current poll call
+        uint64_t num_completed;             //!< Number of completed queries
+        uint64_t num_failed;                //!< Number of failed queries
+        uint64_t num_retries;               //!< Number of retransmissions
+
+        DeviceQueue& getDeviceQueue(const SpeedwireAddress& address);
+        void removeToken(const SpeedwireAddress& address, const uint16_t packet_id);
+        int  poll(const uint64_t now);
+        virtual std::vector<SpeedwireCommandTokenIndex> sendQueryRequests(const std::vector<SpeedwireCommand::QueryRequest>& requests);
+
+    public:
+        SpeedwireQueryEngine(LocalHost& host, SpeedwireCommand& command, SpeedwireQueryHandler& handler, const size_t window_size = 4, const int timeout_in_ms = 1000, const int max_retries = 1);
+        virtual ~SpeedwireQueryEngine(void) {}
+
+        void submit(const SpeedwireCommand::QueryRequest& query);
+        void submit(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register);
+        int  poll(void);
+        void cancel(void);
+
+        virtual void receive(SpeedwireHeader& packet, struct sockaddr& src);
+
+        size_t   getNumberOfPendingQueries(void) const;
+        size_t   getNumberOfInFlightQueries(void) const;
+        uint64_t getNumberOfCompletedQueries(void) const { return num_completed; }
+        uint64_t getNumberOfFailedQueries(void) const { return num_failed; }
+        uint64_t getNumberOfRetries(void) const { return num_retries; }
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREQUERYPLANNER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREQUERYPLANNER_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireData.hpp>
+#include <SpeedwireDevice.hpp>
+#include <SpeedwireHeader.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a query planner for inverter polling.
+     * The planner takes the desired SpeedwireData definitions of each device, groups them by device and command,
+     * and merges overlapping or adjacent register ranges into as few queries as possible, such that the estimated
+     * register data size of each reply stays below a configurable maximum. Replies are demultiplexed back into the
+     * SpeedwireData entries of the device.
+     * Timeline queries, i.e. yield and event queries, use their register range to encode a time window and are not planned.
+     */
+    class SpeedwireQueryPlanner {
+    public:
+        static const size_t default_max_reply_size = 1024;     //!< Default maximum estimated register data size of a reply packet
+
+        //! Planned query covering a range of registers of a single device and command.
+        struct PlannedQuery {
+            const SpeedwireDevice* peer;    //!< Speedwire device the query is sent to
+            Command  command;               //!< Command identifier of the query
+            uint32_t first_register;        //!< First register id of the query
+            uint32_t last_register;         //!< Last register id of the query
+            size_t   estimated_reply_size;  //!< Estimated register data size of the reply packet
+        };
+
+    protected:
+        //! Desired data of a single device.
+        struct DeviceData {
+            const SpeedwireDevice* peer;    //!< Speedwire device
+            SpeedwireDataMap* data;         //!< Desired data definitions; replies are demultiplexed into this map
+        };
+
+        size_t   max_reply_size;                //!< Maximum estimated register data size of a reply packet
+        uint32_t max_register_gap;              //!< Maximum number of unrequested registers between two merged registers
+        std::vector<DeviceData> devices;        //!< Desired data of each device
+        std::vector<PlannedQuery> queries;      //!< Planned queries
+
+        void plan(const DeviceData& device);
+        static size_t getElementSize(const SpeedwireDataType type);
+
+    public:
+        SpeedwireQueryPlanner(const size_t max_reply_size = default_max_reply_size, const uint32_t max_register_gap = 0);
+
+        void add(const SpeedwireDevice& peer, SpeedwireDataMap& data);
+        void clear(void);
+
+        const std::vector<PlannedQuery>& getPlannedQueries(void) const { return queries; }
+        std::vector<SpeedwireCommand::QueryRequest> getQueryRequests(void) const;
+
+        int demultiplex(const SpeedwireHeader& reply) const;
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -7,6 +7,8 @@
 #include <SpeedwireEmeterProtocol.hpp>
 #include <SpeedwireInverterProtocol.hpp>
 #include <SpeedwireSocket.hpp>
+#include <SpeedwireEventLoop.hpp>
+#include <SpeedwirePacketBufferPool.hpp>
 
 namespace libspeedwire {
 
@@ -30,6 +32,17 @@ namespace libspeedwire {
          * @param src Reference to a socket address with the ip address and port of the packet sender.
          */
         virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) = 0;
+
+        /**
+         * Virtual receive method for packet handles - can be overridden by receivers that want to keep the packet beyond
+         * the call, e.g. for queueing, deferred parsing or recording, without copying it; to do so, just retain a copy of the
+         * handle. The default implementation forwards the packet to the receive method above.
+         * @param packet Reference to a handle of the packet buffer holding the packet and its sender address.
+         */
+        virtual void receivePacket(SpeedwirePacketHandle& packet) {
+            SpeedwireHeader header = packet.getHeader();
+            receive(header, packet.getSrc());
+        }
     };
 
 
@@ -56,6 +69,29 @@ namespace libspeedwire {
     };
 
 
+    /**
+     * Interface to be implemented by extended emeter packet receivers; these receive packets sent by home managers only.
+     */
+    class ExtendedEmeterPacketReceiverBase : public SpeedwirePacketReceiverBase {
+    public:
+
+        /**
+         * Constructor - it initialzes protocolID to SpeedwireHeader::sma_extended_emeter_protocol_id.
+         * @param host Reference to LocalHost instance.
+         */
+        ExtendedEmeterPacketReceiverBase(LocalHost& host) : SpeedwirePacketReceiverBase(host) {
+            protocolID = SpeedwireData2Packet::sma_extended_emeter_protocol_id;
+        }
+
+        /**
+         * Virtual receive method - must be overriden.
+         * @param packet Reference to a packet instance that was received from the socket.
+         * @param src Reference to a socket address with the ip address and port of the packet sender.
+         */
+        virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) = 0;
+    };
+
+
     /**
      * Interface to beimplemented by inverter packet receivers.
      */
@@ -79,6 +115,29 @@ namespace libspeedwire {
     };
 
 
+    /**
+     * Interface to be implemented by encryption packet receivers.
+     */
+    class EncryptionPacketReceiverBase : public SpeedwirePacketReceiverBase {
+    public:
+
+        /**
+         * Constructor - it initialzes protocolID to SpeedwireHeader::sma_encryption_protocol_id.
+         * @param host Reference to LocalHost instance.
+         */
+        EncryptionPacketReceiverBase(LocalHost& host) : SpeedwirePacketReceiverBase(host) {
+            protocolID = SpeedwireData2Packet::sma_encryption_protocol_id;
+        }
+
+        /**
+         * Virtual receive method - must be overriden.
+         * @param packet Reference to a packet instance that was received from the socket.
+         * @param src Reference to a socket address with the ip address and port of the packet sender.
+         */
+        virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) = 0;
+    };
+
+
     /**
      * Interface to beimplemented by discovery packet receivers.
      */
@@ -105,24 +164,116 @@ namespace libspeedwire {
     /**
      * Class implementing a receiver and dispatcher for speedwire packets.
      * Classes interested in receiving speedwire packets can register themselves to this class. Calls to
-     * the dispatch method poll all given sockets, receive packet data, check its validity and dispatches
-     * the packet to any corresponding registered receiver.
+     * the dispatch method wait on all given sockets, receive packet data, check its validity and dispatches
+     * the packet to any corresponding registered receiver. Waiting is done by the event loop of the
+     * SpeedwireSocketFactory instance, which is shared with discovery and command receive.
+     * If a batch size larger than 1 is configured, each readable socket is drained by recvmmsg() calls, each
+     * receiving up to batch size packets into packet buffers, before the batch is dispatched.
+     * Packets are received into buffers taken from a fixed size packet buffer pool; receivers get a reference counted
+     * handle to the buffer and can retain it beyond the receive callback.
+     * Packets are routed by a routing table holding the subscriptions for each protocol id, such that each packet is only
+     * passed to its subscribers; routing table entries are looked up by a hash table indexed by protocol id. Subscriptions can be restricted to a single device by its susy id and serial number. Each packet carries its arrival time, taken
+     * from the kernel receive timestamp where available, see SpeedwirePacketHandle::getArrivalTimeInNs().
      */
     class SpeedwireReceiveDispatcher {
+    public:
+        static const size_t   max_udp_packet_size = SpeedwirePacketBuffer::max_packet_size;  //!< Size of each packet buffer
+        static const uint16_t any_susy_id = 0xffff;                                          //!< Wildcard susy id matching any device
+        static const uint32_t any_serial_number = 0xffffffff;                                //!< Wildcard serial number matching any device
+
+        //! Enumeration of the reasons for dropping a received packet.
+        enum class DropReason : uint8_t {
+            BAD_SIGNATURE = 0,      //!< The packet does not start with the SMA signature.
+            BAD_LENGTH,             //!< The length fields of the packet are inconsistent.
+            UNKNOWN_PROTOCOL,       //!< The packet is neither a discovery packet nor a data2 packet of a known or subscribed protocol id, and no receiver is registered for all packets.
+            TRUNCATED,              //!< The packet is shorter than its tag headers indicate.
+            BUFFER_OVERFLOW,        //!< The packet did not fit into a packet buffer, or no packet buffer was available.
+            NUMBER_OF_REASONS       //!< Number of drop reasons; this is not a drop reason.
+        };
+
+        //! Receive statistics of a single socket.
+        class SocketStatistics {
+        public:
+            uint64_t received;                                          //!< Number of packets received from the socket, including dropped packets
+            uint64_t dropped[(size_t)DropReason::NUMBER_OF_REASONS];    //!< Number of dropped packets, indexed by drop reason
+            SocketStatistics(void);
+            uint64_t getNumberOfDroppedPackets(void) const;
+            uint64_t getNumberOfDroppedPackets(const DropReason reason) const { return dropped[(size_t)reason]; }
+        };
+
+        static const char* toString(const DropReason reason);
+
     protected:
+
+        //! Subscription of a receiver, optionally restricted to a single device.
+        struct Subscription {
+            SpeedwirePacketReceiverBase* receiver;  //!< Subscribed receiver
+            uint16_t susy_id;                       //!< Susy id of the device, or any_susy_id
+            uint32_t serial_number;                 //!< Serial number of the device, or any_serial_number
+        };
+
+        //! Routing table entry holding the subscriptions for a single protocol id.
+        struct Route {
+            uint16_t protocol_id;                       //!< Protocol id of the data2 packets routed by this entry
+            bool has_device_subscriptions;              //!< True if any subscription is restricted to a single device
+            std::vector<Subscription> subscriptions;    //!< Subscriptions to packets of this protocol id
+        };
+
         LocalHost& localhost;
-        std::vector<SpeedwirePacketReceiverBase*> receivers;
-        std::vector<struct pollfd> pollfds;
+        std::vector<Route> routes;                          //!< Routing table for data2 packets, one entry for each subscribed protocol id
+        std::vector<int> route_slots;                       //!< Open addressing hash table indexing routes by protocol id; -1 denotes an empty slot
+        int route_slot_bits;                                //!< Number of hash bits, i.e. the hash table holds 1 << route_slot_bits slots
+        std::vector<Subscription> any_subscriptions;        //!< Subscriptions to all discovery and data2 packets
+        std::vector<int> ready_sockets;                     //!< Indexes of the sockets reported readable by the event loop
+        SpeedwireEventLoop* event_loop;                     //!< Event loop used to wait for packets; NULL for the event loop of the socket factory
+
+        int batch_size;                                     //!< Maximum number of packets received by a single receive call
+        int last_batch_size;                                //!< Number of packets received by the last dispatch call
+        SpeedwirePacketBufferPool packet_pool;              //!< Pool of packet buffers handed out to receivers
+        SpeedwirePacketBuffer overflow_buffer;              //!< Buffer used to drain sockets if the packet pool is exhausted
+        std::vector<SpeedwirePacketHandle> batch_packets;   //!< Packet handles of the current batch
+        std::vector<int> batch_nbytes;                      //!< Packet size for each packet of the current batch
+        std::vector<uint64_t> batch_histogram;              //!< Number of receive calls indexed by the number of packets they returned
+        uint64_t pool_exhausted_drops;                      //!< Number of packets dropped as the packet pool was exhausted
+        std::vector<SocketStatistics> socket_statistics;    //!< Receive statistics indexed by socket fd
+
+        int  receiveBatch(const SpeedwireSocket& socket, bool& drained);
+        int  dispatchPacket(SpeedwirePacketHandle& packet, DropReason& reason);
+        SocketStatistics& getStatistics(const SpeedwireSocket& socket);
+        Route* findRoute(const uint16_t protocol_id);
+        size_t getRouteSlot(const uint16_t protocol_id) const;
+        void insertRouteSlot(const int route_index);
+        void subscribe(SpeedwirePacketReceiverBase& receiver, const uint16_t protocol_id, const uint16_t susy_id, const uint32_t serial_number);
+        static void deliver(const std::vector<Subscription>& subscriptions, SpeedwirePacketHandle& packet);
+        static void deliver(const Route& route, SpeedwirePacketHandle& packet, const bool has_device, const uint16_t susy_id, const uint32_t serial_number);
 
     public:
-        SpeedwireReceiveDispatcher(LocalHost& localhost);
+        SpeedwireReceiveDispatcher(LocalHost& localhost, const size_t packet_pool_size = 128);
         ~SpeedwireReceiveDispatcher(void);
 
         int  dispatch(const std::vector<SpeedwireSocket>& sockets, const int poll_timeout_in_ms);
+        void setEventLoop(SpeedwireEventLoop& event_loop);
+
+        void setBatchSize(const int batch_size);
+        int  getBatchSize(void) const { return batch_size; }
+        int  getLastBatchSize(void) const { return last_batch_size; }
+        const std::vector<uint64_t>& getBatchSizeHistogram(void) const { return batch_histogram; }
+        void clearBatchSizeHistogram(void);
+
+        const SpeedwirePacketBufferPool& getPacketPool(void) const { return packet_pool; }
+        uint64_t getNumberOfPoolExhaustedDrops(void) const { return pool_exhausted_drops; }
+
+        // get receive statistics, i.e. the number of received and dropped packets for each socket and drop reason
+        SocketStatistics getSocketStatistics(const SpeedwireSocket& socket) const;
+        uint64_t getNumberOfDroppedPackets(const DropReason reason) const;
+        void clearSocketStatistics(void);
 
         void registerReceiver(SpeedwirePacketReceiverBase& receiver);
+        void registerReceiver(SpeedwirePacketReceiverBase& receiver, const uint16_t protocol_id, const uint16_t susy_id = any_susy_id, const uint32_t serial_number = any_serial_number);
         void registerReceiver(EmeterPacketReceiverBase& receiver);
+        void registerReceiver(ExtendedEmeterPacketReceiverBase& receiver);
         void registerReceiver(InverterPacketReceiverBase& receiver);
+        void registerReceiver(EncryptionPacketReceiverBase& receiver);
         void registerReceiver(DiscoveryPacketReceiverBase& receiver);
     };
 
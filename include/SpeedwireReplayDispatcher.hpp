@@ -0,0 +1,58 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIREREPLAYDISPATCHER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIREREPLAYDISPATCHER_HPP__
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a replay dispatcher for capture files written by SpeedwirePacketRecorder.
+     * Packets are read from the capture file into buffers taken from the packet pool, checked for validity and passed to
+     * the registered receivers, exactly like SpeedwireReceiveDispatcher::dispatch() does for packets received from sockets.
+     * Each packet carries its recorded arrival time and sender address, such that replay is deterministic.
+     * Packets are either replayed at the recorded pace, or as fast as possible to measure the sustained throughput
+     * of the receivers.
+     */
+    class SpeedwireReplayDispatcher : public SpeedwireReceiveDispatcher {
+    public:
+
+        //! Enumeration of the replay pace.
+        enum class Pace {
+            RECORDED,           //!< Replay packets at the pace they were recorded.
+            AS_FAST_AS_POSSIBLE //!< Replay packets without any delay.
+        };
+
+    protected:
+        FILE* file;                         //!< Capture file, or NULL
+        Pace pace;                          //!< Replay pace
+        bool started;                       //!< True once the first packet has been replayed
+        uint64_t first_arrival_time;        //!< Recorded arrival time of the first replayed packet in ns
+        std::chrono::steady_clock::time_point replay_start_time;    //!< Monotonic local time when the first packet was replayed
+        SocketStatistics statistics;        //!< Number of replayed packets and of packets dropped by the validity check
+
+    public:
+        SpeedwireReplayDispatcher(LocalHost& localhost, const Pace pace = Pace::AS_FAST_AS_POSSIBLE, const size_t packet_pool_size = 128);
+        ~SpeedwireReplayDispatcher(void);
+
+        bool open(const std::string& filename);
+        bool rewind(void);
+        void close(void);
+        bool isOpen(void) const { return (file != NULL); }
+
+        void setPace(const Pace pace) { this->pace = pace; }
+        Pace getPace(void) const { return pace; }
+
+        int replay(const size_t max_packets);
+
+        const SocketStatistics& getReplayStatistics(void) const { return statistics; }
+        uint64_t getNumberOfReplayedPackets(void) const { return statistics.received; }
+        uint64_t getNumberOfDroppedPackets(void) const { return statistics.getNumberOfDroppedPackets(); }
+        uint64_t getNumberOfDroppedPackets(const DropReason reason) const { return statistics.getNumberOfDroppedPackets(reason); }
+    };
+
+}   // namespace libspeedwire
+
+#endif
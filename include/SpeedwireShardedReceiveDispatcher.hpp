@@ -0,0 +1,61 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIRESHARDEDRECEIVEDISPATCHER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIRESHARDEDRECEIVEDISPATCHER_HPP__
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <SpeedwireEventLoop.hpp>
+#include <SpeedwireSocketFactory.hpp>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a sharded receiver and dispatcher for speedwire packets.
+     * It is used together with the socket factory strategy SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE, where the kernel
+     * distributes unicast packets across a group of SO_REUSEPORT sockets by a hash of the source ip address. Each shard
+     * owns its sockets, its own event loop and its own SpeedwireReceiveDispatcher, which is run by a separate dispatch thread.
+     * As all packets of a device are received by the same shard, receivers registered with a shard, and any per device
+     * state they keep e.g. in an AveragingProcessor or ObisFilter, are only ever accessed by the thread of that shard and
+     * need no locking.
+     */
+    class SpeedwireShardedReceiveDispatcher {
+    protected:
+
+        //! State of a single shard.
+        class ShardContext {
+        public:
+            SpeedwireEventLoop event_loop;              //!< Event loop used by the shard thread only.
+            SpeedwireReceiveDispatcher dispatcher;      //!< Dispatcher delivering the packets of this shard.
+            std::vector<SpeedwireSocket> sockets;       //!< Sharded sockets of this shard, one for each local interface.
+            std::atomic<uint64_t> received;             //!< Number of packets dispatched by this shard.
+            std::thread thread;                         //!< Shard dispatch thread.
+            ShardContext(LocalHost& localhost, const size_t packet_pool_size);
+        };
+
+        static const unsigned int max_consecutive_errors = 10;  //!< Number of dispatch errors in a row that terminates a shard thread.
+
+        LocalHost& localhost;
+        std::atomic<bool> running;                          //!< True while the shard threads are running.
+        std::vector<std::unique_ptr<ShardContext>> shards;  //!< Shard states.
+
+        void shardThread(ShardContext& shard);
+
+    public:
+        SpeedwireShardedReceiveDispatcher(LocalHost& localhost, const size_t packet_pool_size = 128);
+        SpeedwireShardedReceiveDispatcher(LocalHost& localhost, SpeedwireSocketFactory& factory, const size_t packet_pool_size = 128);
+        ~SpeedwireShardedReceiveDispatcher(void);
+
+        unsigned int getNumberOfShards(void) const { return (unsigned int)shards.size(); }
+        SpeedwireReceiveDispatcher& getShardDispatcher(const unsigned int shard);
+        uint64_t getNumberOfReceivedPackets(const unsigned int shard) const;
+
+        bool start(void);
+        void stop(void);
+        bool isRunning(void) const { return running; }
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -12,6 +12,7 @@
 
 #include <string>
 #include <LocalHost.hpp>
+#include <SpeedwireSocketFilter.hpp>
 
 namespace libspeedwire {
 
@@ -33,12 +34,14 @@ namespace libspeedwire {
 
         const LocalHost& localhost;
 
-        int openSocketV4(const std::string& local_interface_address, const bool multicast);
-        int openSocketV6(const std::string& local_interface_address, const bool multicast);
+        int openSocketV4(const std::string& local_interface_address, const bool multicast, const uint16_t port);
+        int openSocketV6(const std::string& local_interface_address, const bool multicast, const uint16_t port);
 
     public:
 
         static const uint16_t speedwire_port_9522 = 9522;
+        static const int      max_recv_batch_size = 64;     //!< Maximum number of packets received by a single recvmmsg() call
+        static const int      max_send_batch_size = 64;     //!< Maximum number of packets sent by a single sendmmsg() call
         static const struct sockaddr_in  speedwire_multicast_address_239_12_255_254;
         static const struct sockaddr_in  speedwire_multicast_address_239_12_255_255;
         static const struct sockaddr_in6 speedwire_multicast_address_v6;
@@ -61,12 +64,22 @@ namespace libspeedwire {
 
         // open and close a speedwire socket on the given interface
         int openSocket(const std::string& local_interface_address, const bool multicast);
+        int openSocket(const std::string& local_interface_address, const bool multicast, const uint16_t port);
+        int openSocket(const std::string& local_interface_address, const bool multicast, const SpeedwireSocketFilter& filter);
         int closeSocket(void);
 
+        // attach an in-kernel packet filter to the socket
+        int setFilter(const SpeedwireSocketFilter& filter);
+
         // receive data from the socket and return the sender address
         int recvfrom(const void* buff, const size_t buff_size, struct sockaddr_in& src) const;
         int recvfrom(const void* buff, const size_t buff_size, struct sockaddr_in6& src) const;
 
+        // receive a batch of packets from the socket into consecutive buffer slots and return the sender addresses
+        // and optionally the packet arrival times in ns since the unix epoch
+        int recvmmsg(void* buffs, const size_t slot_size, const int max_packets, int* nbytes, struct sockaddr_storage* srcs, uint64_t* arrival_times_in_ns = NULL) const;
+        int recvmmsg(void* const* buffs, const size_t buff_size, const int max_packets, int* nbytes, struct sockaddr_storage* const* srcs, uint64_t* arrival_times_in_ns = NULL) const;
+
         // send data to the socket
         int send(const void* const buff, const unsigned long size) const;
         int sendto(const void* const buff, const unsigned long size, const struct sockaddr& dest) const;
@@ -75,6 +88,9 @@ namespace libspeedwire {
         int sendto(const void* const buff, const unsigned long size, const std::string& dest) const;
         int sendto(const void* const buff, const unsigned long size, const struct sockaddr_in& dest, const struct in_addr& local_interface_address) const;
         int sendto(const void* const buff, const unsigned long size, const struct sockaddr_in6& dest, const struct in6_addr& local_interface_address) const;
+
+        // send a batch of unicast packets, each to its own destination address
+        int sendmmsg(const void* const* buffs, const unsigned long* sizes, const struct sockaddr_storage* const* dests, const int npackets) const;
     };
 
 }   // namespace libspeedwire
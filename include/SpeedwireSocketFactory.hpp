@@ -4,7 +4,9 @@
 #include <string>
 #include <vector>
 #include <LocalHost.hpp>
+#include <SpeedwireDevice.hpp>
 #include <SpeedwireSocket.hpp>
+#include <SpeedwireEventLoop.hpp>
 
 namespace libspeedwire {
 
@@ -42,7 +44,11 @@ namespace libspeedwire {
             //! One single multicasts socket socket is created for all local interfaces and one unicast socket is created for each local interface and for both unicast and multicast.
             ONE_MULTICAST_SOCKET_AND_ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE,
             //! One unicast socket is created for each local interface; it is used for both directions.
-            ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE
+            ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE,
+            //! Sockets are created as for ONE_MULTICAST_SOCKET_AND_ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE; in addition a group of SO_REUSEPORT receive
+            //! sockets is bound to the speedwire port of each local interface, one socket for each shard. Unicast packets sent to the speedwire port
+            //! are distributed across the shards by a hash of the source ip address, such that each device is always received by the same shard.
+            SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE
         };
 
     protected:
@@ -53,16 +59,26 @@ namespace libspeedwire {
             SocketDirection direction;                  //!< Send or receive direction that the socket is to be used for.
             SocketType      type;                       //!< Packet type that the socket is to be used for.
             std::string     interface_address;          //!< Local interface address that the socket is opened on.
+            SpeedwireInterfaceID interface_id;          //!< Binary identifier of the local interface that the socket is opened on.
             SpeedwireSocket socket;                     //!< SpeedwireSocket instance.
-            SocketEntry(const LocalHost& localhost) : direction(SocketDirection::NONE), type(SocketType::NOCAST), interface_address(), socket(localhost) {};
+            int             shard;                      //!< Shard index of sharded receive sockets, -1 for all other sockets.
+            SocketEntry(const LocalHost& localhost) : direction(SocketDirection::NONE), type(SocketType::NOCAST), interface_address(), interface_id(), socket(localhost), shard(-1) {};
         };
 
         static SpeedwireSocketFactory* instance;        //!< The static singleton instance.
         std::vector<SocketEntry> sockets;               //!< Vector of SocketEntry instances created by the constructor.
         const LocalHost& localhost;                     //!< Reference to LocalHost instance.
         SocketStrategy strategy;                        //!< Socket creation strategy provided to the getInstance method.
+        SpeedwireEventLoop event_loop;                  //!< Event loop shared by all users of the sockets created by this factory.
+        SpeedwireSocketFilter socket_filter;            //!< In-kernel packet filter attached to each receive socket.
+        bool use_socket_filter;                         //!< True if socket_filter is to be attached to each receive socket.
+        unsigned int number_of_shards;                  //!< Number of shards for SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE, 0 otherwise.
 
         SpeedwireSocketFactory(const LocalHost& localhost, const SocketStrategy strategy);
+        SpeedwireSocketFactory(const LocalHost& localhost, const SocketStrategy strategy, const SpeedwireSocketFilter* const filter, const unsigned int number_of_shards);
+        void openSockets(void);
+        bool openShardedSocketsForEachInterface(void);
+        bool openShardedSocketsForSingleInterface(const std::string& local_ip, const uint16_t port);
         ~SpeedwireSocketFactory(void);
 
         bool openSocketForSingleInterface(const SocketDirection direction, const SocketType type, const std::string& interface_address);
@@ -71,10 +87,20 @@ namespace libspeedwire {
     public:
         static SpeedwireSocketFactory* getInstance(const LocalHost& localhost);
         static SpeedwireSocketFactory* getInstance(const LocalHost& localhost, const SocketStrategy strategy);
+        static SpeedwireSocketFactory* getInstance(const LocalHost& localhost, const SocketStrategy strategy, const SpeedwireSocketFilter& filter);
+        static SpeedwireSocketFactory* getInstance(const LocalHost& localhost, const SocketStrategy strategy, const unsigned int number_of_shards, const SpeedwireSocketFilter* const filter = NULL);
 
         SpeedwireSocket& getSendSocket(const SocketType type, const std::string& if_addr);
+        SpeedwireSocket& getSendSocket(const SocketType type, const SpeedwireInterfaceID& if_id);
         SpeedwireSocket& getRecvSocket(const SocketType type, const std::string& if_addr);
+        SpeedwireSocket& getRecvSocket(const SocketType type, const SpeedwireInterfaceID& if_id);
         std::vector<SpeedwireSocket> getRecvSockets(const SocketType type, const std::vector<std::string>& if_addresses);
+
+        // get the number of shards and the receive sockets of a shard for SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE
+        unsigned int getNumberOfShards(void) const;
+        std::vector<SpeedwireSocket> getShardRecvSockets(const unsigned int shard);
+
+        SpeedwireEventLoop& getEventLoop(void);
     };
 
 
@@ -0,0 +1,67 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIRESOCKETFILTER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIRESOCKETFILTER_HPP__
+
+#include <cstdint>
+#include <vector>
+
+namespace libspeedwire {
+
+    /**
+     *  Class implementing an in-kernel packet filter for speedwire sockets.
+     *  The filter is compiled into a classic BPF program and attached to a socket by SO_ATTACH_FILTER, such that
+     *  the kernel discards unwanted udp packets before they are copied to user space. The filter accepts:
+     *  - speedwire data2 packets starting with the "SMA\0" signature and carrying one of the configured protocol ids;
+     *    if no protocol id is configured, data2 packets of any protocol id are accepted,
+     *  - optionally restricted to the configured serial numbers; the serial number check applies to emeter, extended
+     *    emeter and inverter packets, where the source serial number is located at a fixed offset,
+     *  - speedwire packets starting with the "SMA\0" signature, but without a data2 tag, i.e. discovery packets;
+     *    this can be disabled.
+     *  All other packets are dropped. Socket filters are supported on linux hosts only; on other hosts attach()
+     *  fails and the socket continues to receive all packets.
+     *
+     *  In addition, the class provides a SO_ATTACH_REUSEPORT_CBPF program selecting the socket of a SO_REUSEPORT socket
+     *  group by a hash of the source ip address, such that all packets of a device are received by the same socket.
+     */
+    class SpeedwireSocketFilter {
+    public:
+
+        //! Single classic BPF instruction; the layout is identical to struct sock_filter.
+        struct Instruction {
+            uint16_t code;      //!< Opcode
+            uint8_t  jt;        //!< Relative jump offset if the condition is true
+            uint8_t  jf;        //!< Relative jump offset if the condition is false
+            uint32_t k;         //!< Generic multi-use field
+        };
+
+    protected:
+        std::vector<uint16_t> protocol_ids;     //!< Accepted protocol ids; empty for any protocol id
+        std::vector<uint32_t> serial_numbers;   //!< Accepted source serial numbers; empty for any serial number
+        bool accept_discovery;                  //!< Accept SMA packets without a data2 tag
+
+        static int getSerialNumberOffset(const uint16_t protocol_id, bool& little_endian);
+
+    public:
+
+        SpeedwireSocketFilter(void);
+
+        static SpeedwireSocketFilter getDefaultFilter(void);
+
+        void addProtocolID(const uint16_t protocol_id);
+        void addSerialNumber(const uint32_t serial_number);
+        void setAcceptDiscoveryPackets(const bool accept);
+
+        const std::vector<uint16_t>& getProtocolIDs(void) const { return protocol_ids; }
+        const std::vector<uint32_t>& getSerialNumbers(void) const { return serial_numbers; }
+        bool getAcceptDiscoveryPackets(void) const { return accept_discovery; }
+
+        bool compile(std::vector<Instruction>& program) const;
+        int  attach(const int socket_fd) const;
+        static int detach(const int socket_fd);
+
+        static bool compileReusePortHash(std::vector<Instruction>& program, const bool ipv6, const unsigned int number_of_sockets);
+        static int  attachReusePortHash(const int socket_fd, const bool ipv6, const unsigned int number_of_sockets);
+    };
+
+}   // namespace libspeedwire
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __LIBSPEEDWIRE_SPEEDWIRETHREADEDRECEIVEDISPATCHER_HPP__
+#define __LIBSPEEDWIRE_SPEEDWIRETHREADEDRECEIVEDISPATCHER_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <SpscQueue.hpp>
+#include <SpeedwireReceiveDispatcher.hpp>
+
+namespace libspeedwire {
+
+    /**
+     * Class implementing a multi-threaded receiver and dispatcher for speedwire packets.
+     * One reader thread is started for each socket; it receives packets into buffers taken from a packet buffer pool owned
+     * by the reader and hands them over to a consumer thread through a bounded lock-free single-producer single-consumer
+     * queue. Consumer threads check the packets for validity and pass them to the registered receivers, exactly like
+     * SpeedwireReceiveDispatcher::dispatch() does. Packet buffers return to their pool once no receiver retains them.
+     * Each socket is served by exactly one consumer thread, such that packets from a socket are delivered in order.
+     * If more than one consumer thread is configured, receiver implementations must be thread-safe.
+     * The dispatch() method of the base class must not be used while the threads are running.
+     */
+    class SpeedwireThreadedReceiveDispatcher : public SpeedwireReceiveDispatcher {
+    public:
+
+        //! Enumeration of the behaviour of a reader thread if all of its packet buffers are in use.
+        enum class OverflowPolicy {
+            DROP,   //!< Keep draining the socket and drop the packets.
+            BLOCK   //!< Stop reading from the socket until a packet buffer becomes available; packets are queued in the kernel receive buffer.
+        };
+
+    protected:
+
+        class ConsumerContext;
+
+        //! State of a reader thread.
+        class ReaderContext {
+        public:
+            SpeedwireSocket socket;                 //!< Socket to read from.
+            SpeedwirePacketBufferPool pool;         //!< Packet buffers owned by this reader.
+            SpscQueue<SpeedwirePacketHandle> queue; //!< Queue of received packets from the reader to the consumer thread.
+            ConsumerContext* consumer;              //!< Consumer thread serving this reader.
+            std::atomic<uint64_t> received;         //!< Number of packets received.
+            std::atomic<uint64_t> dropped;          //!< Number of packets dropped due to overflow.
+            std::atomic<uint64_t> invalid[(size_t)DropReason::NUMBER_OF_REASONS];  //!< Number of packets dropped by the consumer, indexed by drop reason.
+            std::mutex mutex;                       //!< Mutex protecting the blocking wait for free packet buffers.
+            std::condition_variable condition;      //!< Condition variable to wake up a reader waiting for free packet buffers.
+            std::atomic<bool> blocked;              //!< True while the reader is waiting for free packet buffers.
+            std::thread thread;                     //!< Reader thread.
+            ReaderContext(const SpeedwireSocket& socket, const size_t queue_size);
+        };
+
+        //! State of a consumer thread.
+        class ConsumerContext {
+        public:
+            std::vector<ReaderContext*> readers;    //!< Readers served by this consumer.
+            std::mutex mutex;                       //!< Mutex protecting the sleep / wakeup handshake.
+            std::condition_variable condition;      //!< Condition variable to wake up the consumer.
+            std::atomic<bool> sleeping;             //!< True while the consumer is waiting for packets.
+            std::thread thread;                     //!< Consumer thread.
+            ConsumerContext(void) : sleeping(false) {}
+        };
+
+        size_t queue_size;                                      //!< Number of packet buffers per reader.
+        int num_consumer_threads;                               //!< Number of consumer threads.
+        OverflowPolicy overflow_policy;                         //!< Behaviour if all packet buffers of a reader are in use.
+        std::atomic<bool> running;                              //!< True while the threads are running.
+        std::vector<std::unique_ptr<ReaderContext>> readers;    //!< Reader thread states, one for each socket.
+        std::vector<std::unique_ptr<ConsumerContext>> consumers;//!< Consumer thread states.
+
+        void readerThread(ReaderContext& reader);
+        void consumerThread(ConsumerContext& consumer);
+        static bool hasPendingPackets(const ConsumerContext& consumer);
+        static void wakeupConsumer(ConsumerContext& consumer);
+        static void wakeupReader(ReaderContext& reader);
+        void waitForFreeBuffers(ReaderContext& reader);
+
+    public:
+        SpeedwireThreadedReceiveDispatcher(LocalHost& localhost, const size_t queue_size = 256, const int num_consumer_threads = 1, const OverflowPolicy policy = OverflowPolicy::DROP);
+        ~SpeedwireThreadedReceiveDispatcher(void);
+
+        bool start(const std::vector<SpeedwireSocket>& sockets);
+        void stop(void);
+        bool isRunning(void) const { return running; }
+
+        uint64_t getNumberOfReceivedPackets(void) const;
+        uint64_t getNumberOfDroppedPackets(void) const;
+        uint64_t getNumberOfDroppedPackets(const DropReason reason) const;
+        SocketStatistics getSocketStatistics(const SpeedwireSocket& socket) const;
+    };
+
+}   // namespace libspeedwire
+
+#endif
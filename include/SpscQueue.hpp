@@ -0,0 +1,111 @@
+#ifndef __LIBSPEEDWIRE_SPSCQUEUE_HPP__
+#define __LIBSPEEDWIRE_SPSCQUEUE_HPP__
+
+#include <cstddef>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace libspeedwire {
+
+    /**
+     *  Class encapsulating a bounded lock-free single-producer single-consumer queue for elements of type T.
+     *  Exactly one thread may call push() and exactly one other thread may call pop(); neither call ever blocks.
+     *  The capacity is rounded up to the next power of two.
+     */
+    template<class T> class SpscQueue {
+    protected:
+        std::vector<T>      data_vector;    //!< Array of queue elements
+        size_t              mask;           //!< Capacity - 1, used to wrap the indexes
+        std::atomic<size_t> read_index;     //!< Index of the next element to pop; written by the consumer thread only
+        char                padding[64];    //!< Keep read and write index on separate cache lines
+        std::atomic<size_t> write_index;    //!< Index of the next element to push; written by the producer thread only
+
+    public:
+
+        /**
+         * Constructor.
+         * @param capacity Minimum number of elements the queue can hold
+         */
+        SpscQueue(const size_t capacity) : read_index(0), write_index(0) {
+            size_t size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            data_vector.resize(size);
+            mask = size - 1;
+        }
+
+        /**
+         *  Push an element to the tail of the queue - to be called from the producer thread only.
+         *  @param element the element to push
+         *  @return true if successful, false if the queue is full
+         */
+        bool push(const T& element) {
+            const size_t w = write_index.load(std::memory_order_relaxed);
+            if (w - read_index.load(std::memory_order_acquire) > mask) {
+                return false;
+            }
+            data_vector[w & mask] = element;
+            write_index.store(w + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         *  Move an element to the tail of the queue - to be called from the producer thread only.
+         *  @param element the element to move; it is left unchanged, if the queue is full
+         *  @return true if successful, false if the queue is full
+         */
+        bool push(T&& element) {
+            const size_t w = write_index.load(std::memory_order_relaxed);
+            if (w - read_index.load(std::memory_order_acquire) > mask) {
+                return false;
+            }
+            data_vector[w & mask] = std::move(element);
+            write_index.store(w + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         *  Pop an element from the head of the queue - to be called from the consumer thread only.
+         *  @param element reference to the element receiving the popped value
+         *  @return true if successful, false if the queue is empty
+         */
+        bool pop(T& element) {
+            const size_t r = read_index.load(std::memory_order_relaxed);
+            if (r == write_index.load(std::memory_order_acquire)) {
+                return false;
+            }
+            element = std::move(data_vector[r & mask]);
+            read_index.store(r + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         *  Get the number of elements that are currently stored in the queue. The result is a snapshot, if the queue is in use.
+         *  @return the number of elements
+         */
+        size_t getNumberOfElements(void) const {
+            return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+        }
+
+        /**
+         *  Get the maximum number of elements that can be stored in the queue.
+         *  @return the maximum number
+         */
+        size_t getMaximumNumberOfElements(void) const {
+            return data_vector.size();
+        }
+
+        /**
+         *  Check if the queue is empty. The result is a snapshot, if the queue is in use.
+         *  @return true if the queue is empty
+         */
+        bool isEmpty(void) const {
+            return (getNumberOfElements() == 0);
+        }
+    };
+
+}   // namespace libspeedwire
+
+#endif
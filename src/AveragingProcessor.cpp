@@ -97,7 +97,7 @@ bool AveragingProcessor::process(const SpeedwireDevice& device, const DeviceType
     AveragingState& state = states[index];
 
     // get the most recent measurement timestamp
-    uint32_t measurementTime = measurement.measurementValues.getNewestElement().time;
+    uint32_t measurementTime = measurement.getNewestMeasurement().time;
 
     // if no averaging is intended, leave the measurement value as is
     if (state.averagingTime == 0) {
@@ -172,6 +172,37 @@ void AveragingProcessor::endOfObisData(const SpeedwireDevice& device, const uint
 }
 
 
+/**
+ * Callback to consume all obis data of an emeter packet at once - implements the temporal averaging of obis values.
+ * Elements that reached the averaging time are passed on to the registered consumers in a single batch.
+ * @param device The originating emeter device.
+ * @param elements An array of pointers to ObisData instances, holding output data of the ObisFilter.
+ * @param num_elements The number of elements in the array.
+ * @param time The timestamp associated with the just finished emeter packet.
+ */
+void AveragingProcessor::consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time) {
+    obisPacketElements.clear();
+    for (size_t i = 0; i < num_elements; ++i) {
+        if (process(device, DeviceType::EMETER, *elements[i]) == true) {
+            obisPacketElements.push_back(elements[i]);
+        }
+    }
+    int index = findStateIndex(device.deviceAddress.serialNumber);
+    if (index >= 0 && states[index].averagingTimeReached == true) {
+        for (int i = 0; i < obisConsumerTable.size(); ++i) {
+            obisConsumerTable[i]->consumePacket(device, obisPacketElements.data(), obisPacketElements.size(), time);
+        }
+    }
+    else if (obisPacketElements.size() > 0) {
+        for (int i = 0; i < obisConsumerTable.size(); ++i) {
+            for (size_t j = 0; j < obisPacketElements.size(); ++j) {
+                obisConsumerTable[i]->consume(device, *obisPacketElements[j]);
+            }
+        }
+    }
+}
+
+
 /**
  * Callback to notify that the last obis data in the inverter packet has been processed.
  * @param device The originating inverter device.
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <CalculatedValueProcessor.hpp>
 #include <LocalHost.hpp>
 #include <SpeedwireTime.hpp>
@@ -5,16 +6,29 @@
 using namespace libspeedwire;
 
 
+// Get the floating point measurement values of the given measurement; raw measurements are converted into the given buffer
+static const MeasurementValues& getMeasurementValues(const Measurement& measurement, MeasurementValues& buffer) {
+    if (measurement.rawStorage) {
+        measurement.rawMeasurementValues.toMeasurementValues(buffer);
+        return buffer;
+    }
+    return measurement.measurementValues;
+}
+
+
 // Calculate difference between all positive and negative measurement values and store it in diff values
-static void calculateValueDiffs(Measurement& diff, const Measurement& pos, const Measurement& neg) {
-    const MeasurementValues& pos_values = pos.measurementValues;
-    const MeasurementValues& neg_values = neg.measurementValues;
-    MeasurementValues& diff_values = diff.measurementValues;
-    diff_values.clear();
+static void calculateValueDiffs(Measurement& diff, const MeasurementValues& pos_values, const MeasurementValues& neg_values) {
+    diff.measurementValues.clear();
+    diff.rawMeasurementValues.clear();
     for (size_t i = 0; i < pos_values.getNumberOfElements(); ++i) {
         if (pos_values[i].time == neg_values[i].time) {
             double signed_value = pos_values[i].value - neg_values[i].value;
-            diff_values.addMeasurement(signed_value, pos_values[i].time);
+            if (diff.rawStorage) {
+                diff.rawMeasurementValues.addMeasurement((int64_t)llround(signed_value * diff.rawMeasurementValues.getDivisor()), pos_values[i].time);
+            }
+            else {
+                diff.measurementValues.addMeasurement(signed_value, pos_values[i].time);
+            }
         }
     }
 }
@@ -22,14 +36,41 @@ static void calculateValueDiffs(Measurement& diff, const Measurement& pos, const
 
 /**
  * Constructor of the CalculatedValueProcessor instance.
+ * @param _obis_filter   Reference to the obis filter, where the received obis values of each device reside.
+ * @param speedwire_map  Reference to the data map, where all received inverter values reside.
+ * @param _producer      Reference to producer to receive the consumed and calculated values.
+ */
+CalculatedValueProcessor::CalculatedValueProcessor(ObisFilter& _obis_filter, SpeedwireDataMap& speedwire_map, Producer& _producer) :
+    obis_filter(&_obis_filter),
+    obis_data_map(NULL),
+    emeter_address(0, 0),
+    household_emeter_address(0, 0),
+    speedwire_data_map(speedwire_map),
+    producer(_producer),
+    pos_values(0),
+    neg_values(0),
+    sig_values(0),
+    bat_values(0) {
+}
+
+
+/**
+ * Constructor of the CalculatedValueProcessor instance for a single emeter device.
  * @param obis_map       Reference to the data map, where all received obis values reside.
  * @param speedwire_map  Reference to the data map, where all received inverter values reside.
  * @param _producer      Reference to producer to receive the consumed and calculated values.
  */
 CalculatedValueProcessor::CalculatedValueProcessor(ObisDataMap& obis_map, SpeedwireDataMap& speedwire_map, Producer& _producer) :
-    obis_data_map(obis_map),
+    obis_filter(NULL),
+    obis_data_map(&obis_map),
+    emeter_address(0, 0),
+    household_emeter_address(0, 0),
     speedwire_data_map(speedwire_map),
-    producer(_producer) {
+    producer(_producer),
+    pos_values(0),
+    neg_values(0),
+    sig_values(0),
+    bat_values(0) {
 }
 
 
@@ -39,13 +80,53 @@ CalculatedValueProcessor::CalculatedValueProcessor(ObisDataMap& obis_map, Speedw
 CalculatedValueProcessor::~CalculatedValueProcessor(void) { }
 
 
+/**
+ * Set the emeter device whose obis values are used to calculate household values.
+ * @param address The susy id and serial number of the emeter device, or 0:0 to use the most recent emeter device.
+ */
+void CalculatedValueProcessor::setHouseholdEmeter(const SpeedwireAddress& address) {
+    household_emeter_address = address;
+}
+
+
+/**
+ * Get the obis data instance of the given element for the given emeter device.
+ * @param address The susy id and serial number of the emeter device; it is ignored if this instance was constructed from an obis data map.
+ * @param element The obis element.
+ * @return a pointer to the obis data instance, or NULL if the element is not filtered
+ */
+ObisData* CalculatedValueProcessor::getObisData(const SpeedwireAddress& address, const ObisType& element) {
+    if (obis_filter != NULL) {
+        return obis_filter->getFilter(address, element);
+    }
+    ObisDataMap::iterator it = obis_data_map->find(element.toKey());
+    return (it != obis_data_map->end() ? &it->second : NULL);
+}
+
+
 /**
  * Callback to produce the given obis data to the next stage in the processing pipeline.
  * @param device The originating inverter device.
  * @param element A reference to a received ObisData instance, holding output data of the ObisFilter.
  */
 void CalculatedValueProcessor::consume(const SpeedwireDevice& device, ObisData& element) {
-    producer.produce(device, element.measurementType, element.wire, element.measurementValues.estimateMean(), element.measurementValues.getNewestElement().time);
+    producer.produce(device, element.measurementType, element.wire, element.estimateMean(), element.getNewestMeasurement().time);
+}
+
+
+/**
+ * Callback to produce all obis data of an emeter packet at once, followed by the calculated values of the packet.
+ * @param device The originating emeter device.
+ * @param elements An array of pointers to received ObisData instances, holding output data of the ObisFilter.
+ * @param num_elements The number of elements in the array.
+ * @param time The timestamp associated with the just finished emeter packet.
+ */
+void CalculatedValueProcessor::consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time) {
+    for (size_t i = 0; i < num_elements; ++i) {
+        const ObisData& element = *elements[i];
+        producer.produce(device, element.measurementType, element.wire, element.estimateMean(), element.getNewestMeasurement().time);
+    }
+    CalculatedValueProcessor::endOfObisData(device, time);
 }
 
 
@@ -55,7 +136,7 @@ void CalculatedValueProcessor::consume(const SpeedwireDevice& device, ObisData&
  * @param element A reference to a received SpeedwireData instance.
  */
 void CalculatedValueProcessor::consume(const SpeedwireDevice& device, SpeedwireData& element) {
-    producer.produce(device, element.measurementType, element.wire, element.measurementValues.estimateMean(), element.measurementValues.getNewestElement().time);
+    producer.produce(device, element.measurementType, element.wire, element.estimateMean(), element.getNewestMeasurement().time);
 }
 
 
@@ -65,46 +146,48 @@ void CalculatedValueProcessor::consume(const SpeedwireDevice& device, SpeedwireD
  * @param timestamp The timestamp associated with the just finished emeter packet.
  */
 void CalculatedValueProcessor::endOfObisData(const SpeedwireDevice& device, const uint32_t timestamp) {
-    ObisDataMap::const_iterator pos, neg, end = obis_data_map.end();
-    ObisDataMap::iterator sig;
+    const SpeedwireAddress& address = device.deviceAddress;
+    const ObisData *pos, *neg;
+    ObisData *sig;
+    emeter_address = address;
 
     // calculate signed power L1
-    if ((pos = obis_data_map.find(ObisData::PositiveActivePowerL1.toKey())) != end &&
-        (neg = obis_data_map.find(ObisData::NegativeActivePowerL1.toKey())) != end &&
-        (sig = obis_data_map.find(ObisData::SignedActivePowerL1.toKey())) != end) {
-        calculateValueDiffs(sig->second, pos->second, neg->second);
-        producer.produce(device, ObisData::SignedActivePowerL1.measurementType, ObisData::SignedActivePowerL1.wire, sig->second.measurementValues.estimateMean(), timestamp);
+    if ((pos = getObisData(address, ObisData::PositiveActivePowerL1)) != NULL &&
+        (neg = getObisData(address, ObisData::NegativeActivePowerL1)) != NULL &&
+        (sig = getObisData(address, ObisData::SignedActivePowerL1)) != NULL) {
+        calculateValueDiffs(*sig, getMeasurementValues(*pos, pos_values), getMeasurementValues(*neg, neg_values));
+        producer.produce(device, ObisData::SignedActivePowerL1.measurementType, ObisData::SignedActivePowerL1.wire, sig->estimateMean(), timestamp);
     }
 
     // calculate signed power L2
-    if ((pos = obis_data_map.find(ObisData::PositiveActivePowerL2.toKey())) != end &&
-        (neg = obis_data_map.find(ObisData::NegativeActivePowerL2.toKey())) != end &&
-        (sig = obis_data_map.find(ObisData::SignedActivePowerL2.toKey())) != end) {
-        calculateValueDiffs(sig->second, pos->second, neg->second);
-        producer.produce(device, ObisData::SignedActivePowerL2.measurementType, ObisData::SignedActivePowerL2.wire, sig->second.measurementValues.estimateMean(), timestamp);
+    if ((pos = getObisData(address, ObisData::PositiveActivePowerL2)) != NULL &&
+        (neg = getObisData(address, ObisData::NegativeActivePowerL2)) != NULL &&
+        (sig = getObisData(address, ObisData::SignedActivePowerL2)) != NULL) {
+        calculateValueDiffs(*sig, getMeasurementValues(*pos, pos_values), getMeasurementValues(*neg, neg_values));
+        producer.produce(device, ObisData::SignedActivePowerL2.measurementType, ObisData::SignedActivePowerL2.wire, sig->estimateMean(), timestamp);
     }
 
     // calculate signed power L3
-    if ((pos = obis_data_map.find(ObisData::PositiveActivePowerL3.toKey())) != end &&
-        (neg = obis_data_map.find(ObisData::NegativeActivePowerL3.toKey())) != end &&
-        (sig = obis_data_map.find(ObisData::SignedActivePowerL3.toKey())) != end) {
-        calculateValueDiffs(sig->second, pos->second, neg->second);
-        producer.produce(device, ObisData::SignedActivePowerL3.measurementType, ObisData::SignedActivePowerL3.wire, sig->second.measurementValues.estimateMean(), timestamp);
+    if ((pos = getObisData(address, ObisData::PositiveActivePowerL3)) != NULL &&
+        (neg = getObisData(address, ObisData::NegativeActivePowerL3)) != NULL &&
+        (sig = getObisData(address, ObisData::SignedActivePowerL3)) != NULL) {
+        calculateValueDiffs(*sig, getMeasurementValues(*pos, pos_values), getMeasurementValues(*neg, neg_values));
+        producer.produce(device, ObisData::SignedActivePowerL3.measurementType, ObisData::SignedActivePowerL3.wire, sig->estimateMean(), timestamp);
     }
 
     // calculate signed total power
-    if ((pos = obis_data_map.find(ObisData::PositiveActivePowerTotal.toKey())) != end &&
-        (neg = obis_data_map.find(ObisData::NegativeActivePowerTotal.toKey())) != end &&
-        (sig = obis_data_map.find(ObisData::SignedActivePowerTotal.toKey())) != end) {
-        calculateValueDiffs(sig->second, pos->second, neg->second);
-        producer.produce(device, ObisData::SignedActivePowerTotal.measurementType, ObisData::SignedActivePowerTotal.wire, sig->second.measurementValues.estimateMean(), timestamp);
+    if ((pos = getObisData(address, ObisData::PositiveActivePowerTotal)) != NULL &&
+        (neg = getObisData(address, ObisData::NegativeActivePowerTotal)) != NULL &&
+        (sig = getObisData(address, ObisData::SignedActivePowerTotal)) != NULL) {
+        calculateValueDiffs(*sig, getMeasurementValues(*pos, pos_values), getMeasurementValues(*neg, neg_values));
+        producer.produce(device, ObisData::SignedActivePowerTotal.measurementType, ObisData::SignedActivePowerTotal.wire, sig->estimateMean(), timestamp);
 
 #if 1
         // experimental setup to feed time-accurate power measurements
         static uint32_t last_time = 0;
         SpeedwireDevice experimental_device;
         experimental_device.deviceAddress.serialNumber = 1234567890;
-        const MeasurementValues& mvalues = sig->second.measurementValues;
+        const MeasurementValues& mvalues = getMeasurementValues(*sig, sig_values);
         std::vector<MeasurementValueInterval> intervals;
         LineSegmentEstimator::findPiecewiseConstantIntervals(mvalues, intervals);
         for (auto& iv : intervals) {
@@ -131,8 +214,9 @@ void CalculatedValueProcessor::endOfObisData(const SpeedwireDevice& device, cons
         static MeasurementValues experimentalValues(1024);
 
         // experimental setup to feed time-accurate power measurements
-        for (size_t i = 0; i < sig->second.measurementValues.getNumberOfElements(); ++i) {
-            const TimestampDoublePair& pair = sig->second.measurementValues.at(i);
+        const MeasurementValues& sig_mvalues = getMeasurementValues(*sig, sig_values);
+        for (size_t i = 0; i < sig_mvalues.getNumberOfElements(); ++i) {
+            const TimestampDoublePair& pair = sig_mvalues.at(i);
             experimentalValues.addMeasurement(pair.value, pair.time);
         }
         static uint32_t last_time = 0;
@@ -199,12 +283,12 @@ void CalculatedValueProcessor::endOfSpeedwireData(const SpeedwireDevice& device,
         if ((value1 = speedwire_data_map.find(SpeedwireData::BatteryPowerL1.toKey())) != end &&
             (value2 = speedwire_data_map.find(SpeedwireData::BatteryPowerL2.toKey())) != end &&
             (value3 = speedwire_data_map.find(SpeedwireData::BatteryPowerL3.toKey())) != end &&
-            (value1_time = value1->second.measurementValues.getNewestElement().time,
-                value2_time = value2->second.measurementValues.getNewestElement().time,
-                value3_time = value3->second.measurementValues.getNewestElement().time,
+            (value1_time = value1->second.getNewestMeasurement().time,
+                value2_time = value2->second.getNewestMeasurement().time,
+                value3_time = value3->second.getNewestMeasurement().time,
                 SpeedwireTime::calculateAbsTimeDifference(value1_time, value2_time) <= 1 &&
                 SpeedwireTime::calculateAbsTimeDifference(value1_time, value3_time) <= 1)) {
-            ac_total = value1->second.measurementValues.estimateMean() + value2->second.measurementValues.estimateMean() + value3->second.measurementValues.estimateMean();
+            ac_total = value1->second.estimateMean() + value2->second.estimateMean() + value3->second.estimateMean();
             producer.produce(device, SpeedwireData::BatteryPowerACTotal.measurementType, SpeedwireData::BatteryPowerACTotal.wire, ac_total, value1_time);
         }
     }
@@ -217,13 +301,13 @@ void CalculatedValueProcessor::endOfSpeedwireData(const SpeedwireDevice& device,
         // calculate total dc power
         if ((value1 = speedwire_data_map.find(SpeedwireData::InverterPowerMPP1.toKey())) != end &&
             (value2 = speedwire_data_map.find(SpeedwireData::InverterPowerMPP2.toKey())) != end &&
-            (value1_time = value1->second.measurementValues.getNewestElement().time,
-                value2_time = value2->second.measurementValues.getNewestElement().time,
+            (value1_time = value1->second.getNewestMeasurement().time,
+                value2_time = value2->second.getNewestMeasurement().time,
                 SpeedwireTime::calculateAbsTimeDifference(value1_time, value2_time) <= 1)) {
             dc_age = (uint32_t)SpeedwireTime::calculateAbsTimeDifference(inverter_time, value1_time);
             dc_time = value1_time;
             //if (dc_age < max_age) {
-            dc_total = value1->second.measurementValues.estimateMean() + value2->second.measurementValues.estimateMean();
+            dc_total = value1->second.estimateMean() + value2->second.estimateMean();
             producer.produce(device, SpeedwireData::InverterPowerDCTotal.measurementType, SpeedwireData::InverterPowerDCTotal.wire, dc_total, value1_time);
             //}
         }
@@ -232,15 +316,15 @@ void CalculatedValueProcessor::endOfSpeedwireData(const SpeedwireDevice& device,
         if ((value1 = speedwire_data_map.find(SpeedwireData::InverterPowerL1.toKey())) != end &&
             (value2 = speedwire_data_map.find(SpeedwireData::InverterPowerL2.toKey())) != end &&
             (value3 = speedwire_data_map.find(SpeedwireData::InverterPowerL3.toKey())) != end &&
-            (value1_time = value1->second.measurementValues.getNewestElement().time,
-                value2_time = value2->second.measurementValues.getNewestElement().time,
-                value3_time = value3->second.measurementValues.getNewestElement().time,
+            (value1_time = value1->second.getNewestMeasurement().time,
+                value2_time = value2->second.getNewestMeasurement().time,
+                value3_time = value3->second.getNewestMeasurement().time,
                 SpeedwireTime::calculateAbsTimeDifference(value1_time, value2_time) <= 1 &&
                 SpeedwireTime::calculateAbsTimeDifference(value1_time, value3_time) <= 1)) {
             ac_age = (uint32_t)SpeedwireTime::calculateAbsTimeDifference(inverter_time, value1_time);
             ac_time = value1_time;
             //if (ac_age < max_age) {
-            ac_total = value1->second.measurementValues.estimateMean() + value2->second.measurementValues.estimateMean() + value3->second.measurementValues.estimateMean();
+            ac_total = value1->second.estimateMean() + value2->second.estimateMean() + value3->second.estimateMean();
             producer.produce(device, SpeedwireData::InverterPowerACTotal.measurementType, SpeedwireData::InverterPowerACTotal.wire, ac_total, value1_time);
             //}
 
@@ -255,31 +339,32 @@ void CalculatedValueProcessor::endOfSpeedwireData(const SpeedwireDevice& device,
             }
         }
 
-        ObisDataMap::const_iterator pos, neg;
-        if ((pos = obis_data_map.find(ObisData::PositiveActivePowerTotal.toKey())) != obis_data_map.end() &&
-            (neg = obis_data_map.find(ObisData::NegativeActivePowerTotal.toKey())) != obis_data_map.end()) {
-            uint32_t feed_in_time = neg->second.measurementValues.getNewestElement().time;
+        const ObisData *pos, *neg;
+        const SpeedwireAddress& household_emeter = (household_emeter_address.isComplete() ? household_emeter_address : emeter_address);
+        if ((pos = getObisData(household_emeter, ObisData::PositiveActivePowerTotal)) != NULL &&
+            (neg = getObisData(household_emeter, ObisData::NegativeActivePowerTotal)) != NULL) {
+            uint32_t feed_in_time = neg->getNewestMeasurement().time;
             uint32_t grid_age = SpeedwireTime::calculateAbsTimeDifference(emeter_time, feed_in_time);
             if (grid_age < max_age * 1000) {
-                double neg_average_value = neg->second.measurementValues.estimateMean();
+                double neg_average_value = neg->estimateMean();
 
                 // calculate total power consumption of the house: positive power from grid + inverter power - negative power to grid
                 double household;
                 if (ac_total == 0.0) {
-                    household = pos->second.measurementValues.estimateMean() - neg_average_value;
+                    household = pos->estimateMean() - neg_average_value;
                 }
                 else {
                     uint32_t ac_time_emeter = SpeedwireTime::convertInverterToEmeterTime(ac_time, current_time);
-                    //household = pos->second.measurementValues.findClosestMeasurement(ac_time_emeter).value + ac_total - neg->second.measurementValues.findClosestMeasurement(ac_time_emeter).value;
-                    household = pos->second.measurementValues.interpolateClosestValues(ac_time_emeter) + ac_total - neg->second.measurementValues.interpolateClosestValues(ac_time_emeter);
+                    //household = pos->measurementValues.findClosestMeasurement(ac_time_emeter).value + ac_total - neg->measurementValues.findClosestMeasurement(ac_time_emeter).value;
+                    household = getMeasurementValues(*pos, pos_values).interpolateClosestValues(ac_time_emeter) + ac_total - getMeasurementValues(*neg, neg_values).interpolateClosestValues(ac_time_emeter);
                     if (household < 0.0) household = 0.0;  // this can happen if there is a steep change in solar production or energy consumption and measurements are taken at different points in time
                 }
                 // consider battery inverter power: household power + battery inverter power
                 if ((value1 = speedwire_data_map.find(SpeedwireData::BatteryPowerACTotal.toKey())) != end &&
-                    (value1_time = value1->second.measurementValues.getNewestElement().time)) {
+                    (value1_time = value1->second.getNewestMeasurement().time)) {
                     uint32_t bat_ac_age = (uint32_t)SpeedwireTime::calculateAbsTimeDifference(inverter_time, value1_time);
                     if (SpeedwireTime::calculateAbsTimeDifference(bat_ac_age, ac_age) <= 10) {
-                        household += value1->second.measurementValues.interpolateClosestValues(ac_time);
+                        household += getMeasurementValues(value1->second, bat_values).interpolateClosestValues(ac_time);
                         if (household < 0.0) household = 0.0;  // this can happen if there is a steep change in solar production or energy consumption and measurements are taken at different points in time
                     }
                 }
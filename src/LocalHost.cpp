@@ -436,6 +436,16 @@ uint64_t LocalHost::getUnixEpochTimeInMs(void) {
 }
 
 
+/**
+ *  Platform neutral method to get the unix epoch time in ns.
+ */
+uint64_t LocalHost::getUnixEpochTimeInNs(void) {
+    std::chrono::system_clock::duration time = std::chrono::system_clock::now().time_since_epoch();
+    std::chrono::nanoseconds time_in_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time);
+    return time_in_ns.count();
+}
+
+
 /**
  *  Platform neutral conversion of unix epoch time in ms to a formatted string.
  */
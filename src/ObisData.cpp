@@ -90,7 +90,7 @@ bool ObisData::equals(const ObisType &other) const {
 
 //! Print this instance to file
 void ObisData::print(FILE *file) const {
-    TimestampDoublePair measurementValue = measurementValues.getNewestElement();
+    TimestampDoublePair measurementValue = getNewestMeasurement();
     uint32_t    timer  = measurementValue.time;
     double      value  = measurementValue.value;
     std::string string = measurementValues.value_string;
@@ -104,7 +104,7 @@ void ObisData::print(FILE *file) const {
 
 //! Convert this instance into its byte array representation according to the obis byte stream definition
 std::array<uint8_t, 12> ObisData::toByteArray(void) const {
-    TimestampDoublePair measurementValue = measurementValues.getNewestElement();
+    TimestampDoublePair measurementValue = getNewestMeasurement();
     std::array<uint8_t, 12> byte_array = ObisType::toByteArray();
     switch (type) {
     case 0:
@@ -306,3 +306,53 @@ const ObisDataMap& ObisDataMap::getAllPredefined(void) {
 }
 
 ObisDataMap ObisDataMap::allPredefined;
+
+
+/*******************************
+ *  Class implementing a perfect hash table for obis keys.
+ ********************************/
+
+/**
+ *  Default constructor - an empty table.
+ */
+ObisKeyTable::ObisKeyTable(void) :
+    slots(2, -1),
+    multiplier(1),
+    shift(31) {
+}
+
+/**
+ *  Build the table for the given set of distinct keys.
+ *  Multiplicative hash functions are tried with increasing table sizes until one maps all keys to distinct slots; for the
+ *  obis keys of an emeter packet this takes a table of 2 to 4 slots per key.
+ *  @param new_keys The set of keys
+ *  @return true on success, false if no collision free hash function was found, e.g. because of duplicate keys
+ */
+bool ObisKeyTable::build(const std::vector<uint32_t>& new_keys) {
+    uint32_t bits = 1;
+    while (((size_t)1 << bits) < 2 * new_keys.size()) {
+        ++bits;
+    }
+    uint32_t candidate = 0x9e3779b1;    // golden ratio, followed by a linear congruential sequence of odd multipliers
+    std::vector<int16_t> table;
+    for (; bits <= 16; ++bits) {
+        for (int attempt = 0; attempt < 1000; ++attempt, candidate = candidate * 1664525u + 1013904223u) {
+            const uint32_t mult = (candidate | 1);
+            table.assign((size_t)1 << bits, -1);
+            bool collision = false;
+            for (size_t i = 0; i < new_keys.size() && collision == false; ++i) {
+                int16_t& slot = table[(uint32_t)(new_keys[i] * mult) >> (32 - bits)];
+                collision = (slot >= 0);
+                slot = (int16_t)i;
+            }
+            if (collision == false) {
+                keys = new_keys;
+                slots.swap(table);
+                multiplier = mult;
+                shift = 32 - bits;
+                return true;
+            }
+        }
+    }
+    return false;
+}
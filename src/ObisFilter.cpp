@@ -1,21 +1,29 @@
+#include <utility>
 #include <ObisFilter.hpp>
 #include <SpeedwireEmeterProtocol.hpp>
 using namespace libspeedwire;
 
 
-ObisFilter::ObisFilter(void) {
-    // nothing to do
+ObisFilter::ObisFilter(void) :
+    deviceIndex(16, -1) {
 }
 
 ObisFilter::~ObisFilter(void) {
     filterMap.clear();
+    deviceFilters.clear();
     consumerTable.clear();
 }
 
+/**
+ *  Add the given ObisData instance to the filter; it is also added to the filter state of all known devices.
+ */
 void ObisFilter::addFilter(const ObisData &entry) {
-    ObisData& filter_entry = filterMap[entry.toKey()];
-    filter_entry = entry;
-    filter_entry.measurementValues.setMaximumNumberOfElements(entry.measurementValues.getMaximumNumberOfElements());
+    assignEntry(filterMap[entry.toKey()], entry);
+    rebuild();
+    const int index = keyTable.find(entry.toKey());
+    for (auto& device_filter : deviceFilters) {
+        assignEntry(device_filter.entries[index], entry);
+    }
 }
 
 void ObisFilter::addFilter(const std::vector<ObisData> &entries) {
@@ -32,12 +40,44 @@ void ObisFilter::addFilter(const ObisDataMap& entries) {
 
 void ObisFilter::removeFilter(const ObisData &entry) {
     filterMap.remove(entry);
+    rebuild();
 }
 
+/**
+ *  Get the map of registered ObisData instances; it is the template for the filter state of devices seen later.
+ */
 ObisDataMap& ObisFilter::getFilter(void) {
     return filterMap;
 }
 
+/**
+ *  Get the ObisData instances holding the measurements of the given device, in the order of the registered obis keys.
+ *  @return a pointer to the vector of instances, or NULL if no obis data of the device has been consumed so far
+ */
+std::vector<ObisData>* ObisFilter::getFilter(const SpeedwireAddress& address) {
+    const size_t mask = deviceIndex.size() - 1;
+    for (size_t i = hash(address) & mask; deviceIndex[i] >= 0; i = (i + 1) & mask) {
+        DeviceFilter& device_filter = deviceFilters[deviceIndex[i]];
+        if (device_filter.address == address) {
+            return &device_filter.entries;
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Get the ObisData instance holding the measurements of the given device and obis type; unlike filter(), no filter state is created for new devices.
+ *  @return a pointer to the instance, or NULL if the obis type is not registered or no obis data of the device has been consumed so far
+ */
+ObisData* const ObisFilter::getFilter(const SpeedwireAddress& address, const ObisType& element) {
+    const int index = keyTable.find(element.toKey());
+    std::vector<ObisData>* entries;
+    if (index >= 0 && (entries = getFilter(address)) != NULL) {
+        return &(*entries)[index];
+    }
+    return NULL;
+}
+
 /**
  *  Add an obis consumer to receive the result of the ObisFilter.
  */
@@ -45,41 +85,84 @@ void ObisFilter::addConsumer(ObisConsumer& obisConsumer) {
     consumerTable.push_back(&obisConsumer);
 }
 
+/**
+ *  Consume the obis element at the given position of an emeter packet.
+ *  @return true if the element passed the filter, false otherwise
+ */
 bool ObisFilter::consume(const SpeedwireDevice& device, const void *const obis, const uint32_t time) {
-    ObisType element(SpeedwireEmeterProtocol::getObisChannel(obis),
-                     SpeedwireEmeterProtocol::getObisIndex(obis),
-                     SpeedwireEmeterProtocol::getObisType(obis),
-                     SpeedwireEmeterProtocol::getObisTariff(obis));
+    SpeedwireEmeterProtocol::ObisElement element;
+    element.decode((const uint8_t*)obis, SpeedwireEmeterProtocol::getObisLength(obis));
+    return consume(device, element, time);
+}
 
-    ObisData *const filteredElement = filter(device, element);
+/**
+ *  Consume an obis element decoded by SpeedwireEmeterProtocol; the decoded value is used without reading the packet bytes again.
+ *  @return true if the element passed the filter, false otherwise
+ */
+bool ObisFilter::consume(const SpeedwireDevice& device, const SpeedwireEmeterProtocol::ObisElement& obis, const uint32_t time) {
+    ObisData* const filteredElement = consumeElement(getDeviceFilter(device.deviceAddress), obis, time);
     if (filteredElement != NULL) {
+        produce(device, *filteredElement);
+        return true;
+    }
+    return false;
+}
+
+/**
+ *  Update the filter state of a device with a decoded obis element; consumers are not notified.
+ *  @return a pointer to the updated ObisData instance, or NULL if the element did not pass the filter
+ */
+ObisData* ObisFilter::consumeElement(DeviceFilter& device_filter, const SpeedwireEmeterProtocol::ObisElement& obis, const uint32_t time) {
+    const int index = keyTable.find(obis.key);
+    if (index >= 0) {
+        ObisData *const filteredElement = &device_filter.entries[index];
         switch (filteredElement->type) {
         case 0:
-            filteredElement->measurementValues.value_string = SpeedwireEmeterProtocol::toValueString(obis, false);
+            filteredElement->measurementValues.value_string = SpeedwireEmeterProtocol::toValueString(obis.data, false);
             break;
         case 4:
-            filteredElement->addMeasurement((uint32_t)SpeedwireEmeterProtocol::getObisValue4(obis), time);
+            filteredElement->addMeasurement((uint32_t)obis.value, time);
             break;
         case 7:
-            filteredElement->addMeasurement((int32_t)SpeedwireEmeterProtocol::getObisValue4(obis), time);
+            filteredElement->addMeasurement((int32_t)(uint32_t)obis.value, time);
             break;
         case 8:
-            filteredElement->addMeasurement(SpeedwireEmeterProtocol::getObisValue8(obis), time);
+            filteredElement->addMeasurement(obis.value, time);
             break;
         default:
             perror("obis identifier not implemented");
         }
-        produce(device, *filteredElement);
-
-        return true;
+        return filteredElement;
     }
-    return false;
+    return NULL;
+}
+
+/**
+ *  Consume all obis elements of the given emeter packet; the elements that passed the filter are delivered to the consumers
+ *  in a single batch, followed by the end of obis data notification.
+ *  @return the number of elements that passed the filter
+ */
+int ObisFilter::consume(const SpeedwireDevice& device, const SpeedwireEmeterProtocol& packet, const uint32_t time) {
+    DeviceFilter& device_filter = getDeviceFilter(device.deviceAddress);
+    packetElements.clear();
+    packet.visitObisElements([&](const SpeedwireEmeterProtocol::ObisElement& element) {
+        ObisData* const filteredElement = consumeElement(device_filter, element, time);
+        if (filteredElement != NULL) {
+            packetElements.push_back(filteredElement);
+        }
+    });
+    produce(device, packetElements.data(), packetElements.size(), time);
+    return (int)packetElements.size();
 }
 
+/**
+ *  Find the ObisData instance of the given device matching the given obis type.
+ *  @return a pointer to the ObisData instance, or NULL if the obis type is not registered with the filter
+ */
 ObisData *const ObisFilter::filter(const SpeedwireDevice& device, const ObisType &element) {
-    const auto& it = filterMap.find(element.toKey());
-    if (it != filterMap.end()) {
-        return &(it->second);
+    const int index = keyTable.find(element.toKey());
+    if (index >= 0) {
+        return &getDeviceFilter(device.deviceAddress).entries[index];
     }
     return NULL;
 }
@@ -90,8 +173,113 @@ void ObisFilter::produce(const SpeedwireDevice& device, ObisData &element) {
     }
 }
 
+/**
+ *  Deliver the ObisData instances updated by an emeter packet to all consumers, one batch per consumer.
+ */
+void ObisFilter::produce(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t time) {
+    for (std::vector<ObisConsumer*>::iterator it = consumerTable.begin(); it != consumerTable.end(); it++) {
+        (*it)->consumePacket(device, elements, num_elements, time);
+    }
+}
+
 void ObisFilter::endOfObisData(const SpeedwireDevice& device, const uint32_t time) {
     for (std::vector<ObisConsumer*>::iterator it = consumerTable.begin(); it != consumerTable.end(); it++) {
         (*it)->endOfObisData(device, time);
     }
 }
+
+/**
+ *  Get the filter state of the given device; it is created from the registered ObisData instances if the device is new.
+ */
+ObisFilter::DeviceFilter& ObisFilter::getDeviceFilter(const SpeedwireAddress& address) {
+    const size_t mask = deviceIndex.size() - 1;
+    for (size_t i = hash(address) & mask; deviceIndex[i] >= 0; i = (i + 1) & mask) {
+        DeviceFilter& device_filter = deviceFilters[deviceIndex[i]];
+        if (device_filter.address == address) {
+            return device_filter;
+        }
+    }
+    deviceFilters.push_back(DeviceFilter());
+    DeviceFilter& device_filter = deviceFilters.back();
+    device_filter.address = address;
+    device_filter.entries.resize(filterMap.size());
+    size_t index = 0;
+    for (const auto& entry : filterMap) {
+        assignEntry(device_filter.entries[index++], entry.second);
+    }
+
+    // keep the load factor of the hash index at or below 1/2
+    if (2 * deviceFilters.size() > deviceIndex.size()) {
+        deviceIndex.assign(2 * deviceIndex.size(), -1);
+        for (size_t i = 0; i < deviceFilters.size(); ++i) {
+            insertHash((int32_t)i);
+        }
+    }
+    else {
+        insertHash((int32_t)(deviceFilters.size() - 1));
+    }
+    return deviceFilters.back();
+}
+
+/**
+ *  Rebuild the obis key table from the registered ObisData instances and rearrange the entries of all devices accordingly;
+ *  entries of obis keys that remain registered keep their measurements.
+ */
+void ObisFilter::rebuild(void) {
+    const ObisKeyTable old_table = keyTable;
+    std::vector<uint32_t> keys;
+    keys.reserve(filterMap.size());
+    for (const auto& entry : filterMap) {
+        keys.push_back(entry.first);
+    }
+    keyTable.build(keys);   // the keys of a map are distinct, hence a perfect hash function is always found
+
+    for (auto& device_filter : deviceFilters) {
+        std::vector<ObisData> entries(keys.size());
+        size_t index = 0;
+        for (const auto& entry : filterMap) {
+            const int old_index = old_table.find(entry.first);
+            if (old_index >= 0) {
+                entries[index++] = std::move(device_filter.entries[old_index]);
+            }
+            else {
+                assignEntry(entries[index++], entry.second);
+            }
+        }
+        device_filter.entries.swap(entries);
+    }
+}
+
+/**
+ *  Assign the given registered ObisData instance to the given entry; copying does not preserve the ring buffer capacities
+ *  and reserving cannot shrink them, hence empty ring buffers with the registered capacities are assigned explicitly.
+ */
+void ObisFilter::assignEntry(ObisData& entry, const ObisData& registered) {
+    entry = registered;
+    entry.measurementValues = MeasurementValues(registered.measurementValues.getMaximumNumberOfElements());
+    entry.rawMeasurementValues = RawMeasurementValues(registered.rawMeasurementValues.getMaximumNumberOfElements());
+    entry.rawMeasurementValues.setDivisor(registered.measurementType.divisor);
+}
+
+/**
+ *  Insert the given device filter index into the hash index; linear probing.
+ */
+void ObisFilter::insertHash(const int32_t index) {
+    const size_t mask = deviceIndex.size() - 1;
+    size_t i = hash(deviceFilters[index].address) & mask;
+    while (deviceIndex[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    deviceIndex[i] = index;
+}
+
+/**
+ *  Calculate the hash value of the given device address.
+ */
+size_t ObisFilter::hash(const SpeedwireAddress& address) {
+    uint64_t key = ((uint64_t)address.serialNumber << 16) | address.susyID;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (size_t)key;
+}
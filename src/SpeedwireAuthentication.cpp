@@ -11,10 +11,13 @@
 #include <SpeedwireTime.hpp>
 #include <SpeedwireCommand.hpp>
 #include <SpeedwireAuthentication.hpp>
+#include <SpeedwireSocketFactory.hpp>
 using namespace libspeedwire;
 
 static Logger logger("SpeedwireAuthentication");
 
+const uint32_t SpeedwireAuthentication::session_timeout_in_s;
+
 
 /**
  *  Login this local device from to other devices. This is done by sending a broadcast login command for this device to each local interface.
@@ -24,7 +27,7 @@ bool SpeedwireAuthentication::login(const Credentials& credentials, const int ti
     const SpeedwireAddress& local_address     = SpeedwireAddress::getLocalAddress();
     const SpeedwireAddress& broadcast_address = SpeedwireAddress::getBroadcastAddress();
     for (const auto& entry : socket_map) {
-        result &= login(entry.first, broadcast_address, local_address, credentials, timeout_in_ms);
+        result &= login(entry.interface_address, broadcast_address, local_address, credentials, timeout_in_ms);
     }
     for (const auto& device : devices) {
         if (!AddressConversion::resideOnSameSubnet(device.deviceIpAddress, device.interfaceIpAddress, 24) && device.interfaceIpAddress.length() > 0) { // FIXME: hard coded prefix
@@ -42,7 +45,7 @@ bool SpeedwireAuthentication::loginAnyToAny(const Credentials& credentials, cons
     const SpeedwireAddress& broadcast_address = SpeedwireAddress::getBroadcastAddress();
     for (const auto& device : devices) {
         for (const auto& entry : socket_map) {
-            result &= login(entry.first, broadcast_address, device.deviceAddress, credentials, timeout_in_ms);
+            result &= login(entry.interface_address, broadcast_address, device.deviceAddress, credentials, timeout_in_ms);
         }
     }
     return result;
@@ -63,7 +66,7 @@ bool SpeedwireAuthentication::login(const std::string& if_address, const Speedwi
         src.susyID, src.serialNumber, dst.susyID, dst.serialNumber, localhost.getUnixEpochTimeInMs());
 
     // determine receive socket
-    SocketIndex socket_index = socket_map[if_address];
+    SocketIndex socket_index = getSocketIndex(if_address);
     if (socket_index < 0) {
         logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
         return false;
@@ -97,12 +100,12 @@ bool SpeedwireAuthentication::login(const std::string& if_address, const Speedwi
             if (error_code != 0x0000) {
                 if (error_code == 0x0017) {
                     logger.print(LogLevel::LOG_ERROR, "lost connection - not authenticated (error code 0x0017)");
-                    token_repository.needs_login = true;
+                    token_repository.setNeedsLogin(SpeedwireAddress(inverter_packet.getSrcSusyID(), inverter_packet.getSrcSerialNumber()));
                 }
                 else if (error_code == 0x0100) {
                     logger.print(LogLevel::LOG_ERROR, "invalid password - not authenticated");
                 }
-                else if (token_repository.size() > token_index && token_repository.at(token_index).command == Command::LOGIN) { // login command
+                else if (token_repository.isValid(token_index) && token_repository.at(token_index).command == Command::LOGIN) { // login command
                     logger.print(LogLevel::LOG_ERROR, "login failure - not authenticated");
                 }
                 else {
@@ -114,6 +117,12 @@ bool SpeedwireAuthentication::login(const std::string& if_address, const Speedwi
         }
     }
     token_repository.remove(token_index);
+    if (dst.isBroadcast() == false) {
+        LoginSession& session = getSession(dst);
+        session.state = SessionState::AUTHENTICATED;
+        session.error_code = 0;
+        session.expiry_time = localhost.getUnixEpochTimeInMs() + session_timeout_in_s * 1000ull;
+    }
     return true;
 }
 
@@ -126,7 +135,7 @@ bool SpeedwireAuthentication::logoff(void) {
     const SpeedwireAddress &local_address     = SpeedwireAddress::getLocalAddress();
     const SpeedwireAddress &broadcast_address = SpeedwireAddress::getBroadcastAddress();
     for (const auto& entry : socket_map) {
-        result &= logoff(entry.first, broadcast_address, local_address);
+        result &= logoff(entry.interface_address, broadcast_address, local_address);
     }
     for (const auto& device : devices) {
         if (!AddressConversion::resideOnSameSubnet(device.deviceIpAddress, device.interfaceIpAddress, 24) && device.interfaceIpAddress.length() > 0) { // FIXME: hard coded prefix
@@ -144,7 +153,7 @@ bool SpeedwireAuthentication::logoffAnyFromAny(void) {
     const SpeedwireAddress& broadcast_address = SpeedwireAddress::getBroadcastAddress();
     for (const auto& device : devices) {
         for (const auto& entry : socket_map) {
-            result &= logoff(entry.first, broadcast_address, device.deviceAddress);
+            result &= logoff(entry.interface_address, broadcast_address, device.deviceAddress);
         }
     }
     return result;
@@ -201,14 +210,14 @@ SpeedwireCommandTokenIndex SpeedwireAuthentication::sendLoginRequest(const std::
     request.setPacketID(packet_id);
     request.setCommandID(Command::LOGIN);
     request.setFirstRegisterID((uint32_t)credentials.getUserCode());    // user: 0x7  installer: 0xa
-    request.setLastRegisterID(0x00000384);     // timeout
+    request.setLastRegisterID(session_timeout_in_s);     // timeout
     request.setDataUint32(0, SpeedwireTime::getInverterTimeNow());
     request.setDataUint32(4, 0x00000000);
     std::array<uint8_t, 12> encoded_password = credentials.getEncodedPassword();
     request.setDataUint8Array(8, encoded_password.data(), (unsigned long)encoded_password.size());
 
     // identify the socket to be used
-    SocketIndex socket_index = socket_map[if_address];
+    SocketIndex socket_index = getSocketIndex(if_address);
     if (socket_index < 0) {
         logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
         return -1;
@@ -272,7 +281,7 @@ bool SpeedwireAuthentication::sendLogoffRequest(const std::string& if_address, c
     request.setLastRegisterID(0x00000000);
 
     // identify the destination ip address to be used
-    SocketIndex socket_index = socket_map.at(if_address);
+    SocketIndex socket_index = getSocketIndex(if_address);
     if (socket_index < 0) {
         logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
         return false;
@@ -300,6 +309,193 @@ bool SpeedwireAuthentication::sendLogoffRequest(const std::string& if_address, c
 }
 
 
+/**
+ *  Concurrent login method - send login requests to all devices at once and wait until all replies are received or the timeout expires.
+ *  Devices with an authenticated session that does not expire within the renew margin are skipped; repeated calls therefore just
+ *  re-login devices whose session lapsed, expired or is about to expire.
+ *  @return the number of devices with an authenticated session
+ */
+int SpeedwireAuthentication::loginConcurrently(const Credentials& credentials, const int timeout_in_ms, const int renew_margin_in_ms) {
+    int npending = sendLoginRequests(credentials, renew_margin_in_ms);
+
+    // receive replies on all interface sockets until all pending sessions are resolved or the timeout expires
+    SpeedwireEventLoop& event_loop = SpeedwireSocketFactory::getInstance(localhost)->getEventLoop();
+    const uint64_t deadline = localhost.getUnixEpochTimeInMs() + timeout_in_ms;
+    std::vector<int> ready_indexes;
+    unsigned char response_buffer[2048];
+    while (npending > 0) {
+        const uint64_t now = localhost.getUnixEpochTimeInMs();
+        if (now >= deadline || event_loop.wait(sockets, ready_indexes, (int)(deadline - now)) <= 0) {
+            break;
+        }
+        for (int index : ready_indexes) {
+            SpeedwireSocket& socket = sockets[index];
+            struct sockaddr_storage src;
+            int nbytes = -1;
+            if (socket.isIpv4()) {
+                nbytes = socket.recvfrom(response_buffer, sizeof(response_buffer), AddressConversion::toSockAddrIn(AddressConversion::toSockAddr(src)));
+            }
+            else if (socket.isIpv6()) {
+                nbytes = socket.recvfrom(response_buffer, sizeof(response_buffer), AddressConversion::toSockAddrIn6(AddressConversion::toSockAddr(src)));
+            }
+            if (nbytes <= 0) {
+                event_loop.clearReady(socket);  // the socket is drained, wait for the next packet
+                continue;
+            }
+            SpeedwireHeader speedwire_packet(response_buffer, nbytes);
+            if (handleLoginReply(speedwire_packet, AddressConversion::toSockAddr(src)) == true) {
+                --npending;
+            }
+        }
+    }
+    expireLoginRequests(0);
+
+    int nauthenticated = 0;
+    for (auto& session : sessions) {
+        if (isAuthenticated(session.address)) {
+            ++nauthenticated;
+        }
+    }
+    return nauthenticated;
+}
+
+
+/**
+ *  Asynchronous concurrent login method - send login requests to all devices without an authenticated session and return immediately.
+ *  Sessions of devices that replied with error code 0x0017 since the last call are considered lapsed. Replies must be passed to
+ *  handleLoginReply(), e.g. from an inverter packet receiver; unanswered requests are resolved by expireLoginRequests().
+ *  @return the number of sent login requests
+ */
+int SpeedwireAuthentication::sendLoginRequests(const Credentials& credentials, const int renew_margin_in_ms) {
+    const uint64_t now = localhost.getUnixEpochTimeInMs();
+
+    // invalidate the sessions of those devices that replied with error code 0x0017
+    for (auto& address : token_repository.needs_login_devices) {
+        invalidateSession(address);
+    }
+    token_repository.needs_login_devices.clear();
+    token_repository.needs_login = false;
+
+    int nsent = 0;
+    for (auto& device : devices) {
+        if (device.deviceAddress.isComplete() == false || device.deviceClass == libspeedwire::toString(SpeedwireDeviceClass::EMETER)) {
+            continue;
+        }
+        LoginSession& session = getSession(device.deviceAddress);
+        if (session.state == SessionState::PENDING || (session.state == SessionState::AUTHENTICATED && now + renew_margin_in_ms < session.expiry_time)) {
+            continue;
+        }
+        logger.print(LogLevel::LOG_INFO_0, "login susyid %u serial %lu time 0x%016llx", device.deviceAddress.susyID, device.deviceAddress.serialNumber, now);
+        SpeedwireCommandTokenIndex token_index = sendLoginRequest(device.interfaceIpAddress, device.deviceAddress, SpeedwireAddress::getLocalAddress(), credentials);
+        if (token_index < 0) {
+            session.state = SessionState::FAILED;
+            continue;
+        }
+        session.state = SessionState::PENDING;
+        session.packet_id = token_repository.at(token_index).packetid;
+        session.request_time = now;
+        ++nsent;
+    }
+    return nsent;
+}
+
+
+/**
+ *  Handle a reply to a login request sent by sendLoginRequests() and update the session state of the replying device.
+ *  @return true if the packet is a valid login reply, false otherwise
+ */
+bool SpeedwireAuthentication::handleLoginReply(const SpeedwireHeader& packet, const struct sockaddr& src) {
+    const int token_index = findCommandToken(packet);
+    if (token_index < 0 || token_repository.at(token_index).command != Command::LOGIN) {
+        return false;
+    }
+    if (checkReply(packet, src, token_repository.at(token_index)) == false) {
+        return false;
+    }
+    token_repository.remove(token_index);
+
+    const SpeedwireInverterProtocol inverter_packet(packet);
+    LoginSession& session = getSession(SpeedwireAddress(inverter_packet.getSrcSusyID(), inverter_packet.getSrcSerialNumber()));
+    session.error_code = inverter_packet.getErrorCode();
+    if (session.error_code == 0x0000) {
+        session.state = SessionState::AUTHENTICATED;
+        session.expiry_time = localhost.getUnixEpochTimeInMs() + session_timeout_in_s * 1000ull;
+    }
+    else {
+        session.state = SessionState::FAILED;
+        if (session.error_code == 0x0100) {
+            logger.print(LogLevel::LOG_ERROR, "invalid password - susyid %u serial %lu not authenticated", session.address.susyID, session.address.serialNumber);
+        }
+        else {
+            logger.print(LogLevel::LOG_ERROR, "login failure - susyid %u serial %lu not authenticated (error code 0x%04x)", session.address.susyID, session.address.serialNumber, session.error_code);
+        }
+    }
+    return true;
+}
+
+
+/**
+ *  Resolve login requests that did not receive a reply within the given timeout; their sessions are marked as failed.
+ *  @return the number of expired login requests
+ */
+int SpeedwireAuthentication::expireLoginRequests(const int timeout_in_ms) {
+    const uint64_t now = localhost.getUnixEpochTimeInMs();
+    int nexpired = 0;
+    for (auto& session : sessions) {
+        if (session.state == SessionState::PENDING && now >= session.request_time + timeout_in_ms) {
+            int token_index = token_repository.find(session.address.susyID, session.address.serialNumber, session.packet_id);
+            if (token_index >= 0) {
+                token_repository.remove(token_index);
+            }
+            logger.print(LogLevel::LOG_ERROR, "login timeout - susyid %u serial %lu not authenticated", session.address.susyID, session.address.serialNumber);
+            session.state = SessionState::FAILED;
+            ++nexpired;
+        }
+    }
+    return nexpired;
+}
+
+
+/**
+ *  Check if the given device has an authenticated session that has not yet expired.
+ */
+bool SpeedwireAuthentication::isAuthenticated(const SpeedwireAddress& address) const {
+    for (auto& session : sessions) {
+        if (session.address == address) {
+            return (session.state == SessionState::AUTHENTICATED && localhost.getUnixEpochTimeInMs() < session.expiry_time);
+        }
+    }
+    return false;
+}
+
+
+/**
+ *  Mark the session of the given device as lapsed, such that the next call to sendLoginRequests() or loginConcurrently() logs it in again.
+ */
+void SpeedwireAuthentication::invalidateSession(const SpeedwireAddress& address) {
+    for (auto& session : sessions) {
+        if (session.address == address && session.state != SessionState::PENDING) {
+            session.state = SessionState::NONE;
+        }
+    }
+}
+
+
+/**
+ *  Get the session of the given device; a new session is created if there is none yet.
+ */
+SpeedwireAuthentication::LoginSession& SpeedwireAuthentication::getSession(const SpeedwireAddress& address) {
+    for (auto& session : sessions) {
+        if (session.address == address) {
+            return session;
+        }
+    }
+    LoginSession session = { address, SessionState::NONE, 0, 0, 0, 0 };
+    sessions.push_back(session);
+    return sessions.back();
+}
+
+
 /**
  *  Encode password string into its 12 byte binary line encoding.
  */
@@ -1,12 +1,10 @@
 #ifdef _WIN32
 #include <Winsock2.h>
 #include <Ws2tcpip.h>
-#define poll(a, b, c)  WSAPoll((a), (b), (c))
 #else
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <poll.h>
 #endif
 
 #include <string.h>
@@ -27,32 +25,133 @@ using namespace libspeedwire;
 static Logger logger("SpeedwireCommand");
 
 uint16_t SpeedwireCommand::packet_id = 0x8001;
+const size_t SpeedwireCommand::query_request_size;
 
 
 SpeedwireCommand::SpeedwireCommand(const LocalHost &_localhost, const std::vector<SpeedwireDevice> &_devices) :
     localhost(_localhost),
     devices(_devices) {
-    // loop across all speedwire devices
+    // loop across all speedwire devices, open a socket for each interface and resolve the route to each device
     for (auto& device : devices) {
-        // check if there is already a map entry for the interface ip address
-        if (socket_map.find(device.interfaceIpAddress) == socket_map.end() && device.interfaceIpAddress.length() > 0 && device.interfaceIpAddress != "0.0.0.0") {
-            // create and open a socket for the interface
-            SpeedwireSocket socket = SpeedwireSocketFactory::getInstance(localhost)->getRecvSocket(SpeedwireSocketFactory::SocketType::UNICAST, device.interfaceIpAddress);
-            if (socket.getSocketFd() >= 0) {
-                // add it to the map
-                socket_map[device.interfaceIpAddress] = (SocketIndex)sockets.size();
-                sockets.push_back(socket);
-            }
-            else {
-                socket_map[device.interfaceIpAddress] = -1;
-            }
-        }
+        registerDevice(device);
     }
 }
 
 SpeedwireCommand::~SpeedwireCommand(void) {
     sockets.clear();
     socket_map.clear();
+    routes.clear();
+}
+
+
+/**
+ *  resolve the socket and the destination address of the given peer; the route is cached if the peer has a complete device address,
+ *  such that subsequent queries to the peer do not involve any string operations
+ */
+bool SpeedwireCommand::registerDevice(const SpeedwireDevice& peer) {
+    DeviceRoute route;
+    if (resolveRoute(peer, route) == false) {
+        return false;
+    }
+    if (peer.deviceAddress.isComplete() && peer.deviceAddress.isBroadcast() == false) {
+        routes[((uint64_t)peer.deviceAddress.susyID << 32) | peer.deviceAddress.serialNumber] = route;
+    }
+    return true;
+}
+
+
+/**
+ *  get the route to the given peer; cached routes are looked up by device address, all other routes are resolved.
+ *  A cached route is resolved again if the binary device address or interface identifier of the peer changed since, e.g. by dhcp or by discovery;
+ *  peers that only carry ip address strings must be registered again by registerDevice() whenever these strings change
+ */
+const SpeedwireCommand::DeviceRoute* SpeedwireCommand::getRoute(const SpeedwireDevice& peer) {
+    std::unordered_map<uint64_t, DeviceRoute>::const_iterator it = routes.find(((uint64_t)peer.deviceAddress.susyID << 32) | peer.deviceAddress.serialNumber);
+    if (it != routes.end()) {
+        if (it->second.matches(peer) == true) {
+            return &it->second;
+        }
+        routes.erase(it);
+    }
+    if (registerDevice(peer) == false) {
+        logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
+        return NULL;
+    }
+    it = routes.find(((uint64_t)peer.deviceAddress.susyID << 32) | peer.deviceAddress.serialNumber);
+    if (it != routes.end()) {
+        return &it->second;
+    }
+    resolveRoute(peer, uncached_route);
+    return &uncached_route;
+}
+
+
+/**
+ *  resolve the socket and the destination address of the given peer from its binary addresses, or from its ip address strings if they are unresolved
+ */
+bool SpeedwireCommand::resolveRoute(const SpeedwireDevice& peer, DeviceRoute& route) {
+    const SpeedwireInterfaceID if_id = (peer.interfaceID.isValid() ? peer.interfaceID : SpeedwireInterfaceID(localhost, peer.interfaceIpAddress));
+    if (if_id.isValid() == false || if_id.isAny() == true) {
+        return false;
+    }
+    route.socket_index = openInterfaceSocket(if_id);
+    if (route.socket_index < 0) {
+        return false;
+    }
+    if (peer.deviceSockAddress.ss_family != AF_UNSPEC) {
+        route.dest = peer.deviceSockAddress;
+    }
+    else if (AddressConversion::isIpv4(peer.deviceIpAddress) || AddressConversion::isIpv6(peer.deviceIpAddress)) {
+        route.dest = AddressConversion::toSockAddr(peer.deviceIpAddress, SpeedwireSocket::speedwire_port_9522);
+    }
+    else {
+        return false;
+    }
+    route.device_address = peer.deviceSockAddress;
+    route.interface_id = peer.interfaceID;
+    return true;
+}
+
+
+/**
+ *  get the index of the socket opened for the given interface, or open a socket if there is none yet
+ */
+SpeedwireCommand::SocketIndex SpeedwireCommand::openInterfaceSocket(const SpeedwireInterfaceID& if_id) {
+    for (auto& entry : socket_map) {
+        if (entry.interface_id == if_id) {
+            return entry.socket_index;
+        }
+    }
+    // create and open a socket for the interface and add it to the map
+    InterfaceSocket entry = { if_id, if_id.toString(), -1 };
+    SpeedwireSocket socket = SpeedwireSocketFactory::getInstance(localhost)->getRecvSocket(SpeedwireSocketFactory::SocketType::UNICAST, if_id);
+    if (socket.getSocketFd() >= 0) {
+        entry.socket_index = (SocketIndex)sockets.size();
+        sockets.push_back(socket);
+    }
+    socket_map.push_back(entry);
+    return entry.socket_index;
+}
+
+
+/**
+ *  get the index of the socket opened for the given interface, or -1 if there is none
+ */
+SpeedwireCommand::SocketIndex SpeedwireCommand::getSocketIndex(const SpeedwireInterfaceID& if_id) const {
+    for (auto& entry : socket_map) {
+        if (entry.interface_id == if_id) {
+            return entry.socket_index;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ *  get the index of the socket opened for the given interface ip address, or -1 if there is none
+ */
+SpeedwireCommand::SocketIndex SpeedwireCommand::getSocketIndex(const std::string& if_address) const {
+    return getSocketIndex(SpeedwireInterfaceID(localhost, if_address));
 }
 
 
@@ -63,12 +162,11 @@ SpeedwireCommand::~SpeedwireCommand(void) {
 int32_t SpeedwireCommand::query(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, void* udp_buffer, const size_t udp_buffer_size, const int timeout_in_ms) {
 
     // determine receive socket
-    SocketIndex socket_index = socket_map[peer.interfaceIpAddress];
-    if (socket_index < 0) {
-        logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
+    const DeviceRoute* route = getRoute(peer);
+    if (route == NULL) {
         return -1;
     }
-    SpeedwireSocket& socket = sockets[socket_index];
+    SpeedwireSocket& socket = sockets[route->socket_index];
 
     // send query request to peer
     SpeedwireCommandTokenIndex token_index = sendQueryRequest(peer, command, first_register, last_register);
@@ -89,7 +187,7 @@ int32_t SpeedwireCommand::query(const SpeedwireDevice& peer, const Command comma
     if (error_code != 0x0000) {
         if (error_code == 0x0017) {
             logger.print(LogLevel::LOG_ERROR, "lost connection - not authenticated (error code 0x0017)");
-            token_repository.needs_login = true;
+            token_repository.setNeedsLogin(peer.deviceAddress);
         }
         else {
             logger.print(LogLevel::LOG_ERROR, "query error code received");
@@ -140,18 +238,42 @@ SpeedwireCommandTokenIndex SpeedwireCommand::sendQueryRequest(const SpeedwireDev
     // Request  534d4100000402a00000000100260010 606509a0 7a01842a71b30001 7d0042be283a0001 000000000a80 00028051 00644100 ff644100 00000000 =>  query grid relay status
     // Response 534d4100000402a000000001004e0010 606513a0 7d0042be283a00a1 7a01842a71b30001 000000000a80 01028051 07000000 07000000 01644108 59c5e95f 33000001 37010000 fdffff00 feffff00 00000000 00000000 00000000 00000000 00000000
 
-    // assemble unicast device login packet                                                                                 
-    unsigned char request_buffer[24 + 8 + 8 + 6 + 4 + 4 + 4];
-    memset(request_buffer, 0, sizeof(request_buffer));
+    // assemble unicast query request packet
+    uint8_t request_buffer[query_request_size];
+    const uint16_t packet_id = getIncrementedPacketID();
+    assembleQueryRequest(request_buffer, peer, command, first_register, last_register, packet_id);
 
-    SpeedwireHeader request_header(request_buffer, sizeof(request_buffer));
-    request_header.setDefaultHeader(1, sizeof(request_buffer) - 20, SpeedwireData2Packet::sma_inverter_protocol_id);
+    // send query request packet to peer
+    const DeviceRoute* route = getRoute(peer);
+    if (route == NULL) {
+        return -1;
+    }
+    const struct sockaddr& dest = AddressConversion::toSockAddr(route->dest);
+    int nsent = sockets[route->socket_index].sendto(request_buffer, sizeof(request_buffer), dest);
+    if (nsent <= 0) {
+        logger.print(LogLevel::LOG_ERROR, "cannot send data to socket");
+        return -1;
+    }
+
+    // add a query token; this is used to match reply packets to this request packet
+    SpeedwireCommandTokenIndex index = token_repository.add(peer.deviceAddress.susyID, peer.deviceAddress.serialNumber, packet_id, dest, command);
+
+    return index;
+}
+
+
+/**
+ *  assemble inverter query command packet into the given buffer of query_request_size bytes
+ */
+void SpeedwireCommand::assembleQueryRequest(uint8_t* buffer, const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, const uint16_t packet_id) {
+    memset(buffer, 0, query_request_size);
+
+    SpeedwireHeader request_header(buffer, query_request_size);
+    request_header.setDefaultHeader(1, query_request_size - 20, SpeedwireData2Packet::sma_inverter_protocol_id);
 
     SpeedwireData2Packet data2_packet(request_header);
     data2_packet.setControl(0xa0);
-    //LocalHost::hexdump(request_buffer, sizeof(request_buffer));
-
-    const uint16_t packet_id = getIncrementedPacketID();
+    //LocalHost::hexdump(buffer, query_request_size);
 
     SpeedwireInverterProtocol request(request_header);
     request.setDstSusyID(peer.deviceAddress.susyID);
@@ -167,24 +289,67 @@ SpeedwireCommandTokenIndex SpeedwireCommand::sendQueryRequest(const SpeedwireDev
     request.setFirstRegisterID(first_register);
     request.setLastRegisterID(last_register);
     //printf("query: command %08lx first 0x%08lx last 0x%08lx\n", command, first_register, last_register);
+}
 
-    // send query request packet to peer
-    SocketIndex socket_index = socket_map[peer.interfaceIpAddress];
-    if (socket_index < 0) {
-        logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
-        return -1;
+
+/**
+ *  assemble inverter query commands for all given requests into a contiguous buffer arena and send them with a single
+ *  sendmmsg call per socket; this replaces one sendto call for each device and command by one system call per interface
+ *  and polling cycle. The returned vector holds a command token index for each request, in the order of the requests;
+ *  the token index is -1 if the request could not be sent.
+ */
+std::vector<SpeedwireCommandTokenIndex> SpeedwireCommand::sendQueryRequests(const std::vector<QueryRequest>& requests) {
+    std::vector<SpeedwireCommandTokenIndex> token_indexes(requests.size(), -1);
+    if (request_arena.size() < requests.size() * query_request_size) {
+        request_arena.resize(requests.size() * query_request_size);
     }
-    SpeedwireSocket& socket = sockets[socket_index];
-    int nsent = socket.sendto(request_buffer, sizeof(request_buffer), peer.deviceIpAddress);
-    if (nsent <= 0) {
-        logger.print(LogLevel::LOG_ERROR, "cannot send data to socket");
-        return -1;
+    request_dests.resize(requests.size());
+    request_sockets.resize(requests.size());
+    request_packet_ids.resize(requests.size());
+
+    // assemble all query request packets into the arena and determine their sockets
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const SpeedwireDevice& peer = *requests[i].peer;
+        const DeviceRoute* route = getRoute(peer);
+        request_sockets[i] = (route != NULL ? route->socket_index : -1);
+        if (request_sockets[i] < 0) {
+            continue;
+        }
+        request_packet_ids[i] = getIncrementedPacketID();
+        assembleQueryRequest(&request_arena[i * query_request_size], peer, requests[i].command, requests[i].first_register, requests[i].last_register, request_packet_ids[i]);
+        request_dests[i] = route->dest;
     }
 
-    // add a query token; this is used to match reply packets to this request packet
-    SpeedwireCommandTokenIndex index = token_repository.add(peer.deviceAddress.susyID, peer.deviceAddress.serialNumber, packet_id, peer.deviceIpAddress, command);
+    // send the query request packets of each socket with a single sendmmsg call
+    for (SocketIndex socket_index = 0; socket_index < (SocketIndex)sockets.size(); ++socket_index) {
+        batch_buffs.clear();
+        batch_sizes.clear();
+        batch_dests.clear();
+        batch_requests.clear();
+        for (size_t i = 0; i < requests.size(); ++i) {
+            if (request_sockets[i] == socket_index) {
+                batch_buffs.push_back(&request_arena[i * query_request_size]);
+                batch_sizes.push_back(query_request_size);
+                batch_dests.push_back(&request_dests[i]);
+                batch_requests.push_back(i);
+            }
+        }
+        if (batch_requests.size() == 0) {
+            continue;
+        }
+        int nsent = sockets[socket_index].sendmmsg(batch_buffs.data(), batch_sizes.data(), batch_dests.data(), (int)batch_requests.size());
+        if (nsent < (int)batch_requests.size()) {
+            logger.print(LogLevel::LOG_ERROR, "cannot send data to socket");
+        }
 
-    return index;
+        // add a query token for each sent packet; this is used to match reply packets to their request packets
+        for (int j = 0; j < nsent; ++j) {
+            const size_t i = batch_requests[j];
+            const SpeedwireDevice& peer = *requests[i].peer;
+            token_indexes[i] = token_repository.add(peer.deviceAddress.susyID, peer.deviceAddress.serialNumber, request_packet_ids[i], AddressConversion::toSockAddr(request_dests[i]), requests[i].command);
+        }
+    }
+    return token_indexes;
 }
 
 
@@ -206,12 +371,11 @@ SpeedwireDevice SpeedwireCommand::queryDeviceType(const SpeedwireDevice& peer, c
     //SpeedwireCommandTokenIndex token_index = sendQueryRequest(peer, Command::DEVICE_QUERY, 0x00823400, 0x008234FF);  // query software version
 
     // determine socket
-    SocketIndex socket_index = socket_map[peer.interfaceIpAddress];
-    if (socket_index < 0) {
-        logger.print(LogLevel::LOG_ERROR, "invalid socket_index");
+    const DeviceRoute* route = getRoute(peer);
+    if (route == NULL) {
         return info;
     }
-    SpeedwireSocket& socket = sockets[socket_index];
+    SpeedwireSocket& socket = sockets[route->socket_index];
 
     // wait for response
     unsigned char udp_packet[2048];
@@ -274,19 +438,16 @@ SpeedwireDevice SpeedwireCommand::queryDeviceType(const SpeedwireDevice& peer, c
  */
 int32_t SpeedwireCommand::receiveResponse(const SpeedwireCommandTokenIndex token_index, SpeedwireSocket& socket, void* udp_buffer, const size_t udp_buffer_size, const int timeout_in_ms) {
 
-    // prepare the pollfd structure
-    struct pollfd pollfds;
-    pollfds.fd      = socket.getSocketFd();
-    pollfds.events  = POLLIN;
-    pollfds.revents = 0;
+    // use the event loop shared with the receive dispatcher and the discovery
+    SpeedwireEventLoop& event_loop = SpeedwireSocketFactory::getInstance(localhost)->getEventLoop();
 
     // enter packet receive wait loop - any udp packets received before the inverter packet or before the timeout kicks in are skipped(!)
     int  nbytes = -1;
     bool valid  = false;
-    while (valid == false && nbytes != 0) {
+    while (valid == false) {
 
         // wait for a packet on the configured socket
-        int pollresult = poll(&pollfds, 1, timeout_in_ms);
+        int pollresult = event_loop.wait(socket, timeout_in_ms);
         if (pollresult == 0) {
             //perror("poll timeout in SpeedwireCommand");
             return 0;
@@ -296,35 +457,35 @@ int32_t SpeedwireCommand::receiveResponse(const SpeedwireCommandTokenIndex token
             return -1;
         }
 
-        // determine if the socket received a packet
-        if ((pollfds.revents & POLLIN) != 0) {
+        // read packet data
+        struct sockaddr_storage src;
+        if (socket.isIpv4()) {
+            nbytes = socket.recvfrom(udp_buffer, udp_buffer_size, AddressConversion::toSockAddrIn(AddressConversion::toSockAddr(src)));
+        }
+        else if (socket.isIpv6()) {
+            nbytes = socket.recvfrom(udp_buffer, udp_buffer_size, AddressConversion::toSockAddrIn6(AddressConversion::toSockAddr(src)));
+        }
+        if (nbytes <= 0) {
+            event_loop.clearReady(socket);  // the socket is drained, wait for the next packet
+            continue;
+        }
 
-            // read packet data
-            struct sockaddr src;
-            if (socket.isIpv4()) {
-                nbytes = socket.recvfrom(udp_buffer, udp_buffer_size, AddressConversion::toSockAddrIn(src));
-            }
-            else if (socket.isIpv6()) {
-                nbytes = socket.recvfrom(udp_buffer, udp_buffer_size, AddressConversion::toSockAddrIn6(src));
+        // check if the reply is a valid sma speedwire data2 packet
+        SpeedwireHeader speedwire_packet(udp_buffer, nbytes);
+        if (speedwire_packet.isValidData2Packet()) {
+            if (!speedwire_packet.isValidData2Packet(true)) {
+                printf("is valid speedwire packet, but minor deviations from standard detected\n");
             }
+            SpeedwireData2Packet data2_packet(speedwire_packet);
 
-            // check if the reply is a valid sma speedwire data2 packet
-            SpeedwireHeader speedwire_packet(udp_buffer, nbytes);
-            if (speedwire_packet.isValidData2Packet()) {
-                if (!speedwire_packet.isValidData2Packet(true)) {
-                    printf("is valid speedwire packet, but minor deviations from standard detected\n");
-                }
-                SpeedwireData2Packet data2_packet(speedwire_packet);
-
-                // check if the reply is an inverter packet
-                if (data2_packet.isInverterProtocolID()) {
+            // check if the reply is an inverter packet
+            if (data2_packet.isInverterProtocolID()) {
 
-                    // check reply packet for validity
-                    const SpeedwireCommandToken& token = token_repository.at(token_index);
-                    if (checkReply(speedwire_packet, src, token) == true) {
-                        valid = true;
-                        token_repository.remove(token_index);
-                    }
+                // check reply packet for validity
+                const SpeedwireCommandToken& token = token_repository.at(token_index);
+                if (checkReply(speedwire_packet, AddressConversion::toSockAddr(src), token) == true) {
+                    valid = true;
+                    token_repository.remove(token_index);
                 }
             }
         }
@@ -436,10 +597,9 @@ bool SpeedwireCommand::checkReply(const SpeedwireHeader& speedwire_reply_packet,
             printf("ipv4 port %u is not 9522\n", (unsigned)ntohs(addr.sin_port));
             return false;
         }
-        struct in_addr token_in_addr = AddressConversion::toInAddress(token.peer_ip_address);
-        if (token_in_addr.s_addr != addr.sin_addr.s_addr &&
-            token_in_addr.s_addr != SpeedwireSocket(localhost).getSpeedwireMulticastIn4Address().sin_addr.s_addr) {
-            printf("ipv4 address %s is not peer ip address %s\n", AddressConversion::toString(addr.sin_addr).c_str(), token.peer_ip_address.c_str());
+        if (token.peer_family != AF_INET || (token.peer_ip.v4.s_addr != addr.sin_addr.s_addr &&
+            token.peer_ip.v4.s_addr != SpeedwireSocket::speedwire_multicast_address_239_12_255_254.sin_addr.s_addr)) {
+            printf("ipv4 address %s is not peer ip address %s\n", AddressConversion::toString(addr.sin_addr).c_str(), AddressConversion::toString(token.peer_ip.v4).c_str());
             return false;
         }
     }
@@ -449,9 +609,8 @@ bool SpeedwireCommand::checkReply(const SpeedwireHeader& speedwire_reply_packet,
             printf("ipv6 port %u is not 9522\n", (unsigned)ntohs(addr.sin6_port));
             return false;
         }
-        struct in6_addr temp = AddressConversion::toIn6Address(token.peer_ip_address);
-        if (memcmp(&addr.sin6_addr, &temp, sizeof(temp)) != 0) {
-            printf("ipv4 address %s is not peer ip address %s\n", AddressConversion::toString(addr.sin6_addr).c_str(), token.peer_ip_address.c_str());
+        if (token.peer_family != AF_INET6 || memcmp(&addr.sin6_addr, &token.peer_ip.v6, sizeof(token.peer_ip.v6)) != 0) {
+            printf("ipv6 address %s is not peer ip address %s\n", AddressConversion::toString(addr.sin6_addr).c_str(), AddressConversion::toString(token.peer_ip.v6).c_str());
             return false;
         }
     }
@@ -462,56 +621,387 @@ bool SpeedwireCommand::checkReply(const SpeedwireHeader& speedwire_reply_packet,
 
 //=====================================================================================
 
+const int SpeedwireCommandTokenRepository::wheel_level0_bits;
+const int SpeedwireCommandTokenRepository::wheel_level_bits;
+const int SpeedwireCommandTokenRepository::wheel_levels;
+const int SpeedwireCommandTokenRepository::wheel_buckets;
+
+
+/**
+ *  constructor - creates an empty repository
+ */
+SpeedwireCommandTokenRepository::SpeedwireCommandTokenRepository(void) :
+    needs_login(false),
+    free_slots(-1),
+    num_tokens(0),
+    wheel_time(0) {
+    clear();
+}
+
+
+/**
+ *  add a token for the given peer ip address in dot (ipv4) or colon (ipv6) notation; return its index
+ */
 SpeedwireCommandTokenIndex SpeedwireCommandTokenRepository::add(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid, const std::string& peer_ip_address, const Command command) {
-    uint32_t create_time = (uint32_t)LocalHost::getUnixEpochTimeInMs();
-    SpeedwireCommandToken new_token = { susyid, serialnumber, packetid, peer_ip_address, command, create_time };
-    token.push_back(new_token);
-    return (SpeedwireCommandTokenIndex)token.size()-1;
+    SpeedwireCommandToken new_token;
+    memset(&new_token, 0, sizeof(new_token));
+    new_token.susyid = susyid;
+    new_token.serialnumber = serialnumber;
+    new_token.packetid = packetid;
+    new_token.command = command;
+    if (peer_ip_address.find(':') == std::string::npos) {
+        new_token.peer_family = AF_INET;
+        new_token.peer_ip.v4 = AddressConversion::toInAddress(peer_ip_address);
+    }
+    else {
+        new_token.peer_family = AF_INET6;
+        new_token.peer_ip.v6 = AddressConversion::toIn6Address(peer_ip_address);
+    }
+    return add(new_token, LocalHost::getUnixEpochTimeInMs());
 }
 
+
+/**
+ *  add a token for the given peer socket address; return its index
+ */
+SpeedwireCommandTokenIndex SpeedwireCommandTokenRepository::add(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid, const struct sockaddr& peer_address, const Command command) {
+    SpeedwireCommandToken new_token;
+    memset(&new_token, 0, sizeof(new_token));
+    new_token.susyid = susyid;
+    new_token.serialnumber = serialnumber;
+    new_token.packetid = packetid;
+    new_token.command = command;
+    new_token.peer_family = peer_address.sa_family;
+    if (peer_address.sa_family == AF_INET) {
+        new_token.peer_ip.v4 = AddressConversion::toSockAddrIn(peer_address).sin_addr;
+    }
+    else if (peer_address.sa_family == AF_INET6) {
+        new_token.peer_ip.v6 = AddressConversion::toSockAddrIn6(peer_address).sin6_addr;
+    }
+    return add(new_token, LocalHost::getUnixEpochTimeInMs());
+}
+
+
+/**
+ *  add the given token created at the given time in ms since the unix epoch; return its index
+ */
+SpeedwireCommandTokenIndex SpeedwireCommandTokenRepository::add(const SpeedwireCommandToken& token, const uint64_t time) {
+    if (free_slots < 0) {
+        grow();
+    }
+    const int32_t slot = free_slots;
+    free_slots = slots[slot].next;
+    slots[slot].token = token;
+    slots[slot].token.create_time = (uint32_t)time;
+    slots[slot].time = time;
+    ++num_tokens;
+    insertHash(slot);
+
+    // start the timer wheel at the creation time of the first token
+    if (num_tokens == 1 && time > wheel_time) {
+        wheel_time = time;
+    }
+    insertWheel(slot);
+    return (SpeedwireCommandTokenIndex)slot;
+}
+
+
+/**
+ *  remove the token with the given index
+ */
 void SpeedwireCommandTokenRepository::remove(const SpeedwireCommandTokenIndex index) {
-    int i = 0;
-    for (std::vector<SpeedwireCommandToken>::iterator it = token.begin(); it != token.end(); ++it, ++i) {
-        if (i == index) {
-            it = token.erase(it);
-            break;
-        }
+    if (isValid(index)) {
+        removeHash(index);
+        removeWheel(index);
+        release(index);
     }
 }
 
+
+/**
+ *  find the token for the given device and packet id; return its index or -1
+ */
 int SpeedwireCommandTokenRepository::find(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid) const {
-    for (int i = 0; i < token.size(); ++i) {
-        const SpeedwireCommandToken& t = token[i];
-        if (t.susyid == susyid && t.serialnumber == serialnumber && t.packetid == (packetid | 0x8000)) {
-            return i;
+    const uint16_t key_packetid = (packetid | 0x8000);
+    const size_t mask = hash_index.size() - 1;
+    for (size_t i = hash(susyid, serialnumber, key_packetid) & mask; hash_index[i] >= 0; i = (i + 1) & mask) {
+        const SpeedwireCommandToken& t = slots[hash_index[i]].token;
+        if (t.susyid == susyid && t.serialnumber == serialnumber && t.packetid == key_packetid) {
+            return hash_index[i];
         }
     }
     return -1;
 }
 
+
+/**
+ *  get the token with the given index; the index must be valid
+ */
 const SpeedwireCommandToken& SpeedwireCommandTokenRepository::at(const SpeedwireCommandTokenIndex index) const {
-    return token[index];
+    return slots[index].token;
 }
 
+
+/**
+ *  check if the given index refers to a token in use
+ */
+bool SpeedwireCommandTokenRepository::isValid(const SpeedwireCommandTokenIndex index) const {
+    return (index >= 0 && index < (int)slots.size() && slots[index].bucket >= 0);
+}
+
+
+/**
+ *  remove all tokens
+ */
 void SpeedwireCommandTokenRepository::clear(void) {
-    token.clear();
+    slots.clear();
+    hash_index.assign(16, -1);
+    free_slots = -1;
+    num_tokens = 0;
+    for (int i = 0; i < wheel_buckets; ++i) {
+        wheel[i] = -1;
+    }
+    for (int i = 0; i < wheel_levels; ++i) {
+        wheel_count[i] = 0;
+    }
 }
 
+
+/**
+ *  record that the given device replied with error code 0x0017, i.e. its login session lapsed
+ */
+void SpeedwireCommandTokenRepository::setNeedsLogin(const SpeedwireAddress& device) {
+    needs_login = true;
+    for (auto& address : needs_login_devices) {
+        if (address == device) {
+            return;
+        }
+    }
+    needs_login_devices.push_back(device);
+}
+
+
+/**
+ *  remove all tokens older than the given timeout; return the number of removed tokens
+ */
 int SpeedwireCommandTokenRepository::expire(const int timeout_in_ms) {
-    uint32_t now = (uint32_t)LocalHost::getUnixEpochTimeInMs();
+    return expire(timeout_in_ms, LocalHost::getUnixEpochTimeInMs());
+}
+
+
+/**
+ *  remove all tokens created more than the given timeout before the given time; return the number of removed tokens.
+ *  The timer wheel advances tick by tick, but skips ticks where all levels below the next boundary are empty.
+ */
+int SpeedwireCommandTokenRepository::expire(const int timeout_in_ms, const uint64_t now) {
+    if (now <= (uint64_t)timeout_in_ms) {
+        return 0;
+    }
+    const uint64_t cutoff = now - (uint64_t)timeout_in_ms;    // tokens created before the cutoff time expire
     int count = 0;
-    for (std::vector<SpeedwireCommandToken>::iterator it = token.begin(); it != token.end(); /*nop*/) {
-        if ((now - it->create_time) > (uint32_t)timeout_in_ms) {
-            it = token.erase(it);
-            ++count;
+    while (wheel_time < cutoff) {
+        if (num_tokens == 0) {
+            wheel_time = cutoff;
+            break;
         }
-        else {
-            ++it;
+
+        // at level boundaries, move the tokens of the next higher level bucket down; higher levels first
+        if ((wheel_time & ((1 << wheel_level0_bits) - 1)) == 0) {
+            for (int level = wheel_levels - 1; level > 0; --level) {
+                const int shift = wheel_level0_bits + (level - 1) * wheel_level_bits;
+                if ((wheel_time & ((1ull << shift) - 1)) == 0) {
+                    cascade((1 << wheel_level0_bits) + (level - 1) * (1 << wheel_level_bits) + (int)((wheel_time >> shift) & ((1 << wheel_level_bits) - 1)));
+                }
+            }
+        }
+
+        // skip to the next boundary if all levels below it are empty
+        int empty_bits = 0;
+        for (int level = 0; level < wheel_levels - 1 && wheel_count[level] == 0; ++level) {
+            empty_bits = wheel_level0_bits + level * wheel_level_bits;
         }
+        if (empty_bits > 0) {
+            const uint64_t next = (wheel_time | ((1ull << empty_bits) - 1)) + 1;
+            wheel_time = (next < cutoff ? next : cutoff);
+            continue;
+        }
+
+        // expire all tokens of the current tick
+        int32_t& head = wheel[wheel_time & ((1 << wheel_level0_bits) - 1)];
+        while (head >= 0) {
+            const int32_t slot = head;
+            removeHash(slot);
+            removeWheel(slot);
+            release(slot);
+            ++count;
+        }
+        ++wheel_time;
     }
     return count;
 }
 
+
+/**
+ *  get the number of tokens
+ */
 int SpeedwireCommandTokenRepository::size(void) const {
-    return (int)token.size();
+    return num_tokens;
+}
+
+
+/**
+ *  double the number of token slots and rebuild the hash index; token indexes remain unchanged
+ */
+void SpeedwireCommandTokenRepository::grow(void) {
+    const size_t old_size = slots.size();
+    const size_t new_size = (old_size > 0 ? 2 * old_size : 16);
+    slots.resize(new_size);
+    for (size_t i = new_size; i > old_size; --i) {
+        slots[i - 1].bucket = -1;
+        slots[i - 1].next = free_slots;
+        free_slots = (int32_t)(i - 1);
+    }
+    hash_index.assign(2 * new_size, -1);
+    for (size_t i = 0; i < old_size; ++i) {
+        if (slots[i].bucket >= 0) {
+            insertHash((int32_t)i);
+        }
+    }
+}
+
+
+/**
+ *  calculate the hash value of the given token key
+ */
+size_t SpeedwireCommandTokenRepository::hash(const uint16_t susyid, const uint32_t serialnumber, const uint16_t packetid) {
+    uint64_t key = ((uint64_t)serialnumber << 32) | ((uint64_t)susyid << 16) | packetid;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+
+/**
+ *  insert the given slot into the hash index; linear probing
+ */
+void SpeedwireCommandTokenRepository::insertHash(const int32_t slot) {
+    const SpeedwireCommandToken& t = slots[slot].token;
+    const size_t mask = hash_index.size() - 1;
+    size_t i = hash(t.susyid, t.serialnumber, t.packetid) & mask;
+    while (hash_index[i] >= 0) {
+        i = (i + 1) & mask;
+    }
+    hash_index[i] = slot;
+}
+
+
+/**
+ *  remove the given slot from the hash index; subsequent entries of the probe sequence are shifted back to close the gap
+ */
+void SpeedwireCommandTokenRepository::removeHash(const int32_t slot) {
+    const SpeedwireCommandToken& t = slots[slot].token;
+    const size_t mask = hash_index.size() - 1;
+    size_t i = hash(t.susyid, t.serialnumber, t.packetid) & mask;
+    while (hash_index[i] != slot) {
+        if (hash_index[i] < 0) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    for (size_t j = (i + 1) & mask; hash_index[j] >= 0; j = (j + 1) & mask) {
+        const SpeedwireCommandToken& u = slots[hash_index[j]].token;
+        const size_t home = hash(u.susyid, u.serialnumber, u.packetid) & mask;
+        // move the entry to the gap, unless its home position lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            hash_index[i] = hash_index[j];
+            i = j;
+        }
+    }
+    hash_index[i] = -1;
+}
+
+
+/**
+ *  get the timer wheel bucket for the given time, relative to the current timer wheel time
+ */
+int SpeedwireCommandTokenRepository::getBucket(uint64_t time) const {
+    if (time < wheel_time) {
+        time = wheel_time;      // already expired, expire with the next tick
+    }
+    const uint64_t delta = time - wheel_time;
+    if (delta < (1ull << wheel_level0_bits)) {
+        return (int)(time & ((1 << wheel_level0_bits) - 1));
+    }
+    int level = 1;
+    int shift = wheel_level0_bits;
+    while (level < wheel_levels - 1 && delta >= (1ull << (shift + wheel_level_bits))) {
+        ++level;
+        shift += wheel_level_bits;
+    }
+    if (delta >= (1ull << (shift + wheel_level_bits))) {
+        time = wheel_time + (1ull << (shift + wheel_level_bits)) - 1;  // beyond the range of the timer wheel; re-inserted when cascaded
+    }
+    return (1 << wheel_level0_bits) + (level - 1) * (1 << wheel_level_bits) + (int)((time >> shift) & ((1 << wheel_level_bits) - 1));
+}
+
+
+/**
+ *  insert the given slot into its timer wheel bucket
+ */
+void SpeedwireCommandTokenRepository::insertWheel(const int32_t slot) {
+    const int bucket = getBucket(slots[slot].time);
+    const int level = (bucket < (1 << wheel_level0_bits) ? 0 : 1 + (bucket - (1 << wheel_level0_bits)) / (1 << wheel_level_bits));
+    slots[slot].bucket = (int16_t)bucket;
+    slots[slot].prev = -1;
+    slots[slot].next = wheel[bucket];
+    if (wheel[bucket] >= 0) {
+        slots[wheel[bucket]].prev = slot;
+    }
+    wheel[bucket] = slot;
+    ++wheel_count[level];
+}
+
+
+/**
+ *  remove the given slot from its timer wheel bucket
+ */
+void SpeedwireCommandTokenRepository::removeWheel(const int32_t slot) {
+    const int bucket = slots[slot].bucket;
+    const int level = (bucket < (1 << wheel_level0_bits) ? 0 : 1 + (bucket - (1 << wheel_level0_bits)) / (1 << wheel_level_bits));
+    if (slots[slot].prev >= 0) {
+        slots[slots[slot].prev].next = slots[slot].next;
+    }
+    else {
+        wheel[bucket] = slots[slot].next;
+    }
+    if (slots[slot].next >= 0) {
+        slots[slots[slot].next].prev = slots[slot].prev;
+    }
+    --wheel_count[level];
+}
+
+
+/**
+ *  move all tokens of the given higher level timer wheel bucket to lower levels
+ */
+void SpeedwireCommandTokenRepository::cascade(const int bucket) {
+    int32_t slot = wheel[bucket];
+    while (slot >= 0) {
+        const int32_t next = slots[slot].next;
+        removeWheel(slot);
+        insertWheel(slot);
+        slot = next;
+    }
+}
+
+
+/**
+ *  return the given slot to the free list; the slot must already be removed from the hash index and the timer wheel
+ */
+void SpeedwireCommandTokenRepository::release(const int32_t slot) {
+    slots[slot].bucket = -1;
+    slots[slot].next = free_slots;
+    free_slots = slot;
+    --num_tokens;
 }
@@ -663,7 +663,7 @@ bool SpeedwireData::consume(const SpeedwireRawData& data) {
  *  @return A string representation
  */
 std::string SpeedwireData::toString(void) const {
-    TimestampDoublePair measurementValue = measurementValues.getNewestElement();
+    TimestampDoublePair measurementValue = getNewestMeasurement();
     char buff[256];
     snprintf(buff, sizeof(buff), "%-16s  time %lu  %s  => %lf %s\n", description.c_str(), measurementValue.time, SpeedwireRawData::toString().c_str(), measurementValue.value, measurementType.unit.c_str());
     return std::string(buff);
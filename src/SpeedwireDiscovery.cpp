@@ -6,12 +6,10 @@
 #ifdef _WIN32
 #include <Winsock2.h>
 #include <Ws2tcpip.h>
-#define poll(a, b, c)  WSAPoll((a), (b), (c))
 #else
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <poll.h>
 #endif
 
 #include <string.h>
@@ -258,43 +256,34 @@ int SpeedwireDiscovery::discoverDevices(const bool full_scan) {
 
 
 int SpeedwireDiscovery::pollSockets(const std::vector<SpeedwireSocket>& sockets, int timeout) {
-    // prepare pollfd structure
-    std::vector<struct pollfd> fds;
-    for (auto& socket : sockets) {
-        struct pollfd pfd;
-        pfd.fd = socket.getSocketFd();
-        fds.push_back(pfd);
-    }
+    SpeedwireEventLoop& event_loop = SpeedwireSocketFactory::getInstance(localhost)->getEventLoop();
+    std::vector<int> ready_sockets;
 
     int result = 0;
     while (true) {
 
-        for (auto& pfd : fds) {
-            pfd.events = POLLIN;
-            pfd.revents = 0;
-        }
-
         // wait for inbound packets on any of the configured sockets
         //fprintf(stdout, "poll() ...\n");
-        int result = poll(fds.data(), (uint32_t)fds.size(), timeout);
-        if (result < 0) {   // error
+        int nready = event_loop.wait(sockets, ready_sockets, timeout);
+        if (nready < 0) {   // error
             perror("poll failed");
             return -1;
         }
-        else if (result == 0) {  // timeout
+        else if (nready == 0) {  // timeout
             //fprintf(stdout, "... timeout\n");
             break;
         }
         else {
             //fprintf(stdout, "... done\n");
 
-            // determine the socket that received a packet
-            // read packet data, analyze it and create a device information record
-            for (int j = 0; j < fds.size(); ++j) {
-                if ((fds[j].revents & POLLIN) != 0) {
-                    recvDiscoveryPackets(sockets[j]);
+            // read packet data from the sockets that received a packet, analyze it and create a device information record
+            for (int j : ready_sockets) {
+                if (recvDiscoveryPackets(sockets[j]) > 0) {
                     ++result;
                 }
+                else {
+                    event_loop.clearReady(sockets[j]);  // the socket is drained
+                }
             }
         }
     }
@@ -447,9 +436,9 @@ bool SpeedwireDiscovery::sendUnicastDiscoveryRequestToSockets(size_t& subnet_cou
 
 /**
  *  Receive a discovery packet, analyze it and create a device information record.
+ *  @return the number of bytes received, 0 if no packet was available, or -1 in case of an error
  */
-bool SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
-    bool result = false;
+int SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
 
     std::string peer_ip_address;
     char udp_packet[1600];
@@ -508,9 +497,9 @@ bool SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
                 if (device.interfaceIpAddress == "" && socket.isIpAny() == false) {
                     device.interfaceIpAddress = socket.getLocalInterfaceAddress();
                 }
+                device.resolveAddresses(localhost);
                 if (registerDevice(device)) {
                     printf("found susyid %u serial %lu ip %s\n", device.deviceAddress.susyID, device.deviceAddress.serialNumber, device.deviceIpAddress.c_str());
-                    result = true;
                 }
             }
             // check for inverter protocol and ignore loopback packets
@@ -528,6 +517,7 @@ bool SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
                 if (device.interfaceIpAddress.length() == 0 && socket.isIpAny() == false) {
                     device.interfaceIpAddress = socket.getLocalInterfaceAddress();
                 }
+                device.resolveAddresses(localhost);
                 // try to get further information about the device by examining the susy id; this is not accurate
                 const SpeedwireDeviceType& device_type = SpeedwireDeviceType::fromSusyID(device.deviceAddress.susyID);
                 if (device_type.deviceClass != SpeedwireDeviceClass::UNKNOWN) {
@@ -536,7 +526,6 @@ bool SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
                 }
                 if (registerDevice(device)) {
                     printf("found susyid %u serial %lu ip %s\n", device.deviceAddress.susyID, device.deviceAddress.serialNumber, device.deviceIpAddress.c_str());
-                    result = true;
                 }
 #if 0
                 // dump reply information; this is just the src susyid and serialnumber together with some unknown bits
@@ -553,7 +542,7 @@ bool SpeedwireDiscovery::recvDiscoveryPackets(const SpeedwireSocket& socket) {
             }
         }
     }
-    return result;
+    return nbytes;
 }
 
 
@@ -569,6 +558,7 @@ bool SpeedwireDiscovery::completeDeviceInformation(void) {
         for (auto& device : speedwireDevices) {
             if (device.interfaceIpAddress.length() == 0 || device.interfaceIpAddress == "0.0.0.0") {
                 device.interfaceIpAddress = localhost.getMatchingLocalIPAddress(device.deviceIpAddress);
+                device.resolveAddresses(localhost);
             }
             // if the ip address and interface address is known, just query the device
             if (device.isComplete() == false && device.deviceIpAddress.length() != 0 && device.interfaceIpAddress.length() != 0) {
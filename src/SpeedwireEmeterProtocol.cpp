@@ -99,6 +99,19 @@ const void* SpeedwireEmeterProtocol::getNextObisElement(const void* const curren
     return next_element;
 }
 
+/** Get an iterator pointing to the first obis element in udp packet. */
+SpeedwireEmeterProtocol::ObisElementIterator SpeedwireEmeterProtocol::begin(void) const {
+    if (size < sma_first_obis_offset) {
+        return ObisElementIterator();
+    }
+    return ObisElementIterator(udp + sma_first_obis_offset, udp + size);
+}
+
+/** Get an iterator pointing behind the last obis element in udp packet. */
+SpeedwireEmeterProtocol::ObisElementIterator SpeedwireEmeterProtocol::end(void) const {
+    return ObisElementIterator();
+}
+
 /** Set given obis element right at location of the given current element. */
 void* SpeedwireEmeterProtocol::setObisElement(void *const current_element, const void* const obis) {
     const unsigned long obis_length = getObisLength(obis);
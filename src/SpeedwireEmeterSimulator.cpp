@@ -0,0 +1,305 @@
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <Logger.hpp>
+#include <AddressConversion.hpp>
+#include <SpeedwireHeader.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireEmeterProtocol.hpp>
+#include <SpeedwireEmeterSimulator.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireEmeterSimulator");
+
+const size_t SpeedwireEmeterSimulator::max_packet_size;
+const size_t SpeedwireEmeterSimulator::obis_index_range;
+
+static const uint32_t software_version = 0x02030452;    // 2.3.4.R
+
+
+/**
+ * Constructor.
+ * @param host Reference to the LocalHost instance
+ * @param seed Seed of the random generator used for the waveforms, such that runs are reproducible
+ */
+SpeedwireEmeterSimulator::SpeedwireEmeterSimulator(const LocalHost& host, const uint32_t seed) :
+    localhost(host),
+    socket(host),
+    packet_size(0),
+    susy_id(0),
+    period_in_ns(1000000000ull),
+    random(seed),
+    num_packets(0),
+    num_send_errors(0) {
+    memset(&destination, 0, sizeof(destination));
+}
+
+
+/**
+ * Destructor - close the socket.
+ */
+SpeedwireEmeterSimulator::~SpeedwireEmeterSimulator(void) {
+    close();
+}
+
+
+/**
+ * Open the sending socket and create the virtual emeters; their serial numbers are consecutive.
+ * @param local_ip_address Local ip address of the interface to send from, e.g. 127.0.0.1
+ * @param destination_address Destination ip address, either a multicast address like 239.12.255.254 or a unicast address
+ * @param num_devices Number of virtual emeters
+ * @param susy_id Susy id of all virtual emeters, e.g. 349 for an emeter 2.0 or 372 for a home manager 2.0
+ * @param first_serial_number Serial number of the first virtual emeter
+ * @return 0 on success, or -1 if the socket could not be opened
+ */
+int SpeedwireEmeterSimulator::open(const std::string& local_ip_address, const std::string& destination_address, const size_t num_devices, const uint16_t susy_id, const uint32_t first_serial_number) {
+    close();
+    if (AddressConversion::isIpv4(destination_address) == false) {
+        logger.print(LogLevel::LOG_ERROR, "destination %s is not an ipv4 address", destination_address.c_str());
+        return -1;
+    }
+    const struct in_addr dest_address = AddressConversion::toInAddress(destination_address);
+    const bool multicast = ((ntohl(dest_address.s_addr) >> 28) == 0xe);
+    destination = AddressConversion::toSockAddrStorage(AddressConversion::toSockAddrIn(dest_address, SpeedwireSocket::speedwire_port_9522));
+
+    // the socket is bound to an ephemeral port; for multicast destinations it defines the outbound interface
+    if (socket.openSocket(local_ip_address, multicast, 0) < 0) {
+        logger.print(LogLevel::LOG_ERROR, "cannot open socket on %s", local_ip_address.c_str());
+        return -1;
+    }
+    this->susy_id = susy_id;
+
+    const uint64_t now = LocalHost::getUnixEpochTimeInNs();
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    emeters.resize(num_devices);
+    for (size_t i = 0; i < num_devices; ++i) {
+        VirtualEmeter& emeter = emeters[i];
+        emeter.serial_number = first_serial_number + (uint32_t)i;
+        emeter.next_send_time = now + period_in_ns * i / num_devices;     // spread transmissions evenly across the period
+        emeter.last_update_time = 0;
+        emeter.base_load = 60.0 + 100.0 * uniform(random);
+        emeter.pv_peak = (i % 3 != 2 ? 3000.0 + 7000.0 * uniform(random) : 0.0);
+        emeter.phase = 2.0 * M_PI * uniform(random);
+        for (int line = 0; line < 3; ++line) {
+            emeter.appliance_power[line] = 0.0;
+            emeter.appliance_until[line] = 0.0;
+        }
+        memset(emeter.values, 0, sizeof(emeter.values));
+        for (size_t index = 0; index < obis_index_range; ++index) {
+            emeter.energy[index] = 1000.0 + 10000.0 * uniform(random);
+        }
+        assembleTemplate(emeter);
+    }
+    logger.print(LogLevel::LOG_INFO_0, "simulating %lu emeters sending %lu bytes to %s every %lu us", (unsigned long)emeters.size(),
+        packet_size, destination_address.c_str(), (unsigned long)(period_in_ns / 1000));
+    return 0;
+}
+
+
+/**
+ * Close the socket and remove all virtual emeters.
+ */
+void SpeedwireEmeterSimulator::close(void) {
+    socket.closeSocket();
+    emeters.clear();
+    slots.clear();
+}
+
+
+/**
+ * Set the number of packets sent by each virtual emeter per second; real emeters send 1 packet per second.
+ * The transmissions of all emeters are spread evenly across the period.
+ * @param packets_per_second Packet rate per virtual emeter, e.g. 1 to 1000
+ */
+void SpeedwireEmeterSimulator::setRate(const double packets_per_second) {
+    const uint64_t old_period = period_in_ns;
+    period_in_ns = (packets_per_second > 0.0 ? (uint64_t)(1e9 / packets_per_second) : 1000000000ull);
+    if (period_in_ns == 0) {
+        period_in_ns = 1;
+    }
+    for (auto& emeter : emeters) {
+        emeter.next_send_time = emeter.next_send_time - old_period + period_in_ns;
+    }
+}
+
+
+/**
+ * Send the packets of all virtual emeters that are due, then wait until the next packet is due; call this method in a loop.
+ * @param timeout_in_ms Maximum time to wait for the next packet in ms
+ * @return the number of sent packets, or -1 in case of an error
+ */
+int SpeedwireEmeterSimulator::run(const int timeout_in_ms) {
+    if (emeters.size() == 0) {
+        return -1;
+    }
+    const uint64_t now = LocalHost::getUnixEpochTimeInNs();
+    uint64_t next_time = UINT64_MAX;
+    send_buffs.clear();
+    send_sizes.clear();
+    send_dests.clear();
+    for (auto& emeter : emeters) {
+        if (emeter.next_send_time <= now) {
+            updateMeasurements(emeter, now);
+            encodeMeasurements(emeter, now);
+            send_buffs.push_back(emeter.packet.data());
+            send_sizes.push_back(packet_size);
+            send_dests.push_back(&destination);
+            // if the sender is late, skip the missed transmissions rather than sending bursts
+            emeter.next_send_time += period_in_ns;
+            if (emeter.next_send_time <= now) {
+                emeter.next_send_time = now + period_in_ns;
+            }
+        }
+        next_time = std::min(next_time, emeter.next_send_time);
+    }
+
+    int nsent = 0;
+    if (send_buffs.size() > 0) {
+        nsent = socket.sendmmsg(send_buffs.data(), send_sizes.data(), send_dests.data(), (int)send_buffs.size());
+        if (nsent < (int)send_buffs.size()) {
+            num_send_errors += send_buffs.size() - (nsent > 0 ? nsent : 0);
+        }
+        num_packets += (nsent > 0 ? nsent : 0);
+    }
+
+    // wait until the next packet is due
+    const uint64_t after = LocalHost::getUnixEpochTimeInNs();
+    if (next_time > after) {
+        const uint64_t wait_in_ms = (next_time - after) / 1000000;
+        if (wait_in_ms > 0) {
+            LocalHost::sleep((uint32_t)std::min(wait_in_ms, (uint64_t)(timeout_in_ms > 0 ? timeout_in_ms : 0)));
+        }
+    }
+    return (nsent >= 0 ? nsent : -1);
+}
+
+
+/**
+ * Assemble the emeter packet template of the given emeter; the first call determines the obis element layout shared by all emeters.
+ */
+void SpeedwireEmeterSimulator::assembleTemplate(VirtualEmeter& emeter) {
+    emeter.packet.assign(max_packet_size, 0);
+    uint8_t* const udp = emeter.packet.data();
+    SpeedwireHeader header(udp, max_packet_size);
+    header.setDefaultHeader(1, (uint16_t)(max_packet_size - 20), SpeedwireData2Packet::sma_emeter_protocol_id);
+    SpeedwireEmeterProtocol emeter_packet(header);
+
+    const bool first = (slots.size() == 0);
+    uint8_t* element = (uint8_t*)emeter_packet.getFirstObisElement();
+    // all predefined elements are in packet order; the elements after end of data are calculated values, not part of a packet
+    for (const auto& obis : ObisData::getAllPredefined()) {
+        const std::array<uint8_t, 12> bytes = obis.toByteArray();
+        uint8_t* const next = (uint8_t*)emeter_packet.setObisElement(element, bytes.data());
+        if (next == NULL) {
+            break;
+        }
+        if (first && (obis.type == 4 || obis.type == 8) && obis.index < obis_index_range) {
+            const ObisSlot slot = { (unsigned long)(element - udp), obis.index, obis.type, (double)obis.measurementType.divisor };
+            slots.push_back(slot);
+        }
+        if (obis.channel == ObisData::SoftwareVersion.channel && obis.index == ObisData::SoftwareVersion.index) {
+            SpeedwireEmeterProtocol::setObisValue4(element, software_version);
+        }
+        element = next;
+        if (obis.equals(ObisData::EndOfData)) {
+            break;
+        }
+    }
+    // shrink the data2 tag to the obis elements, followed by the end of data tag
+    packet_size = (unsigned long)(element - udp) + 4;
+    header.setDefaultHeader(1, (uint16_t)(packet_size - 20), SpeedwireData2Packet::sma_emeter_protocol_id);
+    SpeedwireEmeterProtocol resized_packet(header);
+    resized_packet.setSusyID(susy_id);
+    resized_packet.setSerialNumber(emeter.serial_number);
+}
+
+
+/**
+ * Update the measurement values and energy counters of the given emeter for the given time.
+ */
+void SpeedwireEmeterSimulator::updateMeasurements(VirtualEmeter& emeter, const uint64_t time_in_ns) {
+    const double t  = time_in_ns * 1e-9;
+    const double dt = (emeter.last_update_time > 0 && time_in_ns > emeter.last_update_time ? (time_in_ns - emeter.last_update_time) * 1e-9 : 0.0);
+    emeter.last_update_time = time_in_ns;
+
+    // household load with morning and evening peaks, pv generation as a half sine wave from 06:00 to 18:00 utc with passing clouds
+    const double hours    = fmod(t, 86400.0) / 3600.0;
+    const double profile  = 1.0 + 0.8 * exp(-(hours - 7.5) * (hours - 7.5) / 2.0) + 1.2 * exp(-(hours - 19.0) * (hours - 19.0) / 4.0);
+    const double daylight = (hours > 6.0 && hours < 18.0 ? sin(M_PI * (hours - 6.0) / 12.0) : 0.0);
+    const double clouds   = std::min(1.0, 0.8 + 0.3 * sin(t / 90.0 + emeter.phase) * sin(t / 23.0));
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    double* const values = emeter.values;
+    double p_total = 0.0, q_total = 0.0, s_total = 0.0;
+    for (int line = 0; line < 3; ++line) {
+        // appliances are switched on for 1 to 30 minutes and stay off for 5 to 60 minutes
+        if (t >= emeter.appliance_until[line]) {
+            if (emeter.appliance_power[line] > 0.0 || uniform(random) < 0.5) {
+                emeter.appliance_power[line] = 0.0;
+                emeter.appliance_until[line] = t + 300.0 + 3300.0 * uniform(random);
+            }
+            else {
+                emeter.appliance_power[line] = 500.0 + 2000.0 * uniform(random);
+                emeter.appliance_until[line] = t + 60.0 + 1740.0 * uniform(random);
+            }
+        }
+        const double load    = emeter.base_load * profile * (1.0 + 0.03 * sin(2.0 * M_PI * t / 7.0 + emeter.phase + line)) + emeter.appliance_power[line];
+        const double pv      = emeter.pv_peak / 3.0 * daylight * clouds;
+        const double p       = load - pv;
+        const double q       = 0.33 * load;     // inductive loads with a power factor of about 0.95
+        const double s       = sqrt(p * p + q * q);
+        const double voltage = 230.0 * (1.0 + 0.015 * sin(t / 600.0 + emeter.phase + 2.1 * line) + 0.002 * sin(3.1 * t + line));
+
+        const size_t base = 20 * (line + 1);
+        values[base +  1] = std::max(p, 0.0);
+        values[base +  2] = std::max(-p, 0.0);
+        values[base +  3] = std::max(q, 0.0);
+        values[base +  4] = std::max(-q, 0.0);
+        values[base +  9] = (p >= 0.0 ? s : 0.0);
+        values[base + 10] = (p <  0.0 ? s : 0.0);
+        values[base + 11] = s / voltage;
+        values[base + 12] = voltage;
+        values[base + 13] = (s > 0.0 ? fabs(p) / s : 1.0);
+        p_total += p;
+        q_total += q;
+        s_total += s;
+    }
+    values[ 1] = std::max(p_total, 0.0);
+    values[ 2] = std::max(-p_total, 0.0);
+    values[ 3] = std::max(q_total, 0.0);
+    values[ 4] = std::max(-q_total, 0.0);
+    values[ 9] = (p_total >= 0.0 ? s_total : 0.0);
+    values[10] = (p_total <  0.0 ? s_total : 0.0);
+    values[13] = (s_total > 0.0 ? fabs(p_total) / s_total : 1.0);
+    values[14] = 50.0 + 0.03 * sin(t / 45.0 + emeter.phase) + 0.005 * sin(1.7 * t);
+
+    // integrate energies in kWh from the power values at the same obis index
+    if (dt > 0.0) {
+        for (size_t base = 0; base < obis_index_range; base += 20) {
+            static const size_t power_indexes[] = { 1, 2, 3, 4, 9, 10 };
+            for (size_t index : power_indexes) {
+                emeter.energy[base + index] += values[base + index] * dt / 3600000.0;
+            }
+        }
+    }
+}
+
+
+/**
+ * Encode the current measurement values and energy counters of the given emeter into its packet.
+ */
+void SpeedwireEmeterSimulator::encodeMeasurements(VirtualEmeter& emeter, const uint64_t time_in_ns) {
+    uint8_t* const udp = emeter.packet.data();
+    SpeedwireHeader header(udp, packet_size);
+    SpeedwireEmeterProtocol emeter_packet(header);
+    emeter_packet.setTime((uint32_t)(time_in_ns / 1000000));
+    for (const auto& slot : slots) {
+        if (slot.type == 4) {
+            SpeedwireEmeterProtocol::setObisValue4(udp + slot.offset, (uint32_t)(emeter.values[slot.index] * slot.divisor + 0.5));
+        }
+        else {
+            SpeedwireEmeterProtocol::setObisValue8(udp + slot.offset, (uint64_t)(emeter.energy[slot.index] * slot.divisor + 0.5));
+        }
+    }
+}
@@ -0,0 +1,332 @@
+#ifdef _WIN32
+#include <Winsock2.h>
+#include <Ws2tcpip.h>
+#define poll(a, b, c)  WSAPoll((a), (b), (c))
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <LocalHost.hpp>
+#include <Logger.hpp>
+#include <SpeedwireEventLoop.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireEventLoop");
+
+#if defined(__linux__) && !defined(_WIN32)
+#define SPEEDWIRE_USE_EPOLL
+#endif
+
+
+/**
+ * Constructor - creates the epoll instance on linux hosts.
+ */
+SpeedwireEventLoop::SpeedwireEventLoop(void) {
+#ifdef SPEEDWIRE_USE_EPOLL
+    indexed_sockets = NULL;
+    num_indexed_sockets = 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1 failure");
+    }
+    events.resize(64);
+#endif
+}
+
+
+/**
+ * Destructor - closes the epoll instance.
+ */
+SpeedwireEventLoop::~SpeedwireEventLoop(void) {
+#ifdef SPEEDWIRE_USE_EPOLL
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+#endif
+    socket_states.clear();
+}
+
+
+/**
+ * Register the given socket with the event loop. Registering an already registered socket is a no-op.
+ * On linux hosts, the socket is switched to non-blocking mode and added to the epoll instance with edge-triggered
+ * readiness notification. As packets may have been queued before the registration, the socket is initially marked ready.
+ * @param socket Reference to the socket
+ * @return true if the socket is registered, false otherwise
+ */
+bool SpeedwireEventLoop::registerSocket(const SpeedwireSocket& socket) {
+    int fd = socket.getSocketFd();
+    if (fd < 0) {
+        return false;
+    }
+    if (isRegistered(socket) == true) {
+        return true;
+    }
+#ifdef SPEEDWIRE_USE_EPOLL
+    if (epoll_fd < 0) {
+        return false;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl(O_NONBLOCK) failure");
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0 && errno != EEXIST) {
+        perror("epoll_ctl(EPOLL_CTL_ADD) failure");
+        return false;
+    }
+    if (socket_states.size() <= (size_t)fd) {
+        socket_states.resize(fd + 1, UNREGISTERED);
+    }
+    socket_states[fd] = REGISTERED | (socket_states[fd] & LISTED);
+    markReady(fd);
+#endif
+    return true;
+}
+
+
+/**
+ * Unregister the given socket from the event loop. This must be called before the socket is closed, if the event loop
+ * is to be used further on, as the socket fd may be re-used by the operating system.
+ * @param socket Reference to the socket
+ */
+void SpeedwireEventLoop::unregisterSocket(const SpeedwireSocket& socket) {
+    int fd = socket.getSocketFd();
+    if (isRegistered(socket) == true) {
+#ifdef SPEEDWIRE_USE_EPOLL
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+        socket_states[fd] &= LISTED;    // the fd is removed from the list of ready fds lazily
+    }
+}
+
+
+/**
+ * Check if the given socket is registered with the event loop.
+ * @param socket Reference to the socket
+ * @return true if the socket is registered, false otherwise
+ */
+bool SpeedwireEventLoop::isRegistered(const SpeedwireSocket& socket) const {
+    int fd = socket.getSocketFd();
+    return (fd >= 0 && (size_t)fd < socket_states.size() && (socket_states[fd] & REGISTERED) != 0);
+}
+
+
+/**
+ * Check if the given socket has been reported readable and has not yet been drained.
+ * @param socket Reference to the socket
+ * @return true if the socket is ready, false otherwise
+ */
+bool SpeedwireEventLoop::isReady(const SpeedwireSocket& socket) const {
+    int fd = socket.getSocketFd();
+    return (fd >= 0 && (size_t)fd < socket_states.size() && (socket_states[fd] & READY) != 0);
+}
+
+
+/**
+ * Clear the ready state of the given socket. This must be called once a receive call on the socket returned no
+ * further packet; otherwise the socket would be reported readable forever.
+ * @param socket Reference to the socket
+ */
+void SpeedwireEventLoop::clearReady(const SpeedwireSocket& socket) {
+    int fd = socket.getSocketFd();
+    if (fd >= 0 && (size_t)fd < socket_states.size()) {
+        socket_states[fd] &= ~READY;
+    }
+}
+
+
+#ifdef SPEEDWIRE_USE_EPOLL
+/**
+ * Wait for epoll events and mark all sockets reported readable as ready.
+ * @param timeout_in_ms Timeout in milliseconds, 0 to return immediately, -1 to wait forever
+ * @return the number of events, 0 in case of timeout, -1 in case of an error
+ */
+int SpeedwireEventLoop::harvestEvents(const int timeout_in_ms) {
+    int nevents = epoll_wait(epoll_fd, events.data(), (int)events.size(), timeout_in_ms);
+    if (nevents < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("epoll_wait failure");
+        return -1;
+    }
+    for (int i = 0; i < nevents; ++i) {
+        int fd = events[i].data.fd;
+        if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0 && (size_t)fd < socket_states.size()) {
+            markReady(fd);
+        }
+    }
+    return nevents;
+}
+
+
+/**
+ * Mark the given socket fd as ready and add it to the list of ready fds, unless it is already listed.
+ * @param fd The socket fd
+ */
+void SpeedwireEventLoop::markReady(const int fd) {
+    uint8_t& state = socket_states[fd];
+    state |= READY;
+    if ((state & LISTED) == 0) {
+        state |= LISTED;
+        ready_fds.push_back(fd);
+    }
+}
+
+
+/**
+ * Register all given sockets that are not yet registered and map their fds to their indexes in the given vector.
+ * @param sockets Reference to a vector of sockets
+ */
+void SpeedwireEventLoop::indexSockets(const std::vector<SpeedwireSocket>& sockets) {
+    socket_indexes.assign(socket_indexes.size(), -1);
+    for (int i = 0; i < (int)sockets.size(); ++i) {
+        const int fd = sockets[i].getSocketFd();
+        if (fd < 0) {
+            continue;
+        }
+        if (isRegistered(sockets[i]) == false) {
+            registerSocket(sockets[i]);
+        }
+        if (socket_indexes.size() <= (size_t)fd) {
+            socket_indexes.resize(fd + 1, -1);
+        }
+        socket_indexes[fd] = i;
+    }
+    indexed_sockets = sockets.data();
+    num_indexed_sockets = sockets.size();
+}
+#endif
+
+
+/**
+ * Wait until at least one of the given sockets is readable. Sockets that are not yet registered are registered lazily,
+ * whenever the socket vector differs from the one of the previous call.
+ * Sockets that are still marked ready from a previous call are returned immediately without any system call; only the
+ * list of ready sockets is visited, not the whole socket vector.
+ * @param sockets Reference to a vector of sockets
+ * @param ready_indexes Reference to a vector receiving the indexes of all ready sockets in the sockets vector
+ * @param timeout_in_ms Timeout in milliseconds, 0 to return immediately, -1 to wait forever
+ * @return the number of ready sockets, 0 in case of timeout, -1 in case of an error
+ */
+int SpeedwireEventLoop::wait(const std::vector<SpeedwireSocket>& sockets, std::vector<int>& ready_indexes, const int timeout_in_ms) {
+    ready_indexes.clear();
+
+#ifdef SPEEDWIRE_USE_EPOLL
+    if (sockets.data() != indexed_sockets || sockets.size() != num_indexed_sockets) {
+        indexSockets(sockets);
+    }
+    uint64_t start_time = LocalHost::getTickCountInMs();
+    int remaining = timeout_in_ms;
+    while (true) {
+        // visit the ready fds, drop the ones drained or unregistered since, and report the ones contained in the vector
+        size_t nlisted = 0;
+        for (size_t i = 0; i < ready_fds.size(); ++i) {
+            const int fd = ready_fds[i];
+            uint8_t& state = socket_states[fd];
+            if ((state & (REGISTERED | READY)) != (REGISTERED | READY)) {
+                state &= ~LISTED;
+                continue;
+            }
+            ready_fds[nlisted++] = fd;
+            if ((size_t)fd < socket_indexes.size()) {
+                const int index = socket_indexes[fd];
+                if (index >= 0 && index < (int)sockets.size() && sockets[index].getSocketFd() == fd) {
+                    ready_indexes.push_back(index);
+                }
+            }
+        }
+        ready_fds.resize(nlisted);
+        if (ready_indexes.size() > 0) {
+            std::sort(ready_indexes.begin(), ready_indexes.end());
+            return (int)ready_indexes.size();
+        }
+        // events may be reported for other registered sockets; keep them and wait for the remaining time
+        if (remaining != -1) {
+            uint64_t elapsed = LocalHost::getTickCountInMs() - start_time;
+            remaining = (elapsed >= (uint64_t)timeout_in_ms ? 0 : timeout_in_ms - (int)elapsed);
+        }
+        int nevents = harvestEvents(remaining);
+        if (nevents < 0) {
+            return -1;
+        }
+        if (nevents == 0 && remaining == 0) {
+            return 0;
+        }
+    }
+#else
+    if (pollfds.size() < sockets.size()) {
+        pollfds.resize(sockets.size());
+    }
+    for (int i = 0; i < (int)sockets.size(); ++i) {
+        pollfds[i].fd = sockets[i].getSocketFd();
+        pollfds[i].events = POLLIN;
+        pollfds[i].revents = 0;
+    }
+    int pollresult = poll(&pollfds[0], (unsigned)sockets.size(), timeout_in_ms);
+    if (pollresult < 0) {
+        perror("poll failure");
+        return -1;
+    }
+    for (int i = 0; i < (int)sockets.size() && pollresult > 0; ++i) {
+        if ((pollfds[i].revents & POLLIN) != 0) {
+            ready_indexes.push_back(i);
+        }
+    }
+    return (int)ready_indexes.size();
+#endif
+}
+
+
+/**
+ * Wait until the given socket is readable. The socket is registered lazily, if it is not yet registered.
+ * @param socket Reference to the socket
+ * @param timeout_in_ms Timeout in milliseconds, 0 to return immediately, -1 to wait forever
+ * @return 1 if the socket is ready, 0 in case of timeout, -1 in case of an error
+ */
+int SpeedwireEventLoop::wait(const SpeedwireSocket& socket, const int timeout_in_ms) {
+#ifdef SPEEDWIRE_USE_EPOLL
+    if (isRegistered(socket) == false) {
+        registerSocket(socket);
+    }
+    uint64_t start_time = LocalHost::getTickCountInMs();
+    int remaining = timeout_in_ms;
+    while (isReady(socket) == false) {
+        if (remaining != -1) {
+            uint64_t elapsed = LocalHost::getTickCountInMs() - start_time;
+            remaining = (elapsed >= (uint64_t)timeout_in_ms ? 0 : timeout_in_ms - (int)elapsed);
+        }
+        int nevents = harvestEvents(remaining);
+        if (nevents < 0) {
+            return -1;
+        }
+        if (nevents == 0 && remaining == 0) {
+            return 0;
+        }
+    }
+    return 1;
+#else
+    struct pollfd pfd;
+    pfd.fd = socket.getSocketFd();
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int pollresult = poll(&pfd, 1, timeout_in_ms);
+    if (pollresult < 0) {
+        perror("poll failure");
+        return -1;
+    }
+    return ((pfd.revents & POLLIN) != 0 ? 1 : 0);
+#endif
+}
@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <Logger.hpp>
+#include <LocalHost.hpp>
+#include <SpeedwireByteEncoding.hpp>
+#include <SpeedwireHistoryReader.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireHistoryReader");
+
+const uint32_t SpeedwireHistoryReader::yield_record_size;
+const uint32_t SpeedwireHistoryReader::event_record_size;
+
+
+/**
+ * Constructor.
+ * @param host Reference to the LocalHost instance
+ * @param _command Reference to the SpeedwireCommand instance used to send the queries
+ * @param _consumer Reference to the consumer of the decoded records
+ * @param _pipeline_depth Maximum number of pages in flight per download
+ * @param _timeout_in_ms Timeout of each page in ms; it is restarted with each received fragment
+ * @param _max_retries Maximum number of retries of each page before the download fails
+ */
+SpeedwireHistoryReader::SpeedwireHistoryReader(LocalHost& host, SpeedwireCommand& _command, SpeedwireHistoryConsumer& _consumer, const size_t _pipeline_depth, const int _timeout_in_ms, const int _max_retries) :
+    InverterPacketReceiverBase(host),
+    command(_command),
+    consumer(_consumer),
+    pipeline_depth(_pipeline_depth > 0 ? _pipeline_depth : 1),
+    timeout_in_ms(_timeout_in_ms),
+    max_retries(_max_retries) {}
+
+
+/**
+ * Start a history download; a running download of the same device and command is cancelled and replaced.
+ * The first pages are requested by the next call to poll().
+ * @param peer Reference to the device
+ * @param command History command, i.e. Command::YIELD_BY_MINUTE_QUERY, Command::YIELD_BY_DAY_QUERY or Command::EVENT_QUERY
+ * @param from_time First inverter time of the download; use getSyncedTime() + 1 to resume a download, 0 is treated as 1
+ * @param to_time Last inverter time of the download
+ * @param page_span_in_s Time span of each page in seconds, or 0 for the default of the command, see getDefaultPageSpan()
+ * @return true if the download was started, false if the command is not a history command or the time range is empty
+ */
+bool SpeedwireHistoryReader::start(const SpeedwireDevice& peer, const Command command, const uint32_t from_time, const uint32_t to_time, const uint32_t page_span_in_s) {
+    if (getDefaultPageSpan(command) == 0) {
+        logger.print(LogLevel::LOG_ERROR, "command 0x%08x is not a history command", (unsigned)command);
+        return false;
+    }
+    const uint32_t first_time = std::max(from_time, (uint32_t)1);
+    if (first_time > to_time) {
+        return false;
+    }
+    HistoryJob* job = findJob(peer.deviceAddress, command);
+    if (job == NULL) {
+        jobs.push_back(HistoryJob());
+        job = &jobs.back();
+    }
+    else {
+        cancel(*job);
+    }
+    job->peer = peer;
+    job->command = command;
+    job->next_time = first_time;
+    job->end_time = to_time;
+    job->page_span_in_s = (page_span_in_s > 0 ? page_span_in_s : getDefaultPageSpan(command));
+    job->synced_time = first_time - 1;
+    job->finished = false;
+    return true;
+}
+
+
+/**
+ * Stop a history download and forget its state; tokens of its in-flight pages are removed from the token repository.
+ * @param peer Reference to the device
+ * @param command History command
+ */
+void SpeedwireHistoryReader::stop(const SpeedwireDevice& peer, const Command command) {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (jobs[i].peer.deviceAddress == peer.deviceAddress && jobs[i].command == command) {
+            cancel(jobs[i]);
+            jobs.erase(jobs.begin() + i);
+            return;
+        }
+    }
+}
+
+
+/**
+ * Stop all history downloads.
+ */
+void SpeedwireHistoryReader::clear(void) {
+    for (auto& job : jobs) {
+        cancel(job);
+    }
+    jobs.clear();
+}
+
+
+/**
+ * Retry timed out pages and request further pages up to the pipeline depth.
+ * @return the number of sent queries
+ */
+int SpeedwireHistoryReader::poll(void) {
+    return poll(LocalHost::getUnixEpochTimeInMs());
+}
+
+
+/**
+ * Retry timed out pages and request further pages up to the pipeline depth.
+ * @param now Current time in ms
+ * @return the number of sent queries
+ */
+int SpeedwireHistoryReader::poll(const uint64_t now) {
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    int nsent = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        HistoryJob& job = jobs[i];
+        if (job.finished) {
+            continue;
+        }
+        bool failed = false;
+        for (auto& page : job.pages) {
+            if (page.complete || now < page.sent_time + timeout_in_ms) {
+                continue;
+            }
+            int token_index = repository.find(job.peer.deviceAddress.susyID, job.peer.deviceAddress.serialNumber, page.packet_id);
+            if (token_index >= 0) {
+                repository.remove(token_index);
+            }
+            // all records were received, just the trailing fragment got lost; event records are not in ascending time order
+            if (job.command != Command::EVENT_QUERY && page.delivered_time == page.last_time) {
+                page.complete = true;
+                continue;
+            }
+            if (page.retries >= max_retries) {
+                logger.print(LogLevel::LOG_WARNING, "history query 0x%08x to %s timed out", (unsigned)job.command, job.peer.deviceIpAddress.c_str());
+                failed = true;
+                break;
+            }
+            ++page.retries;
+            // yield records come in ascending time order; request only the records that are still missing
+            if (job.command != Command::EVENT_QUERY) {
+                page.first_time = page.delivered_time + 1;
+            }
+            if (sendPage(job, page, now)) {
+                ++nsent;
+            }
+        }
+        if (failed) {
+            finish(job, false);
+            continue;
+        }
+        advance(job);
+        // endOfHistory() may have started a download, so the job reference is not used beyond this point
+        if (jobs[i].finished == false) {
+            nsent += fill(jobs[i], now);
+        }
+    }
+    return nsent;
+}
+
+
+/**
+ * Check if all history downloads are complete or failed.
+ * @return true if no download is in progress
+ */
+bool SpeedwireHistoryReader::isFinished(void) const {
+    for (auto& job : jobs) {
+        if (job.finished == false) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Check if the history download of the given device and command is complete or failed.
+ * @param peer Reference to the device
+ * @param command History command
+ * @return true if the download is not in progress
+ */
+bool SpeedwireHistoryReader::isFinished(const SpeedwireDevice& peer, const Command command) const {
+    const HistoryJob* job = findJob(peer.deviceAddress, command);
+    return (job == NULL || job->finished);
+}
+
+
+/**
+ * Get the synced time of the history download of the given device and command.
+ * @param peer Reference to the device
+ * @param command History command
+ * @return the inverter time up to and including which all records have been delivered, or 0 if there is no such download
+ */
+uint32_t SpeedwireHistoryReader::getSyncedTime(const SpeedwireDevice& peer, const Command command) const {
+    const HistoryJob* job = findJob(peer.deviceAddress, command);
+    return (job != NULL ? job->synced_time : 0);
+}
+
+
+/**
+ * Receive a reply packet; packets that do not belong to an in-flight page are ignored.
+ * When the last fragment of a page is received, the next page is requested before the records are decoded.
+ * @param packet Reference to the received packet
+ * @param src Reference to the socket address of the packet sender
+ */
+void SpeedwireHistoryReader::receive(SpeedwireHeader& packet, struct sockaddr& src) {
+    if (packet.isValidData2Packet() == false) {
+        return;
+    }
+    const SpeedwireData2Packet data2_packet(packet);
+    if (data2_packet.isInverterProtocolID() == false) {
+        return;
+    }
+    const SpeedwireInverterProtocol inverter(data2_packet);
+    const uint16_t susy_id   = inverter.getSrcSusyID();
+    const uint32_t serial    = inverter.getSrcSerialNumber();
+    const uint16_t packet_id = inverter.getPacketID() | 0x8000;
+
+    // find the in-flight page by device and packet id
+    for (auto& job : jobs) {
+        if (job.finished || job.peer.deviceAddress.susyID != susy_id || job.peer.deviceAddress.serialNumber != serial) {
+            continue;
+        }
+        for (auto& page : job.pages) {
+            if (page.complete || page.packet_id != packet_id) {
+                continue;
+            }
+            SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+            int token_index = repository.find(susy_id, serial, packet_id);
+            if (token_index < 0 || command.checkReply(packet, src, repository.at(token_index)) == false) {
+                return;
+            }
+            const uint64_t now = LocalHost::getUnixEpochTimeInMs();
+            const uint16_t error_code = inverter.getErrorCode();
+            if (error_code != 0x0000) {
+                logger.print(LogLevel::LOG_ERROR, "history query 0x%08x to %s failed with error code 0x%04x", (unsigned)job.command, job.peer.deviceIpAddress.c_str(), error_code);
+                if (error_code == 0x0017) {
+                    repository.setNeedsLogin(job.peer.deviceAddress);
+                }
+                finish(job, false);
+                return;
+            }
+            page.sent_time = now;
+            if (inverter.getFragmentCounter() == 0) {
+                repository.remove(token_index);
+                page.complete = true;
+                fill(job, now);     // references to deque elements remain valid on push_back
+            }
+            deliver(job, page, inverter);
+            advance(job);
+            return;
+        }
+    }
+}
+
+
+/**
+ * Get the default page span of the given history command. Pages are sized to fit into a single reply packet:
+ * 6 hours of 5 minute yield records, 60 days of daily yield records, or 7 days of events.
+ * @param command History command
+ * @return the page span in seconds, or 0 if the command is not a history command
+ */
+uint32_t SpeedwireHistoryReader::getDefaultPageSpan(const Command command) {
+    switch (command) {
+    case Command::YIELD_BY_MINUTE_QUERY: return 6 * 3600;
+    case Command::YIELD_BY_DAY_QUERY:    return 60 * 86400;
+    case Command::EVENT_QUERY:           return 7 * 86400;
+    default:                             return 0;
+    }
+}
+
+
+/**
+ * Send the query of the given page; failures are handled like timeouts.
+ * @return true if the query was sent
+ */
+bool SpeedwireHistoryReader::sendPage(HistoryJob& job, HistoryPage& page, const uint64_t now) {
+    page.sent_time = now;
+    page.packet_id = 0;
+    SpeedwireCommandTokenIndex token_index = sendQueryRequest(job.peer, job.command, page.first_time, page.last_time);
+    if (token_index < 0) {
+        logger.print(LogLevel::LOG_ERROR, "cannot send history query 0x%08x to %s", (unsigned)job.command, job.peer.deviceIpAddress.c_str());
+        return false;
+    }
+    page.packet_id = command.getTokenRepository().at(token_index).packetid;
+    return true;
+}
+
+
+/**
+ * Request further pages of the given download, until the pipeline depth is reached or the time range is exhausted.
+ * @return the number of sent queries
+ */
+int SpeedwireHistoryReader::fill(HistoryJob& job, const uint64_t now) {
+    size_t num_in_flight = 0;
+    for (auto& page : job.pages) {
+        if (page.complete == false) {
+            ++num_in_flight;
+        }
+    }
+    int nsent = 0;
+    while (num_in_flight < pipeline_depth && job.next_time <= job.end_time) {
+        HistoryPage page;
+        page.first_time = (uint32_t)job.next_time;
+        page.last_time = (uint32_t)std::min(job.next_time + job.page_span_in_s - 1, (uint64_t)job.end_time);
+        page.delivered_time = page.first_time - 1;
+        page.retries = 0;
+        page.complete = false;
+        job.next_time = (uint64_t)page.last_time + 1;
+        job.pages.push_back(page);
+        if (sendPage(job, job.pages.back(), now)) {
+            ++nsent;
+        }
+        ++num_in_flight;
+    }
+    return nsent;
+}
+
+
+/**
+ * Advance the synced time over the leading complete pages; finish the download if all pages are complete.
+ */
+void SpeedwireHistoryReader::advance(HistoryJob& job) {
+    while (job.pages.size() > 0 && job.pages.front().complete) {
+        job.synced_time = job.pages.front().last_time;
+        job.pages.pop_front();
+    }
+    if (job.pages.size() == 0 && job.next_time > job.end_time) {
+        finish(job, true);
+    }
+}
+
+
+/**
+ * Remove the tokens of all in-flight pages of the given download and forget its pages.
+ */
+void SpeedwireHistoryReader::cancel(HistoryJob& job) {
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    for (auto& page : job.pages) {
+        int token_index = (page.complete ? -1 : repository.find(job.peer.deviceAddress.susyID, job.peer.deviceAddress.serialNumber, page.packet_id));
+        if (token_index >= 0) {
+            repository.remove(token_index);
+        }
+    }
+    job.pages.clear();
+}
+
+
+/**
+ * Finish the given download and notify the consumer; the synced time is kept, such that the download can be resumed.
+ */
+void SpeedwireHistoryReader::finish(HistoryJob& job, const bool complete) {
+    cancel(job);
+    job.finished = true;
+    // the consumer may restart the download in place, so pass copies
+    const SpeedwireDevice peer = job.peer;
+    const Command  history_command = job.command;
+    const uint32_t synced_time = job.synced_time;
+    consumer.endOfHistory(peer, history_command, synced_time, complete);
+}
+
+
+/**
+ * Decode the records of the given reply packet and pass them to the consumer; records outside the page or already delivered are skipped.
+ */
+void SpeedwireHistoryReader::deliver(const HistoryJob& job, HistoryPage& page, const SpeedwireInverterProtocol& inverter) {
+    const bool     is_event    = (job.command == Command::EVENT_QUERY);
+    const uint32_t record_size = (is_event ? event_record_size : yield_record_size);
+    const uint32_t data_size   = inverter.getDataSize();
+    const uint8_t* record      = (const uint8_t*)inverter.getFirstRawDataElement();
+
+    for (uint32_t offset = 0; offset + record_size <= data_size; offset += record_size, record += record_size) {
+        const uint32_t time = SpeedwireByteEncoding::getUint32LittleEndian(record);
+        if (time == 0) {    // trailer
+            break;
+        }
+        if (time < page.first_time || time > page.last_time || (is_event == false && time <= page.delivered_time)) {
+            continue;
+        }
+        if (is_event) {
+            // a retried event page is requested in full; skip the event records delivered before the retry
+            const uint64_t event_key = ((uint64_t)time << 16) | (SpeedwireByteEncoding::getUint32LittleEndian(record + 4) & 0xffff);
+            if (page.retries > 0 && std::find(page.delivered_events.begin(), page.delivered_events.end(), event_key) != page.delivered_events.end()) {
+                continue;
+            }
+            page.delivered_events.push_back(event_key);
+            const SpeedwireRawDataEvent::EventValue value(time, (uint8_t*)record + 4, SpeedwireRawDataEvent::value_size);
+            consumer.consume(job.peer, value);
+        }
+        else {
+            const SpeedwireRawDataYield::YieldValue value(time, SpeedwireByteEncoding::getUint64LittleEndian(record + 4));
+            consumer.consume(job.peer, job.command, value);
+        }
+        page.delivered_time = std::max(page.delivered_time, time);
+    }
+}
+
+
+/**
+ * Send a history query; this is a separate method to allow derived classes to intercept it.
+ * @return the token index of the query, or -1 on error
+ */
+SpeedwireCommandTokenIndex SpeedwireHistoryReader::sendQueryRequest(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register) {
+    return this->command.sendQueryRequest(peer, command, first_register, last_register);
+}
+
+
+/**
+ * Find the download of the given device and command.
+ */
+SpeedwireHistoryReader::HistoryJob* SpeedwireHistoryReader::findJob(const SpeedwireAddress& address, const Command command) {
+    for (auto& job : jobs) {
+        if (job.peer.deviceAddress == address && job.command == command) {
+            return &job;
+        }
+    }
+    return NULL;
+}
+
+const SpeedwireHistoryReader::HistoryJob* SpeedwireHistoryReader::findJob(const SpeedwireAddress& address, const Command command) const {
+    for (auto& job : jobs) {
+        if (job.peer.deviceAddress == address && job.command == command) {
+            return &job;
+        }
+    }
+    return NULL;
+}
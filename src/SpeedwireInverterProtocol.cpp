@@ -121,6 +121,11 @@ void SpeedwireInverterProtocol::getDataUint8Array(const unsigned long byte_offse
     }
 }
 
+/** Get size of the data bytes following the last register id, including any trailer. */
+uint32_t SpeedwireInverterProtocol::getDataSize(void) const {
+    return (size > sma_data_offset ? (uint32_t)(size - sma_data_offset) : 0);
+}
+
 /**
  * Get length of the given raw data element. 
  * It is assumed that all raw data elements in a given inverter packet have the same size. Then the size of each element can 
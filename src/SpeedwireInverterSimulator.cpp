@@ -0,0 +1,640 @@
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <Logger.hpp>
+#include <AddressConversion.hpp>
+#include <SpeedwireByteEncoding.hpp>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireDiscoveryProtocol.hpp>
+#include <SpeedwireTime.hpp>
+#include <SpeedwireInverterSimulator.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireInverterSimulator");
+
+const size_t SpeedwireInverterSimulator::max_reply_size;
+
+static const uint32_t energy_reference_time = 1577836800;   // 2020-01-01 00:00:00 utc; energy counters and durations start here
+static const uint32_t numeric_element_size = 28;            // register id, timestamp and 5 values
+static const uint32_t status_element_size = 40;             // register id, timestamp and 8 values
+
+
+/**
+ * Constructor.
+ * @param host Reference to the LocalHost instance
+ * @param seed Seed of the random generator used for jitter and loss, such that runs are reproducible
+ */
+SpeedwireInverterSimulator::SpeedwireInverterSimulator(const LocalHost& host, const uint32_t seed) :
+    localhost(host),
+    require_login(true),
+    latency_in_ms(0),
+    jitter_in_ms(0),
+    loss_rate(0.0),
+    max_elements_per_fragment(0),
+    random(seed),
+    reply_sequence(0),
+    recv_buffer(SpeedwireSocket::max_recv_batch_size * max_reply_size),
+    num_requests(0),
+    num_replies(0),
+    num_dropped(0) {
+
+    // answer all pv inverter registers; battery registers on connector 0x07 and derived values are not simulated
+    for (auto& reg : SpeedwireData::getAllPredefined()) {
+        if (reg.command != Command::NONE && reg.conn != 0x00 && reg.conn != 0x07 && (reg.type & SpeedwireDataType::TypeMask) != SpeedwireDataType::Yield &&
+            (reg.type & SpeedwireDataType::TypeMask) != SpeedwireDataType::Event) {
+            registers.push_back(reg);
+        }
+    }
+    std::sort(registers.begin(), registers.end(), [](const SpeedwireData& a, const SpeedwireData& b) {
+        return (a.command != b.command ? a.command < b.command : (a.id != b.id ? a.id < b.id : a.conn < b.conn));
+    });
+}
+
+
+/**
+ * Destructor - close all sockets.
+ */
+SpeedwireInverterSimulator::~SpeedwireInverterSimulator(void) {
+    close();
+}
+
+
+/**
+ * Open a unicast socket on port 9522 for each of the given local ip addresses and create the virtual devices.
+ * Devices are assigned to sockets round robin; their serial numbers are consecutive.
+ * @param local_ip_addresses Local ip addresses, e.g. 127.0.0.2
+ * @param num_devices Number of virtual devices
+ * @param susy_id Susy id of all virtual devices
+ * @param first_serial_number Serial number of the first virtual device
+ * @return the number of opened sockets, or -1 if a socket could not be opened
+ */
+int SpeedwireInverterSimulator::open(const std::vector<std::string>& local_ip_addresses, const size_t num_devices, const uint16_t susy_id, const uint32_t first_serial_number) {
+    close();
+    for (auto& address : local_ip_addresses) {
+        SpeedwireSocket socket(localhost);
+        if (socket.openSocket(address, false, SpeedwireSocket::speedwire_port_9522) < 0) {
+            logger.print(LogLevel::LOG_ERROR, "cannot open socket on %s:%u", address.c_str(), (unsigned)SpeedwireSocket::speedwire_port_9522);
+            close();
+            return -1;
+        }
+        sockets.push_back(socket);
+        event_loop.registerSocket(sockets.back());
+    }
+    socket_devices.resize(sockets.size());
+    for (size_t i = 0; i < num_devices && sockets.size() > 0; ++i) {
+        VirtualDevice device;
+        device.address = SpeedwireAddress(susy_id, first_serial_number + (uint32_t)i);
+        device.socket_index = i % sockets.size();
+        device.rated_power = 3000 + (uint32_t)(i % 8) * 1000;
+        device.session_expiry_time = 0;
+        device_map[((uint64_t)device.address.susyID << 32) | device.address.serialNumber] = devices.size();
+        socket_devices[device.socket_index].push_back(devices.size());
+        devices.push_back(device);
+    }
+    logger.print(LogLevel::LOG_INFO_0, "simulating %lu devices on %lu sockets", (unsigned long)devices.size(), (unsigned long)sockets.size());
+    return (int)sockets.size();
+}
+
+
+/**
+ * Close all sockets and remove all virtual devices and pending replies.
+ */
+void SpeedwireInverterSimulator::close(void) {
+    for (auto& socket : sockets) {
+        event_loop.unregisterSocket(socket);
+        socket.closeSocket();
+    }
+    sockets.clear();
+    socket_devices.clear();
+    devices.clear();
+    device_map.clear();
+    reply_pool.clear();
+    free_replies.clear();
+    reply_heap.clear();
+}
+
+
+/**
+ * Wait for requests, answer them and send replies that are due; call this method in a loop.
+ * @param timeout_in_ms Maximum time to wait for a request in ms; the wait ends earlier if a pending reply becomes due
+ * @return the number of received packets, or -1 in case of an error
+ */
+int SpeedwireInverterSimulator::run(const int timeout_in_ms) {
+    uint64_t now = LocalHost::getTickCountInMs();
+    sendDueReplies(now);
+
+    int wait_time = timeout_in_ms;
+    if (reply_heap.size() > 0) {
+        const uint64_t due_time = reply_heap.front().due_time;
+        const int time_to_due = (due_time > now ? (int)(due_time - now) : 0);
+        wait_time = (wait_time < 0 ? time_to_due : std::min(wait_time, time_to_due));
+    }
+    std::vector<int> ready_indexes;
+    if (event_loop.wait(sockets, ready_indexes, wait_time) < 0) {
+        return -1;
+    }
+
+    // drain each readable socket by batched receive calls
+    int nreceived = 0;
+    int nbytes[SpeedwireSocket::max_recv_batch_size];
+    struct sockaddr_storage srcs[SpeedwireSocket::max_recv_batch_size];
+    for (int index : ready_indexes) {
+        SpeedwireSocket& socket = sockets[index];
+        while (true) {
+            int n = socket.recvmmsg(recv_buffer.data(), max_reply_size, SpeedwireSocket::max_recv_batch_size, nbytes, srcs);
+            now = LocalHost::getTickCountInMs();
+            for (int i = 0; i < n; ++i) {
+                handleRequest(index, recv_buffer.data() + i * max_reply_size, nbytes[i], srcs[i], now);
+            }
+            nreceived += (n > 0 ? n : 0);
+            if (n < SpeedwireSocket::max_recv_batch_size) {
+                event_loop.clearReady(socket);
+                break;
+            }
+        }
+    }
+    sendDueReplies(LocalHost::getTickCountInMs());
+    return nreceived;
+}
+
+
+/**
+ * Get the virtual devices, e.g. to register them with SpeedwireCommand without discovery.
+ * @return a vector of speedwire devices, one for each virtual device
+ */
+std::vector<SpeedwireDevice> SpeedwireInverterSimulator::getDevices(void) const {
+    const SpeedwireDeviceType& type = SpeedwireDeviceType::Tripower5000_3AV40();
+    std::vector<SpeedwireDevice> result;
+    for (auto& device : devices) {
+        SpeedwireDevice info;
+        info.deviceAddress = device.address;
+        info.deviceClass = toString(type.deviceClass);
+        info.deviceModel = type.name;
+        info.deviceIpAddress = sockets[device.socket_index].getLocalInterfaceAddress();
+        info.interfaceIpAddress = localhost.getMatchingLocalIPAddress(info.deviceIpAddress);
+        info.resolveAddresses(localhost);
+        result.push_back(info);
+    }
+    return result;
+}
+
+
+/**
+ * Handle a received packet; requests to the broadcast address are answered by each device of the receiving socket.
+ */
+void SpeedwireInverterSimulator::handleRequest(const size_t socket_index, uint8_t* const packet, const unsigned long size, const struct sockaddr_storage& src, const uint64_t now) {
+    const SpeedwireHeader header(packet, size);
+    if (header.isSMAPacket() == false) {
+        return;
+    }
+    ++num_requests;
+    if (loss_rate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < loss_rate) {
+        ++num_dropped;
+        return;
+    }
+    const uint64_t due_time = now + latency_in_ms + (jitter_in_ms > 0 ? std::uniform_int_distribution<uint32_t>(0, jitter_in_ms)(random) : 0);
+
+    const SpeedwireDiscoveryProtocol discovery(header);
+    if (header.isValidData2Packet() == false) {
+        if (discovery.isMulticastRequestPacket()) {
+            queueDiscoveryResponse(socket_index, src, due_time);
+        }
+        return;
+    }
+    const SpeedwireData2Packet data2_packet(header);
+    if (data2_packet.isInverterProtocolID() == false) {
+        return;
+    }
+    const SpeedwireInverterProtocol request(data2_packet);
+    const bool is_discovery = discovery.isUnicastRequestPacket();
+    const uint16_t susy_id = request.getDstSusyID();
+    const uint32_t serial_number = request.getDstSerialNumber();
+
+    if (susy_id == 0xffff && serial_number == 0xffffffff) {
+        for (size_t device_index : socket_devices[socket_index]) {
+            if (is_discovery) {
+                queueUnicastDiscoveryResponse(devices[device_index], request, src, due_time);
+            }
+            else {
+                handleCommand(devices[device_index], request, src, now, due_time);
+            }
+        }
+    }
+    else {
+        const auto it = device_map.find(((uint64_t)susy_id << 32) | serial_number);
+        if (it != device_map.end()) {
+            handleCommand(devices[it->second], request, src, now, due_time);
+        }
+    }
+}
+
+
+/**
+ * Handle an inverter command addressed to the given device.
+ */
+void SpeedwireInverterSimulator::handleCommand(VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t now, const uint64_t due_time) {
+    const Command command = request.getCommandID();
+    if (command == Command::LOGIN) {
+        handleLogin(device, request, src, now, due_time);
+        return;
+    }
+    if (command == Command::LOGOFF) {   // there is no reply to logoff commands
+        device.session_expiry_time = 0;
+        return;
+    }
+    if (require_login && device.session_expiry_time <= now) {
+        PendingReply& reply = allocateReply(device.socket_index, src, due_time);
+        assembleReplyHeader(reply, device, request, 0).setErrorCode(0x0017);
+        return;
+    }
+    uint32_t element_size = 0;
+    if (command == Command::YIELD_BY_MINUTE_QUERY || command == Command::YIELD_BY_DAY_QUERY || command == Command::EVENT_QUERY) {
+        element_size = assembleTimelineElements(device, command, request.getFirstRegisterID(), request.getLastRegisterID());
+    }
+    else {
+        element_size = assembleQueryElements(device, command, request.getFirstRegisterID(), request.getLastRegisterID(), SpeedwireTime::getInverterTimeNow());
+    }
+    queueReplies(device, request, src, element_size, due_time);
+}
+
+
+/**
+ * Handle a login command; the session lasts for the timeout given in the last register id field of the request.
+ */
+void SpeedwireInverterSimulator::handleLogin(VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t now, const uint64_t due_time) {
+    bool valid = false;
+    if (request.getDataSize() >= 8 + 12) {
+        uint8_t password[12];
+        request.getDataUint8Array(8, password, sizeof(password));
+        const std::array<uint8_t, 12> expected = credentials.get((UserCode)request.getFirstRegisterID()).getEncodedPassword();
+        valid = (memcmp(password, expected.data(), sizeof(password)) == 0);
+    }
+    const uint32_t timeout_in_s = (request.getLastRegisterID() != 0 ? request.getLastRegisterID() : SpeedwireAuthentication::session_timeout_in_s);
+    device.session_expiry_time = (valid ? now + timeout_in_s * (uint64_t)1000 : 0);
+
+    PendingReply& reply = allocateReply(device.socket_index, src, due_time);
+    SpeedwireInverterProtocol response = assembleReplyHeader(reply, device, request, 12);
+    response.setErrorCode(valid ? 0x0000 : 0x0100);
+    response.setDataUint32(0, (request.getDataSize() >= 4 ? request.getDataUint32(0) : SpeedwireTime::getInverterTimeNow()));
+}
+
+
+/**
+ * Assemble the reply elements of all registers in the given register range into the element buffer.
+ * Numeric registers take 28 bytes and status and string registers take 40 bytes; if both are mixed, all elements take 40 bytes.
+ * @return the size of each element, or 0 if there is no register in the range
+ */
+uint32_t SpeedwireInverterSimulator::assembleQueryElements(const VirtualDevice& device, const Command command, const uint32_t first_register, const uint32_t last_register, const uint32_t time) {
+    uint32_t element_size = 0;
+    size_t num_elements = 0;
+    for (auto& reg : registers) {
+        if (reg.command == command && reg.id >= (first_register & 0x00ffff00) && reg.id <= last_register) {
+            const SpeedwireDataType type = (reg.type & SpeedwireDataType::TypeMask);
+            const uint32_t size = ((type == SpeedwireDataType::Status32 || type == SpeedwireDataType::String32) ? status_element_size : numeric_element_size);
+            element_size = std::max(element_size, size);
+            ++num_elements;
+        }
+    }
+    elements.assign(num_elements * element_size, 0);
+    size_t index = 0;
+    for (auto& reg : registers) {
+        if (reg.command == command && reg.id >= (first_register & 0x00ffff00) && reg.id <= last_register) {
+            encodeRegister(device, reg, time, &elements[index * element_size], element_size);
+            ++index;
+        }
+    }
+    return element_size;
+}
+
+
+/**
+ * Assemble the timeline records in the given time range into the element buffer; yield records are generated every 5 minutes
+ * or at midnight utc, with the energy counter at that time; an event record is generated each day at 06:00 utc.
+ * @return the size of each record
+ */
+uint32_t SpeedwireInverterSimulator::assembleTimelineElements(const VirtualDevice& device, const Command command, const uint32_t first_time, const uint32_t last_time) {
+    static const size_t max_records = 4096;
+    const bool     is_event    = (command == Command::EVENT_QUERY);
+    const uint32_t record_size = 4 + (uint32_t)(is_event ? SpeedwireRawDataEvent::value_size : SpeedwireRawDataYield::value_size);
+    const uint32_t interval    = (command == Command::YIELD_BY_MINUTE_QUERY ? 300 : 86400);
+    const uint32_t offset      = (is_event ? 6 * 3600 : 0);
+
+    elements.clear();
+    uint64_t time = ((uint64_t)first_time + interval - 1 - offset) / interval * interval + offset;
+    if (time < first_time) {
+        time += interval;
+    }
+    for (; time <= last_time && elements.size() < max_records * record_size; time += interval) {
+        const size_t pos = elements.size();
+        elements.resize(pos + record_size, 0);
+        uint8_t* const record = &elements[pos];
+        SpeedwireByteEncoding::setUint32LittleEndian(record, (uint32_t)time);
+        if (is_event) {
+            const uint32_t day = (uint32_t)(time / 86400);
+            SpeedwireByteEncoding::setUint32LittleEndian(record +  4, ((uint32_t)device.address.susyID << 16) | (day & 0xffff));   // susy id, entry id
+            SpeedwireByteEncoding::setUint32LittleEndian(record +  8, device.address.serialNumber);
+            SpeedwireByteEncoding::setUint32LittleEndian(record + 12, 0x00000100);                                           // event id
+            SpeedwireByteEncoding::setUint32LittleEndian(record + 24, 0x00000001);                                           // event tag id
+        }
+        else {
+            SpeedwireByteEncoding::setUint64LittleEndian(record + 4, getEnergy(device, (uint32_t)time));
+        }
+    }
+    return record_size;
+}
+
+
+/**
+ * Encode the given register into a reply element; values that do not fit into the element size are left zero.
+ */
+void SpeedwireInverterSimulator::encodeRegister(const VirtualDevice& device, const SpeedwireData& reg, const uint32_t time, uint8_t* const element, const uint32_t element_size) const {
+    if (element_size < 8) {
+        return;
+    }
+    SpeedwireByteEncoding::setUint32LittleEndian(element, ((uint32_t)(uint8_t)reg.type << 24) | reg.id | reg.conn);
+    SpeedwireByteEncoding::setUint32LittleEndian(element + 4, time);
+    uint8_t* const data = element + 8;
+    const uint32_t data_size = element_size - 8;
+
+    switch (reg.type & SpeedwireDataType::TypeMask) {
+    case SpeedwireDataType::Status32: {
+        uint32_t status = 0x133;    // ok
+        if (reg.id == SpeedwireData::InverterDeviceClass.id) {
+            status = (uint32_t)SpeedwireDeviceType::Tripower5000_3AV40().deviceClass;
+        }
+        else if (reg.id == SpeedwireData::InverterDeviceType.id) {
+            status = (uint32_t)SpeedwireDeviceType::Tripower5000_3AV40().deviceModel;
+        }
+        else if (reg.id == SpeedwireData::InverterRelay.id) {
+            status = 0x33;          // closed
+        }
+        if (data_size < 8) {
+            break;
+        }
+        SpeedwireByteEncoding::setUint32LittleEndian(data,     SpeedwireRawDataStatus32::sel | status);
+        SpeedwireByteEncoding::setUint32LittleEndian(data + 4, SpeedwireRawDataStatus32::eod);
+        break;
+    }
+    case SpeedwireDataType::String32: {
+        char name[33];
+        snprintf(name, sizeof(name), "SN: %lu", (unsigned long)device.address.serialNumber);
+        memcpy(data, name, std::min((uint32_t)strlen(name), data_size));
+        break;
+    }
+    default: {
+        // measurement values come as 4 identical values followed by 1
+        if (data_size < 20) {
+            break;
+        }
+        const uint32_t value = (uint32_t)getRegisterValue(device, reg, time);
+        for (uint32_t i = 0; i < 4; ++i) {
+            SpeedwireByteEncoding::setUint32LittleEndian(data + 4 * i, value);
+        }
+        SpeedwireByteEncoding::setUint32LittleEndian(data + 16, 1);
+        break;
+    }
+    }
+}
+
+
+/**
+ * Get the simulated value of the given numeric register, scaled by the divisor of its measurement type.
+ */
+int64_t SpeedwireInverterSimulator::getRegisterValue(const VirtualDevice& device, const SpeedwireData& reg, const uint32_t time) const {
+    const double daylight = getDaylight(time);
+    const double noise = 1.0 + 0.02 * sin(time / 60.0 + device.address.serialNumber);
+    const double pac = device.rated_power * daylight * noise;
+    const double pdc = pac / 0.97;
+    const uint32_t start_of_day = time - time % 86400;
+    const uint32_t days = (time > energy_reference_time ? (time - energy_reference_time) / 86400 : 0);
+
+    if (reg.id == SpeedwireData::InverterSoftwareVersion.id) {
+        return 0x03100a04;
+    }
+    switch (reg.measurementType.quantity) {
+    case Quantity::POWER:
+        if (reg.measurementType.type == Type::NOMINAL)  return device.rated_power;
+        if (reg.measurementType.type == Type::REACTIVE) return 0;
+        switch (reg.wire) {
+        case Wire::L1: case Wire::L2: case Wire::L3: return (int64_t)(pac / 3);
+        case Wire::MPP1: case Wire::MPP2:            return (int64_t)(pdc / 2);
+        case Wire::LOSS_TOTAL:                       return (int64_t)(pdc - pac);
+        default:                                     return (int64_t)pac;
+        }
+    case Quantity::VOLTAGE:
+        switch (reg.wire) {
+        case Wire::MPP1: case Wire::MPP2:               return (daylight > 0.0 ? (int64_t)(55000 + 10000 * daylight) : 0);
+        case Wire::L1L2: case Wire::L2L3: case Wire::L3L1: return (int64_t)(40000 * noise);
+        default:                                        return (int64_t)(23000 * noise);
+        }
+    case Quantity::CURRENT:
+        switch (reg.wire) {
+        case Wire::MPP1: case Wire::MPP2: return (daylight > 0.0 ? (int64_t)(pdc / 2 / (550 + 100 * daylight) * 1000) : 0);
+        default:                          return (int64_t)(pac / 3 / 230 * 1000);
+        }
+    case Quantity::FREQUENCY:
+        return (int64_t)(5000 + 5 * (noise - 1.0) * 50);
+    case Quantity::POWER_FACTOR:
+        return 100;
+    case Quantity::EFFICIENCY:
+        return 97;
+    case Quantity::TEMPERATURE:
+        return (int64_t)(250 + 200 * daylight);
+    case Quantity::ENERGY:
+        if (reg.wire == Wire::NO_WIRE)                  return (int64_t)(getEnergy(device, time) - getEnergy(device, start_of_day));
+        if (reg.wire == Wire::GRID_TOTAL)               return (int64_t)(reg.measurementType.direction == Direction::NEGATIVE ? getEnergy(device, time) * 6 / 10 : getEnergy(device, time) / 10);
+        return (int64_t)getEnergy(device, time);
+    case Quantity::DURATION: {
+        const int64_t hours_of_day = (int64_t)(time - start_of_day) - 6 * 3600;
+        const int64_t operating = (int64_t)days * 12 * 3600 + std::min(std::max(hours_of_day, (int64_t)0), (int64_t)12 * 3600);
+        return (reg.wire == Wire::NO_WIRE ? operating * 95 / 100 : operating);
+    }
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * Get the energy counter of the given device at the given time in Wh; this is the integral of the ac power without noise.
+ */
+uint64_t SpeedwireInverterSimulator::getEnergy(const VirtualDevice& device, const uint32_t time) const {
+    if (time <= energy_reference_time) {
+        return 0;
+    }
+    const uint32_t days = (time - energy_reference_time) / 86400;
+    const double hours = (double)(time % 86400) / 3600.0;
+    const double energy_per_day = device.rated_power * 24.0 / M_PI;     // integral of rated_power * sin() over 12 hours
+    double energy_today = 0.0;
+    if (hours >= 18.0) {
+        energy_today = energy_per_day;
+    }
+    else if (hours > 6.0) {
+        energy_today = energy_per_day * 0.5 * (1.0 - cos(M_PI * (hours - 6.0) / 12.0));
+    }
+    return (uint64_t)(days * energy_per_day + energy_today);
+}
+
+
+/**
+ * Get the relative pv power at the given time: a half sine wave from 06:00 to 18:00 utc.
+ */
+double SpeedwireInverterSimulator::getDaylight(const uint32_t time) {
+    const double hours = (double)(time % 86400) / 3600.0;
+    return (hours > 6.0 && hours < 18.0 ? sin(M_PI * (hours - 6.0) / 12.0) : 0.0);
+}
+
+
+/**
+ * Take a reply slot from the pool and insert it into the heap of pending replies.
+ * The returned reference is valid until the next call.
+ */
+SpeedwireInverterSimulator::PendingReply& SpeedwireInverterSimulator::allocateReply(const size_t socket_index, const struct sockaddr_storage& dest, const uint64_t due_time) {
+    size_t slot;
+    if (free_replies.size() > 0) {
+        slot = free_replies.back();
+        free_replies.pop_back();
+    }
+    else {
+        slot = reply_pool.size();
+        reply_pool.push_back(PendingReply());
+    }
+    PendingReply& reply = reply_pool[slot];
+    reply.socket_index = socket_index;
+    reply.dest = dest;
+    reply.size = 0;
+    const ReplyEntry entry = { due_time, ++reply_sequence, slot };
+    reply_heap.push_back(entry);
+    std::push_heap(reply_heap.begin(), reply_heap.end(), std::greater<ReplyEntry>());
+    return reply;
+}
+
+
+/**
+ * Assemble the header of a reply to the given request into the given reply slot.
+ * @return an inverter protocol instance for the reply packet, to set further fields and the data bytes
+ */
+SpeedwireInverterProtocol SpeedwireInverterSimulator::assembleReplyHeader(PendingReply& reply, const VirtualDevice& device, const SpeedwireInverterProtocol& request, const uint32_t data_size) {
+    reply.size = (unsigned long)(SpeedwireCommand::query_request_size + data_size);
+    memset(reply.packet, 0, reply.size);
+
+    SpeedwireHeader header(reply.packet, reply.size);
+    header.setDefaultHeader(1, (uint16_t)(reply.size - 20), SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireData2Packet data2_packet(header);
+    data2_packet.setControl(0xa0);
+
+    SpeedwireInverterProtocol response(header);
+    response.setDstSusyID(request.getSrcSusyID());
+    response.setDstSerialNumber(request.getSrcSerialNumber());
+    response.setDstControl(request.getSrcControl());
+    response.setSrcSusyID(device.address.susyID);
+    response.setSrcSerialNumber(device.address.serialNumber);
+    response.setSrcControl(0x0100);
+    response.setErrorCode(0);
+    response.setFragmentCounter(0);
+    response.setPacketID(request.getPacketID());
+    response.setCommandID(request.getCommandID() | Command::QUERY_RESPONSE);
+    response.setFirstRegisterID(request.getFirstRegisterID());
+    response.setLastRegisterID(request.getLastRegisterID());
+    return response;
+}
+
+
+/**
+ * Queue the replies carrying the elements in the element buffer; elements exceeding the fragment size are split into fragments
+ * with a count down fragment counter. The first and last register id fields of each fragment hold the element indexes.
+ */
+void SpeedwireInverterSimulator::queueReplies(const VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint32_t element_size, const uint64_t due_time) {
+    const size_t num_elements = (element_size > 0 ? elements.size() / element_size : 0);
+    size_t per_fragment = (element_size > 0 ? (max_reply_size - SpeedwireCommand::query_request_size) / element_size : 1);
+    if (max_elements_per_fragment > 0 && max_elements_per_fragment < per_fragment) {
+        per_fragment = max_elements_per_fragment;
+    }
+    const size_t num_fragments = (num_elements > 0 ? (num_elements + per_fragment - 1) / per_fragment : 1);
+
+    for (size_t fragment = 0; fragment < num_fragments; ++fragment) {
+        const size_t first = fragment * per_fragment;
+        const size_t count = std::min(per_fragment, num_elements - first);
+        PendingReply& reply = allocateReply(device.socket_index, src, due_time);
+        SpeedwireInverterProtocol response = assembleReplyHeader(reply, device, request, (uint32_t)(count * element_size));
+        response.setFragmentCounter((uint16_t)(num_fragments - 1 - fragment));
+        response.setFirstRegisterID((uint32_t)first);
+        response.setLastRegisterID((uint32_t)(count > 0 ? first + count - 1 : first));
+        if (count > 0) {
+            response.setDataUint8Array(0, &elements[first * element_size], (unsigned long)(count * element_size));
+        }
+    }
+}
+
+
+/**
+ * Queue a multicast discovery response carrying the ip address of the given socket.
+ */
+void SpeedwireInverterSimulator::queueDiscoveryResponse(const size_t socket_index, const struct sockaddr_storage& src, const uint64_t due_time) {
+    PendingReply& reply = allocateReply(socket_index, src, due_time);
+    memset(reply.packet, 0, sizeof(reply.packet));
+    SpeedwireDiscoveryProtocol response(SpeedwireHeader(reply.packet, sizeof(reply.packet)));
+    response.setDefaultResponsePacket(0x00000001, AddressConversion::toInAddress(sockets[socket_index].getLocalInterfaceAddress()).s_addr);
+    reply.size = response.getDefaultResponsePacketLength();
+}
+
+
+/**
+ * Queue a unicast discovery response of the given device.
+ */
+void SpeedwireInverterSimulator::queueUnicastDiscoveryResponse(const VirtualDevice& device, const SpeedwireInverterProtocol& request, const struct sockaddr_storage& src, const uint64_t due_time) {
+    PendingReply& reply = allocateReply(device.socket_index, src, due_time);
+    SpeedwireInverterProtocol response = assembleReplyHeader(reply, device, request, 40);
+    response.setFirstRegisterID(0);
+    response.setLastRegisterID(0);
+    response.setDataUint32( 0, 0x00000300);                                             // discovery register id
+    response.setDataUint32( 4, 0x0000ff00);
+    response.setDataUint32(12, ((uint32_t)device.address.susyID << 16) | 0x0001);
+    response.setDataUint32(16, device.address.serialNumber);
+    response.setDataUint32(20, 0x000a0000);
+    response.setDataUint32(24, 0x0000000c);
+    response.setDataUint32(36, 0x00000101);
+}
+
+
+/**
+ * Send all pending replies that are due, with a single sendmmsg call per socket.
+ * @return the number of sent replies
+ */
+int SpeedwireInverterSimulator::sendDueReplies(const uint64_t now) {
+    due_replies.clear();
+    while (reply_heap.size() > 0 && reply_heap.front().due_time <= now) {
+        due_replies.push_back(reply_heap.front().slot);
+        std::pop_heap(reply_heap.begin(), reply_heap.end(), std::greater<ReplyEntry>());
+        reply_heap.pop_back();
+    }
+    int nsent = 0;
+    for (size_t socket_index = 0; socket_index < sockets.size() && due_replies.size() > 0; ++socket_index) {
+        send_buffs.clear();
+        send_sizes.clear();
+        send_dests.clear();
+        for (size_t slot : due_replies) {
+            const PendingReply& reply = reply_pool[slot];
+            if (reply.socket_index == socket_index) {
+                send_buffs.push_back(reply.packet);
+                send_sizes.push_back(reply.size);
+                send_dests.push_back(&reply.dest);
+            }
+        }
+        if (send_buffs.size() > 0) {
+            int n = sockets[socket_index].sendmmsg(send_buffs.data(), send_sizes.data(), send_dests.data(), (int)send_buffs.size());
+            if (n < (int)send_buffs.size()) {
+                logger.print(LogLevel::LOG_WARNING, "sent %d of %lu replies from %s", n, (unsigned long)send_buffs.size(), sockets[socket_index].getLocalInterfaceAddress().c_str());
+            }
+            nsent += (n > 0 ? n : 0);
+        }
+    }
+    for (size_t slot : due_replies) {
+        free_replies.push_back(slot);
+    }
+    num_replies += nsent;
+    return nsent;
+}
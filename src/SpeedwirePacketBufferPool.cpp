@@ -0,0 +1,56 @@
+#include <Logger.hpp>
+#include <SpeedwirePacketBufferPool.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwirePacketBufferPool");
+
+const size_t SpeedwirePacketBuffer::max_packet_size;
+
+
+/**
+ * Constructor - allocates the slab of packet buffers; all buffers are initially free.
+ * @param _num_buffers Number of packet buffers in the pool
+ */
+SpeedwirePacketBufferPool::SpeedwirePacketBufferPool(const size_t _num_buffers) :
+    buffers(new SpeedwirePacketBuffer[_num_buffers > 0 ? _num_buffers : 1]),
+    num_buffers(_num_buffers > 0 ? _num_buffers : 1),
+    free_buffers(num_buffers) {
+    for (size_t i = 0; i < num_buffers; ++i) {
+        buffers[i].pool = this;
+        free_buffers.push(&buffers[i]);
+    }
+}
+
+
+/**
+ * Destructor - all handles referencing buffers of this pool must have been released before.
+ */
+SpeedwirePacketBufferPool::~SpeedwirePacketBufferPool(void) {
+    size_t num_free = free_buffers.getNumberOfElements();
+    if (num_free != num_buffers) {
+        logger.print(LogLevel::LOG_ERROR, "%lu packet buffers still in use\n", (unsigned long)(num_buffers - num_free));
+    }
+}
+
+
+/**
+ * Allocate a packet buffer from the pool.
+ * @return a handle referencing the packet buffer, or an invalid handle if all packet buffers are in use
+ */
+SpeedwirePacketHandle SpeedwirePacketBufferPool::allocate(void) {
+    SpeedwirePacketBuffer* buffer = NULL;
+    if (free_buffers.pop(buffer) == false) {
+        return SpeedwirePacketHandle();
+    }
+    buffer->nbytes = 0;
+    buffer->arrival_time_ns = 0;
+    return SpeedwirePacketHandle(buffer);
+}
+
+
+/**
+ * Return a packet buffer to the pool; this is called when the last handle referencing the buffer is released.
+ */
+void SpeedwirePacketBufferPool::release(SpeedwirePacketBuffer* buffer) {
+    free_buffers.push(buffer);     // cannot fail, the queue is as large as the number of buffers
+}
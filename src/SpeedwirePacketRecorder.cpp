@@ -0,0 +1,217 @@
+#ifdef _WIN32
+#include <Winsock2.h>
+#include <Ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include <cstring>
+#include <Logger.hpp>
+#include <SpeedwireByteEncoding.hpp>
+#include <SpeedwirePacketRecorder.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwirePacketRecorder");
+
+const uint8_t SpeedwirePacketRecorder::file_header[8] = { 'S', 'W', 'C', 'A', 'P', 0x00, 0x00, 0x01 };
+const size_t  SpeedwirePacketRecorder::record_header_size;
+
+
+/**
+ * Constructor.
+ * @param host Reference to the LocalHost instance
+ */
+SpeedwirePacketRecorder::SpeedwirePacketRecorder(LocalHost& host) :
+    SpeedwirePacketReceiverBase(host),
+    file(NULL),
+    num_records(0),
+    num_bytes(0),
+    num_errors(0) {}
+
+
+/**
+ * Destructor. Closes the capture file.
+ */
+SpeedwirePacketRecorder::~SpeedwirePacketRecorder(void) {
+    close();
+}
+
+
+/**
+ * Open the given capture file for appending; the file header is written if the file is empty.
+ * @param filename Path of the capture file
+ * @return true on success, false otherwise
+ */
+bool SpeedwirePacketRecorder::open(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        fclose(file);
+    }
+    file = fopen(filename.c_str(), "ab");
+    if (file == NULL) {
+        perror("fopen failure");
+        return false;
+    }
+    if (fseek(file, 0, SEEK_END) != 0 || (ftell(file) == 0 && writeFileHeader(file) == false)) {
+        logger.print(LogLevel::LOG_ERROR, "cannot write capture file header %s\n", filename.c_str());
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    num_records = 0;
+    num_bytes = 0;
+    num_errors = 0;
+    return true;
+}
+
+
+/**
+ * Flush buffered records to the capture file.
+ */
+void SpeedwirePacketRecorder::flush(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        fflush(file);
+    }
+}
+
+
+/**
+ * Close the capture file.
+ */
+void SpeedwirePacketRecorder::close(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+/**
+ * Receive method called by the dispatcher for packets that are not delivered through packet handles; the arrival time is
+ * taken from the local clock.
+ */
+void SpeedwirePacketRecorder::receive(SpeedwireHeader& packet, struct sockaddr& src) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        if (writeRecord(file, packet.getPacketPointer(), (int)packet.getPacketSize(), src, LocalHost::getUnixEpochTimeInNs()) == false) {
+            ++num_errors;
+            return;
+        }
+        ++num_records;
+        num_bytes += packet.getPacketSize();
+    }
+}
+
+
+/**
+ * Receive method called by the dispatcher for each packet; appends the packet to the capture file.
+ */
+void SpeedwirePacketRecorder::receivePacket(SpeedwirePacketHandle& packet) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        if (writeRecord(file, packet.getData(), packet.getSize(), packet.getSrc(), packet.getArrivalTimeInNs()) == false) {
+            ++num_errors;
+            return;
+        }
+        ++num_records;
+        num_bytes += packet.getSize();
+    }
+}
+
+
+/**
+ * Write the capture file header.
+ * @param file Capture file
+ * @return true on success, false otherwise
+ */
+bool SpeedwirePacketRecorder::writeFileHeader(FILE* file) {
+    return (fwrite(file_header, sizeof(file_header), 1, file) == 1);
+}
+
+
+/**
+ * Read and check the capture file header.
+ * @param file Capture file
+ * @return true if the file header is valid, false otherwise
+ */
+bool SpeedwirePacketRecorder::readFileHeader(FILE* file) {
+    uint8_t header[sizeof(file_header)];
+    return (fread(header, sizeof(header), 1, file) == 1 && memcmp(header, file_header, sizeof(header)) == 0);
+}
+
+
+/**
+ * Write a single record to the capture file.
+ * @param file Capture file
+ * @param data Pointer to the packet data
+ * @param nbytes Number of bytes in the packet
+ * @param src Sender address of the packet
+ * @param arrival_time_in_ns Arrival time of the packet in ns since the unix epoch
+ * @return true on success, false otherwise
+ */
+bool SpeedwirePacketRecorder::writeRecord(FILE* file, const uint8_t* data, const int nbytes, const struct sockaddr& src, const uint64_t arrival_time_in_ns) {
+    if (nbytes < 0 || nbytes > (int)SpeedwirePacketBuffer::max_packet_size) {
+        return false;
+    }
+    uint8_t header[record_header_size];
+    memset(header, 0, sizeof(header));
+    SpeedwireByteEncoding::setUint64LittleEndian(header + 0, arrival_time_in_ns);
+    SpeedwireByteEncoding::setUint16LittleEndian(header + 8, (uint16_t)nbytes);
+    if (src.sa_family == AF_INET) {
+        const struct sockaddr_in& src4 = (const struct sockaddr_in&)src;
+        header[10] = 4;
+        SpeedwireByteEncoding::setUint16LittleEndian(header + 12, ntohs(src4.sin_port));
+        memcpy(header + 16, &src4.sin_addr, sizeof(src4.sin_addr));
+    }
+    else if (src.sa_family == AF_INET6) {
+        const struct sockaddr_in6& src6 = (const struct sockaddr_in6&)src;
+        header[10] = 6;
+        SpeedwireByteEncoding::setUint16LittleEndian(header + 12, ntohs(src6.sin6_port));
+        memcpy(header + 16, &src6.sin6_addr, sizeof(src6.sin6_addr));
+    }
+    return (fwrite(header, sizeof(header), 1, file) == 1 && (nbytes == 0 || fwrite(data, nbytes, 1, file) == 1));
+}
+
+
+/**
+ * Read a single record from the capture file into the given packet buffer.
+ * @param file Capture file
+ * @param packet Reference to a valid packet handle; packet data, size, sender address and arrival time are set
+ * @return 1 on success, 0 at the end of the file, -1 if the record is truncated or invalid
+ */
+int SpeedwirePacketRecorder::readRecord(FILE* file, SpeedwirePacketHandle& packet) {
+    uint8_t header[record_header_size];
+    size_t n = fread(header, 1, sizeof(header), file);
+    if (n == 0 && feof(file)) {
+        return 0;
+    }
+    if (n != sizeof(header)) {
+        return -1;
+    }
+    const uint16_t nbytes = SpeedwireByteEncoding::getUint16LittleEndian(header + 8);
+    if (nbytes > packet.getCapacity() || (nbytes > 0 && fread(packet.getData(), nbytes, 1, file) != 1)) {
+        return -1;
+    }
+    packet.setSize(nbytes);
+    packet.setArrivalTimeInNs(SpeedwireByteEncoding::getUint64LittleEndian(header + 0));
+
+    struct sockaddr_storage& src = packet.getSrcStorage();
+    memset(&src, 0, sizeof(src));
+    const uint16_t port = SpeedwireByteEncoding::getUint16LittleEndian(header + 12);
+    if (header[10] == 4) {
+        struct sockaddr_in& src4 = (struct sockaddr_in&)src;
+        src4.sin_family = AF_INET;
+        src4.sin_port = htons(port);
+        memcpy(&src4.sin_addr, header + 16, sizeof(src4.sin_addr));
+    }
+    else if (header[10] == 6) {
+        struct sockaddr_in6& src6 = (struct sockaddr_in6&)src;
+        src6.sin6_family = AF_INET6;
+        src6.sin6_port = htons(port);
+        memcpy(&src6.sin6_addr, header + 16, sizeof(src6.sin6_addr));
+    }
+    return 1;
+}
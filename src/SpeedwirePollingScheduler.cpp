@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <Logger.hpp>
+#include <LocalHost.hpp>
+#include <SpeedwirePollingScheduler.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwirePollingScheduler");
+
+
+/**
+ * Constructor.
+ * @param _command Reference to the SpeedwireCommand instance used to send the queries
+ * @param _timeout_in_ms Timeout of each query in ms
+ * @param _max_backoff_in_ms Maximum delay of a plan entry after consecutive timeouts in ms; plan entries with a longer interval are not delayed beyond their interval
+ */
+SpeedwirePollingScheduler::SpeedwirePollingScheduler(SpeedwireCommand& _command, const int _timeout_in_ms, const uint32_t _max_backoff_in_ms) :
+    command(_command),
+    timeout_in_ms(_timeout_in_ms),
+    max_backoff_in_ms(_max_backoff_in_ms),
+    num_sent(0),
+    num_completed(0),
+    num_timeouts(0) {}
+
+
+/**
+ * Add a device or update its limits.
+ * @param peer Reference to the device
+ * @param max_in_flight Maximum number of queries waiting for their reply
+ * @param min_gap_in_ms Minimum time between two consecutive queries to the device in ms
+ */
+void SpeedwirePollingScheduler::addDevice(const SpeedwireDevice& peer, const size_t max_in_flight, const uint32_t min_gap_in_ms) {
+    DeviceSchedule* device = findDevice(peer.deviceAddress);
+    if (device == NULL) {
+        DeviceSchedule schedule;
+        schedule.peer = peer;
+        schedule.last_send_time = 0;
+        schedule.num_in_flight = 0;
+        devices.push_back(schedule);
+        device = &devices.back();
+    }
+    device->max_in_flight = (max_in_flight > 0 ? max_in_flight : 1);
+    device->min_gap_in_ms = min_gap_in_ms;
+}
+
+
+/**
+ * Add an entry to the polling plan of a device; the device is added with default limits if it is not yet known.
+ * The first query of the entry is due immediately.
+ * @param peer Reference to the device
+ * @param command Command identifier of the query
+ * @param first_register First register id of the query
+ * @param last_register Last register id of the query
+ * @param interval_in_ms Polling interval in ms
+ */
+void SpeedwirePollingScheduler::addTask(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register, const uint32_t interval_in_ms) {
+    DeviceSchedule* device = findDevice(peer.deviceAddress);
+    if (device == NULL) {
+        addDevice(peer);
+        device = &devices.back();
+    }
+    ScheduledTask task = { { command, first_register, last_register, interval_in_ms }, 0, 0, 0, false, 0 };
+    device->tasks.push_back(task);
+}
+
+
+/**
+ * Remove a device and its polling plan; tokens of its in-flight queries are removed from the token repository.
+ * @param peer Reference to the device
+ */
+void SpeedwirePollingScheduler::removeDevice(const SpeedwireDevice& peer) {
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    for (size_t i = 0; i < devices.size(); ++i) {
+        DeviceSchedule& device = devices[i];
+        if (device.peer.deviceAddress == peer.deviceAddress) {
+            for (auto& task : device.tasks) {
+                int token_index = (task.in_flight ? repository.find(device.peer.deviceAddress.susyID, device.peer.deviceAddress.serialNumber, task.packet_id) : -1);
+                if (token_index >= 0) {
+                    repository.remove(token_index);
+                }
+            }
+            devices.erase(devices.begin() + i);
+            return;
+        }
+    }
+}
+
+
+/**
+ * Remove all devices and their polling plans.
+ */
+void SpeedwirePollingScheduler::clear(void) {
+    while (devices.size() > 0) {
+        removeDevice(devices.back().peer);
+    }
+}
+
+
+/**
+ * Detect completed and timed out queries and send due queries in earliest deadline order.
+ * @return the number of sent queries
+ */
+int SpeedwirePollingScheduler::poll(void) {
+    return poll(LocalHost::getUnixEpochTimeInMs());
+}
+
+
+/**
+ * Detect completed and timed out queries and send due queries in earliest deadline order.
+ * @param now Current time in ms
+ * @return the number of sent queries
+ */
+int SpeedwirePollingScheduler::poll(const uint64_t now) {
+    update(now);
+
+    // collect due tasks and order them by deadline; ties are resolved by device and plan order
+    due_tasks.clear();
+    for (size_t d = 0; d < devices.size(); ++d) {
+        for (size_t t = 0; t < devices[d].tasks.size(); ++t) {
+            const ScheduledTask& task = devices[d].tasks[t];
+            if (task.in_flight == false && task.deadline <= now) {
+                due_tasks.push_back(std::make_pair(task.deadline, std::make_pair(d, t)));
+            }
+        }
+    }
+    std::sort(due_tasks.begin(), due_tasks.end());
+
+    // send them as long as the device limits permit; tasks that are held back keep their deadline and come first next time
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    int nsent = 0;
+    for (auto& due : due_tasks) {
+        DeviceSchedule& device = devices[due.second.first];
+        ScheduledTask& task = device.tasks[due.second.second];
+        if (device.num_in_flight >= device.max_in_flight ||
+            (device.last_send_time != 0 && now < device.last_send_time + device.min_gap_in_ms)) {
+            continue;
+        }
+        SpeedwireCommandTokenIndex token_index = sendQueryRequest(device.peer, task.task);
+        if (token_index < 0) {
+            logger.print(LogLevel::LOG_ERROR, "cannot send query 0x%08x to %s", (unsigned)task.task.command, device.peer.deviceIpAddress.c_str());
+            backoff(task, now);
+            continue;
+        }
+        task.packet_id = repository.at(token_index).packetid;
+        task.sent_time = now;
+        task.in_flight = true;
+        task.deadline += task.task.interval_in_ms;
+        if (task.deadline <= now) {
+            task.deadline = now + task.task.interval_in_ms;
+        }
+        device.last_send_time = now;
+        ++device.num_in_flight;
+        ++num_sent;
+        ++nsent;
+    }
+    return nsent;
+}
+
+
+/**
+ * Get the earliest time when poll() has something to do, i.e. a query is due or an in-flight query times out.
+ * @return the time in ms, or UINT64_MAX if the polling plans are empty
+ */
+uint64_t SpeedwirePollingScheduler::getNextDeadline(void) const {
+    uint64_t next = UINT64_MAX;
+    for (auto& device : devices) {
+        for (auto& task : device.tasks) {
+            uint64_t deadline = task.sent_time + timeout_in_ms;
+            if (task.in_flight == false) {
+                deadline = std::max(task.deadline, device.last_send_time + device.min_gap_in_ms);
+            }
+            next = std::min(next, deadline);
+        }
+    }
+    return next;
+}
+
+
+/**
+ * Detect completed and timed out in-flight queries.
+ * A query is complete if its token was removed from the token repository; it times out if its token is still present after the timeout.
+ */
+void SpeedwirePollingScheduler::update(const uint64_t now) {
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    for (auto& device : devices) {
+        for (auto& task : device.tasks) {
+            if (task.in_flight == false) {
+                continue;
+            }
+            int token_index = repository.find(device.peer.deviceAddress.susyID, device.peer.deviceAddress.serialNumber, task.packet_id);
+            if (token_index < 0) {
+                task.backoff = 0;
+                ++num_completed;
+            }
+            else if (now >= task.sent_time + timeout_in_ms) {
+                repository.remove(token_index);
+                backoff(task, now);
+                ++num_timeouts;
+            }
+            else {
+                continue;
+            }
+            task.in_flight = false;
+            --device.num_in_flight;
+        }
+    }
+}
+
+
+/**
+ * Delay the next query of the given task after a failure by interval * 2^n, where n is the number of consecutive failures.
+ */
+void SpeedwirePollingScheduler::backoff(ScheduledTask& task, const uint64_t now) {
+    if (task.backoff < 16) {
+        ++task.backoff;
+    }
+    const uint64_t delay = (uint64_t)task.task.interval_in_ms << task.backoff;
+    const uint64_t limit = std::max((uint64_t)max_backoff_in_ms, (uint64_t)task.task.interval_in_ms);
+    task.deadline = now + std::min(delay, limit);
+}
+
+
+/**
+ * Send the query of the given task; this is a separate method to allow derived classes to intercept it.
+ * @return the token index of the query, or -1 on error
+ */
+SpeedwireCommandTokenIndex SpeedwirePollingScheduler::sendQueryRequest(const SpeedwireDevice& peer, const PollingTask& task) {
+    return command.sendQueryRequest(peer, task.command, task.first_register, task.last_register);
+}
+
+
+/**
+ * Find the schedule of the given device.
+ */
+SpeedwirePollingScheduler::DeviceSchedule* SpeedwirePollingScheduler::findDevice(const SpeedwireAddress& address) {
+    for (auto& device : devices) {
+        if (device.peer.deviceAddress == address) {
+            return &device;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,261 @@
+#include <Logger.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireQueryEngine.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireQueryEngine");
+
+
+/**
+ * Constructor.
+ * @param host Reference to the LocalHost instance
+ * @param _command Reference to the SpeedwireCommand instance used to send the queries
+ * @param _handler Reference to the handler receiving the completions
+ * @param _window_size Maximum number of in-flight queries for each device
+ * @param _timeout_in_ms Timeout of each query transmission in ms
+ * @param _max_retries Maximum number of retransmissions of each query after a timeout
+ */
+SpeedwireQueryEngine::SpeedwireQueryEngine(LocalHost& host, SpeedwireCommand& _command, SpeedwireQueryHandler& _handler, const size_t _window_size, const int _timeout_in_ms, const int _max_retries) :
+    InverterPacketReceiverBase(host),
+    command(_command),
+    handler(_handler),
+    window_size(_window_size > 0 ? _window_size : 1),
+    timeout_in_ms(_timeout_in_ms),
+    max_retries(_max_retries),
+    num_completed(0),
+    num_failed(0),
+    num_retries(0) {}
+
+
+/**
+ * Submit a query; it is sent by the next call to poll() once the window of its device permits.
+ * @param query Reference to the query parameters; the referenced device must outlive the query.
+ */
+void SpeedwireQueryEngine::submit(const SpeedwireCommand::QueryRequest& query) {
+    getDeviceQueue(query.peer->deviceAddress).pending.push_back(std::make_pair(query, 0));
+}
+
+
+/**
+ * Submit a query; it is sent by the next call to poll() once the window of its device permits.
+ * @param peer Reference to the device; it must outlive the query.
+ * @param cmd Command identifier of the query
+ * @param first_register First register id of the query
+ * @param last_register Last register id of the query
+ */
+void SpeedwireQueryEngine::submit(const SpeedwireDevice& peer, const Command cmd, const uint32_t first_register, const uint32_t last_register) {
+    SpeedwireCommand::QueryRequest query = { &peer, cmd, first_register, last_register };
+    submit(query);
+}
+
+
+/**
+ * Expire timed out queries, queue them for retransmission or report them as failed, and send queued queries up
+ * to the window size of each device. All queries are sent by a single batched call to SpeedwireCommand::sendQueryRequests().
+ * @return the number of sent queries
+ */
+int SpeedwireQueryEngine::poll(void) {
+    return poll(LocalHost::getUnixEpochTimeInMs());
+}
+
+
+/**
+ * Poll implementation taking the current time in ms since the unix epoch.
+ */
+int SpeedwireQueryEngine::poll(const uint64_t now) {
+
+    // expire timed out queries; failures are delivered after the loop, as the handler may submit or cancel queries
+    failed_requests.clear();
+    for (size_t d = 0; d < devices.size(); ++d) {
+        DeviceQueue& device = devices[d];
+        for (size_t i = 0; i < device.in_flight.size(); /*nop*/) {
+            const InFlightQuery query = device.in_flight[i];
+            if (now < query.deadline) {
+                ++i;
+                continue;
+            }
+            device.in_flight.erase(device.in_flight.begin() + i);
+            removeToken(device.address, query.packet_id);
+            if (query.retries < max_retries) {
+                device.pending.push_front(std::make_pair(query.request, query.retries + 1));
+                ++num_retries;
+            }
+            else {
+                ++num_failed;
+                failed_requests.push_back(query.request);
+            }
+        }
+    }
+    for (size_t i = 0; i < failed_requests.size(); ++i) {
+        const SpeedwireCommand::QueryRequest request = failed_requests[i];
+        handler.queryFailed(request, SpeedwireQueryHandler::Failure::TIMEOUT, 0);
+    }
+
+    // collect queued queries up to the window size of each device
+    send_requests.clear();
+    send_slots.clear();
+    for (size_t d = 0; d < devices.size(); ++d) {
+        DeviceQueue& device = devices[d];
+        for (size_t n = device.in_flight.size(); n < window_size && device.pending.size() > 0; ++n) {
+            send_requests.push_back(device.pending.front().first);
+            send_slots.push_back(std::make_pair(d, device.pending.front().second));
+            device.pending.pop_front();
+        }
+    }
+    if (send_requests.size() == 0) {
+        return 0;
+    }
+
+    // send them and record their packet ids
+    std::vector<SpeedwireCommandTokenIndex> tokens = sendQueryRequests(send_requests);
+    SpeedwireCommandTokenRepository& repository = command.getTokenRepository();
+    int nsent = 0;
+    for (size_t i = 0; i < send_requests.size(); ++i) {
+        if (tokens[i] >= 0) {
+            InFlightQuery query = { send_requests[i], repository.at(tokens[i]).packetid, now + timeout_in_ms, send_slots[i].second };
+            devices[send_slots[i].first].in_flight.push_back(query);
+            ++nsent;
+        }
+    }
+
+    // queries that could not be sent count as a retry; they are put back in front of their queue in their original order
+    failed_requests.clear();
+    for (size_t i = send_requests.size(); i-- > 0; ) {
+        if (tokens[i] >= 0) {
+            continue;
+        }
+        if (send_slots[i].second < max_retries) {
+            devices[send_slots[i].first].pending.push_front(std::make_pair(send_requests[i], send_slots[i].second + 1));
+            ++num_retries;
+        }
+        else {
+            ++num_failed;
+            failed_requests.insert(failed_requests.begin(), send_requests[i]);
+        }
+    }
+    for (size_t i = 0; i < failed_requests.size(); ++i) {
+        const SpeedwireCommand::QueryRequest request = failed_requests[i];
+        handler.queryFailed(request, SpeedwireQueryHandler::Failure::SEND_ERROR, 0);
+    }
+    return nsent;
+}
+
+
+/**
+ * Send the given queries; the default implementation calls SpeedwireCommand::sendQueryRequests().
+ * @return the token index of each query, or -1 if the query could not be sent
+ */
+std::vector<SpeedwireCommandTokenIndex> SpeedwireQueryEngine::sendQueryRequests(const std::vector<SpeedwireCommand::QueryRequest>& requests) {
+    return command.sendQueryRequests(requests);
+}
+
+
+/**
+ * Drop all queued and in-flight queries without notifying the handler.
+ */
+void SpeedwireQueryEngine::cancel(void) {
+    for (auto& device : devices) {
+        for (auto& query : device.in_flight) {
+            removeToken(device.address, query.packet_id);
+        }
+        device.in_flight.clear();
+        device.pending.clear();
+    }
+}
+
+
+/**
+ * Receive method called by the dispatcher for each inverter packet; replies to in-flight queries are delivered to the handler.
+ */
+void SpeedwireQueryEngine::receive(SpeedwireHeader& packet, struct sockaddr& src) {
+    SpeedwireInverterProtocol inverter_packet(packet);
+    SpeedwireAddress address;
+    address.susyID = inverter_packet.getSrcSusyID();
+    address.serialNumber = inverter_packet.getSrcSerialNumber();
+    const uint16_t packet_id = inverter_packet.getPacketID() | 0x8000;
+
+    // find the in-flight query matching the reply
+    for (auto& device : devices) {
+        if (device.address.susyID != address.susyID || device.address.serialNumber != address.serialNumber) {
+            continue;
+        }
+        for (size_t i = 0; i < device.in_flight.size(); ++i) {
+            if (device.in_flight[i].packet_id != packet_id) {
+                continue;
+            }
+            int token_index = command.getTokenRepository().find(address.susyID, address.serialNumber, packet_id);
+            if (token_index < 0 || command.checkReply(packet, src, command.getTokenRepository().at(token_index)) == false) {
+                return;
+            }
+            command.getTokenRepository().remove(token_index);
+            SpeedwireCommand::QueryRequest request = device.in_flight[i].request;
+            device.in_flight.erase(device.in_flight.begin() + i);
+
+            // check error code
+            const uint16_t error_code = inverter_packet.getErrorCode();
+            if (error_code != 0x0000) {
+                if (error_code == 0x0017) {
+                    logger.print(LogLevel::LOG_ERROR, "lost connection - not authenticated (error code 0x0017)");
+                    command.getTokenRepository().setNeedsLogin(address);
+                }
+                ++num_failed;
+                handler.queryFailed(request, SpeedwireQueryHandler::Failure::ERROR_CODE, error_code);
+                return;
+            }
+            ++num_completed;
+            handler.queryCompleted(request, packet, src);
+            return;
+        }
+        return;
+    }
+}
+
+
+/**
+ * Get the total number of queued queries not yet sent.
+ */
+size_t SpeedwireQueryEngine::getNumberOfPendingQueries(void) const {
+    size_t result = 0;
+    for (auto& device : devices) {
+        result += device.pending.size();
+    }
+    return result;
+}
+
+
+/**
+ * Get the total number of in-flight queries waiting for their reply.
+ */
+size_t SpeedwireQueryEngine::getNumberOfInFlightQueries(void) const {
+    size_t result = 0;
+    for (auto& device : devices) {
+        result += device.in_flight.size();
+    }
+    return result;
+}
+
+
+/**
+ * Get the query queue of the given device; the queue is created on first use.
+ */
+SpeedwireQueryEngine::DeviceQueue& SpeedwireQueryEngine::getDeviceQueue(const SpeedwireAddress& address) {
+    for (auto& device : devices) {
+        if (device.address.susyID == address.susyID && device.address.serialNumber == address.serialNumber) {
+            return device;
+        }
+    }
+    devices.push_back(DeviceQueue());
+    devices.back().address = address;
+    return devices.back();
+}
+
+
+/**
+ * Remove the command token of the given query from the token repository of the command instance.
+ */
+void SpeedwireQueryEngine::removeToken(const SpeedwireAddress& address, const uint16_t packet_id) {
+    int token_index = command.getTokenRepository().find(address.susyID, address.serialNumber, packet_id);
+    if (token_index >= 0) {
+        command.getTokenRepository().remove(token_index);
+    }
+}
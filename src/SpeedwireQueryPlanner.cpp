@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <map>
+#include <Logger.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireQueryPlanner.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireQueryPlanner");
+
+const size_t SpeedwireQueryPlanner::default_max_reply_size;
+
+
+/**
+ * Constructor.
+ * @param _max_reply_size Maximum estimated register data size of a reply packet; merging stops once it would be exceeded
+ * @param _max_register_gap Maximum number of unrequested registers between two merged registers; 0 merges overlapping and adjacent registers only
+ */
+SpeedwireQueryPlanner::SpeedwireQueryPlanner(const size_t _max_reply_size, const uint32_t _max_register_gap) :
+    max_reply_size(_max_reply_size),
+    max_register_gap(_max_register_gap) {}
+
+
+/**
+ * Add the desired data of a device and plan its queries.
+ * @param peer Reference to the device; it must outlive the planner.
+ * @param data Reference to the map of desired data definitions; it must outlive the planner. Replies are demultiplexed into it.
+ */
+void SpeedwireQueryPlanner::add(const SpeedwireDevice& peer, SpeedwireDataMap& data) {
+    DeviceData device = { &peer, &data };
+    devices.push_back(device);
+    plan(device);
+}
+
+
+/**
+ * Remove all devices and planned queries.
+ */
+void SpeedwireQueryPlanner::clear(void) {
+    devices.clear();
+    queries.clear();
+}
+
+
+/**
+ * Get the planned queries as query requests, e.g. for SpeedwireCommand::sendQueryRequests() or SpeedwireQueryEngine.
+ */
+std::vector<SpeedwireCommand::QueryRequest> SpeedwireQueryPlanner::getQueryRequests(void) const {
+    std::vector<SpeedwireCommand::QueryRequest> requests;
+    requests.reserve(queries.size());
+    for (auto& query : queries) {
+        SpeedwireCommand::QueryRequest request = { query.peer, query.command, query.first_register, query.last_register };
+        requests.push_back(request);
+    }
+    return requests;
+}
+
+
+/**
+ * Plan the queries of the given device. Register ids have the form 0x00RRRR00; registers of the same command are sorted
+ * and merged into ranges 0x00RRRR00 ... 0x00SSSSff.
+ */
+void SpeedwireQueryPlanner::plan(const DeviceData& device) {
+
+    // group the estimated reply sizes of the registers by command; each connector of a register yields its own reply element
+    std::map<uint32_t, std::map<uint32_t, size_t>> commands;
+    for (auto& entry : *device.data) {
+        const SpeedwireData& data = entry.second;
+        const Command id = data.command & Command::ID_MASK;
+        if (id == Command::YIELD_BY_MINUTE || id == Command::YIELD_BY_DAY || id == Command::EVENT) {
+            logger.print(LogLevel::LOG_WARNING, "timeline data %s is not planned", data.name.c_str());
+            continue;
+        }
+        commands[(uint32_t)data.command][(data.id >> 8) & 0xffff] += getElementSize(data.type);
+    }
+
+    // merge sorted registers into ranges, as long as the gap and the estimated reply size permit
+    for (auto& command : commands) {
+        PlannedQuery query = { device.peer, (Command)command.first, 0, 0, 0 };
+        uint32_t first = 0, last = 0;
+        bool open = false;
+        for (auto& reg : command.second) {
+            if (open == true) {
+                const uint32_t gap = reg.first - last - 1;
+                const size_t size = query.estimated_reply_size + gap * getElementSize(SpeedwireDataType::Unsigned32) + reg.second;
+                if (gap <= max_register_gap && size <= max_reply_size) {
+                    query.estimated_reply_size = size;
+                    last = reg.first;
+                    continue;
+                }
+                query.first_register = (first << 8);
+                query.last_register  = (last << 8) | 0xff;
+                queries.push_back(query);
+            }
+            first = last = reg.first;
+            query.estimated_reply_size = reg.second;
+            open = true;
+        }
+        if (open == true) {
+            query.first_register = (first << 8);
+            query.last_register  = (last << 8) | 0xff;
+            queries.push_back(query);
+        }
+    }
+}
+
+
+/**
+ * Demultiplex a reply packet into the SpeedwireData entries of the replying device.
+ * @param reply Reference to the reply packet; it must be a valid inverter packet
+ * @return the number of SpeedwireData entries updated from the reply, or -1 if the reply is not from a planned device
+ */
+int SpeedwireQueryPlanner::demultiplex(const SpeedwireHeader& reply) const {
+    const SpeedwireInverterProtocol inverter_packet(reply);
+    const uint16_t susyid = inverter_packet.getSrcSusyID();
+    const uint32_t serial = inverter_packet.getSrcSerialNumber();
+    const Command  reply_command = inverter_packet.getCommandID() & ~Command::REQUEST_TYPE_MASK;
+
+    for (auto& device : devices) {
+        if (device.peer->deviceAddress.susyID != susyid || device.peer->deviceAddress.serialNumber != serial) {
+            continue;
+        }
+        int count = 0;
+        std::vector<SpeedwireRawData> elements = inverter_packet.getRawDataElements();
+        for (auto& raw : elements) {
+            SpeedwireDataMap::iterator it = device.data->find(raw.toKey());
+            if (it == device.data->end() || (it->second.command & ~Command::REQUEST_TYPE_MASK) != reply_command) {
+                continue;
+            }
+            // replies carry the response command code; match it with the query command code of the definition
+            SpeedwireRawData element = raw;
+            element.command = it->second.command;
+            if (it->second.consume(element) == true) {
+                ++count;
+            }
+        }
+        return count;
+    }
+    return -1;
+}
+
+
+/**
+ * Get the estimated size of a reply data element of the given type: register id, timestamp and data words.
+ */
+size_t SpeedwireQueryPlanner::getElementSize(const SpeedwireDataType type) {
+    switch (type & SpeedwireDataType::TypeMask) {
+    case SpeedwireDataType::Status32:
+    case SpeedwireDataType::String32:
+        return 4 + 4 + 32;
+    default:
+        return 4 + 4 + 20;
+    }
+}
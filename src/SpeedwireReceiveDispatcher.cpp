@@ -1,67 +1,83 @@
 #ifdef _WIN32
 #include <Winsock2.h>
 #include <Ws2tcpip.h>
-#define poll(a, b, c)  WSAPoll((a), (b), (c))
 #else
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <poll.h>
 #endif
 
 #include <AddressConversion.hpp>
 #include <Logger.hpp>
 #include <SpeedwireTagHeader.hpp>
 #include <SpeedwireEncryptionProtocol.hpp>
+#include <SpeedwireSocketFactory.hpp>
 #include <SpeedwireReceiveDispatcher.hpp>
 using namespace libspeedwire;
 
 static Logger logger("SpeedwireReceiveDispatcher");
 
+const size_t SpeedwireReceiveDispatcher::max_udp_packet_size;
+const uint16_t SpeedwireReceiveDispatcher::any_susy_id;
+const uint32_t SpeedwireReceiveDispatcher::any_serial_number;
+
 
 /**
  * Constructor.
+ * @param _localhost Reference to the LocalHost instance
+ * @param packet_pool_size Number of packet buffers in the packet pool; this limits the number of packets receivers can retain
+ */
+SpeedwireReceiveDispatcher::SpeedwireReceiveDispatcher(LocalHost& _localhost, const size_t packet_pool_size)
+  : localhost(_localhost),
+    event_loop(NULL),
+    packet_pool(packet_pool_size) {
+    last_batch_size = 0;
+    pool_exhausted_drops = 0;
+    route_slot_bits = 4;
+    route_slots.assign((size_t)1 << route_slot_bits, -1);
+    setBatchSize(1);
+}
+
+/**
+ * Use the given event loop to wait for packets, instead of the event loop shared by all users of the socket factory.
+ * This is needed if dispatch is called from several threads, as each event loop must only be used by a single thread.
+ * @param loop Reference to the event loop; it must outlive this instance.
  */
-SpeedwireReceiveDispatcher::SpeedwireReceiveDispatcher(LocalHost& _localhost)
-  : localhost(_localhost) {}
+void SpeedwireReceiveDispatcher::setEventLoop(SpeedwireEventLoop& loop) {
+    event_loop = &loop;
+}
 
 /**
- * Destructor. Clears all receivers and pollfds.
+ * Destructor. Clears all receivers.
  */
 SpeedwireReceiveDispatcher::~SpeedwireReceiveDispatcher(void) {
-    receivers.clear();
-    pollfds.clear();
+    routes.clear();
+    route_slots.clear();
+    any_subscriptions.clear();
+    ready_sockets.clear();
+    batch_packets.clear();
 }
 
 
 /**
- * Dispatch method - polls on all given sockets and dispatches received packets to their corresponding registered receivers.
+ * Dispatch method - waits on all given sockets and dispatches received packets to their corresponding registered receivers.
  * The implementation is implemented as a synchronous receive methods. A timeout can be provided to cancel the receive after
  * some given time period. After receiving a packet it is checked to make sure it starts with a valid sma speedwire packet
  * header followed by either valid emeter data or inverter data. Depending on the protocol id, the packet is then forwarded
- * to any registered corresponding receiver. Packets failing the validity check are silently ignored.
+ * to any registered corresponding receiver. Packets failing the validity check are dropped and counted in the receive
+ * statistics of their socket by drop reason; they never affect the dispatch of other packets.
+ * If the batch size is larger than 1, each readable socket is drained in batches of up to batch size packets.
  * @param sockets Reference to an array of sockets
  * @param poll_timeout_in_ms Poll timeout in milliseconds
- * @return Returns the number of received packets, or 0 in case of timeout.
+ * @return Returns the number of received valid emeter and inverter packets, 0 in case of timeout, or -1 if waiting failed.
  */
 int  SpeedwireReceiveDispatcher::dispatch(const std::vector<SpeedwireSocket>& sockets, const int poll_timeout_in_ms) {
     int npackets = 0;
-    unsigned char udp_packet[2048];
+    last_batch_size = 0;
 
-    // make sure the backing array of the vector is big enough (yes, it is contiguous memory)
-    if (pollfds.size() < sockets.size()) {
-        pollfds.resize(sockets.size());
-    }
-
-    // prepare the pollfd structure
-    for (int j = 0; j < sockets.size(); ++j) {
-        pollfds[j].fd = sockets[j].getSocketFd();
-        pollfds[j].events = POLLIN;
-        pollfds[j].revents = 0;
-    }
-
-    // wait for a packet on the configured socket
-    int pollresult = poll(&pollfds[0], (unsigned)sockets.size(), poll_timeout_in_ms);
+    // wait for a packet on the configured sockets; sockets are registered with the event loop on first use
+    SpeedwireEventLoop& loop = (event_loop != NULL ? *event_loop : SpeedwireSocketFactory::getInstance(localhost)->getEventLoop());
+    int pollresult = loop.wait(sockets, ready_sockets, poll_timeout_in_ms);
     if (pollresult == 0) {
         //perror("poll timeout in SpeedwireReceiveDispatcher");
         return 0;
@@ -71,144 +87,490 @@ int  SpeedwireReceiveDispatcher::dispatch(const std::vector<SpeedwireSocket>& so
         return -1;
     }
 
-    // determine if the socket received a packet
-    for (int j = 0; j < sockets.size(); ++j) {
+    // receive packets from the sockets that are ready; a socket stays ready until a receive call finds it drained
+    for (int j : ready_sockets) {
         const SpeedwireSocket& socket = sockets[j];
 
-        if ((pollfds[j].revents & POLLIN) != 0) {
-
-            // read packet data
-            int nbytes = -1;
-            struct sockaddr src;
-            if (socket.isIpv4()) {
-                nbytes = socket.recvfrom(udp_packet, sizeof(udp_packet), AddressConversion::toSockAddrIn(src));
+        // in batch mode, drain the socket; otherwise receive a single packet
+        bool drained = false;
+        do {
+            int nreceived = receiveBatch(socket, drained);
+            if (drained == true) {
+                loop.clearReady(socket);
             }
-            else if (socket.isIpv6()) {
-                nbytes = socket.recvfrom(udp_packet, sizeof(udp_packet), AddressConversion::toSockAddrIn6(src));
+            if (nreceived <= 0) {
+                break;
             }
+            ++batch_histogram[nreceived];
+            last_batch_size += nreceived;
+            SocketStatistics& statistics = getStatistics(socket);
+            statistics.received += nreceived;
 
-            // check if it is a speedwire discovery packet
-            SpeedwireHeader speedwire_packet(udp_packet, nbytes);
-            if (speedwire_packet.isValidDiscoveryPacket()) {
-                logger.print(LogLevel::LOG_INFO_2, "received discovery packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
-                for (auto& receiver : receivers) {
-                    if (receiver->protocolID == 0x0000) {
-                        receiver->receive(speedwire_packet, src);
-                    }
-                }
-            }
-            // check if it is an sma data2 speedwire packet
-            else if (speedwire_packet.isValidData2Packet()) {
-
-                SpeedwireData2Packet data2_packet(speedwire_packet);
-                uint16_t length     = data2_packet.getTagLength();
-                uint16_t protocolID = data2_packet.getProtocolID();
-
-                bool valid_emeter_packet = false;
-                bool valid_inverter_packet = false;
-
-                // check if it is an sma emeter packet
-                if (SpeedwireData2Packet::isEmeterProtocolID(protocolID) ||
-                    SpeedwireData2Packet::isExtendedEmeterProtocolID(protocolID)) {
-                    SpeedwireEmeterProtocol emeter(speedwire_packet);
-                    uint16_t susyid = emeter.getSusyID();
-                    uint32_t serial = emeter.getSerialNumber();
-                    uint32_t time   = emeter.getTime();
-                    logger.print(LogLevel::LOG_INFO_2, "received emeter packet  time %lu\n", time);
-                    valid_emeter_packet = true;
-                    ++npackets;
-                }
-                // check if it is an sma inverter packet
-                else if (SpeedwireData2Packet::isInverterProtocolID(protocolID)) {
-                    uint8_t longwords = data2_packet.getLongWords();
-
-                    // a few quick sanity checks
-                    if ((length + (size_t)20) > sizeof(udp_packet)) {    // packet length - starting to count from the byte following protocolID, # of long words and control byte, i.e. with byte #20
-                        logger.print(LogLevel::LOG_ERROR, "length field %u and buff_size %u mismatch\n", length, (unsigned)sizeof(udp_packet));
-                        return -1;
-                    }
-                    if (length < (8 + 8 + 6)) {                         // up to and including packetID
-                        logger.print(LogLevel::LOG_ERROR, "length field %u too small to hold inverter packet (8 + 8 + 6)\n", length);
-                        return -1;
-                    }
-                    if ((longwords != (length / sizeof(uint32_t)))) {
-                        logger.print(LogLevel::LOG_ERROR, "length field %u and long words %u mismatch\n", length, longwords);
-                        return -1;
-                    }
-
-                    logger.print(LogLevel::LOG_INFO_2, "received inverter packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
-                    valid_inverter_packet = true;
-                    ++npackets;
-                }
-                // check if it is an sma 6075 packet
-                else if (SpeedwireData2Packet::isEncryptionProtocolID(protocolID)) {
-                    SpeedwireEncryptionProtocol encryption(speedwire_packet);
-                    logger.print(LogLevel::LOG_INFO_2, "received encryption packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
-                    //logger.print(LogLevel::LOG_INFO_2, "%s\n", encryption.toString().c_str());
-                    valid_inverter_packet = true;
-                    ++npackets;
+            // check and dispatch the batch of packets; packet buffers are returned to the pool unless a receiver retained them
+            for (int i = 0; i < nreceived; ++i) {
+                DropReason reason = DropReason::NUMBER_OF_REASONS;
+                int result = dispatchPacket(batch_packets[i], reason);
+                if (result < 0) {
+                    ++statistics.dropped[(size_t)reason];
                 }
                 else {
-                    logger.print(LogLevel::LOG_WARNING, "received unknown protocol 0x%04x time %lu\n", protocolID, (uint32_t)LocalHost::getUnixEpochTimeInMs());
+                    npackets += result;
                 }
+                batch_packets[i].reset();
+            }
+        } while (batch_size > 1 && drained == false);
+    }
+    return npackets;
+}
 
-                // pass it to the relevant registered packet consumers
-                for (auto& receiver : receivers) {
-                    switch (receiver->protocolID) {
-                    case 0x0000:
-                        receiver->receive(speedwire_packet, src);
-                        break;
-                    case SpeedwireData2Packet::sma_emeter_protocol_id:
-                        if (valid_emeter_packet == true) {
-                            receiver->receive(speedwire_packet, src);
-                        }
-                        break;
-                    case SpeedwireData2Packet::sma_inverter_protocol_id:
-                        if (valid_inverter_packet == true) {
-                            receiver->receive(speedwire_packet, src);
-                        }
-                        break;
-                    }
-                }
+
+/**
+ * Receive up to batch size packets from the given socket into packet buffers taken from the packet pool.
+ * If the packet pool is exhausted, because receivers retain too many packets, the socket is drained and all
+ * its packets are dropped.
+ * @param socket Reference to the socket
+ * @param drained Reference to a flag that is set to true, if the socket was found drained
+ * @return Returns the number of received packets, or -1 in case of an error.
+ */
+int SpeedwireReceiveDispatcher::receiveBatch(const SpeedwireSocket& socket, bool& drained) {
+    void* buffs[SpeedwireSocket::max_recv_batch_size];
+    struct sockaddr_storage* srcs[SpeedwireSocket::max_recv_batch_size];
+    uint64_t arrival_times[SpeedwireSocket::max_recv_batch_size];
+
+    // take packet buffers from the pool
+    int nbuffers = 0;
+    while (nbuffers < batch_size) {
+        SpeedwirePacketHandle& packet = batch_packets[nbuffers];
+        packet = packet_pool.allocate();
+        if (packet.isValid() == false) {
+            break;
+        }
+        buffs[nbuffers] = packet.getData();
+        srcs[nbuffers] = &packet.getSrcStorage();
+        ++nbuffers;
+    }
+
+    // if the pool is exhausted, drain the socket into the overflow buffer
+    if (nbuffers == 0) {
+        void* buff = overflow_buffer.data;
+        struct sockaddr_storage* src = &overflow_buffer.src;
+        SocketStatistics& statistics = getStatistics(socket);
+        while (socket.recvmmsg(&buff, sizeof(overflow_buffer.data), 1, &overflow_buffer.nbytes, &src) > 0) {
+            ++pool_exhausted_drops;
+            ++statistics.received;
+            ++statistics.dropped[(size_t)DropReason::BUFFER_OVERFLOW];
+            logger.print(LogLevel::LOG_WARNING, "packet pool exhausted - dropped packet\n");
+        }
+        drained = true;
+        return 0;
+    }
+
+    // receive packets into the packet buffers and return unused packet buffers to the pool
+    int nreceived = socket.recvmmsg(buffs, max_udp_packet_size, nbuffers, &batch_nbytes[0], srcs, arrival_times);
+    for (int i = 0; i < nbuffers; ++i) {
+        if (i < nreceived) {
+            batch_packets[i].setSize(batch_nbytes[i]);
+            batch_packets[i].setArrivalTimeInNs(arrival_times[i]);
+        }
+        else {
+            batch_packets[i].reset();
+        }
+    }
+    drained = (nreceived < nbuffers);
+    return nreceived;
+}
+
+
+/**
+ * Check a single received packet for validity and pass it to the relevant registered receivers.
+ * Packets of an unknown protocol id are still passed to receivers registered for all packets; they are only dropped if there is no such receiver.
+ * @param packet Reference to a handle of the packet buffer holding the packet and its sender address.
+ * @param reason Reference to a drop reason; it is set if the packet is dropped.
+ * @return Returns 1 if the packet is a valid emeter or inverter packet, 0 if it is some other packet, or -1 if it is dropped.
+ */
+int SpeedwireReceiveDispatcher::dispatchPacket(SpeedwirePacketHandle& packet, DropReason& reason) {
+    int npackets = 0;
+    const int nbytes = packet.getSize();
+    uint8_t* udp_packet = packet.getData();
+    if (nbytes <= 0) {
+        return 0;
+    }
+
+    // a packet filling the entire packet buffer has most likely been truncated by the receive call
+    if (nbytes >= (int)max_udp_packet_size) {
+        logger.print(LogLevel::LOG_WARNING, "packet size %d exceeds buffer size %u\n", nbytes, (unsigned)max_udp_packet_size);
+        reason = DropReason::BUFFER_OVERFLOW;
+        return -1;
+    }
+
+    // check if it is a speedwire packet
+    SpeedwireHeader speedwire_packet(udp_packet, nbytes);
+    if (speedwire_packet.isSMAPacket() == false) {
+        reason = DropReason::BAD_SIGNATURE;
+        return -1;
+    }
+
+    // check if it is a speedwire discovery packet
+    if (speedwire_packet.isValidDiscoveryPacket()) {
+        logger.print(LogLevel::LOG_INFO_2, "received discovery packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
+        deliver(any_subscriptions, packet);
+    }
+    // check if it is an sma data2 speedwire packet
+    else if (speedwire_packet.isValidData2Packet()) {
+
+        SpeedwireData2Packet data2_packet(speedwire_packet);
+        uint16_t length     = data2_packet.getTagLength();
+        uint16_t protocolID = data2_packet.getProtocolID();
+
+        // the device keys are only extracted if there are subscriptions restricted to a single device
+        Route* route = findRoute(protocolID);
+        bool need_device = (route != NULL && route->has_device_subscriptions);
+        bool has_device = false;
+        uint16_t susyid = any_susy_id;
+        uint32_t serial = any_serial_number;
+
+        // check if it is an sma emeter packet
+        if (SpeedwireData2Packet::isEmeterProtocolID(protocolID) ||
+            SpeedwireData2Packet::isExtendedEmeterProtocolID(protocolID)) {
+            SpeedwireEmeterProtocol emeter(speedwire_packet);
+            if (need_device) {
+                susyid = emeter.getSusyID();
+                serial = emeter.getSerialNumber();
+                has_device = true;
+            }
+            logger.print(LogLevel::LOG_INFO_2, "received emeter packet  time %lu\n", emeter.getTime());
+            ++npackets;
+        }
+        // check if it is an sma inverter packet
+        else if (SpeedwireData2Packet::isInverterProtocolID(protocolID)) {
+            uint8_t longwords = data2_packet.getLongWords();
+
+            // a few quick sanity checks
+            if ((length + (size_t)20) > max_udp_packet_size) {    // packet length - starting to count from the byte following protocolID, # of long words and control byte, i.e. with byte #20
+                logger.print(LogLevel::LOG_ERROR, "length field %u and buff_size %u mismatch\n", length, (unsigned)max_udp_packet_size);
+                reason = DropReason::BAD_LENGTH;
+                return -1;
+            }
+            if (length < (8 + 8 + 6)) {                         // up to and including packetID
+                logger.print(LogLevel::LOG_ERROR, "length field %u too small to hold inverter packet (8 + 8 + 6)\n", length);
+                reason = DropReason::BAD_LENGTH;
+                return -1;
+            }
+            if ((longwords != (length / sizeof(uint32_t)))) {
+                logger.print(LogLevel::LOG_ERROR, "length field %u and long words %u mismatch\n", length, longwords);
+                reason = DropReason::BAD_LENGTH;
+                return -1;
+            }
+            if (need_device) {
+                SpeedwireInverterProtocol inverter(speedwire_packet);
+                susyid = inverter.getSrcSusyID();
+                serial = inverter.getSrcSerialNumber();
+                has_device = true;
+            }
+            logger.print(LogLevel::LOG_INFO_2, "received inverter packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
+            ++npackets;
+        }
+        // check if it is an sma 6075 packet
+        else if (SpeedwireData2Packet::isEncryptionProtocolID(protocolID)) {
+            if (need_device) {
+                SpeedwireEncryptionProtocol encryption(speedwire_packet);
+                susyid = encryption.getSrcSusyID();
+                serial = encryption.getSrcSerialNumber();
+                has_device = true;
             }
+            logger.print(LogLevel::LOG_INFO_2, "received encryption packet  time %lu\n", (uint32_t)LocalHost::getUnixEpochTimeInMs());
+            //logger.print(LogLevel::LOG_INFO_2, "%s\n", encryption.toString().c_str());
+            ++npackets;
+        }
+        else {
+            logger.print(LogLevel::LOG_WARNING, "received unknown protocol 0x%04x time %lu\n", protocolID, (uint32_t)LocalHost::getUnixEpochTimeInMs());
+        }
+
+        // pass it to the subscribers of all packets and to the subscribers of its protocol id
+        deliver(any_subscriptions, packet);
+        if (route != NULL) {
+            deliver(*route, packet, has_device, susyid, serial);
+        }
+        else if (npackets == 0 && any_subscriptions.empty()) {
+            reason = DropReason::UNKNOWN_PROTOCOL;
+            return -1;
         }
     }
+    // it is an sma packet that is neither a discovery nor a data2 packet; complete packets conclude with an end-of-data tag
+    else {
+        reason = (speedwire_packet.findEodTagPacket() == NULL ? DropReason::TRUNCATED : DropReason::UNKNOWN_PROTOCOL);
+        return -1;
+    }
     return npackets;
 }
 
 
 /**
- * Register a receiver for speedwire packets belonging to protocol id 0x0000.
+ * Set the maximum number of packets received from a socket by a single receive call. A batch size of 1 receives
+ * a single packet per readable socket and dispatch call; larger batch sizes drain each readable socket by recvmmsg()
+ * calls. The batch size is limited to SpeedwireSocket::max_recv_batch_size. Changing the batch size
+ * clears the batch size histogram.
+ * @param size The maximum number of packets per receive call
+ */
+void SpeedwireReceiveDispatcher::setBatchSize(const int size) {
+    batch_size = (size < 1 ? 1 : (size > SpeedwireSocket::max_recv_batch_size ? SpeedwireSocket::max_recv_batch_size : size));
+    batch_packets.resize(batch_size);
+    batch_nbytes.resize(batch_size);
+    batch_histogram.assign(batch_size + 1, 0);
+}
+
+
+/**
+ * Clear the batch size histogram.
+ */
+void SpeedwireReceiveDispatcher::clearBatchSizeHistogram(void) {
+    batch_histogram.assign(batch_size + 1, 0);
+}
+
+
+/**
+ * Get the receive statistics of the given socket; statistics are created on first use.
+ */
+SpeedwireReceiveDispatcher::SocketStatistics& SpeedwireReceiveDispatcher::getStatistics(const SpeedwireSocket& socket) {
+    const size_t fd = (size_t)socket.getSocketFd();
+    if (fd >= socket_statistics.size()) {
+        socket_statistics.resize(fd + 1);
+    }
+    return socket_statistics[fd];
+}
+
+
+/**
+ * Get a copy of the receive statistics of the given socket.
+ * @param socket Reference to the socket
+ * @return the receive statistics; all counters are 0 if no packet has been received from the socket
+ */
+SpeedwireReceiveDispatcher::SocketStatistics SpeedwireReceiveDispatcher::getSocketStatistics(const SpeedwireSocket& socket) const {
+    const size_t fd = (size_t)socket.getSocketFd();
+    if (fd < socket_statistics.size()) {
+        return socket_statistics[fd];
+    }
+    return SocketStatistics();
+}
+
+
+/**
+ * Get the number of packets dropped for the given reason across all sockets.
+ */
+uint64_t SpeedwireReceiveDispatcher::getNumberOfDroppedPackets(const DropReason reason) const {
+    uint64_t result = 0;
+    for (auto& statistics : socket_statistics) {
+        result += statistics.getNumberOfDroppedPackets(reason);
+    }
+    return result;
+}
+
+
+/**
+ * Clear the receive statistics of all sockets.
+ */
+void SpeedwireReceiveDispatcher::clearSocketStatistics(void) {
+    socket_statistics.clear();
+}
+
+
+/**
+ * Constructor of the receive statistics of a single socket; all counters are 0.
+ */
+SpeedwireReceiveDispatcher::SocketStatistics::SocketStatistics(void) : received(0) {
+    for (auto& counter : dropped) {
+        counter = 0;
+    }
+}
+
+
+/**
+ * Get the number of dropped packets for all drop reasons.
+ */
+uint64_t SpeedwireReceiveDispatcher::SocketStatistics::getNumberOfDroppedPackets(void) const {
+    uint64_t result = 0;
+    for (auto& counter : dropped) {
+        result += counter;
+    }
+    return result;
+}
+
+
+/**
+ * Get a printable name of the given drop reason.
+ */
+const char* SpeedwireReceiveDispatcher::toString(const DropReason reason) {
+    switch (reason) {
+    case DropReason::BAD_SIGNATURE:    return "bad signature";
+    case DropReason::BAD_LENGTH:       return "bad length";
+    case DropReason::UNKNOWN_PROTOCOL: return "unknown protocol";
+    case DropReason::TRUNCATED:        return "truncated";
+    case DropReason::BUFFER_OVERFLOW:  return "buffer overflow";
+    default:                           return "unknown";
+    }
+}
+
+
+/**
+ * Find the routing table entry for the given protocol id.
+ * @param protocol_id The protocol id
+ * @return a pointer to the routing table entry, or NULL if there are no subscriptions to the protocol id
+ */
+SpeedwireReceiveDispatcher::Route* SpeedwireReceiveDispatcher::findRoute(const uint16_t protocol_id) {
+    const int index = route_slots[getRouteSlot(protocol_id)];
+    return (index >= 0 ? &routes[index] : NULL);
+}
+
+
+/**
+ * Get the hash table slot of the given protocol id, i.e. the slot holding its route index, or the empty slot where it would be inserted.
+ * Slots are probed linearly, starting at the fibonacci hash of the protocol id; the table is kept at most half full.
+ */
+size_t SpeedwireReceiveDispatcher::getRouteSlot(const uint16_t protocol_id) const {
+    const size_t mask = route_slots.size() - 1;
+    size_t slot = (size_t)(((uint32_t)protocol_id * 2654435769u) >> (32 - route_slot_bits));
+    while (route_slots[slot] >= 0 && routes[route_slots[slot]].protocol_id != protocol_id) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+
+/**
+ * Insert the given routing table entry into the hash table; the hash table is doubled in size if it would become more than half full.
+ */
+void SpeedwireReceiveDispatcher::insertRouteSlot(const int route_index) {
+    if (routes.size() * 2 > route_slots.size()) {
+        ++route_slot_bits;
+        route_slots.assign((size_t)1 << route_slot_bits, -1);
+        for (int i = 0; i < (int)routes.size(); ++i) {
+            if (i != route_index) {
+                route_slots[getRouteSlot(routes[i].protocol_id)] = i;
+            }
+        }
+    }
+    route_slots[getRouteSlot(routes[route_index].protocol_id)] = route_index;
+}
+
+
+/**
+ * Subscribe the given receiver to data2 packets of the given protocol id, optionally restricted to a single device.
+ */
+void SpeedwireReceiveDispatcher::subscribe(SpeedwirePacketReceiverBase& receiver, const uint16_t protocol_id, const uint16_t susy_id, const uint32_t serial_number) {
+    Route* route = findRoute(protocol_id);
+    if (route == NULL) {
+        Route new_route;
+        new_route.protocol_id = protocol_id;
+        new_route.has_device_subscriptions = false;
+        routes.push_back(new_route);
+        insertRouteSlot((int)routes.size() - 1);
+        route = &routes.back();
+    }
+    Subscription subscription = { &receiver, susy_id, serial_number };
+    route->subscriptions.push_back(subscription);
+    if (susy_id != any_susy_id || serial_number != any_serial_number) {
+        route->has_device_subscriptions = true;
+    }
+}
+
+
+/**
+ * Pass the given packet to all given subscriptions.
+ */
+void SpeedwireReceiveDispatcher::deliver(const std::vector<Subscription>& subscriptions, SpeedwirePacketHandle& packet) {
+    for (auto& subscription : subscriptions) {
+        subscription.receiver->receivePacket(packet);
+    }
+}
+
+
+/**
+ * Pass the given packet to all subscriptions of the given route matching the device that sent the packet. If the device
+ * is unknown, the packet is only passed to subscriptions that are not restricted to a single device.
+ */
+void SpeedwireReceiveDispatcher::deliver(const Route& route, SpeedwirePacketHandle& packet, const bool has_device, const uint16_t susy_id, const uint32_t serial_number) {
+    for (auto& subscription : route.subscriptions) {
+        if (subscription.susy_id != any_susy_id && (has_device == false || subscription.susy_id != susy_id)) {
+            continue;
+        }
+        if (subscription.serial_number != any_serial_number && (has_device == false || subscription.serial_number != serial_number)) {
+            continue;
+        }
+        subscription.receiver->receivePacket(packet);
+    }
+}
+
+
+/**
+ * Register a receiver for all speedwire discovery and data2 packets; its protocol id is set to 0x0000.
  * @param receiver Reference to the packet receiver instance.
  */
 void SpeedwireReceiveDispatcher::registerReceiver(SpeedwirePacketReceiverBase& receiver) {
     receiver.protocolID = 0x0000;
-    receivers.push_back(&receiver);
+    Subscription subscription = { &receiver, any_susy_id, any_serial_number };
+    any_subscriptions.push_back(subscription);
+}
+
+/**
+ * Register a receiver for speedwire data2 packets belonging to the given protocol id, optionally restricted to a single device.
+ * For emeter packets, the device is given by the susy id and serial number of the emeter; for inverter and encryption
+ * packets, it is given by the source susy id and serial number.
+ * @param receiver Reference to the packet receiver instance.
+ * @param protocol_id The protocol id.
+ * @param susy_id The susy id of the device, or any_susy_id.
+ * @param serial_number The serial number of the device, or any_serial_number.
+ */
+void SpeedwireReceiveDispatcher::registerReceiver(SpeedwirePacketReceiverBase& receiver, const uint16_t protocol_id, const uint16_t susy_id, const uint32_t serial_number) {
+    receiver.protocolID = protocol_id;
+    subscribe(receiver, protocol_id, susy_id, serial_number);
 }
 
 /**
- * Register a receiver for speedwire emeter packets belonging to protocol id SpeedwireHeader::sma_emeter_protocol_id.
+ * Register a receiver for speedwire emeter packets belonging to protocol id SpeedwireHeader::sma_emeter_protocol_id;
+ * the receiver also gets extended emeter packets sent by home managers.
  * @param receiver Reference to the packet receiver instance.
  */
 void SpeedwireReceiveDispatcher::registerReceiver(EmeterPacketReceiverBase& receiver) {
     receiver.protocolID = SpeedwireData2Packet::sma_emeter_protocol_id;
-    receivers.push_back(&receiver);
+    subscribe(receiver, SpeedwireData2Packet::sma_emeter_protocol_id, any_susy_id, any_serial_number);
+    subscribe(receiver, SpeedwireData2Packet::sma_extended_emeter_protocol_id, any_susy_id, any_serial_number);
 }
 
 /**
- * Register a receiver for speedwire inverter packets belonging to protocol id SpeedwireHeader::sma_inverter_protocol_id.
+ * Register a receiver for speedwire extended emeter packets belonging to protocol id SpeedwireHeader::sma_extended_emeter_protocol_id.
+ * @param receiver Reference to the packet receiver instance.
+ */
+void SpeedwireReceiveDispatcher::registerReceiver(ExtendedEmeterPacketReceiverBase& receiver) {
+    receiver.protocolID = SpeedwireData2Packet::sma_extended_emeter_protocol_id;
+    subscribe(receiver, SpeedwireData2Packet::sma_extended_emeter_protocol_id, any_susy_id, any_serial_number);
+}
+
+/**
+ * Register a receiver for speedwire inverter packets belonging to protocol id SpeedwireHeader::sma_inverter_protocol_id;
+ * the receiver also gets encryption packets.
  * @param receiver Reference to the packet receiver instance.
  */
 void SpeedwireReceiveDispatcher::registerReceiver(InverterPacketReceiverBase& receiver) {
     receiver.protocolID = SpeedwireData2Packet::sma_inverter_protocol_id;
-    receivers.push_back(&receiver);
+    subscribe(receiver, SpeedwireData2Packet::sma_inverter_protocol_id, any_susy_id, any_serial_number);
+    subscribe(receiver, SpeedwireData2Packet::sma_encryption_protocol_id, any_susy_id, any_serial_number);
+}
+
+/**
+ * Register a receiver for speedwire encryption packets belonging to protocol id SpeedwireHeader::sma_encryption_protocol_id.
+ * @param receiver Reference to the packet receiver instance.
+ */
+void SpeedwireReceiveDispatcher::registerReceiver(EncryptionPacketReceiverBase& receiver) {
+    receiver.protocolID = SpeedwireData2Packet::sma_encryption_protocol_id;
+    subscribe(receiver, SpeedwireData2Packet::sma_encryption_protocol_id, any_susy_id, any_serial_number);
 }
 
 /**
- * Register a receiver for discovery packets.
+ * Register a receiver for discovery packets; like receivers registered for all packets, it also gets all data2 packets.
  * @param receiver Reference to the packet receiver instance.
  */
 void SpeedwireReceiveDispatcher::registerReceiver(DiscoveryPacketReceiverBase& receiver) {
     receiver.protocolID = 0x0000;
-    receivers.push_back(&receiver);
+    Subscription subscription = { &receiver, any_susy_id, any_serial_number };
+    any_subscriptions.push_back(subscription);
 }
@@ -0,0 +1,132 @@
+#include <chrono>
+#include <thread>
+#include <Logger.hpp>
+#include <SpeedwirePacketRecorder.hpp>
+#include <SpeedwireReplayDispatcher.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireReplayDispatcher");
+
+
+/**
+ * Constructor.
+ * @param localhost Reference to the LocalHost instance
+ * @param _pace Replay pace
+ * @param packet_pool_size Number of packet buffers in the packet pool; this limits the number of packets receivers can retain
+ */
+SpeedwireReplayDispatcher::SpeedwireReplayDispatcher(LocalHost& localhost, const Pace _pace, const size_t packet_pool_size) :
+    SpeedwireReceiveDispatcher(localhost, packet_pool_size),
+    file(NULL),
+    pace(_pace),
+    started(false),
+    first_arrival_time(0),
+    replay_start_time() {}
+
+
+/**
+ * Destructor. Closes the capture file.
+ */
+SpeedwireReplayDispatcher::~SpeedwireReplayDispatcher(void) {
+    close();
+}
+
+
+/**
+ * Open the given capture file for replay.
+ * @param filename Path of the capture file
+ * @return true on success, false if the file cannot be opened or is not a capture file
+ */
+bool SpeedwireReplayDispatcher::open(const std::string& filename) {
+    close();
+    file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        perror("fopen failure");
+        return false;
+    }
+    if (SpeedwirePacketRecorder::readFileHeader(file) == false) {
+        logger.print(LogLevel::LOG_ERROR, "invalid capture file header %s\n", filename.c_str());
+        close();
+        return false;
+    }
+    started = false;
+    statistics = SocketStatistics();
+    return true;
+}
+
+
+/**
+ * Restart the replay from the first record of the capture file; this allows for replaying a capture file in a loop.
+ * @return true on success, false otherwise
+ */
+bool SpeedwireReplayDispatcher::rewind(void) {
+    if (file == NULL) {
+        return false;
+    }
+    if (fseek(file, 0, SEEK_SET) != 0 || SpeedwirePacketRecorder::readFileHeader(file) == false) {
+        return false;
+    }
+    started = false;
+    return true;
+}
+
+
+/**
+ * Close the capture file.
+ */
+void SpeedwireReplayDispatcher::close(void) {
+    if (file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+
+/**
+ * Replay up to the given number of packets from the capture file. Each packet is checked for validity and passed to
+ * the registered receivers. If the pace is Pace::RECORDED, the call sleeps before each packet until its recorded
+ * offset from the first replayed packet has elapsed.
+ * @param max_packets Maximum number of packets to replay
+ * @return Returns the number of replayed packets, 0 at the end of the capture file, or -1 if the capture file is not open or a record is invalid.
+ */
+int SpeedwireReplayDispatcher::replay(const size_t max_packets) {
+    if (file == NULL) {
+        return -1;
+    }
+    int npackets = 0;
+    while ((size_t)npackets < max_packets) {
+        SpeedwirePacketHandle packet = packet_pool.allocate();
+        if (packet.isValid() == false) {
+            logger.print(LogLevel::LOG_ERROR, "packet pool exhausted\n");
+            return -1;
+        }
+        int result = SpeedwirePacketRecorder::readRecord(file, packet);
+        if (result == 0) {
+            break;
+        }
+        if (result < 0) {
+            logger.print(LogLevel::LOG_ERROR, "invalid capture file record\n");
+            return -1;
+        }
+
+        // wait until the recorded offset from the first replayed packet has elapsed
+        const uint64_t arrival_time = packet.getArrivalTimeInNs();
+        if (started == false) {
+            started = true;
+            first_arrival_time = arrival_time;
+            replay_start_time = std::chrono::steady_clock::now();
+        }
+        else if (pace == Pace::RECORDED && arrival_time > first_arrival_time) {
+            // use the monotonic clock, such that wall clock adjustments do not stall or rush the replay
+            std::this_thread::sleep_until(replay_start_time + std::chrono::nanoseconds(arrival_time - first_arrival_time));
+        }
+
+        // check and dispatch the packet; the packet buffer is returned to the pool unless a receiver retained it
+        DropReason reason = DropReason::NUMBER_OF_REASONS;
+        if (dispatchPacket(packet, reason) < 0) {
+            ++statistics.dropped[(size_t)reason];
+        }
+        ++statistics.received;
+        ++npackets;
+    }
+    return npackets;
+}
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <chrono>
+#include <Logger.hpp>
+#include <SpeedwireSocketFactory.hpp>
+#include <SpeedwireShardedReceiveDispatcher.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireShardedReceiveDispatcher");
+
+
+/**
+ * Constructor of the shard state; the dispatcher of the shard waits on the event loop of the shard.
+ */
+SpeedwireShardedReceiveDispatcher::ShardContext::ShardContext(LocalHost& localhost, const size_t packet_pool_size) :
+    dispatcher(localhost, packet_pool_size),
+    received(0) {
+    dispatcher.setEventLoop(event_loop);
+}
+
+
+/**
+ * Constructor - creates one shard for each shard of the socket factory instance. The socket factory must have been
+ * created with strategy SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE; otherwise there are no shards.
+ * @param localhost Reference to the LocalHost instance
+ * @param packet_pool_size Number of packet buffers in the packet pool of each shard
+ */
+SpeedwireShardedReceiveDispatcher::SpeedwireShardedReceiveDispatcher(LocalHost& _localhost, const size_t packet_pool_size) :
+    SpeedwireShardedReceiveDispatcher(_localhost, *SpeedwireSocketFactory::getInstance(_localhost), packet_pool_size) {
+}
+
+
+/**
+ * Constructor - creates one shard for each shard of the given socket factory.
+ * @param localhost Reference to the LocalHost instance
+ * @param factory Reference to the socket factory providing the sharded sockets
+ * @param packet_pool_size Number of packet buffers in the packet pool of each shard
+ */
+SpeedwireShardedReceiveDispatcher::SpeedwireShardedReceiveDispatcher(LocalHost& _localhost, SpeedwireSocketFactory& factory, const size_t packet_pool_size) :
+    localhost(_localhost),
+    running(false) {
+    for (unsigned int i = 0; i < factory.getNumberOfShards(); ++i) {
+        ShardContext* shard = new ShardContext(localhost, packet_pool_size);
+        shard->sockets = factory.getShardRecvSockets(i);
+        shards.push_back(std::unique_ptr<ShardContext>(shard));
+    }
+    if (shards.size() == 0) {
+        logger.print(LogLevel::LOG_ERROR, "socket factory does not provide sharded sockets\n");
+    }
+}
+
+
+/**
+ * Destructor. Stops all shard threads.
+ */
+SpeedwireShardedReceiveDispatcher::~SpeedwireShardedReceiveDispatcher(void) {
+    stop();
+}
+
+
+/**
+ * Get the dispatcher of the given shard; it is used to register the receivers of the shard and to configure it, e.g. its batch size.
+ * Receivers must be registered before the shard threads are started.
+ */
+SpeedwireReceiveDispatcher& SpeedwireShardedReceiveDispatcher::getShardDispatcher(const unsigned int shard) {
+    return shards[shard]->dispatcher;
+}
+
+
+/**
+ * Get the number of packets dispatched by the given shard.
+ */
+uint64_t SpeedwireShardedReceiveDispatcher::getNumberOfReceivedPackets(const unsigned int shard) const {
+    return shards[shard]->received;
+}
+
+
+/**
+ * Start one dispatch thread for each shard.
+ * @return true if the threads were started, false if they are already running or if there are no shards
+ */
+bool SpeedwireShardedReceiveDispatcher::start(void) {
+    if (running == true || shards.size() == 0) {
+        return false;
+    }
+    running = true;
+    for (auto& shard : shards) {
+        shard->thread = std::thread(&SpeedwireShardedReceiveDispatcher::shardThread, this, std::ref(*shard));
+    }
+    return true;
+}
+
+
+/**
+ * Stop all shard threads and wait for them to terminate.
+ */
+void SpeedwireShardedReceiveDispatcher::stop(void) {
+    if (running == false) {
+        return;
+    }
+    running = false;
+    for (auto& shard : shards) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
+
+
+/**
+ * Shard thread - dispatches the packets of the shard sockets to the receivers registered with the shard.
+ * On dispatch errors, e.g. if the shard sockets have been closed, the thread backs off exponentially instead of
+ * spinning; it terminates after max_consecutive_errors errors in a row.
+ */
+void SpeedwireShardedReceiveDispatcher::shardThread(ShardContext& shard) {
+    unsigned int errors = 0;
+    while (running == true) {
+        int npackets = shard.dispatcher.dispatch(shard.sockets, 100);
+        if (npackets >= 0) {
+            shard.received += npackets;
+            errors = 0;
+            continue;
+        }
+        if (++errors >= max_consecutive_errors) {
+            logger.print(LogLevel::LOG_ERROR, "shard thread terminates after %u consecutive dispatch errors\n", errors);
+            break;
+        }
+        const unsigned int backoff_in_ms = std::min(10u << errors, 1000u);
+        std::this_thread::sleep_for(std::chrono::milliseconds(backoff_in_ms));
+    }
+}
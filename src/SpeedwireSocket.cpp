@@ -1,5 +1,6 @@
 #define _WINSOCK_DEPRECATED_NO_WARNINGS
 #include <cstring>
+#include <cerrno>
 #include <stdio.h>
 #include <vector>
 #include <SpeedwireSocket.hpp>
@@ -20,6 +21,9 @@ static struct sockaddr_in toSockAddrIn(const std::string& addr, uint16_t port) {
     return AddressConversion::toSockAddrIn(AddressConversion::toSockAddr(AddressConversion::toInAddress(addr), port));
 }
 
+const int SpeedwireSocket::max_recv_batch_size;
+const int SpeedwireSocket::max_send_batch_size;
+
 const struct sockaddr_in  SpeedwireSocket::speedwire_multicast_address_239_12_255_254 = toSockAddrIn("239.12.255.254", speedwire_port_9522);;
 const struct sockaddr_in  SpeedwireSocket::speedwire_multicast_address_239_12_255_255 = toSockAddrIn("239.12.255.255", speedwire_port_9522);;
 const struct sockaddr_in6 SpeedwireSocket::speedwire_multicast_address_v6 = AddressConversion::toSockAddrIn6(AddressConversion::toSockAddr(AddressConversion::toIn6Address("::"), speedwire_port_9522));
@@ -141,14 +145,24 @@ const sockaddr_in6 SpeedwireSocket::getSpeedwireMulticastIn6Address(void) const
  *  dot notation (e.g. "192.168.178.1") or an ipv6 interface in : notation
  */
 int SpeedwireSocket::openSocket(const std::string &local_interface_address, const bool multicast) {
+    // multicast sockets are bound to the speedwire port, for unicast sockets let the OS choose an available port
+    return openSocket(local_interface_address, multicast, (multicast == true ? speedwire_port_9522 : 0));
+}
+
+
+/**
+ *  Open socket for the given interface and bind it to the given port; if the port is 0, the OS chooses an available port.
+ *  Binding unicast sockets to the speedwire port allows a group of sockets to share the unicast traffic by SO_REUSEPORT.
+ */
+int SpeedwireSocket::openSocket(const std::string& local_interface_address, const bool multicast, const uint16_t port) {
     socket_interface = local_interface_address;
     if (AddressConversion::isIpv4(local_interface_address) == true) {
         socket_family = AF_INET;
-        socket_fd = openSocketV4(local_interface_address, multicast);
+        socket_fd = openSocketV4(local_interface_address, multicast, port);
     }
     else if (AddressConversion::isIpv6(local_interface_address) == true) {
         socket_family = AF_INET6;
-        socket_fd = openSocketV6(local_interface_address, multicast);
+        socket_fd = openSocketV6(local_interface_address, multicast, port);
     }
     else {
         socket_family = AF_UNSPEC;
@@ -159,6 +173,31 @@ int SpeedwireSocket::openSocket(const std::string &local_interface_address, cons
 }
 
 
+/**
+ *  Open socket for the given interface and attach the given in-kernel packet filter to it. If the filter cannot
+ *  be attached, the socket is kept open and receives all packets.
+ */
+int SpeedwireSocket::openSocket(const std::string& local_interface_address, const bool multicast, const SpeedwireSocketFilter& filter) {
+    int fd = openSocket(local_interface_address, multicast);
+    if (fd >= 0) {
+        setFilter(filter);
+    }
+    return fd;
+}
+
+
+/**
+ *  Attach the given in-kernel packet filter to the socket; any previously attached filter is replaced.
+ *  @return 0 if successful, -1 in case of an error or if socket filters are not supported on this host
+ */
+int SpeedwireSocket::setFilter(const SpeedwireSocketFilter& filter) {
+    if (socket_fd < 0) {
+        return -1;
+    }
+    return filter.attach(socket_fd);
+}
+
+
 /**
  *  Close socket
  */
@@ -182,7 +221,7 @@ int SpeedwireSocket::closeSocket(void) {
 /**
  *  Open socket for the given interface described in ipv4 dot notation (e.g. "192.168.178.1")
  */
-int SpeedwireSocket::openSocketV4(const std::string &local_interface_address, const bool multicast) {
+int SpeedwireSocket::openSocketV4(const std::string &local_interface_address, const bool multicast, const uint16_t port) {
 
     // convert the given interface address to socket structs
     socket_interface_v4 = AddressConversion::toInAddress(local_interface_address);
@@ -206,6 +245,12 @@ int SpeedwireSocket::openSocketV4(const std::string &local_interface_address, co
     int result2 = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuseaddr, sizeof(reuseaddr));
 #else
     int result2 = 0;
+#endif
+#ifdef SO_TIMESTAMPNS
+    // ask the kernel to provide the packet arrival time with each received packet; it is read by recvmmsg()
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (const char*)&reuseaddr, sizeof(reuseaddr)) < 0) {
+        perror("setsockopt(SO_TIMESTAMPNS) failure");
+    }
 #endif
     int result3 = setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl, sizeof(ttl));
 #if 0
@@ -228,11 +273,7 @@ int SpeedwireSocket::openSocketV4(const std::string &local_interface_address, co
     saddr.sin_family = AF_INET;
     //saddr.sin_addr.s_addr = htonl(INADDR_ANY);  // receive udp unicast and multicast traffic directed to port below
     saddr.sin_addr = socket_interface_v4;         // receive udp unicast and multicast traffic directed to port below
-    if (multicast == true) {
-        saddr.sin_port = htons(speedwire_port_9522);
-    } else {
-        saddr.sin_port = 0;                       // let the OS choose an available port
-    }
+    saddr.sin_port = htons(port);                 // if 0, let the OS choose an available port
 #ifdef __APPLE__
     saddr.sin_len = sizeof(struct sockaddr_in);
 #endif
@@ -325,7 +366,7 @@ int SpeedwireSocket::openSocketV4(const std::string &local_interface_address, co
 /**
  *  Open socket for the given interface described in ipv6 interface in : notation
  */
-int SpeedwireSocket::openSocketV6(const std::string &local_interface_address, const bool multicast) {
+int SpeedwireSocket::openSocketV6(const std::string &local_interface_address, const bool multicast, const uint16_t port) {
 
     // convert the given interface address to socket structs
     socket_interface_v6 = AddressConversion::toIn6Address(local_interface_address);
@@ -350,6 +391,12 @@ int SpeedwireSocket::openSocketV6(const std::string &local_interface_address, co
     int result2 = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuseaddr, sizeof(reuseaddr));
 #else
     int result2 = 0;
+#endif
+#ifdef SO_TIMESTAMPNS
+    // ask the kernel to provide the packet arrival time with each received packet; it is read by recvmmsg()
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, (const char*)&reuseaddr, sizeof(reuseaddr)) < 0) {
+        perror("setsockopt(SO_TIMESTAMPNS) failure");
+    }
 #endif
     int result3 = setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char*)&hops, sizeof(hops));
 #if 0
@@ -372,12 +419,7 @@ int SpeedwireSocket::openSocketV6(const std::string &local_interface_address, co
     saddr.sin6_family = AF_INET6;
     //memcpy(&saddr.sin6_addr, &IN6_ADDRESS_ANY, sizeof(IN6_ADDRESS_ANY));  // receive udp traffic directed to port below
     saddr.sin6_addr = socket_interface_v6;
-    if (multicast == true) {
-        saddr.sin6_port = speedwire_multicast_address_v6.sin6_port;
-    }
-    else {
-        saddr.sin6_port = 0; // let the OS choose an available port
-    }
+    saddr.sin6_port = htons(port);  // if 0, let the OS choose an available port
 #ifdef __APPLE__
     saddr.sin6_len = sizeof(struct sockaddr_in6);
 #endif
@@ -441,6 +483,10 @@ int SpeedwireSocket::recvfrom(const void *buff, const size_t buff_size, struct s
         if (error == WSAEWOULDBLOCK) {  // this is by design, as we are using non-blocking io sockets
             return 0;
         }
+#else
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {  // non-blocking sockets, e.g. if registered with SpeedwireEventLoop
+            return 0;
+        }
 #endif
         perror("recvfrom failure");
     }
@@ -469,6 +515,10 @@ int SpeedwireSocket::recvfrom(const void *buff, const size_t buff_size, struct s
         if (error == WSAEWOULDBLOCK) {  // this is by design, as we are using non-blocking io sockets
             return 0;
         }
+#else
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {  // non-blocking sockets, e.g. if registered with SpeedwireEventLoop
+            return 0;
+        }
 #endif
         perror("recvfrom failure");
     }
@@ -482,6 +532,182 @@ int SpeedwireSocket::recvfrom(const void *buff, const size_t buff_size, struct s
     return nbytes;
 }
 
+/**
+ *  Receive a batch of udp packets from the socket and also provide the source addresses of the senders.
+ *  The packets are stored into consecutive buffer slots, each slot_size bytes long.
+ *  @param buffs Pointer to max_packets consecutive buffer slots
+ *  @param slot_size Size of each buffer slot in bytes
+ *  @param max_packets Maximum number of packets to receive; it is limited to max_recv_batch_size
+ *  @param nbytes Pointer to an array of max_packets entries receiving the packet size of each received packet
+ *  @param srcs Pointer to an array of max_packets entries receiving the sender address of each received packet
+ *  @param arrival_times_in_ns Optional pointer to an array of max_packets entries receiving the arrival time of each received packet
+ *  @return the number of received packets, 0 if no packet was available, or -1 in case of an error
+ */
+int SpeedwireSocket::recvmmsg(void* buffs, const size_t slot_size, const int max_packets, int* nbytes, struct sockaddr_storage* srcs, uint64_t* arrival_times_in_ns) const {
+    void* buff_ptrs[max_recv_batch_size];
+    struct sockaddr_storage* src_ptrs[max_recv_batch_size];
+    const int n = (max_packets < max_recv_batch_size ? max_packets : max_recv_batch_size);
+    for (int i = 0; i < n; ++i) {
+        buff_ptrs[i] = (uint8_t*)buffs + i * slot_size;
+        src_ptrs[i] = &srcs[i];
+    }
+    return recvmmsg(buff_ptrs, slot_size, n, nbytes, src_ptrs, arrival_times_in_ns);
+}
+
+
+/**
+ *  Receive a batch of udp packets from the socket into the given buffers and also provide the source addresses of the senders.
+ *  On linux this is implemented by a single non-blocking recvmmsg() call; on all other platforms it falls back to a
+ *  single recvfrom() call and thus receives at most one packet.
+ *  Packet arrival times are taken from the kernel receive timestamp (SO_TIMESTAMPNS) where available; otherwise, or if
+ *  the timestamp is missing, the current unix epoch time is used.
+ *  @param buffs Pointer to an array of max_packets buffer pointers
+ *  @param buff_size Size of each buffer in bytes
+ *  @param max_packets Maximum number of packets to receive; it is limited to max_recv_batch_size
+ *  @param nbytes Pointer to an array of max_packets entries receiving the packet size of each received packet
+ *  @param srcs Pointer to an array of max_packets pointers to socket addresses receiving the sender address of each received packet
+ *  @param arrival_times_in_ns Optional pointer to an array of max_packets entries receiving the arrival time of each received packet
+ *  @return the number of received packets, 0 if no packet was available, or -1 in case of an error
+ */
+int SpeedwireSocket::recvmmsg(void* const* buffs, const size_t buff_size, const int max_packets, int* nbytes, struct sockaddr_storage* const* srcs, uint64_t* arrival_times_in_ns) const {
+    if (max_packets <= 0) {
+        return 0;
+    }
+#if defined(__linux__)
+    struct mmsghdr msgs[max_recv_batch_size];
+    struct iovec   iovs[max_recv_batch_size];
+#ifdef SO_TIMESTAMPNS
+    union { struct cmsghdr align; uint8_t buff[CMSG_SPACE(sizeof(struct timespec))]; } controls[max_recv_batch_size];
+#endif
+    const int n = (max_packets < max_recv_batch_size ? max_packets : max_recv_batch_size);
+
+    memset(msgs, 0, n * sizeof(struct mmsghdr));
+    for (int i = 0; i < n; ++i) {
+        iovs[i].iov_base = buffs[i];
+        iovs[i].iov_len  = buff_size;
+        msgs[i].msg_hdr.msg_name    = srcs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        msgs[i].msg_hdr.msg_iov     = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen  = 1;
+#ifdef SO_TIMESTAMPNS
+        if (arrival_times_in_ns != NULL) {
+            msgs[i].msg_hdr.msg_control    = controls[i].buff;
+            msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buff);
+        }
+#endif
+    }
+
+    // receive whatever is queued in the socket, but do not wait for further packets
+    int npackets = ::recvmmsg(socket_fd, msgs, n, MSG_DONTWAIT, NULL);
+    if (npackets < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        perror("recvmmsg failure");
+        return -1;
+    }
+    for (int i = 0; i < npackets; ++i) {
+        nbytes[i] = (int)msgs[i].msg_len;
+    }
+    if (arrival_times_in_ns != NULL) {
+        uint64_t now = 0;
+        for (int i = 0; i < npackets; ++i) {
+            arrival_times_in_ns[i] = 0;
+#ifdef SO_TIMESTAMPNS
+            for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                    struct timespec ts;
+                    memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                    arrival_times_in_ns[i] = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+                    break;
+                }
+            }
+#endif
+            // fall back to the user space clock if the kernel did not provide a timestamp
+            if (arrival_times_in_ns[i] == 0) {
+                if (now == 0) now = LocalHost::getUnixEpochTimeInNs();
+                arrival_times_in_ns[i] = now;
+            }
+        }
+    }
+    return npackets;
+#else
+    int result = -1;
+    if (isIpv4()) {
+        result = recvfrom(buffs[0], buff_size, (struct sockaddr_in&)*srcs[0]);
+    }
+    else if (isIpv6()) {
+        result = recvfrom(buffs[0], buff_size, (struct sockaddr_in6&)*srcs[0]);
+    }
+    if (result <= 0) {
+        return result;
+    }
+    nbytes[0] = result;
+    if (arrival_times_in_ns != NULL) {
+        arrival_times_in_ns[0] = LocalHost::getUnixEpochTimeInNs();
+    }
+    return 1;
+#endif
+}
+
+
+/**
+ *  Send a batch of udp packets, each to its own ipv4 or ipv6 unicast destination address.
+ *  On linux this is implemented by sendmmsg() calls, each sending up to max_send_batch_size packets; on all other platforms,
+ *  and if any destination is a multicast address, it falls back to one sendto() call for each packet.
+ *  @param buffs Pointer to an array of npackets buffer pointers
+ *  @param sizes Pointer to an array of npackets packet sizes in bytes
+ *  @param dests Pointer to an array of npackets pointers to destination socket addresses
+ *  @param npackets Number of packets to send
+ *  @return the number of packets sent; packets are sent in order, i.e. the first n packets have been sent. -1 if no packet could be sent.
+ */
+int SpeedwireSocket::sendmmsg(const void* const* buffs, const unsigned long* sizes, const struct sockaddr_storage* const* dests, const int npackets) const {
+    if (npackets <= 0) {
+        return 0;
+    }
+#if defined(__linux__)
+    // multicast destinations need per packet socket options
+    bool unicast = true;
+    for (int i = 0; i < npackets && unicast == true; ++i) {
+        const struct sockaddr_storage& dest = *dests[i];
+        unicast = ((dest.ss_family == AF_INET  && !IN_MULTICAST(ntohl(((const struct sockaddr_in&)dest).sin_addr.s_addr))) ||
+                   (dest.ss_family == AF_INET6 && !IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6&)dest).sin6_addr)));
+    }
+    if (unicast == true) {
+        struct mmsghdr msgs[max_send_batch_size];
+        struct iovec   iovs[max_send_batch_size];
+        int nsent = 0;
+        while (nsent < npackets) {
+            const int n = (npackets - nsent < max_send_batch_size ? npackets - nsent : max_send_batch_size);
+            memset(msgs, 0, n * sizeof(struct mmsghdr));
+            for (int i = 0; i < n; ++i) {
+                const struct sockaddr_storage* dest = dests[nsent + i];
+                iovs[i].iov_base = (void*)buffs[nsent + i];
+                iovs[i].iov_len  = sizes[nsent + i];
+                msgs[i].msg_hdr.msg_name    = (void*)dest;
+                msgs[i].msg_hdr.msg_namelen = (dest->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6));
+                msgs[i].msg_hdr.msg_iov     = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen  = 1;
+            }
+            // sendmmsg may send fewer packets than requested; continue with the first unsent packet
+            int result = ::sendmmsg(socket_fd, msgs, n, 0);
+            if (result <= 0) {
+                perror("sendmmsg failure");
+                return (nsent > 0 ? nsent : -1);
+            }
+            nsent += result;
+        }
+        return nsent;
+    }
+#endif
+    for (int i = 0; i < npackets; ++i) {
+        if (sendto(buffs[i], sizes[i], (const struct sockaddr&)*dests[i]) < 0) {
+            return (i > 0 ? i : -1);
+        }
+    }
+    return npackets;
+}
+
 
 /**
  *  Send udp multicast packet to the speedwire multicast address
@@ -1,3 +1,4 @@
+#include <thread>
 #include <SpeedwireSocketFactory.hpp>
 using namespace libspeedwire;
 
@@ -40,10 +41,71 @@ SpeedwireSocketFactory* SpeedwireSocketFactory::getInstance(const LocalHost& loc
 }
 
 
+/**
+ * Singleton get instance method using the given strategy for obtaining sockets from the operating system; the given
+ * in-kernel packet filter is attached to each receive socket, such that unwanted packets are dropped by the kernel.
+ * @param localhost Reference to a LocalHost instance.
+ * @param strategy The strategy to use for obtaining sockets from the OS.
+ * @param filter The packet filter, e.g. SpeedwireSocketFilter::getDefaultFilter().
+ */
+SpeedwireSocketFactory* SpeedwireSocketFactory::getInstance(const LocalHost& localhost, const SocketStrategy strategy, const SpeedwireSocketFilter& filter) {
+    if (instance == NULL) {
+        instance = new SpeedwireSocketFactory(localhost, strategy, &filter, 0);
+    }
+    return instance;
+}
+
+
+/**
+ * Singleton get instance method using the given strategy for obtaining sockets from the operating system and the given
+ * number of shards for strategy SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE.
+ * @param localhost Reference to a LocalHost instance.
+ * @param strategy The strategy to use for obtaining sockets from the OS.
+ * @param number_of_shards The number of shards; if 0, the number of hardware threads is used.
+ * @param filter Pointer to the packet filter attached to each receive socket, or NULL.
+ */
+SpeedwireSocketFactory* SpeedwireSocketFactory::getInstance(const LocalHost& localhost, const SocketStrategy strategy, const unsigned int number_of_shards, const SpeedwireSocketFilter* const filter) {
+    if (instance == NULL) {
+        instance = new SpeedwireSocketFactory(localhost, strategy, filter, number_of_shards);
+    }
+    return instance;
+}
+
+
 /**
  * Non-public constructor - depending on the strategy, a set of sockets is created and opened.
  */
-SpeedwireSocketFactory::SpeedwireSocketFactory(const LocalHost& _localhost, const SocketStrategy _strategy) : localhost(_localhost), strategy(_strategy) {
+SpeedwireSocketFactory::SpeedwireSocketFactory(const LocalHost& _localhost, const SocketStrategy _strategy) :
+    SpeedwireSocketFactory(_localhost, _strategy, NULL, 0) {
+}
+
+
+/**
+ * Non-public constructor - depending on the strategy, a set of sockets is created and opened; if a packet filter is given,
+ * it is attached to each receive socket.
+ */
+SpeedwireSocketFactory::SpeedwireSocketFactory(const LocalHost& _localhost, const SocketStrategy _strategy, const SpeedwireSocketFilter* const filter, const unsigned int _number_of_shards) :
+    localhost(_localhost), strategy(_strategy), use_socket_filter(filter != NULL), number_of_shards(0) {
+    if (filter != NULL) {
+        socket_filter = *filter;
+    }
+    if (strategy == SocketStrategy::SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE) {
+        number_of_shards = (_number_of_shards > 0 ? _number_of_shards : std::thread::hardware_concurrency());
+#ifndef SO_REUSEPORT
+        number_of_shards = 1;   // without SO_REUSEPORT, only a single socket can be bound to the speedwire port
+#endif
+        if (number_of_shards == 0) {
+            number_of_shards = 1;
+        }
+    }
+    openSockets();
+}
+
+
+/**
+ * Depending on the strategy, create and open a set of sockets and register all receive sockets with the event loop.
+ */
+void SpeedwireSocketFactory::openSockets(void) {
 
     if (strategy == SocketStrategy::ONE_SOCKET_FOR_EACH_INTERFACE) {
         // create one socket for each local interface address; this works for windows hosts
@@ -63,6 +125,21 @@ SpeedwireSocketFactory::SpeedwireSocketFactory(const LocalHost& _localhost, cons
         // create one unicast socket for each local interface address
         openSocketForEachInterface((SocketDirection::SEND | SocketDirection::RECV), SocketType::UNICAST);
     }
+    else if (strategy == SocketStrategy::SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE) {
+        // create one unicast socket for each local interface address
+        openSocketForEachInterface((SocketDirection::SEND | SocketDirection::RECV), SocketType::UNICAST);
+        // create a single socket for multicast
+        openSocketForSingleInterface((SocketDirection::SEND | SocketDirection::RECV), (SocketType::MULTICAST | SocketType::UNICAST), "0.0.0.0");
+        // create a group of sharded receive sockets for each local interface address
+        openShardedSocketsForEachInterface();
+    }
+
+    // register all receive sockets with the event loop; sharded sockets are waited on by their shard
+    for (auto& entry : sockets) {
+        if ((entry.direction & SocketDirection::RECV) != 0 && entry.shard < 0) {
+            event_loop.registerSocket(entry.socket);
+        }
+    }
 }
 
 
@@ -71,6 +148,7 @@ SpeedwireSocketFactory::SpeedwireSocketFactory(const LocalHost& _localhost, cons
  */
 SpeedwireSocketFactory::~SpeedwireSocketFactory(void) {
     for (auto& entry : sockets) {
+        event_loop.unregisterSocket(entry.socket);
         entry.socket.closeSocket();
     }
     sockets.clear();
@@ -87,9 +165,13 @@ bool SpeedwireSocketFactory::openSocketForSingleInterface(const SocketDirection
         perror("cannot open recv socket instance");
         return false;
     }
+    if (use_socket_filter && (direction & SocketDirection::RECV) != 0) {
+        entry.socket.setFilter(socket_filter);
+    }
     entry.direction = direction;
     entry.type = type;
     entry.interface_address = interface_address;
+    entry.interface_id = SpeedwireInterfaceID(localhost, interface_address);
     sockets.push_back(entry);
     return true;
 }
@@ -112,15 +194,71 @@ bool SpeedwireSocketFactory::openSocketForEachInterface(const SocketDirection di
 }
 
 
+/**
+ *  Open a group of SO_REUSEPORT receive sockets bound to the speedwire port for each local interface, one socket for each shard.
+ *  A reuseport program is attached to each group, such that packets are distributed by a hash of their source ip address.
+ */
+bool SpeedwireSocketFactory::openShardedSocketsForEachInterface(void) {
+    bool result = true;
+    const std::vector<std::string>& localIPs = localhost.getLocalIPv4Addresses();
+    for (auto& local_ip : localIPs) {
+        if (openShardedSocketsForSingleInterface(local_ip, SpeedwireSocket::speedwire_port_9522) == false) {
+            result = false;
+        }
+    }
+    return result;
+}
+
+
+/**
+ *  Open a group of SO_REUSEPORT receive sockets bound to the given port of the given local interface, one socket for each shard.
+ */
+bool SpeedwireSocketFactory::openShardedSocketsForSingleInterface(const std::string& local_ip, const uint16_t port) {
+    int first_fd = -1;
+    for (unsigned int shard = 0; shard < number_of_shards; ++shard) {
+        SocketEntry entry(localhost);
+        if (entry.socket.openSocket(local_ip, false, port) < 0) {
+            perror("cannot open sharded recv socket instance");
+            return false;
+        }
+        if (use_socket_filter) {
+            entry.socket.setFilter(socket_filter);
+        }
+        if (first_fd < 0) {
+            first_fd = entry.socket.getSocketFd();
+        }
+        entry.direction = SocketDirection::RECV;
+        entry.type = SocketType::UNICAST;
+        entry.interface_address = local_ip;
+        entry.interface_id = SpeedwireInterfaceID(localhost, local_ip);
+        entry.shard = (int)shard;
+        sockets.push_back(entry);
+    }
+    // sockets are indexed by the order they have been bound to the port, i.e. by their shard index
+    if (first_fd >= 0 && number_of_shards > 1) {
+        SpeedwireSocketFilter::attachReusePortHash(first_fd, false, number_of_shards);
+    }
+    return true;
+}
+
+
 /**
  *  Get a suitable socket for sending to the given interface ip address.
  */
 SpeedwireSocket& SpeedwireSocketFactory::getSendSocket(const SocketType type, const std::string& if_addr) {
+    return getSendSocket(type, SpeedwireInterfaceID(localhost, if_addr));
+}
+
+
+/**
+ *  Get a suitable socket for sending to the given interface.
+ */
+SpeedwireSocket& SpeedwireSocketFactory::getSendSocket(const SocketType type, const SpeedwireInterfaceID& if_id) {
     // first try to find an interface specific socket
-    if (if_addr != "0.0.0.0") {
+    if (if_id.isAny() == false) {
         for (auto& entry : sockets) {
             if ((entry.direction & SocketDirection::SEND) != 0 && (entry.type & type) == type) {
-                if (entry.interface_address == if_addr) {
+                if (entry.interface_id == if_id) {
                     return entry.socket;
                 }
             }
@@ -129,7 +267,7 @@ SpeedwireSocket& SpeedwireSocketFactory::getSendSocket(const SocketType type, co
     // try to find an INADDR_ANY socket
     for (auto& entry : sockets) {
         if ((entry.direction & SocketDirection::SEND) != 0 && (entry.type & type) == type) {
-            if (entry.interface_address == "0.0.0.0") {
+            if (entry.interface_id.isAny()) {
                 return entry.socket;
             }
         }
@@ -143,19 +281,27 @@ SpeedwireSocket& SpeedwireSocketFactory::getSendSocket(const SocketType type, co
  *  Get a suitable socket for receiving from the given interface ip address.
  */
 SpeedwireSocket& SpeedwireSocketFactory::getRecvSocket(const SocketType type, const std::string& if_addr) {
-    if (if_addr != "0.0.0.0") {
+    return getRecvSocket(type, SpeedwireInterfaceID(localhost, if_addr));
+}
+
+
+/**
+ *  Get a suitable socket for receiving from the given interface.
+ */
+SpeedwireSocket& SpeedwireSocketFactory::getRecvSocket(const SocketType type, const SpeedwireInterfaceID& if_id) {
+    if (if_id.isAny() == false) {
         // first try to find an interface and cast specific socket
         for (auto& entry : sockets) {
-            if ((entry.direction & SocketDirection::RECV) != 0 && (entry.type & type) == type) {
-                if (entry.interface_address == if_addr) {
+            if ((entry.direction & SocketDirection::RECV) != 0 && entry.shard < 0 && (entry.type & type) == type) {
+                if (entry.interface_id == if_id) {
                     return entry.socket;
                 }
             }
         }
         // then try to find an interface specific socket
         for (auto& entry : sockets) {
-            if ((entry.direction & SocketDirection::RECV) != 0 && (entry.type & type) != 0) {
-                if (entry.interface_address == if_addr) {
+            if ((entry.direction & SocketDirection::RECV) != 0 && entry.shard < 0 && (entry.type & type) != 0) {
+                if (entry.interface_id == if_id) {
                     return entry.socket;
                 }
             }
@@ -163,8 +309,8 @@ SpeedwireSocket& SpeedwireSocketFactory::getRecvSocket(const SocketType type, co
     }
     // try to find an INADDR_ANY socket
     for (auto& entry : sockets) {
-        if ((entry.direction & SocketDirection::RECV) != 0 && (entry.type & type) == type) {
-            if (entry.interface_address == "0.0.0.0") {
+        if ((entry.direction & SocketDirection::RECV) != 0 && entry.shard < 0 && (entry.type & type) == type) {
+            if (entry.interface_id.isAny()) {
                 return entry.socket;
             }
         }
@@ -180,7 +326,8 @@ SpeedwireSocket& SpeedwireSocketFactory::getRecvSocket(const SocketType type, co
  */
 std::vector<SpeedwireSocket> SpeedwireSocketFactory::getRecvSockets(const SocketType type, const std::vector<std::string>& if_addresses) {
     std::vector<SpeedwireSocket> recv_sockets;
-    if ((type & SocketType::MULTICAST) == type && strategy == SocketStrategy::ONE_MULTICAST_SOCKET_AND_ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE) {
+    if ((type & SocketType::MULTICAST) == type && (strategy == SocketStrategy::ONE_MULTICAST_SOCKET_AND_ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE ||
+                                                   strategy == SocketStrategy::SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE)) {
         SpeedwireSocket& socket = getRecvSocket(SocketType::MULTICAST, "0.0.0.0");
         recv_sockets.push_back(socket);
         return recv_sockets;
@@ -232,3 +379,35 @@ std::vector<SpeedwireSocket> SpeedwireSocketFactory::getRecvSockets(const Socket
     }
     return recv_sockets;
 }
+
+
+/**
+ * Get the event loop shared by all users of the sockets created by this factory. All receive sockets are registered
+ * with the event loop; further sockets are registered lazily when they are first waited on.
+ */
+SpeedwireEventLoop& SpeedwireSocketFactory::getEventLoop(void) {
+    return event_loop;
+}
+
+
+/**
+ * Get the number of shards; this is 0 unless the strategy is SHARDED_UNICAST_SOCKETS_FOR_EACH_INTERFACE.
+ */
+unsigned int SpeedwireSocketFactory::getNumberOfShards(void) const {
+    return number_of_shards;
+}
+
+
+/**
+ * Get the sharded receive sockets of the given shard, one socket for each local interface. The sockets are not registered
+ * with the shared event loop; they are meant to be waited on by a separate event loop for each shard.
+ */
+std::vector<SpeedwireSocket> SpeedwireSocketFactory::getShardRecvSockets(const unsigned int shard) {
+    std::vector<SpeedwireSocket> recv_sockets;
+    for (auto& entry : sockets) {
+        if (entry.shard >= 0 && (unsigned int)entry.shard == shard) {
+            recv_sockets.push_back(entry.socket);
+        }
+    }
+    return recv_sockets;
+}
@@ -0,0 +1,322 @@
+#ifdef _WIN32
+#include <Winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+#if defined(__linux__)
+#include <linux/filter.h>
+#endif
+
+#include <cstdio>
+#include <Logger.hpp>
+#include <SpeedwireHeader.hpp>
+#include <SpeedwireTagHeader.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireSocketFilter.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireSocketFilter");
+
+// classic bpf opcodes, see linux/bpf_common.h; they are defined here to allow compilation on any host
+static const uint16_t bpf_ld_w_abs  = 0x00 | 0x00 | 0x20;   // BPF_LD  | BPF_W   | BPF_ABS
+static const uint16_t bpf_ld_h_abs  = 0x00 | 0x08 | 0x20;   // BPF_LD  | BPF_H   | BPF_ABS
+static const uint16_t bpf_jmp_jeq_k = 0x05 | 0x10 | 0x00;   // BPF_JMP | BPF_JEQ | BPF_K
+static const uint16_t bpf_ret_k     = 0x06 | 0x00;          // BPF_RET | BPF_K
+static const uint16_t bpf_ret_a     = 0x06 | 0x10;          // BPF_RET | BPF_A
+static const uint16_t bpf_alu_rsh_k = 0x04 | 0x70 | 0x00;   // BPF_ALU | BPF_RSH | BPF_K
+static const uint16_t bpf_alu_xor_x = 0x04 | 0xa0 | 0x08;   // BPF_ALU | BPF_XOR | BPF_X
+static const uint16_t bpf_alu_mod_k = 0x04 | 0x90 | 0x00;   // BPF_ALU | BPF_MOD | BPF_K
+static const uint16_t bpf_misc_tax  = 0x07 | 0x00;          // BPF_MISC | BPF_TAX
+static const uint32_t bpf_net_off   = (uint32_t)-0x100000;  // SKF_NET_OFF, negative offsets address the network header
+
+// the filter program sees the packet starting with the udp header
+static const uint32_t udp_header_length       = 8;
+static const uint32_t sma_signature           = 0x534d4100;                                                 // "SMA\0"
+static const uint32_t data2_tag_offset        = 4 + SpeedwireTagHeader::TAG_HEADER_LENGTH + 4;              // behind the signature and the group id tag
+static const uint32_t protocol_offset         = data2_tag_offset + SpeedwireTagHeader::TAG_HEADER_LENGTH;   // behind the data2 tag header
+static const uint32_t emeter_payload_offset   = protocol_offset + 2;                                        // behind the protocol id
+static const uint32_t inverter_payload_offset = protocol_offset + 4;                                        // behind the protocol id, long words and control byte
+static const uint32_t emeter_serial_offset    = 2;                                                          // behind the susy id
+static const uint32_t inverter_serial_offset  = 10;                                                         // behind dst susy id, dst serial, dst control and src susy id
+static const uint32_t accept_packet           = 0xffffffff;
+static const uint32_t reject_packet           = 0;
+
+
+/**
+ *  Helper class to assemble a bpf program with forward jumps to symbolic labels.
+ */
+class BpfAssembler {
+public:
+    static const int next = -1;                     // jump target denoting the next instruction
+    std::vector<SpeedwireSocketFilter::Instruction> program;
+    std::vector<int> jump_true;                     // label of the jump true target for each instruction
+    std::vector<int> jump_false;                    // label of the jump false target for each instruction
+    std::vector<int> labels;                        // instruction index for each label
+
+    int  newLabel(void) { labels.push_back(-1); return (int)labels.size() - 1; }
+    void setLabel(const int label) { labels[label] = (int)program.size(); }
+    void emit(const uint16_t code, const uint32_t k, const int jt = next, const int jf = next) {
+        SpeedwireSocketFilter::Instruction instruction = { code, 0, 0, k };
+        program.push_back(instruction);
+        jump_true.push_back(jt);
+        jump_false.push_back(jf);
+    }
+
+    // resolve labels into relative jump offsets; classic bpf supports forward jumps of up to 255 instructions
+    bool resolve(void) {
+        for (size_t i = 0; i < program.size(); ++i) {
+            int offsets[2] = { 0, 0 };
+            const int targets[2] = { jump_true[i], jump_false[i] };
+            for (int j = 0; j < 2; ++j) {
+                if (targets[j] != next) {
+                    offsets[j] = labels[targets[j]] - (int)i - 1;
+                    if (offsets[j] < 0 || offsets[j] > 255) {
+                        return false;
+                    }
+                }
+            }
+            program[i].jt = (uint8_t)offsets[0];
+            program[i].jf = (uint8_t)offsets[1];
+        }
+        return true;
+    }
+};
+
+
+/**
+ *  Constructor - creates a filter accepting all speedwire packets, i.e. data2 packets of any protocol id and discovery packets.
+ */
+SpeedwireSocketFilter::SpeedwireSocketFilter(void) :
+    accept_discovery(true) {
+}
+
+
+/**
+ *  Get a filter accepting discovery packets and the emeter, extended emeter, inverter and encryption protocol ids.
+ */
+SpeedwireSocketFilter SpeedwireSocketFilter::getDefaultFilter(void) {
+    SpeedwireSocketFilter filter;
+    filter.addProtocolID(SpeedwireData2Packet::sma_emeter_protocol_id);
+    filter.addProtocolID(SpeedwireData2Packet::sma_extended_emeter_protocol_id);
+    filter.addProtocolID(SpeedwireData2Packet::sma_inverter_protocol_id);
+    filter.addProtocolID(SpeedwireData2Packet::sma_encryption_protocol_id);
+    return filter;
+}
+
+
+/**
+ *  Add a protocol id to the set of accepted protocol ids.
+ */
+void SpeedwireSocketFilter::addProtocolID(const uint16_t protocol_id) {
+    for (auto& id : protocol_ids) {
+        if (id == protocol_id) return;
+    }
+    protocol_ids.push_back(protocol_id);
+}
+
+
+/**
+ *  Add a serial number to the set of accepted source serial numbers.
+ */
+void SpeedwireSocketFilter::addSerialNumber(const uint32_t serial_number) {
+    for (auto& serial : serial_numbers) {
+        if (serial == serial_number) return;
+    }
+    serial_numbers.push_back(serial_number);
+}
+
+
+/**
+ *  Configure whether SMA packets without a data2 tag, i.e. discovery packets, are accepted.
+ */
+void SpeedwireSocketFilter::setAcceptDiscoveryPackets(const bool accept) {
+    accept_discovery = accept;
+}
+
+
+/**
+ *  Get the offset of the source serial number from the start of the speedwire packet for the given protocol id.
+ *  @param protocol_id The protocol id
+ *  @param little_endian Reference to a flag receiving the byte order of the serial number
+ *  @return the offset, or -1 if packets of this protocol id do not carry a source serial number at a fixed offset
+ */
+int SpeedwireSocketFilter::getSerialNumberOffset(const uint16_t protocol_id, bool& little_endian) {
+    little_endian = false;
+    switch (protocol_id) {
+    case SpeedwireData2Packet::sma_emeter_protocol_id:
+        return (int)(emeter_payload_offset + emeter_serial_offset);
+    case SpeedwireData2Packet::sma_extended_emeter_protocol_id:
+        return (int)(inverter_payload_offset + emeter_serial_offset);
+    case SpeedwireData2Packet::sma_inverter_protocol_id:
+        little_endian = true;
+        return (int)(inverter_payload_offset + inverter_serial_offset);
+    }
+    return -1;
+}
+
+
+/**
+ *  Compile the filter into a classic bpf program.
+ *  @param program Reference to a vector receiving the bpf instructions
+ *  @return true if successful, false if the filter is too large to be expressed by forward jumps
+ */
+bool SpeedwireSocketFilter::compile(std::vector<Instruction>& program) const {
+    BpfAssembler bpf;
+    const int reject = bpf.newLabel();
+    const int not_data2 = bpf.newLabel();
+
+    // check the SMA signature and the data2 tag id
+    bpf.emit(bpf_ld_w_abs, udp_header_length);
+    bpf.emit(bpf_jmp_jeq_k, sma_signature, BpfAssembler::next, reject);
+    bpf.emit(bpf_ld_h_abs, udp_header_length + data2_tag_offset + 2);
+    bpf.emit(bpf_jmp_jeq_k, SpeedwireTagHeader::sma_tag_data2, BpfAssembler::next, not_data2);
+
+    if (protocol_ids.size() == 0) {
+        bpf.emit(bpf_ret_k, accept_packet);
+    }
+    else {
+        // check the protocol id; each protocol id jumps to its own serial number check block
+        std::vector<int> blocks;
+        bpf.emit(bpf_ld_h_abs, udp_header_length + protocol_offset);
+        for (auto& id : protocol_ids) {
+            blocks.push_back(bpf.newLabel());
+            bpf.emit(bpf_jmp_jeq_k, id, blocks.back(), BpfAssembler::next);
+        }
+        bpf.emit(bpf_ret_k, reject_packet);
+
+        for (size_t i = 0; i < protocol_ids.size(); ++i) {
+            bool little_endian = false;
+            int serial_offset = getSerialNumberOffset(protocol_ids[i], little_endian);
+            bpf.setLabel(blocks[i]);
+            if (serial_numbers.size() == 0 || serial_offset < 0) {
+                bpf.emit(bpf_ret_k, accept_packet);
+                continue;
+            }
+            // bpf loads are big endian, so compare little endian serial numbers in swapped byte order
+            const int block_accept = bpf.newLabel();
+            bpf.emit(bpf_ld_w_abs, udp_header_length + (uint32_t)serial_offset);
+            for (auto& serial : serial_numbers) {
+                uint32_t value = serial;
+                if (little_endian) {
+                    value = ((serial & 0xff) << 24) | ((serial & 0xff00) << 8) | ((serial >> 8) & 0xff00) | (serial >> 24);
+                }
+                bpf.emit(bpf_jmp_jeq_k, value, block_accept, BpfAssembler::next);
+            }
+            bpf.emit(bpf_ret_k, reject_packet);
+            bpf.setLabel(block_accept);
+            bpf.emit(bpf_ret_k, accept_packet);
+        }
+    }
+
+    // SMA packets without a data2 tag
+    bpf.setLabel(not_data2);
+    bpf.emit(bpf_ret_k, (accept_discovery ? accept_packet : reject_packet));
+    bpf.setLabel(reject);
+    bpf.emit(bpf_ret_k, reject_packet);
+
+    if (bpf.resolve() == false) {
+        logger.print(LogLevel::LOG_ERROR, "filter too large - %lu protocol ids, %lu serial numbers\n", (unsigned long)protocol_ids.size(), (unsigned long)serial_numbers.size());
+        return false;
+    }
+    program.swap(bpf.program);
+    return true;
+}
+
+
+/**
+ *  Compile the filter and attach it to the given socket; any previously attached filter is replaced.
+ *  @param socket_fd The socket file descriptor
+ *  @return 0 if successful, -1 in case of an error or if socket filters are not supported on this host
+ */
+int SpeedwireSocketFilter::attach(const int socket_fd) const {
+#if defined(__linux__)
+    std::vector<Instruction> program;
+    if (compile(program) == false) {
+        return -1;
+    }
+    struct sock_fprog fprog;
+    fprog.len = (unsigned short)program.size();
+    fprog.filter = (struct sock_filter*)&program[0];
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+        perror("setsockopt(SO_ATTACH_FILTER) failure");
+        return -1;
+    }
+    return 0;
+#else
+    logger.print(LogLevel::LOG_WARNING, "socket filters are not supported on this host\n");
+    return -1;
+#endif
+}
+
+
+/**
+ *  Detach any filter from the given socket.
+ *  @param socket_fd The socket file descriptor
+ *  @return 0 if successful, -1 in case of an error or if socket filters are not supported on this host
+ */
+int SpeedwireSocketFilter::detach(const int socket_fd) {
+#if defined(__linux__)
+    int dummy = 0;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)) < 0) {
+        perror("setsockopt(SO_DETACH_FILTER) failure");
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+
+/**
+ *  Compile a SO_ATTACH_REUSEPORT_CBPF program selecting the socket of a SO_REUSEPORT group by a hash of the source ip address.
+ *  For ipv6, the hash is calculated from the last 4 bytes of the source address.
+ *  @param program Reference to a vector receiving the bpf instructions
+ *  @param ipv6 True if the sockets of the group are ipv6 sockets
+ *  @param number_of_sockets Number of sockets in the socket group
+ *  @return true if successful, false if the number of sockets is 0
+ */
+bool SpeedwireSocketFilter::compileReusePortHash(std::vector<Instruction>& program, const bool ipv6, const unsigned int number_of_sockets) {
+    if (number_of_sockets == 0) {
+        return false;
+    }
+    BpfAssembler bpf;
+    bpf.emit(bpf_ld_w_abs, bpf_net_off + (ipv6 ? 20 : 12));     // source ip address, or its last 4 bytes for ipv6
+    bpf.emit(bpf_misc_tax, 0);
+    bpf.emit(bpf_alu_rsh_k, 16);                                 // fold the upper half onto the lower half
+    bpf.emit(bpf_alu_xor_x, 0);
+    bpf.emit(bpf_alu_mod_k, number_of_sockets);
+    bpf.emit(bpf_ret_a, 0);                                      // return the index of the socket in the group
+    bpf.resolve();
+    program.swap(bpf.program);
+    return true;
+}
+
+
+/**
+ *  Compile and attach a SO_ATTACH_REUSEPORT_CBPF program to the given socket; the program applies to the entire SO_REUSEPORT
+ *  socket group the socket belongs to. Sockets are indexed in the order they have been bound to the port.
+ *  @param socket_fd The socket file descriptor
+ *  @param ipv6 True if the sockets of the group are ipv6 sockets
+ *  @param number_of_sockets Number of sockets in the socket group
+ *  @return 0 if successful, -1 in case of an error or if reuseport programs are not supported on this host
+ */
+int SpeedwireSocketFilter::attachReusePortHash(const int socket_fd, const bool ipv6, const unsigned int number_of_sockets) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    std::vector<Instruction> program;
+    if (compileReusePortHash(program, ipv6, number_of_sockets) == false) {
+        return -1;
+    }
+    struct sock_fprog fprog;
+    fprog.len = (unsigned short)program.size();
+    fprog.filter = (struct sock_filter*)&program[0];
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &fprog, sizeof(fprog)) < 0) {
+        perror("setsockopt(SO_ATTACH_REUSEPORT_CBPF) failure");
+        return -1;
+    }
+    return 0;
+#else
+    logger.print(LogLevel::LOG_WARNING, "reuseport programs are not supported on this host\n");
+    return -1;
+#endif
+}
@@ -0,0 +1,331 @@
+#ifdef _WIN32
+#include <Winsock2.h>
+#include <Ws2tcpip.h>
+#define poll(a, b, c)  WSAPoll((a), (b), (c))
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#endif
+
+#include <chrono>
+#include <AddressConversion.hpp>
+#include <Logger.hpp>
+#include <SpeedwireThreadedReceiveDispatcher.hpp>
+using namespace libspeedwire;
+
+static Logger logger("SpeedwireThreadedReceiveDispatcher");
+
+
+/**
+ * Constructor of the reader state.
+ */
+SpeedwireThreadedReceiveDispatcher::ReaderContext::ReaderContext(const SpeedwireSocket& _socket, const size_t queue_size) :
+    socket(_socket),
+    pool(queue_size),
+    queue(queue_size),
+    consumer(NULL),
+    received(0),
+    dropped(0),
+    blocked(false) {
+    for (auto& counter : invalid) {
+        counter = 0;
+    }
+}
+
+
+/**
+ * Constructor.
+ * @param localhost Reference to the LocalHost instance
+ * @param queue_size Number of packet buffers for each socket
+ * @param num_consumer_threads Number of consumer threads; each socket is assigned to one of them in a round robin fashion
+ * @param policy Behaviour of a reader thread if all of its packet slots are in use
+ */
+SpeedwireThreadedReceiveDispatcher::SpeedwireThreadedReceiveDispatcher(LocalHost& _localhost, const size_t _queue_size, const int _num_consumer_threads, const OverflowPolicy policy) :
+    SpeedwireReceiveDispatcher(_localhost),
+    queue_size(_queue_size > 0 ? _queue_size : 1),
+    num_consumer_threads(_num_consumer_threads > 0 ? _num_consumer_threads : 1),
+    overflow_policy(policy),
+    running(false) {}
+
+
+/**
+ * Destructor. Stops all threads.
+ */
+SpeedwireThreadedReceiveDispatcher::~SpeedwireThreadedReceiveDispatcher(void) {
+    stop();
+}
+
+
+/**
+ * Start one reader thread for each of the given sockets and the configured number of consumer threads.
+ * All receivers must be registered before the threads are started.
+ * @param sockets Reference to an array of sockets
+ * @return true if the threads were started, false if they are already running
+ */
+bool SpeedwireThreadedReceiveDispatcher::start(const std::vector<SpeedwireSocket>& sockets) {
+    if (running == true) {
+        return false;
+    }
+    readers.clear();
+    consumers.clear();
+    for (int i = 0; i < num_consumer_threads && i < (int)sockets.size(); ++i) {
+        consumers.push_back(std::unique_ptr<ConsumerContext>(new ConsumerContext()));
+    }
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        ReaderContext* reader = new ReaderContext(sockets[i], queue_size);
+        reader->consumer = consumers[i % consumers.size()].get();
+        reader->consumer->readers.push_back(reader);
+        readers.push_back(std::unique_ptr<ReaderContext>(reader));
+    }
+    running = true;
+    for (auto& consumer : consumers) {
+        consumer->thread = std::thread(&SpeedwireThreadedReceiveDispatcher::consumerThread, this, std::ref(*consumer));
+    }
+    for (auto& reader : readers) {
+        reader->thread = std::thread(&SpeedwireThreadedReceiveDispatcher::readerThread, this, std::ref(*reader));
+    }
+    return true;
+}
+
+
+/**
+ * Stop all threads and wait for them to terminate. Packets still queued are discarded.
+ */
+void SpeedwireThreadedReceiveDispatcher::stop(void) {
+    if (running == false) {
+        return;
+    }
+    running = false;
+    for (auto& reader : readers) {
+        if (reader->thread.joinable()) {
+            reader->thread.join();
+        }
+    }
+    for (auto& consumer : consumers) {
+        {
+            std::lock_guard<std::mutex> lock(consumer->mutex);
+            consumer->condition.notify_all();
+        }
+        if (consumer->thread.joinable()) {
+            consumer->thread.join();
+        }
+    }
+}
+
+
+/**
+ * Get the total number of packets received by all reader threads, including dropped packets.
+ */
+uint64_t SpeedwireThreadedReceiveDispatcher::getNumberOfReceivedPackets(void) const {
+    uint64_t result = 0;
+    for (auto& reader : readers) {
+        result += reader->received;
+    }
+    return result;
+}
+
+
+/**
+ * Get the total number of packets dropped by all reader threads, as no packet buffer was available.
+ */
+uint64_t SpeedwireThreadedReceiveDispatcher::getNumberOfDroppedPackets(void) const {
+    uint64_t result = 0;
+    for (auto& reader : readers) {
+        result += reader->dropped;
+    }
+    return result;
+}
+
+
+/**
+ * Get the total number of packets dropped for the given reason; packets dropped as no packet buffer was available
+ * are counted as buffer overflows.
+ */
+uint64_t SpeedwireThreadedReceiveDispatcher::getNumberOfDroppedPackets(const DropReason reason) const {
+    uint64_t result = 0;
+    for (auto& reader : readers) {
+        result += reader->invalid[(size_t)reason];
+        if (reason == DropReason::BUFFER_OVERFLOW) {
+            result += reader->dropped;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * Get the receive statistics of the given socket.
+ * @param socket Reference to the socket
+ * @return the receive statistics; all counters are 0 if the socket is not served by a reader thread
+ */
+SpeedwireReceiveDispatcher::SocketStatistics SpeedwireThreadedReceiveDispatcher::getSocketStatistics(const SpeedwireSocket& socket) const {
+    SocketStatistics statistics;
+    for (auto& reader : readers) {
+        if (reader->socket.getSocketFd() == socket.getSocketFd()) {
+            statistics.received += reader->received;
+            for (size_t i = 0; i < (size_t)DropReason::NUMBER_OF_REASONS; ++i) {
+                statistics.dropped[i] += reader->invalid[i];
+            }
+            statistics.dropped[(size_t)DropReason::BUFFER_OVERFLOW] += reader->dropped;
+        }
+    }
+    return statistics;
+}
+
+
+/**
+ * Reader thread - waits for packets on its socket and drains it into packet buffers taken from its pool. Received
+ * packets are handed over to the consumer thread; the consumer thread is woken up if it is waiting for packets.
+ */
+void SpeedwireThreadedReceiveDispatcher::readerThread(ReaderContext& reader) {
+    SpeedwirePacketBuffer overflow_buffer;
+    ConsumerContext& consumer = *reader.consumer;
+
+    struct pollfd pfd;
+    pfd.fd = reader.socket.getSocketFd();
+
+    while (running == true) {
+
+        // wait for packets, but check the running flag periodically
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int pollresult = poll(&pfd, 1, 100);
+        if (pollresult < 0) {
+            perror("poll failure");
+            break;
+        }
+        if (pollresult == 0 || (pfd.revents & POLLIN) == 0) {
+            continue;
+        }
+
+        // drain the socket; recvmmsg() never blocks, even if the socket is a blocking socket
+        int npackets = 0;
+        while (running == true) {
+            SpeedwirePacketHandle packet = reader.pool.allocate();
+            void* buff = overflow_buffer.data;
+            struct sockaddr_storage* src = &overflow_buffer.src;
+            int nbytes = 0;
+            uint64_t arrival_time = 0;
+            if (packet.isValid() == true) {
+                buff = packet.getData();
+                src = &packet.getSrcStorage();
+            }
+            else if (overflow_policy == OverflowPolicy::BLOCK) {
+                wakeupConsumer(consumer);
+                waitForFreeBuffers(reader);
+                continue;
+            }
+            if (reader.socket.recvmmsg(&buff, max_udp_packet_size, 1, &nbytes, &src, &arrival_time) <= 0) {
+                break;
+            }
+            ++reader.received;
+            if (packet.isValid() == false) {
+                ++reader.dropped;
+                continue;
+            }
+            packet.setSize(nbytes);
+            packet.setArrivalTimeInNs(arrival_time);
+            reader.queue.push(std::move(packet));   // cannot fail, the queue is as large as the pool
+            ++npackets;
+        }
+
+        // wake up the consumer if it is waiting for packets
+        if (npackets > 0) {
+            wakeupConsumer(consumer);
+        }
+    }
+}
+
+
+/**
+ * Wake up the given consumer thread, if it is waiting for packets.
+ */
+void SpeedwireThreadedReceiveDispatcher::wakeupConsumer(ConsumerContext& consumer) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer.sleeping == true) {
+        std::lock_guard<std::mutex> lock(consumer.mutex);
+        consumer.condition.notify_one();
+    }
+}
+
+
+/**
+ * Wake up the given reader thread, if it is waiting for free packet buffers.
+ */
+void SpeedwireThreadedReceiveDispatcher::wakeupReader(ReaderContext& reader) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (reader.blocked == true) {
+        std::lock_guard<std::mutex> lock(reader.mutex);
+        reader.condition.notify_one();
+    }
+}
+
+
+/**
+ * Wait until the pool of the given reader has free packet buffers. The consumer wakes up the reader after it has
+ * dispatched packets; the timeout covers packet buffers retained by receivers and released later from other threads.
+ */
+void SpeedwireThreadedReceiveDispatcher::waitForFreeBuffers(ReaderContext& reader) {
+    std::unique_lock<std::mutex> lock(reader.mutex);
+    reader.blocked = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (reader.pool.getNumberOfFreeBuffers() == 0 && running == true) {
+        reader.condition.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    reader.blocked = false;
+}
+
+
+/**
+ * Check if any of the readers served by the given consumer has packets queued.
+ */
+bool SpeedwireThreadedReceiveDispatcher::hasPendingPackets(const ConsumerContext& consumer) {
+    for (auto& reader : consumer.readers) {
+        if (reader->queue.isEmpty() == false) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Consumer thread - takes packets from the queues of its readers, checks and dispatches them to the registered
+ * receivers and releases the packet buffers. If there are no packets, it waits until a reader wakes it up.
+ */
+void SpeedwireThreadedReceiveDispatcher::consumerThread(ConsumerContext& consumer) {
+    while (running == true) {
+        bool idle = true;
+
+        for (auto& reader : consumer.readers) {
+            SpeedwirePacketHandle packet;
+            bool released = false;
+            while (reader->queue.pop(packet) == true) {
+                DropReason reason = DropReason::NUMBER_OF_REASONS;
+                if (dispatchPacket(packet, reason) < 0) {
+                    ++reader->invalid[(size_t)reason];
+                }
+                packet.reset();
+                released = true;
+                idle = false;
+            }
+            // wake up the reader if it is waiting for free packet buffers
+            if (released == true) {
+                wakeupReader(*reader);
+            }
+        }
+
+        // wait for packets; the timeout is just a safety net, readers wake up the consumer when they queue packets
+        if (idle == true) {
+            std::unique_lock<std::mutex> lock(consumer.mutex);
+            consumer.sleeping = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (hasPendingPackets(consumer) == false && running == true) {
+                consumer.condition.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            consumer.sleeping = false;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <CalculatedValueProcessor.hpp>
+#include <ObisFilter.hpp>
+
+using namespace libspeedwire;
+
+// producer recording the serial numbers, measurement types and values it receives
+class RecordingProducer : public Producer {
+public:
+    struct Value { uint32_t serial; Quantity quantity; Wire wire; double value; };
+    std::vector<Value> values;
+
+    virtual void flush(void) {}
+    virtual void produce(const SpeedwireDevice& device, const MeasurementType& type, const Wire wire, const double value, const uint32_t time_in_ms) {
+        Value v = { device.deviceAddress.serialNumber, type.quantity, wire, value };
+        values.push_back(v);
+    }
+
+    // get the most recent value produced for the given device and wire, or -1 if there is none
+    double find(const uint32_t serial, const Wire wire) const {
+        for (auto it = values.rbegin(); it != values.rend(); ++it) {
+            if (it->serial == serial && it->wire == wire) {
+                return it->value;
+            }
+        }
+        return -1.0;
+    }
+
+    // get the most recent value produced for the given device, quantity and wire, or -1 if there is none
+    double find(const uint32_t serial, const Quantity quantity, const Wire wire) const {
+        for (auto it = values.rbegin(); it != values.rend(); ++it) {
+            if (it->serial == serial && it->quantity == quantity && it->wire == wire) {
+                return it->value;
+            }
+        }
+        return -1.0;
+    }
+};
+
+// consume a single obis value of the given device
+static void consume(ObisFilter& filter, const SpeedwireDevice& device, const ObisType& type, const uint32_t value, const uint32_t time) {
+    std::array<uint8_t, 12> bytes = type.toByteArray();
+    SpeedwireEmeterProtocol::setObisValue4(bytes.data(), value);
+    filter.consume(device, bytes.data(), time);
+}
+
+// test that signed power values are calculated from the obis values of the originating device
+TEST(CalculatedValueProcessorTest, SignedPowerPerDevice) {
+    ObisFilter filter;
+    filter.addFilter(std::vector<ObisData>({ ObisData::PositiveActivePowerL1, ObisData::NegativeActivePowerL1, ObisData::SignedActivePowerL1 }));
+    SpeedwireDataMap speedwire_map;
+    RecordingProducer producer;
+    CalculatedValueProcessor processor(filter, speedwire_map, producer);
+    filter.addConsumer(processor);
+
+    SpeedwireDevice device1, device2;
+    device1.deviceAddress = SpeedwireAddress(349, 1901234567);
+    device2.deviceAddress = SpeedwireAddress(349, 1901234568);
+
+    // device 1 draws power from the grid, device 2 feeds power into the grid; the packets interleave
+    for (uint32_t time = 1000; time <= 3000; time += 1000) {
+        consume(filter, device1, ObisData::PositiveActivePowerL1, 1000, time);
+        consume(filter, device1, ObisData::NegativeActivePowerL1, 0, time);
+        consume(filter, device2, ObisData::PositiveActivePowerL1, 0, time);
+        consume(filter, device2, ObisData::NegativeActivePowerL1, 500, time);
+        filter.endOfObisData(device1, time);
+        ASSERT_DOUBLE_EQ(producer.find(device1.deviceAddress.serialNumber, ObisData::SignedActivePowerL1.wire), 100.0);
+        filter.endOfObisData(device2, time);
+        ASSERT_DOUBLE_EQ(producer.find(device2.deviceAddress.serialNumber, ObisData::SignedActivePowerL1.wire), -50.0);
+    }
+
+    // the signed values are kept per device, the registered instances are left untouched
+    ASSERT_DOUBLE_EQ(filter.getFilter(device1.deviceAddress, ObisData::SignedActivePowerL1)->measurementValues.getNewestElement().value, 100.0);
+    ASSERT_DOUBLE_EQ(filter.getFilter(device2.deviceAddress, ObisData::SignedActivePowerL1)->measurementValues.getNewestElement().value, -50.0);
+    ASSERT_EQ(filter.getFilter().find(ObisData::SignedActivePowerL1.toKey())->second.measurementValues.getNumberOfElements(), 0);
+    ASSERT_EQ(filter.getFilter(SpeedwireAddress(349, 1901234569), ObisData::SignedActivePowerL1), (ObisData*)NULL);
+}
+
+// test that signed power values are calculated from measurements in raw storage mode
+TEST(CalculatedValueProcessorTest, RawStorage) {
+    std::vector<ObisData> entries({ ObisData::PositiveActivePowerL1, ObisData::NegativeActivePowerL1, ObisData::SignedActivePowerL1 });
+    for (auto& entry : entries) {
+        entry.setRawStorage(4);
+    }
+    ObisFilter filter;
+    filter.addFilter(entries);
+    SpeedwireDataMap speedwire_map;
+    RecordingProducer producer;
+    CalculatedValueProcessor processor(filter, speedwire_map, producer);
+    filter.addConsumer(processor);
+
+    SpeedwireDevice device;
+    device.deviceAddress = SpeedwireAddress(349, 1901234567);
+    for (uint32_t time = 1000; time <= 4000; time += 1000) {
+        consume(filter, device, ObisData::PositiveActivePowerL1, 1000 + time / 100, time);
+        consume(filter, device, ObisData::NegativeActivePowerL1, 5, time);
+        filter.endOfObisData(device, time);
+    }
+
+    // the mean of 100.5, 101.5, 102.5 and 103.5 W
+    ASSERT_DOUBLE_EQ(producer.find(device.deviceAddress.serialNumber, ObisData::SignedActivePowerL1.wire), 102.0);
+    const ObisData* sig = filter.getFilter(device.deviceAddress, ObisData::SignedActivePowerL1);
+    ASSERT_EQ(sig->rawMeasurementValues.getNumberOfElements(), 4);
+    ASSERT_DOUBLE_EQ(sig->getNewestMeasurement().value, 103.5);
+    ASSERT_EQ(sig->getNewestMeasurement().time, 4000);
+}
+
+// test that instances constructed from an obis data map calculate signed power values from this map
+TEST(CalculatedValueProcessorTest, ObisDataMap) {
+    ObisDataMap obis_map(std::vector<ObisData>({ ObisData::PositiveActivePowerL1, ObisData::NegativeActivePowerL1, ObisData::SignedActivePowerL1 }));
+    SpeedwireDataMap speedwire_map;
+    RecordingProducer producer;
+    CalculatedValueProcessor processor(obis_map, speedwire_map, producer);
+
+    SpeedwireDevice device;
+    device.deviceAddress = SpeedwireAddress(349, 1901234567);
+    obis_map.find(ObisData::PositiveActivePowerL1.toKey())->second.addMeasurement((uint32_t)1000, 1000);
+    obis_map.find(ObisData::NegativeActivePowerL1.toKey())->second.addMeasurement((uint32_t)250, 1000);
+    processor.endOfObisData(device, 1000);
+    ASSERT_DOUBLE_EQ(producer.find(device.deviceAddress.serialNumber, ObisData::SignedActivePowerL1.wire), 75.0);
+    ASSERT_DOUBLE_EQ(obis_map.find(ObisData::SignedActivePowerL1.toKey())->second.getNewestMeasurement().value, 75.0);
+}
+
+// test that household power is calculated from the configured emeter device, independent of the packet arrival order
+TEST(CalculatedValueProcessorTest, HouseholdEmeter) {
+    ObisFilter filter;
+    filter.addFilter(std::vector<ObisData>({ ObisData::PositiveActivePowerTotal, ObisData::NegativeActivePowerTotal }));
+    SpeedwireDataMap speedwire_map;
+    RecordingProducer producer;
+    CalculatedValueProcessor processor(filter, speedwire_map, producer);
+    filter.addConsumer(processor);
+
+    SpeedwireDevice emeter1, emeter2, inverter;
+    emeter1.deviceAddress = SpeedwireAddress(349, 1901234567);
+    emeter2.deviceAddress = SpeedwireAddress(349, 1901234568);
+    inverter.deviceAddress = SpeedwireAddress(378, 3000000000u);
+    const uint32_t household_serial = 0xcafebabe;
+
+    const uint32_t time = (uint32_t)LocalHost::getUnixEpochTimeInMs();
+    consume(filter, emeter1, ObisData::PositiveActivePowerTotal, 10000, time);
+    consume(filter, emeter1, ObisData::NegativeActivePowerTotal, 0, time);
+    filter.endOfObisData(emeter1, time);
+    consume(filter, emeter2, ObisData::PositiveActivePowerTotal, 5000, time);
+    consume(filter, emeter2, ObisData::NegativeActivePowerTotal, 0, time);
+    filter.endOfObisData(emeter2, time);
+
+    // by default, the most recent emeter device is used
+    processor.endOfSpeedwireData(inverter, time / 1000);
+    ASSERT_DOUBLE_EQ(producer.find(household_serial, SpeedwireData::HouseholdPowerTotal.measurementType.quantity, SpeedwireData::HouseholdPowerTotal.wire), 500.0);
+
+    // the configured emeter device is used, even if it is not the most recent one
+    processor.setHouseholdEmeter(emeter1.deviceAddress);
+    processor.endOfSpeedwireData(inverter, time / 1000);
+    ASSERT_DOUBLE_EQ(producer.find(household_serial, SpeedwireData::HouseholdPowerTotal.measurementType.quantity, SpeedwireData::HouseholdPowerTotal.wire), 1000.0);
+    filter.endOfObisData(emeter2, time);
+    processor.endOfSpeedwireData(inverter, time / 1000);
+    ASSERT_DOUBLE_EQ(producer.find(household_serial, SpeedwireData::HouseholdPowerTotal.measurementType.quantity, SpeedwireData::HouseholdPowerTotal.wire), 1000.0);
+}
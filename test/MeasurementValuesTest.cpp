@@ -481,3 +481,64 @@ TEST(MeasurementValuesTest, Capacity3_estimateLinearRegressionDown) {
     ASSERT_EQ(variance, 1.0);
     EXPECT_DOUBLE_EQ(slope, -1.0);
 }
+
+// test raw measurement values - scaling on read, integer sums and rebasing
+TEST(MeasurementValuesTest, RawMeasurementValues) {
+    ASSERT_EQ(sizeof(TimestampRawPair) * 2, sizeof(TimestampDoublePair));
+
+    RawMeasurementValues rv(3, 10);
+    ASSERT_EQ(rv.getMaximumNumberOfElements(), 3);
+    ASSERT_EQ(rv.getNewestMeasurement().time, TimestampDoublePair::defaultPair.time);
+    ASSERT_EQ(rv.estimateMean(), 0.0);
+
+    rv.addMeasurement(10, 1000);
+    rv.addMeasurement(20, 2000);
+    rv.addMeasurement(30, 3000);
+    rv.addMeasurement(40, 4000);
+    ASSERT_EQ(rv.getNumberOfElements(), 3);
+    ASSERT_EQ(rv.getRawValue(0), 20);
+    ASSERT_EQ(rv.getValue(2), 4.0);
+    ASSERT_EQ(rv.getNewestMeasurement().value, 4.0);
+    ASSERT_EQ(rv.getNewestMeasurement().time, 4000);
+    ASSERT_EQ(rv.estimateMean(), 3.0);
+    ASSERT_EQ(rv.estimateMean(1, 2), 3.5);
+
+    double mean, variance;
+    rv.estimateMeanAndVariance(0, 2, mean, variance);
+    ASSERT_EQ(mean, 3.0);
+    ASSERT_EQ(variance, 1.0);
+
+    // the same values as floating point measurements
+    MeasurementValues mv(0);
+    rv.toMeasurementValues(mv);
+    ASSERT_EQ(mv.getMaximumNumberOfElements(), 3);
+    ASSERT_EQ(mv.getNumberOfElements(), 3);
+    ASSERT_EQ(mv.at(0).value, 2.0);
+    ASSERT_EQ(mv.at(0).time, 2000);
+    ASSERT_EQ(mv.estimateMean(), rv.estimateMean());
+
+    // large uint64 energy counters are rebased and stay exact
+    RawMeasurementValues ev(4, 3600000);
+    const int64_t energy = 0x0000123456789abcll;
+    ev.addMeasurement(energy, 1000);
+    ev.addMeasurement(energy + 0x7fffffffll, 2000);
+    ev.addMeasurement(energy + 0xffffffffll, 3000);
+    ASSERT_EQ(ev.getNumberOfElements(), 3);
+    ASSERT_EQ(ev.getRawValue(0), energy);
+    ASSERT_EQ(ev.getRawValue(1), energy + 0x7fffffffll);
+    ASSERT_EQ(ev.getRawValue(2), energy + 0xffffffffll);
+    ASSERT_DOUBLE_EQ(ev.estimateMean(), (energy + (0x7fffffffll + 0xffffffffll) / 3.0) / 3600000.0);
+
+    // squares of centered values beyond 32 bits do not overflow
+    ev.estimateMeanAndVariance(0, 2, mean, variance);
+    const double y_mean = (0x7fffffffll + 0xffffffffll) / 3.0;
+    const double y_var = ((0.0 - y_mean) * (0.0 - y_mean) + (0x7fffffffll - y_mean) * (0x7fffffffll - y_mean) + (0xffffffffll - y_mean) * (0xffffffffll - y_mean)) / 2.0;
+    ASSERT_DOUBLE_EQ(mean, (energy + y_mean) / 3600000.0);
+    ASSERT_NEAR(variance, y_var / (3600000.0 * 3600000.0), 1e-9 * y_var / (3600000.0 * 3600000.0));
+
+    // values too far apart to be rebased drop the older values
+    ev.addMeasurement(energy + 0x200000000ll, 4000);
+    ASSERT_EQ(ev.getNumberOfElements(), 1);
+    ASSERT_EQ(ev.getRawValue(0), energy + 0x200000000ll);
+    ASSERT_EQ(ev.getNewestMeasurement().time, 4000);
+}
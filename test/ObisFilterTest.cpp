@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <ObisFilter.hpp>
+
+using namespace libspeedwire;
+
+// consumer recording the serial numbers and values it receives
+class RecordingObisConsumer : public ObisConsumer {
+public:
+    std::vector<uint32_t> serials;
+    std::vector<double> values;
+    virtual void consume(const SpeedwireDevice& device, ObisData& element) {
+        serials.push_back(device.deviceAddress.serialNumber);
+        values.push_back(element.measurementValues.getNewestElement().value);
+    }
+    virtual void endOfObisData(const SpeedwireDevice& device, const uint32_t timestamp) {}
+};
+
+// test that measurements of different devices are kept apart
+TEST(ObisFilterTest, PerDevice) {
+    ObisFilter filter;
+    ObisData power = ObisData::PositiveActivePowerTotal;
+    power.measurementValues.setMaximumNumberOfElements(4);
+    filter.addFilter(power);
+    RecordingObisConsumer consumer;
+    filter.addConsumer(consumer);
+
+    std::array<uint8_t, 12> bytes = ObisData::PositiveActivePowerTotal.toByteArray();
+    SpeedwireDevice device1, device2;
+    device1.deviceAddress = SpeedwireAddress(349, 1901234567);
+    device2.deviceAddress = SpeedwireAddress(349, 1901234568);
+    ASSERT_EQ(filter.getFilter(device1.deviceAddress), (std::vector<ObisData>*)NULL);
+    for (uint32_t i = 0; i < 6; ++i) {
+        SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 100 + i);
+        ASSERT_TRUE(filter.consume(device1, bytes.data(), i));
+        SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 200 + i);
+        ASSERT_TRUE(filter.consume(device2, bytes.data(), i));
+    }
+    ASSERT_EQ(filter.getNumberOfDevices(), 2);
+    ASSERT_EQ(consumer.serials.size(), 12);
+    ASSERT_EQ(consumer.serials[10], 1901234567u);
+    ASSERT_DOUBLE_EQ(consumer.values[10], 10.5);
+    ASSERT_DOUBLE_EQ(consumer.values[11], 20.5);
+
+    // each device holds its own ring buffer with the capacity of the registered instance
+    ASSERT_EQ(filter.getFilter(device1.deviceAddress)->size(), 1);
+    const MeasurementValues& values1 = filter.filter(device1, power)->measurementValues;
+    const MeasurementValues& values2 = filter.filter(device2, power)->measurementValues;
+    ASSERT_EQ(values1.getMaximumNumberOfElements(), 4);
+    ASSERT_EQ(values1.getNumberOfElements(), 4);
+    ASSERT_DOUBLE_EQ(values1.getNewestElement().value, 10.5);
+    ASSERT_DOUBLE_EQ(values2.getNewestElement().value, 20.5);
+    ASSERT_EQ(filter.getFilter().begin()->second.measurementValues.getNumberOfElements(), 0);
+
+    // elements added later are added to all devices
+    filter.addFilter(ObisData::Frequency);
+    ASSERT_EQ(filter.getFilter(device2.deviceAddress)->size(), 2);
+    ASSERT_TRUE(filter.filter(device2, ObisData::Frequency)->equals(ObisData::Frequency));
+    ASSERT_DOUBLE_EQ(filter.filter(device2, power)->measurementValues.getNewestElement().value, 20.5);
+    filter.removeFilter(ObisData::Frequency);
+    ASSERT_EQ(filter.getFilter(device2.deviceAddress)->size(), 1);
+    ASSERT_EQ(filter.filter(device2, ObisData::Frequency), (ObisData*)NULL);
+    ASSERT_EQ(filter.filter(device2, power)->measurementValues.getNumberOfElements(), 4);
+}
+
+// test the device lookup with many devices
+TEST(ObisFilterTest, ManyDevices) {
+    ObisFilter filter;
+    filter.addFilter(ObisData::PositiveActivePowerTotal);
+    std::array<uint8_t, 12> bytes = ObisData::PositiveActivePowerTotal.toByteArray();
+    SpeedwireDevice device;
+    for (int round = 0; round < 2; ++round) {
+        for (uint32_t serial = 1; serial <= 5000; ++serial) {
+            device.deviceAddress = SpeedwireAddress(349, 1900000000 + serial);
+            SpeedwireEmeterProtocol::setObisValue4(bytes.data(), serial);
+            ASSERT_TRUE(filter.consume(device, bytes.data(), round));
+        }
+    }
+    ASSERT_EQ(filter.getNumberOfDevices(), 5000);
+    for (uint32_t serial = 1; serial <= 5000; serial += 499) {
+        std::vector<ObisData>* entries = filter.getFilter(SpeedwireAddress(349, 1900000000 + serial));
+        ASSERT_NE(entries, (std::vector<ObisData>*)NULL);
+        ASSERT_EQ((*entries)[0].measurementValues.getNewestElement().time, 1);
+        ASSERT_DOUBLE_EQ((*entries)[0].measurementValues.getNewestElement().value, serial / 10.0);
+    }
+    ASSERT_EQ(filter.getFilter(SpeedwireAddress(372, 1900000001)), (std::vector<ObisData>*)NULL);
+}
+
+// test the perfect hash table with the obis keys of all predefined elements
+TEST(ObisFilterTest, KeyTable) {
+    ObisKeyTable empty;
+    ASSERT_EQ(empty.size(), 0);
+    ASSERT_EQ(empty.find(ObisData::Frequency.toKey()), -1);
+
+    std::vector<uint32_t> keys;
+    for (const auto& entry : ObisData::getAllPredefined()) {
+        keys.push_back(entry.toKey());
+    }
+    ObisKeyTable table;
+    ASSERT_TRUE(table.build(keys));
+    ASSERT_EQ(table.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(table.find(keys[i]), (int)i);
+    }
+    ASSERT_EQ(table.find(ObisType(0, 15, 4, 0).toKey()), -1);
+    ASSERT_EQ(table.find(ObisType(144, 1, 0, 0).toKey()), -1);
+
+    // duplicate keys cannot be hashed perfectly
+    keys.push_back(keys.front());
+    ASSERT_FALSE(table.build(keys));
+}
+
+// test that raw storage is kept by the per-device copies and read through the measurement accessors
+TEST(ObisFilterTest, RawStorage) {
+    ObisFilter filter;
+    ObisData power = ObisData::PositiveActivePowerTotal;
+    power.measurementValues.setMaximumNumberOfElements(16);
+    filter.addFilter(power);
+    power.setRawStorage(8);
+    ASSERT_EQ(power.measurementValues.getMaximumNumberOfElements(), 0);
+
+    std::array<uint8_t, 12> bytes = ObisData::PositiveActivePowerTotal.toByteArray();
+    SpeedwireDevice device;
+    device.deviceAddress = SpeedwireAddress(349, 1901234567);
+    for (uint32_t i = 0; i < 4; ++i) {
+        SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 1000 + i);
+        ASSERT_TRUE(filter.consume(device, bytes.data(), 100 * i));
+    }
+    ASSERT_EQ(filter.filter(device, power)->measurementValues.getMaximumNumberOfElements(), 16);
+
+    // switching the registered instance to raw storage releases the floating point ring buffers of the device
+    filter.addFilter(power);
+    for (uint32_t i = 0; i < 4; ++i) {
+        SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 1000 + i);
+        ASSERT_TRUE(filter.consume(device, bytes.data(), 100 * i));
+    }
+    const ObisData* entry = filter.filter(device, power);
+    ASSERT_TRUE(entry->rawStorage);
+    ASSERT_EQ(entry->measurementValues.getMaximumNumberOfElements(), 0);
+    ASSERT_EQ(entry->measurementValues.getNumberOfElements(), 0);
+    ASSERT_EQ(entry->rawMeasurementValues.getMaximumNumberOfElements(), 8);
+    ASSERT_EQ(entry->rawMeasurementValues.getNumberOfElements(), 4);
+    ASSERT_EQ(entry->rawMeasurementValues.getRawValue(3), 1003);
+    ASSERT_DOUBLE_EQ(entry->getNewestMeasurement().value, 100.3);
+    ASSERT_EQ(entry->getNewestMeasurement().time, 300);
+    ASSERT_DOUBLE_EQ(entry->estimateMean(), 100.15);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <AddressConversion.hpp>
+#include <SpeedwireAuthentication.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireSocketFactory.hpp>
+
+using namespace libspeedwire;
+
+static SpeedwireDevice makeDevice(const uint32_t serial, const std::string& ip_address) {
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 378;
+    device.deviceAddress.serialNumber = serial;
+    device.deviceIpAddress = ip_address;
+    device.interfaceIpAddress = "127.0.0.1";
+    return device;
+}
+
+// get the session of the given device
+static const SpeedwireAuthentication::LoginSession* getSession(const SpeedwireAuthentication& authentication, const SpeedwireDevice& device) {
+    for (auto& session : authentication.getSessions()) {
+        if (session.address == device.deviceAddress) {
+            return &session;
+        }
+    }
+    return NULL;
+}
+
+// inject a login reply of the given device into the authentication; the packet id is taken from the device's pending session
+static bool reply(SpeedwireAuthentication& authentication, const SpeedwireDevice& device, const uint16_t error_code) {
+    uint8_t buff[24 + 8 + 8 + 6 + 4 + 4 + 4 + 4 + 12 + 4];
+    memset(buff, 0, sizeof(buff));
+    SpeedwireHeader header(buff, sizeof(buff));
+    header.setDefaultHeader(1, (uint16_t)(sizeof(buff) - 20), SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireData2Packet(header).setControl(0xa0);
+    SpeedwireInverterProtocol inverter(header);
+    inverter.setDstSusyID(SpeedwireAddress::getLocalAddress().susyID);
+    inverter.setDstSerialNumber(SpeedwireAddress::getLocalAddress().serialNumber);
+    inverter.setSrcSusyID(device.deviceAddress.susyID);
+    inverter.setSrcSerialNumber(device.deviceAddress.serialNumber);
+    inverter.setErrorCode(error_code);
+    inverter.setPacketID(getSession(authentication, device)->packet_id & 0x7fff);
+    inverter.setCommandID(Command::LOGIN | Command::QUERY_RESPONSE);
+
+    struct sockaddr_in src;
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_port = htons(SpeedwireSocket::speedwire_port_9522);
+    src.sin_addr = AddressConversion::toInAddress(device.deviceIpAddress);
+    return authentication.handleLoginReply(header, AddressConversion::toSockAddr(src));
+}
+
+// test the session state machine of concurrent logins; only sessions that lapsed, failed or are about to expire are logged in again
+TEST(SpeedwireAuthenticationTest, LoginSessions) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireSocketFactory::getInstance(host);
+
+    const std::vector<SpeedwireDevice> devices = { makeDevice(3000000200u, "127.0.0.20"), makeDevice(3000000201u, "127.0.0.21"), makeDevice(3000000202u, "127.0.0.22") };
+    SpeedwireAuthentication authentication(host, devices);
+    const Credentials credentials(UserCode::USER, "0000");
+
+    // all devices are sent a login request at once
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 3);
+    ASSERT_EQ(authentication.getSessions().size(), 3);
+    ASSERT_EQ(authentication.getTokenRepository().size(), 3);
+    for (auto& device : devices) {
+        ASSERT_EQ(getSession(authentication, device)->state, SpeedwireAuthentication::SessionState::PENDING);
+    }
+
+    // pending sessions are not sent another request
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 0);
+
+    // replies resolve their sessions; a reply from an unexpected ip address or a repeated reply is ignored
+    SpeedwireDevice wrong_ip = devices[0];
+    wrong_ip.deviceIpAddress = "127.0.0.23";
+    ASSERT_FALSE(reply(authentication, wrong_ip, 0x0000));
+    ASSERT_TRUE(reply(authentication, devices[0], 0x0000));
+    ASSERT_FALSE(reply(authentication, devices[0], 0x0000));
+    ASSERT_TRUE(reply(authentication, devices[1], 0x0100));
+    ASSERT_TRUE(authentication.isAuthenticated(devices[0].deviceAddress));
+    ASSERT_FALSE(authentication.isAuthenticated(devices[1].deviceAddress));
+    ASSERT_EQ(getSession(authentication, devices[1])->state, SpeedwireAuthentication::SessionState::FAILED);
+    ASSERT_EQ(getSession(authentication, devices[1])->error_code, 0x0100);
+
+    // unanswered requests expire
+    ASSERT_EQ(authentication.expireLoginRequests(0), 1);
+    ASSERT_EQ(getSession(authentication, devices[2])->state, SpeedwireAuthentication::SessionState::FAILED);
+    ASSERT_EQ(authentication.getTokenRepository().size(), 0);
+
+    // only failed sessions are logged in again
+    uint16_t packet_id = getSession(authentication, devices[0])->packet_id;
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 2);
+    ASSERT_EQ(getSession(authentication, devices[0])->packet_id, packet_id);
+    ASSERT_TRUE(reply(authentication, devices[1], 0x0000));
+    ASSERT_TRUE(reply(authentication, devices[2], 0x0000));
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 0);
+
+    // devices that replied with error code 0x0017 are handed over by the token repository and logged in again
+    authentication.getTokenRepository().setNeedsLogin(devices[1].deviceAddress);
+    ASSERT_TRUE(authentication.getTokenRepository().needs_login);
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 1);
+    ASSERT_EQ(getSession(authentication, devices[1])->state, SpeedwireAuthentication::SessionState::PENDING);
+    ASSERT_TRUE(authentication.getTokenRepository().needs_login_devices.empty());
+    ASSERT_FALSE(authentication.getTokenRepository().needs_login);
+    ASSERT_TRUE(reply(authentication, devices[1], 0x0000));
+
+    // an invalidated session is logged in again
+    authentication.invalidateSession(devices[2].deviceAddress);
+    ASSERT_FALSE(authentication.isAuthenticated(devices[2].deviceAddress));
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 1);
+    ASSERT_TRUE(reply(authentication, devices[2], 0x0000));
+
+    // sessions expiring within the renew margin are renewed
+    const int renew_margin_in_ms = (SpeedwireAuthentication::session_timeout_in_s + 60) * 1000;
+    ASSERT_EQ(authentication.sendLoginRequests(credentials, renew_margin_in_ms), 3);
+    ASSERT_EQ(authentication.expireLoginRequests(0), 3);
+    ASSERT_EQ(authentication.getTokenRepository().size(), 0);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <AddressConversion.hpp>
+#include <SpeedwireCommand.hpp>
+
+using namespace libspeedwire;
+
+// command exposing the route lookup
+class RouteCommand : public SpeedwireCommand {
+public:
+    typedef SpeedwireCommand::DeviceRoute DeviceRoute;
+    typedef SpeedwireCommand::SocketIndex SocketIndex;
+
+    RouteCommand(void) : SpeedwireCommand(LocalHost::getInstance(), std::vector<SpeedwireDevice>()) {}
+    const DeviceRoute* route(const SpeedwireDevice& peer) { return getRoute(peer); }
+    SocketIndex socketIndex(const std::string& if_address) const { return getSocketIndex(if_address); }
+
+    static uint32_t destAddress(const DeviceRoute* route) {
+        return ntohl(AddressConversion::toSockAddrIn(reinterpret_cast<const struct sockaddr&>(route->dest)).sin_addr.s_addr);
+    }
+};
+
+// test that cached routes are resolved again when the binary ip address or the interface of a device changes
+TEST(SpeedwireCommandTest, RouteInvalidation) {
+    RouteCommand command;
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 0x0179;
+    device.deviceAddress.serialNumber = 1901234567;
+    device.deviceIpAddress = "127.0.0.10";
+    device.interfaceIpAddress = "127.0.0.1";
+    device.resolveAddresses(LocalHost::getInstance());
+
+    // the route is cached and reused as long as the device does not change
+    const RouteCommand::DeviceRoute* route = command.route(device);
+    ASSERT_TRUE(route != NULL);
+    ASSERT_EQ(RouteCommand::destAddress(route), 0x7f00000a);
+    ASSERT_EQ(command.route(device), route);
+
+    // a new device ip address is picked up
+    device.deviceIpAddress = "127.0.0.11";
+    device.resolveAddresses(LocalHost::getInstance());
+    route = command.route(device);
+    ASSERT_TRUE(route != NULL);
+    ASSERT_EQ(RouteCommand::destAddress(route), 0x7f00000b);
+
+    // a new interface is picked up
+    device.interfaceIpAddress = "127.0.0.2";
+    device.resolveAddresses(LocalHost::getInstance());
+    route = command.route(device);
+    ASSERT_TRUE(route != NULL);
+    ASSERT_EQ(route->socket_index, command.socketIndex("127.0.0.2"));
+    ASSERT_NE(route->socket_index, command.socketIndex("127.0.0.1"));
+
+    // an invalid device ip address drops the route
+    device.deviceIpAddress = "";
+    device.resolveAddresses(LocalHost::getInstance());
+    ASSERT_TRUE(command.route(device) == NULL);
+}
+
+// test that routes of devices without resolved binary addresses are kept until the device is registered again
+TEST(SpeedwireCommandTest, RouteRegistration) {
+    RouteCommand command;
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 0x0179;
+    device.deviceAddress.serialNumber = 1901234568;
+    device.deviceIpAddress = "127.0.0.10";
+    device.interfaceIpAddress = "127.0.0.1";
+
+    const RouteCommand::DeviceRoute* route = command.route(device);
+    ASSERT_TRUE(route != NULL);
+    ASSERT_EQ(RouteCommand::destAddress(route), 0x7f00000a);
+
+    // changed ip address strings are not parsed on the send path
+    device.deviceIpAddress = "127.0.0.11";
+    ASSERT_EQ(command.route(device), route);
+    ASSERT_EQ(RouteCommand::destAddress(route), 0x7f00000a);
+
+    // registering the device again resolves the route
+    ASSERT_TRUE(command.registerDevice(device));
+    route = command.route(device);
+    ASSERT_TRUE(route != NULL);
+    ASSERT_EQ(RouteCommand::destAddress(route), 0x7f00000b);
+}
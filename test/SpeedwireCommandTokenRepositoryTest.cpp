@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <SpeedwireCommand.hpp>
+
+using namespace libspeedwire;
+
+// repository exposing the methods taking explicit times
+class TestRepository : public SpeedwireCommandTokenRepository {
+public:
+    SpeedwireCommandTokenIndex add(const uint32_t serial, const uint16_t packetid, const uint64_t time) {
+        SpeedwireCommandToken token;
+        memset(&token, 0, sizeof(token));
+        token.susyid = 0x1234;
+        token.serialnumber = serial;
+        token.packetid = packetid | 0x8000;
+        token.command = Command::AC_QUERY;
+        return SpeedwireCommandTokenRepository::add(token, time);
+    }
+    int expire(const int timeout_in_ms, const uint64_t now) {
+        return SpeedwireCommandTokenRepository::expire(timeout_in_ms, now);
+    }
+};
+
+// test adding, finding and removing tokens
+TEST(SpeedwireCommandTokenRepositoryTest, AddFindRemove) {
+    SpeedwireCommandTokenRepository repository;
+    std::vector<SpeedwireCommandTokenIndex> indexes;
+    for (uint16_t i = 0; i < 1000; ++i) {
+        indexes.push_back(repository.add(0x1234, 1900000000 + (i % 10), 0x8000 | i, (i & 1) ? "192.168.1.10" : "fe80::1", Command::AC_QUERY));
+    }
+    ASSERT_EQ(repository.size(), 1000);
+    for (uint16_t i = 0; i < 1000; ++i) {
+        ASSERT_EQ(repository.find(0x1234, 1900000000 + (i % 10), i), indexes[i]);
+    }
+    ASSERT_EQ(repository.find(0x1234, 1900000001, 0), -1);
+    ASSERT_EQ(repository.at(indexes[1]).peer_family, AF_INET);
+    ASSERT_EQ(repository.at(indexes[2]).peer_family, AF_INET6);
+
+    // token indexes remain valid when other tokens are removed
+    for (uint16_t i = 0; i < 1000; i += 2) {
+        repository.remove(indexes[i]);
+    }
+    ASSERT_EQ(repository.size(), 500);
+    for (uint16_t i = 0; i < 1000; ++i) {
+        ASSERT_EQ(repository.isValid(indexes[i]), (i & 1) != 0);
+        ASSERT_EQ(repository.find(0x1234, 1900000000 + (i % 10), i), (i & 1) ? indexes[i] : -1);
+        if (i & 1) {
+            ASSERT_EQ(repository.at(indexes[i]).packetid, 0x8000 | i);
+        }
+    }
+    repository.clear();
+    ASSERT_EQ(repository.size(), 0);
+    ASSERT_EQ(repository.find(0x1234, 1900000001, 1), -1);
+}
+
+// test timer wheel expiry across all wheel levels
+TEST(SpeedwireCommandTokenRepositoryTest, Expire) {
+    TestRepository repository;
+    const uint64_t t0 = 1700000000000ull;
+    const uint64_t offsets[] = { 0, 1, 255, 256, 300, 16383, 16384, 20000, 1048576, 5000000, 67108864, 100000000 };
+    const int n = sizeof(offsets) / sizeof(offsets[0]);
+    for (int i = 0; i < n; ++i) {
+        repository.add(1, (uint16_t)i, t0 + offsets[i]);
+    }
+    ASSERT_EQ(repository.size(), n);
+
+    // expire step by step and check that exactly the tokens created before the cutoff are removed
+    const int timeout = 1000;
+    for (uint64_t cutoff = t0; cutoff <= t0 + 100000001; cutoff += 97) {
+        repository.expire(timeout, cutoff + timeout);
+        for (int i = 0; i < n; ++i) {
+            ASSERT_EQ(repository.find(0x1234, 1, (uint16_t)i) >= 0, t0 + offsets[i] >= cutoff) << "offset " << offsets[i] << " cutoff " << (cutoff - t0);
+        }
+        if (cutoff > t0 + 2000000) {
+            cutoff += 50000;
+        }
+    }
+    repository.expire(timeout, t0 + 100000001 + timeout);
+    ASSERT_EQ(repository.size(), 0);
+
+    // tokens added after the wheel advanced
+    const uint64_t t1 = t0 + 200000000;
+    SpeedwireCommandTokenIndex a = repository.add(2, 1, t1);
+    SpeedwireCommandTokenIndex b = repository.add(2, 2, t1 + 500);
+    ASSERT_EQ(repository.expire(timeout, t1 + timeout + 1), 1);
+    ASSERT_FALSE(repository.isValid(a));
+    ASSERT_TRUE(repository.isValid(b));
+    repository.remove(b);
+    ASSERT_EQ(repository.expire(timeout, t1 + 10 * timeout), 0);
+    ASSERT_EQ(repository.size(), 0);
+}
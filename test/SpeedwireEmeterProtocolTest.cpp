@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <ObisFilter.hpp>
+#include <SpeedwireEmeterProtocol.hpp>
+
+using namespace libspeedwire;
+
+// consumer using the per-element interface, i.e. the default adapter of consumePacket()
+class ElementObisConsumer : public ObisConsumer {
+public:
+    int elements = 0;
+    int packets = 0;
+    virtual void consume(const SpeedwireDevice& device, ObisData& element) { ++elements; }
+    virtual void endOfObisData(const SpeedwireDevice& device, const uint32_t timestamp) { ++packets; }
+};
+
+// consumer using the batch interface
+class PacketObisConsumer : public ObisConsumer {
+public:
+    std::vector<std::vector<ObisData*>> packets;
+    virtual void consume(const SpeedwireDevice& device, ObisData& element) { FAIL(); }
+    virtual void consumePacket(const SpeedwireDevice& device, ObisData* const* elements, const size_t num_elements, const uint32_t timestamp) {
+        packets.push_back(std::vector<ObisData*>(elements, elements + num_elements));
+    }
+};
+
+// assemble an emeter packet holding a power, an energy, the software version and the end of data element
+static unsigned long assembleEmeterPacket(uint8_t* buff, const size_t buff_size) {
+    memset(buff, 0, buff_size);
+    const uint16_t length = 2 + 10 + 8 + 12 + 8 + 4;
+    SpeedwireHeader header(buff, buff_size);
+    header.setDefaultHeader(1, length, SpeedwireData2Packet::sma_emeter_protocol_id);
+    SpeedwireEmeterProtocol emeter(header);
+    emeter.setSusyID(349);
+    emeter.setSerialNumber(1901234567);
+
+    void* element = (void*)emeter.getFirstObisElement();
+    std::array<uint8_t, 12> bytes = ObisData::PositiveActivePowerTotal.toByteArray();
+    SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 12345);
+    element = emeter.setObisElement(element, bytes.data());
+    bytes = ObisData::PositiveActiveEnergyTotal.toByteArray();
+    SpeedwireEmeterProtocol::setObisValue8(bytes.data(), 0x0102030405060708ull);
+    element = emeter.setObisElement(element, bytes.data());
+    bytes = ObisData::SoftwareVersion.toByteArray();
+    SpeedwireEmeterProtocol::setObisValue4(bytes.data(), 0x02001252);
+    element = emeter.setObisElement(element, bytes.data());
+    bytes = ObisData::EndOfData.toByteArray();
+    element = emeter.setObisElement(element, bytes.data());
+    return 4 + 8 + 4 + length + 4;
+}
+
+// test iterating over decoded obis elements
+TEST(SpeedwireEmeterProtocolTest, Iterator) {
+    uint8_t buff[128];
+    const unsigned long size = assembleEmeterPacket(buff, sizeof(buff));
+    SpeedwireHeader header(buff, size);
+    ASSERT_TRUE(header.isValidData2Packet());
+    SpeedwireEmeterProtocol emeter(header);
+
+    std::vector<SpeedwireEmeterProtocol::ObisElement> elements;
+    for (const auto& element : emeter) {
+        elements.push_back(element);
+    }
+    ASSERT_EQ(elements.size(), 4);
+    ASSERT_EQ(elements[0].key, ObisData::PositiveActivePowerTotal.toKey());
+    ASSERT_EQ(elements[0].value, 12345);
+    ASSERT_EQ(elements[0].length, 8);
+    ASSERT_EQ(elements[0].data, emeter.getFirstObisElement());
+    ASSERT_EQ(elements[1].key, ObisData::PositiveActiveEnergyTotal.toKey());
+    ASSERT_EQ(elements[1].value, 0x0102030405060708ull);
+    ASSERT_EQ(elements[1].length, 12);
+    ASSERT_EQ(elements[2].getChannel(), 144);
+    ASSERT_EQ(elements[2].value, 0x02001252);
+    ASSERT_EQ(elements[2].length, 8);
+    ASSERT_EQ(elements[3].key, ObisData::EndOfData.toKey());
+    ASSERT_EQ(elements[3].length, 4);
+
+    // the iterator agrees with the pointer based accessors
+    const void* obis = emeter.getFirstObisElement();
+    for (auto it = emeter.begin(); it != emeter.end(); ++it) {
+        ASSERT_EQ(it->data, obis);
+        ASSERT_EQ(it->getIndex(), SpeedwireEmeterProtocol::getObisIndex(obis));
+        ASSERT_EQ(it->getType(), SpeedwireEmeterProtocol::getObisType(obis));
+        obis = emeter.getNextObisElement(obis);
+    }
+    ASSERT_EQ(obis, (const void*)NULL);
+
+    // a truncated packet ends before the first incomplete element
+    SpeedwireHeader truncated(buff, size);
+    SpeedwireData2Packet(truncated).setTagLength(2 + 10 + 8 + 6);
+    SpeedwireEmeterProtocol truncated_emeter(truncated);
+    ASSERT_EQ(std::distance(truncated_emeter.begin(), truncated_emeter.end()), 1);
+    ASSERT_EQ(truncated_emeter.visitObisElements([](const SpeedwireEmeterProtocol::ObisElement&) {}), 1);
+}
+
+// test visiting obis elements and passing them to an obis filter
+TEST(SpeedwireEmeterProtocolTest, Visitor) {
+    uint8_t buff[128];
+    const unsigned long size = assembleEmeterPacket(buff, sizeof(buff));
+    SpeedwireHeader header(buff, size);
+    SpeedwireEmeterProtocol emeter(header);
+
+    uint64_t sum = 0;
+    ASSERT_EQ(emeter.visitObisElements([&sum](const SpeedwireEmeterProtocol::ObisElement& element) { sum += element.value; }), 4);
+    ASSERT_EQ(sum, 12345 + 0x0102030405060708ull + 0x02001252);
+
+    ObisFilter filter;
+    filter.addFilter(ObisData::PositiveActivePowerTotal);
+    filter.addFilter(ObisData::PositiveActiveEnergyTotal);
+    ElementObisConsumer element_consumer;
+    PacketObisConsumer packet_consumer;
+    filter.addConsumer(element_consumer);
+    filter.addConsumer(packet_consumer);
+    SpeedwireDevice device;
+    ASSERT_EQ(filter.consume(device, emeter, 1000), 2);
+    ASSERT_EQ(element_consumer.elements, 2);
+    ASSERT_EQ(element_consumer.packets, 1);
+    ASSERT_EQ(packet_consumer.packets.size(), 1);
+    ASSERT_EQ(packet_consumer.packets[0].size(), 2);
+    ASSERT_EQ(packet_consumer.packets[0][0], filter.filter(device, ObisData::PositiveActivePowerTotal));
+    ASSERT_EQ(packet_consumer.packets[0][1], filter.filter(device, ObisData::PositiveActiveEnergyTotal));
+    ASSERT_NE(filter.getFilter(device.deviceAddress), (std::vector<ObisData>*)NULL);
+    ASSERT_DOUBLE_EQ(filter.filter(device, ObisData::PositiveActivePowerTotal)->measurementValues.getNewestElement().value, 1234.5);
+    ASSERT_EQ(filter.filter(device, ObisData::PositiveActiveEnergyTotal)->measurementValues.getNewestElement().time, 1000);
+}
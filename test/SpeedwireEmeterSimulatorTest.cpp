@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <SpeedwireHeader.hpp>
+#include <SpeedwireEmeterProtocol.hpp>
+#include <SpeedwireEmeterSimulator.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace libspeedwire;
+
+// test emeter packets sent to a loopback udp socket
+TEST(SpeedwireEmeterSimulatorTest, Packets) {
+    int rx = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    ASSERT_GE(rx, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9522);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.3");     // more specific than sockets bound to any address by other tests
+    int reuseaddr = 1;
+    ASSERT_EQ(setsockopt(rx, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr)), 0);
+    ASSERT_EQ(bind(rx, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    struct timeval timeout = { 1, 0 };
+    ASSERT_EQ(setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)), 0);
+
+    SpeedwireEmeterSimulator simulator(LocalHost::getInstance());
+    simulator.setRate(100);
+    ASSERT_EQ(simulator.open("127.0.0.1", "127.0.0.3", 2, 349, 1900000000), 0);
+    ASSERT_EQ(simulator.run(10), 1);
+
+    uint8_t buffer[2048];
+    int nbytes = (int)recv(rx, buffer, sizeof(buffer), 0);
+    ASSERT_GT(nbytes, 0);
+    SpeedwireHeader header(buffer, nbytes);
+    ASSERT_TRUE(header.isValidData2Packet());
+    SpeedwireEmeterProtocol emeter(header);
+    ASSERT_EQ(emeter.getSusyID(), 349);
+    ASSERT_EQ(emeter.getSerialNumber(), 1900000000u);
+
+    // all predefined elements up to end of data, in the order of ObisData::getAllPredefined()
+    std::vector<ObisData> predefined = ObisData::getAllPredefined();
+    size_t count = 0;
+    const void* element = emeter.getFirstObisElement();
+    for (; element != NULL; element = emeter.getNextObisElement(element), ++count) {
+        ASSERT_LT(count, predefined.size());
+        ObisType type(SpeedwireEmeterProtocol::getObisChannel(element), SpeedwireEmeterProtocol::getObisIndex(element),
+                      SpeedwireEmeterProtocol::getObisType(element), SpeedwireEmeterProtocol::getObisTariff(element));
+        ASSERT_TRUE(predefined[count].equals(type));
+        if (type.equals(ObisData::VoltageL1) || type.equals(ObisData::VoltageL3)) {
+            ASSERT_NEAR(SpeedwireEmeterProtocol::getObisValue4(element), 230000, 5000);
+        }
+        if (type.equals(ObisData::Frequency)) {
+            ASSERT_NEAR(SpeedwireEmeterProtocol::getObisValue4(element), 50000, 50);
+        }
+        if (type.equals(ObisData::SoftwareVersion)) {
+            ASSERT_EQ(SpeedwireEmeterProtocol::getObisValue4(element), 0x02030452);
+        }
+    }
+    ASSERT_TRUE(predefined[count - 1].equals(ObisData::EndOfData));
+
+    // the second emeter follows within the period
+    while (simulator.getNumberOfPackets() < 2) {
+        ASSERT_GE(simulator.run(10), 0);
+    }
+    nbytes = (int)recv(rx, buffer, sizeof(buffer), 0);
+    SpeedwireHeader header2(buffer, nbytes);
+    ASSERT_EQ(SpeedwireEmeterProtocol(header2).getSerialNumber(), 1900000001u);
+    ASSERT_EQ(simulator.getNumberOfSendErrors(), 0u);
+    close(rx);
+}
+#endif
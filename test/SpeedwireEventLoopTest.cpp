@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <SpeedwireEventLoop.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace libspeedwire;
+
+// send a datagram to the given port on 127.0.0.5
+static void sendTo(const int tx, const uint16_t port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.5");
+    const uint8_t data[4] = { 1, 2, 3, 4 };
+    ASSERT_EQ(sendto(tx, data, sizeof(data), 0, (struct sockaddr*)&addr, sizeof(addr)), (ssize_t)sizeof(data));
+}
+
+// drain the given socket
+static void drain(const SpeedwireSocket& socket) {
+    uint8_t buffer[64];
+    struct sockaddr_in src;
+    while (socket.recvfrom(buffer, sizeof(buffer), src) > 0) {}
+}
+
+// test that only ready sockets are reported, for different socket vectors
+TEST(SpeedwireEventLoopTest, ReadySockets) {
+    const LocalHost& host = LocalHost::getInstance();
+    const uint16_t base_port = 9600;
+    std::vector<SpeedwireSocket> sockets;
+    for (uint16_t i = 0; i < 32; ++i) {
+        sockets.push_back(SpeedwireSocket(host));
+        ASSERT_GE(sockets.back().openSocket("127.0.0.5", false, (uint16_t)(base_port + i)), 0);
+    }
+    SpeedwireEventLoop loop;
+    std::vector<int> ready_indexes;
+
+    // sockets are initially marked ready, as packets may have been queued before their registration
+    ASSERT_EQ(loop.wait(sockets, ready_indexes, 0), 32);
+    for (auto& socket : sockets) {
+        drain(socket);
+        loop.clearReady(socket);
+    }
+    ASSERT_EQ(loop.wait(sockets, ready_indexes, 0), 0);
+
+    int tx = (int)::socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    ASSERT_GE(tx, 0);
+    sendTo(tx, base_port + 20);
+    sendTo(tx, base_port + 3);
+    for (int i = 0; i < 100 && ready_indexes.size() < 2; ++i) {
+        ASSERT_GE(loop.wait(sockets, ready_indexes, 100), 1);
+    }
+    ASSERT_EQ(ready_indexes, std::vector<int>({ 3, 20 }));
+
+    // a socket stays ready until it is drained
+    drain(sockets[3]);
+    loop.clearReady(sockets[3]);
+    ASSERT_EQ(loop.wait(sockets, ready_indexes, 0), 1);
+    ASSERT_EQ(ready_indexes[0], 20);
+
+    // a different vector holding the same socket at another index
+    std::vector<SpeedwireSocket> subset = { sockets[5], sockets[20] };
+    ASSERT_EQ(loop.wait(subset, ready_indexes, 0), 1);
+    ASSERT_EQ(ready_indexes[0], 1);
+    drain(sockets[20]);
+    loop.clearReady(sockets[20]);
+    ASSERT_EQ(loop.wait(subset, ready_indexes, 0), 0);
+    ASSERT_EQ(loop.wait(sockets, ready_indexes, 0), 0);
+
+    // unregistered sockets are not reported
+    sendTo(tx, base_port + 7);
+    ASSERT_EQ(loop.wait(sockets[7], 1000), 1);
+    loop.unregisterSocket(sockets[7]);
+    ASSERT_EQ(loop.wait(sockets, ready_indexes, 0), 0);
+
+    close(tx);
+    for (auto& socket : sockets) {
+        socket.closeSocket();
+    }
+}
+#endif
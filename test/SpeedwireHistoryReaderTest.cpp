@@ -0,0 +1,237 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <AddressConversion.hpp>
+#include <SpeedwireByteEncoding.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireHistoryReader.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+
+using namespace libspeedwire;
+
+// reader recording the sent queries instead of sending them, and exposing the poll method taking an explicit time
+class TestReader : public SpeedwireHistoryReader {
+public:
+    struct Query { uint32_t first; uint32_t last; uint16_t packet_id; };
+    std::vector<Query> sent;
+    uint16_t packet_id;
+
+    TestReader(SpeedwireCommand& command, SpeedwireHistoryConsumer& consumer) :
+        SpeedwireHistoryReader(LocalHost::getInstance(), command, consumer, 2, 1000, 1), packet_id(0x8000) {}
+
+    int poll(const uint64_t now) { return SpeedwireHistoryReader::poll(now); }
+
+protected:
+    virtual SpeedwireCommandTokenIndex sendQueryRequest(const SpeedwireDevice& peer, const Command command, const uint32_t first_register, const uint32_t last_register) {
+        Query query = { first_register, last_register, ++packet_id };
+        sent.push_back(query);
+        return this->command.getTokenRepository().add(peer.deviceAddress.susyID, peer.deviceAddress.serialNumber, packet_id, "192.168.1.10", command);
+    }
+};
+
+// consumer recording the delivered records
+class TestConsumer : public SpeedwireHistoryConsumer {
+public:
+    std::vector<SpeedwireRawDataYield::YieldValue> yields;
+    std::vector<SpeedwireRawDataEvent::EventValue> events;
+    int num_finished;
+    uint32_t synced_time;
+    bool complete;
+
+    TestConsumer(void) : num_finished(0), synced_time(0), complete(false) {}
+
+    virtual void consume(const SpeedwireDevice& device, const Command command, const SpeedwireRawDataYield::YieldValue& value) {
+        yields.push_back(value);
+    }
+    virtual void consume(const SpeedwireDevice& device, const SpeedwireRawDataEvent::EventValue& value) {
+        events.push_back(value);
+    }
+    virtual void endOfHistory(const SpeedwireDevice& device, const Command command, const uint32_t _synced_time, const bool _complete) {
+        ++num_finished;
+        synced_time = _synced_time;
+        complete = _complete;
+    }
+};
+
+static SpeedwireDevice createDevice(void) {
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 0x0179;
+    device.deviceAddress.serialNumber = 1901234567;
+    return device;
+}
+
+// assemble a yield reply packet holding the given records of 4 bytes time and 8 bytes yield each, followed by a trailer
+static void receiveReply(SpeedwireHistoryReader& reader, const SpeedwireDevice& device, const uint16_t packet_id, const uint16_t fragment,
+                         const uint16_t error_code, const std::vector<std::pair<uint32_t, uint64_t>>& records) {
+    uint8_t buff[512];
+    memset(buff, 0, sizeof(buff));
+    SpeedwireHeader header(buff, sizeof(buff));
+    header.setDefaultHeader(1, (uint16_t)(4 + 34 + records.size() * SpeedwireHistoryReader::yield_record_size + 4), SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireInverterProtocol inverter(header);
+    inverter.setDstSusyID(0xffff);
+    inverter.setDstSerialNumber(0xffffffff);
+    inverter.setSrcSusyID(device.deviceAddress.susyID);
+    inverter.setSrcSerialNumber(device.deviceAddress.serialNumber);
+    inverter.setErrorCode(error_code);
+    inverter.setFragmentCounter(fragment);
+    inverter.setPacketID(packet_id);
+    inverter.setCommandID(Command::YIELD_BY_MINUTE_QUERY | Command::QUERY_RESPONSE);
+    for (size_t i = 0; i < records.size(); ++i) {
+        inverter.setDataUint32(i * SpeedwireHistoryReader::yield_record_size,     records[i].first);
+        inverter.setDataUint64(i * SpeedwireHistoryReader::yield_record_size + 4, records[i].second);
+    }
+    struct sockaddr_in src = AddressConversion::toSockAddrIn("192.168.1.10");
+    src.sin_port = htons(9522);
+    reader.receive(header, AddressConversion::toSockAddr(src));
+}
+
+// assemble an event reply packet holding the given records of 4 bytes time and 44 bytes event data each, followed by a trailer
+static void receiveEventReply(SpeedwireHistoryReader& reader, const SpeedwireDevice& device, const uint16_t packet_id, const uint16_t fragment,
+                              const std::vector<std::pair<uint32_t, uint16_t>>& records) {
+    uint8_t buff[512];
+    memset(buff, 0, sizeof(buff));
+    SpeedwireHeader header(buff, sizeof(buff));
+    header.setDefaultHeader(1, (uint16_t)(4 + 34 + records.size() * SpeedwireHistoryReader::event_record_size + 4), SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireInverterProtocol inverter(header);
+    inverter.setDstSusyID(0xffff);
+    inverter.setDstSerialNumber(0xffffffff);
+    inverter.setSrcSusyID(device.deviceAddress.susyID);
+    inverter.setSrcSerialNumber(device.deviceAddress.serialNumber);
+    inverter.setFragmentCounter(fragment);
+    inverter.setPacketID(packet_id);
+    inverter.setCommandID(Command::EVENT_QUERY | Command::QUERY_RESPONSE);
+    for (size_t i = 0; i < records.size(); ++i) {
+        inverter.setDataUint32(i * SpeedwireHistoryReader::event_record_size,     records[i].first);
+        inverter.setDataUint32(i * SpeedwireHistoryReader::event_record_size + 4, ((uint32_t)device.deviceAddress.susyID << 16) | records[i].second);
+        inverter.setDataUint32(i * SpeedwireHistoryReader::event_record_size + 8, device.deviceAddress.serialNumber);
+    }
+    struct sockaddr_in src = AddressConversion::toSockAddrIn("192.168.1.10");
+    src.sin_port = htons(9522);
+    reader.receive(header, AddressConversion::toSockAddr(src));
+}
+
+// test paging, pipelining, fragments, out of order replies and retries
+TEST(SpeedwireHistoryReaderTest, Download) {
+    SpeedwireDevice device = createDevice();
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestConsumer consumer;
+    TestReader reader(command, consumer);
+
+    // three pages of one hour; the pipeline depth admits two of them
+    const uint32_t from = 1600000000;
+    const uint32_t to = from + 3 * 3600 - 1;
+    ASSERT_FALSE(reader.start(device, Command::AC_QUERY, from, to));
+    ASSERT_TRUE(reader.start(device, Command::YIELD_BY_MINUTE_QUERY, from, to, 3600));
+    const uint64_t t0 = LocalHost::getUnixEpochTimeInMs();
+    ASSERT_EQ(reader.poll(t0), 2);
+    ASSERT_EQ(reader.sent[0].first, from);
+    ASSERT_EQ(reader.sent[0].last, from + 3599);
+    ASSERT_EQ(reader.sent[1].first, from + 3600);
+    ASSERT_EQ(reader.poll(t0), 0);
+
+    // the second page completes first; the third page is requested right away, the synced time is held back by the first page
+    receiveReply(reader, device, reader.sent[1].packet_id, 0, 0, { { from + 3600, 10 }, { from + 3900, 11 } });
+    ASSERT_EQ(consumer.yields.size(), 2);
+    ASSERT_EQ(reader.sent.size(), 3);
+    ASSERT_EQ(reader.sent[2].first, from + 7200);
+    ASSERT_EQ(reader.sent[2].last, to);
+    ASSERT_EQ(reader.getSyncedTime(device, Command::YIELD_BY_MINUTE_QUERY), from - 1);
+
+    // the first page comes in two fragments; the second one without the high bit of the packet id; records outside the page are skipped
+    receiveReply(reader, device, reader.sent[0].packet_id, 1, 0, { { from - 300, 8 }, { from, 9 } });
+    ASSERT_EQ(consumer.yields.size(), 3);
+    ASSERT_EQ(consumer.yields.back().epoch_time, from);
+    ASSERT_EQ(consumer.yields.back().yield_value, 9);
+    receiveReply(reader, device, reader.sent[0].packet_id & 0x7fff, 0, 0, { { from + 300, 12 } });
+    ASSERT_EQ(consumer.yields.size(), 4);
+    ASSERT_EQ(reader.getSyncedTime(device, Command::YIELD_BY_MINUTE_QUERY), from + 7199);
+
+    // the third page times out after one record and is retried for the missing records
+    receiveReply(reader, device, reader.sent[2].packet_id, 1, 0, { { from + 7200, 13 } });
+    ASSERT_EQ(reader.poll(t0 + 100000), 1);
+    ASSERT_EQ(reader.sent.size(), 4);
+    ASSERT_EQ(reader.sent[3].first, from + 7201);
+    ASSERT_EQ(command.getTokenRepository().size(), 1);
+    ASSERT_FALSE(reader.isFinished());
+    receiveReply(reader, device, reader.sent[3].packet_id, 0, 0, { { from + 7500, 14 } });
+    ASSERT_EQ(consumer.yields.size(), 6);
+    ASSERT_TRUE(reader.isFinished());
+    ASSERT_EQ(consumer.num_finished, 1);
+    ASSERT_TRUE(consumer.complete);
+    ASSERT_EQ(consumer.synced_time, to);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+
+    // replies that do not belong to an in-flight page are ignored
+    receiveReply(reader, device, reader.sent[3].packet_id, 0, 0, { { from + 7800, 15 } });
+    ASSERT_EQ(consumer.yields.size(), 6);
+}
+
+// test failures and resuming from the synced time
+TEST(SpeedwireHistoryReaderTest, Resume) {
+    SpeedwireDevice device = createDevice();
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestConsumer consumer;
+    TestReader reader(command, consumer);
+
+    const uint32_t from = 1600000000;
+    const uint32_t to = from + 2 * 3600 - 1;
+    ASSERT_TRUE(reader.start(device, Command::YIELD_BY_MINUTE_QUERY, from, to, 3600));
+    const uint64_t t0 = LocalHost::getUnixEpochTimeInMs();
+    ASSERT_EQ(reader.poll(t0), 2);
+    receiveReply(reader, device, reader.sent[0].packet_id, 0, 0, { { from, 1 } });
+
+    // the second page fails with an authentication error
+    receiveReply(reader, device, reader.sent[1].packet_id, 0, 0x0017, {});
+    ASSERT_EQ(consumer.num_finished, 1);
+    ASSERT_FALSE(consumer.complete);
+    ASSERT_EQ(consumer.synced_time, from + 3599);
+    ASSERT_TRUE(command.getTokenRepository().needs_login);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+
+    // resume from the synced time
+    ASSERT_TRUE(reader.start(device, Command::YIELD_BY_MINUTE_QUERY, reader.getSyncedTime(device, Command::YIELD_BY_MINUTE_QUERY) + 1, to, 3600));
+    ASSERT_EQ(reader.poll(t0), 1);
+    ASSERT_EQ(reader.sent.back().first, from + 3600);
+
+    // retries are exhausted
+    ASSERT_EQ(reader.poll(t0 + 100000), 1);
+    ASSERT_EQ(reader.poll(t0 + 200000), 0);
+    ASSERT_EQ(consumer.num_finished, 2);
+    ASSERT_FALSE(consumer.complete);
+    ASSERT_EQ(consumer.synced_time, from + 3599);
+    ASSERT_TRUE(reader.isFinished(device, Command::YIELD_BY_MINUTE_QUERY));
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+}
+
+// test that a retried event page, which is requested in full, delivers each event once
+TEST(SpeedwireHistoryReaderTest, EventRetry) {
+    SpeedwireDevice device = createDevice();
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestConsumer consumer;
+    TestReader reader(command, consumer);
+
+    const uint32_t from = 1600000000;
+    const uint32_t to = from + 86400 - 1;
+    ASSERT_TRUE(reader.start(device, Command::EVENT_QUERY, from, to, 86400));
+    const uint64_t t0 = LocalHost::getUnixEpochTimeInMs();
+    ASSERT_EQ(reader.poll(t0), 1);
+
+    // the newest events come first; the page times out after the first fragment, although the last time of the page was seen
+    receiveEventReply(reader, device, reader.sent[0].packet_id, 1, { { to, 7 }, { from + 600, 6 }, { from + 600, 5 } });
+    ASSERT_EQ(consumer.events.size(), 3);
+    ASSERT_EQ(reader.poll(t0 + 100000), 1);
+    ASSERT_EQ(reader.sent.size(), 2);
+    ASSERT_EQ(reader.sent[1].first, from);
+    ASSERT_EQ(reader.sent[1].last, to);
+
+    // the retry repeats the delivered events; only the missing ones are delivered
+    receiveEventReply(reader, device, reader.sent[1].packet_id, 1, { { to, 7 }, { from + 600, 6 }, { from + 600, 5 }, { from + 300, 4 } });
+    receiveEventReply(reader, device, reader.sent[1].packet_id, 0, { { from + 300, 3 } });
+    ASSERT_EQ(consumer.events.size(), 5);
+    ASSERT_EQ(consumer.events[3].entry_id, 4);
+    ASSERT_EQ(consumer.events[4].entry_id, 3);
+    ASSERT_EQ(consumer.events[4].serial_number, device.deviceAddress.serialNumber);
+    ASSERT_TRUE(reader.isFinished());
+    ASSERT_TRUE(consumer.complete);
+    ASSERT_EQ(consumer.synced_time, to);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+}
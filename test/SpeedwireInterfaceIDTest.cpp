@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include <SpeedwireDevice.hpp>
+
+using namespace libspeedwire;
+
+// test resolving and comparing interface identifiers
+TEST(SpeedwireInterfaceIDTest, Resolve) {
+    LocalHost& host = LocalHost::getInstance();
+
+    SpeedwireInterfaceID unresolved;
+    ASSERT_FALSE(unresolved.isValid());
+    ASSERT_FALSE(unresolved.isAny());
+    ASSERT_EQ(unresolved.toString(), "");
+
+    SpeedwireInterfaceID any(host, "0.0.0.0");
+    ASSERT_TRUE(any.isValid());
+    ASSERT_TRUE(any.isAny());
+
+    SpeedwireInterfaceID loopback(host, "127.0.0.1");
+    ASSERT_TRUE(loopback.isValid());
+    ASSERT_FALSE(loopback.isAny());
+    ASSERT_EQ(loopback.family, AF_INET);
+    ASSERT_EQ(loopback.ifIndex, host.getInterfaceIndex("127.0.0.1"));
+    ASSERT_EQ(loopback.toString(), "127.0.0.1");
+    ASSERT_TRUE(loopback == SpeedwireInterfaceID(host, "127.0.0.1"));
+    ASSERT_FALSE(loopback == any);
+
+    SpeedwireInterfaceID v6(host, "fe80::1");
+    ASSERT_EQ(v6.family, AF_INET6);
+    ASSERT_TRUE(v6 == SpeedwireInterfaceID(host, "fe80::1"));
+    ASSERT_FALSE(v6 == SpeedwireInterfaceID(host, "fe80::2"));
+
+    ASSERT_FALSE(SpeedwireInterfaceID(host, "").isValid());
+    SpeedwireDevice device;
+    ASSERT_FALSE(device.interfaceID.isValid());
+    ASSERT_EQ(device.deviceSockAddress.ss_family, AF_UNSPEC);
+}
@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <SpeedwireAuthentication.hpp>
+#include <SpeedwireCommand.hpp>
+#include <SpeedwireSocketFactory.hpp>
+#include <SpeedwireInverterSimulator.hpp>
+
+using namespace libspeedwire;
+
+// test login and queries against simulated devices on the loopback interface
+TEST(SpeedwireInverterSimulatorTest, LoginAndQuery) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireSocketFactory::getInstance(host);
+
+    SpeedwireInverterSimulator simulator(host);
+    ASSERT_EQ(simulator.open({ "127.0.0.2" }, 2, 378, 3000000000u), 1);
+    const std::vector<SpeedwireDevice> devices = simulator.getDevices();
+    ASSERT_EQ(devices.size(), 2);
+    ASSERT_EQ(devices[1].deviceAddress.serialNumber, 3000000001u);
+    ASSERT_EQ(devices[1].deviceIpAddress, "127.0.0.2");
+
+    std::atomic<bool> stop(false);
+    std::thread thread([&]() { while (!stop) { simulator.run(10); } });
+
+    SpeedwireAuthentication authentication(host, devices);
+    SpeedwireCommand command(host, devices);
+    uint8_t buffer[2048];
+
+    // queries are rejected until the device is logged in
+    ASSERT_LT(command.query(devices[0], Command::AC_QUERY, 0x00464000, 0x004642FF, buffer, sizeof(buffer)), 0);
+    ASSERT_FALSE(authentication.login(devices[0], Credentials(UserCode::USER, "9999")));
+    ASSERT_TRUE(authentication.login(devices[0], Credentials(UserCode::USER, "0000")));
+
+    // three numeric ac power elements
+    int32_t nbytes = command.query(devices[0], Command::AC_QUERY, 0x00464000, 0x004642FF, buffer, sizeof(buffer));
+    ASSERT_EQ(nbytes, 58 + 3 * 28);
+    SpeedwireHeader header(buffer, nbytes);
+    SpeedwireInverterProtocol reply(header);
+    ASSERT_EQ(reply.getCommandID(), Command::AC_QUERY | Command::QUERY_RESPONSE);
+    ASSERT_EQ(reply.getSrcSerialNumber(), 3000000000u);
+    ASSERT_EQ(reply.getErrorCode(), 0);
+    ASSERT_EQ(reply.getFirstRegisterID(), 0);
+    ASSERT_EQ(reply.getLastRegisterID(), 2);
+
+    // status elements carrying device class and model
+    nbytes = command.query(devices[0], Command::DEVICE_QUERY, 0x00821E00, 0x008220FF, buffer, sizeof(buffer));
+    ASSERT_EQ(nbytes, 58 + 3 * 40);
+    SpeedwireHeader header2(buffer, nbytes);
+    SpeedwireInverterProtocol reply2(header2);
+    const void* element = reply2.getFirstRawDataElement();
+    element = reply2.getNextRawDataElement(element, reply2.getRawDataLength());
+    SpeedwireRawData device_class = reply2.getRawData(element, reply2.getRawDataLength());
+    ASSERT_EQ(device_class.id, SpeedwireData::InverterDeviceClass.id);
+    ASSERT_EQ(SpeedwireByteEncoding::getUint32LittleEndian(device_class.data), SpeedwireRawDataStatus32::sel | (uint32_t)SpeedwireDeviceClass::PV_INVERTER);
+
+    // the second device has not logged in
+    ASSERT_LT(command.query(devices[1], Command::AC_QUERY, 0x00464000, 0x004642FF, buffer, sizeof(buffer)), 0);
+
+    stop = true;
+    thread.join();
+    ASSERT_GE(simulator.getNumberOfRequests(), 6u);
+    ASSERT_EQ(simulator.getNumberOfDroppedRequests(), 0u);
+}
+
+// test batched query transmission by a single sendmmsg call per socket; each device answers its own query
+TEST(SpeedwireInverterSimulatorTest, SendQueryRequests) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireSocketFactory::getInstance(host);
+
+    SpeedwireInverterSimulator simulator(host);
+    ASSERT_EQ(simulator.open({ "127.0.0.8" }, 3, 378, 3000000200u), 1);
+    const std::vector<SpeedwireDevice> devices = simulator.getDevices();
+    ASSERT_EQ(devices.size(), 3);
+
+    std::atomic<bool> stop(false);
+    std::thread thread([&]() { while (!stop) { simulator.run(10); } });
+
+    SpeedwireAuthentication authentication(host, devices);
+    ASSERT_EQ(authentication.loginConcurrently(Credentials(UserCode::USER, "0000"), 2000), 3);
+
+    // send one query to each device
+    SpeedwireCommand command(host, devices);
+    std::vector<SpeedwireCommand::QueryRequest> requests;
+    for (auto& device : devices) {
+        SpeedwireCommand::QueryRequest request = { &device, Command::AC_QUERY, 0x00464000, 0x004642FF };
+        requests.push_back(request);
+    }
+    const uint64_t num_requests = simulator.getNumberOfRequests();
+    std::vector<SpeedwireCommandTokenIndex> tokens = command.sendQueryRequests(requests);
+    ASSERT_EQ(tokens.size(), 3);
+    for (auto token : tokens) {
+        ASSERT_GE(token, 0);
+    }
+    ASSERT_EQ(command.getTokenRepository().size(), 3);
+
+    // receive the replies from the command socket and match them to their tokens
+    SpeedwireSocket& socket = SpeedwireSocketFactory::getInstance(host)->getRecvSocket(SpeedwireSocketFactory::SocketType::UNICAST, devices[0].interfaceIpAddress);
+    SpeedwireEventLoop& event_loop = SpeedwireSocketFactory::getInstance(host)->getEventLoop();
+    std::vector<uint32_t> serials;
+    uint8_t buffer[2048];
+    for (int i = 0; i < 100 && serials.size() < devices.size(); ++i) {
+        if (event_loop.wait(socket, 20) <= 0) {
+            continue;
+        }
+        struct sockaddr_storage src;
+        int nbytes = socket.recvfrom(buffer, sizeof(buffer), AddressConversion::toSockAddrIn(AddressConversion::toSockAddr(src)));
+        if (nbytes <= 0) {
+            event_loop.clearReady(socket);
+            continue;
+        }
+        SpeedwireHeader header(buffer, nbytes);
+        const int token_index = command.findCommandToken(header);
+        if (token_index >= 0 && command.checkReply(header, AddressConversion::toSockAddr(src)) == true) {
+            command.getTokenRepository().remove(token_index);
+            SpeedwireInverterProtocol reply(header);
+            ASSERT_EQ(reply.getErrorCode(), 0);
+            serials.push_back(reply.getSrcSerialNumber());
+        }
+    }
+    std::sort(serials.begin(), serials.end());
+    ASSERT_EQ(serials, std::vector<uint32_t>({ 3000000200u, 3000000201u, 3000000202u }));
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+
+    stop = true;
+    thread.join();
+    ASSERT_EQ(simulator.getNumberOfRequests(), num_requests + 3u);
+    ASSERT_EQ(simulator.getNumberOfDroppedRequests(), 0u);
+}
+
+// get the packet ids of the most recent login requests of the given devices; a changed packet id indicates a new login request
+static std::vector<uint16_t> getPacketIDs(const SpeedwireAuthentication& authentication, const std::vector<SpeedwireDevice>& devices) {
+    std::vector<uint16_t> packet_ids;
+    for (auto& device : devices) {
+        uint16_t packet_id = 0;
+        for (auto& session : authentication.getSessions()) {
+            if (session.address == device.deviceAddress) {
+                packet_id = session.packet_id;
+            }
+        }
+        packet_ids.push_back(packet_id);
+    }
+    return packet_ids;
+}
+
+// get the indexes of the devices that were sent a login request since the given packet ids were taken
+static std::vector<size_t> getResent(const std::vector<uint16_t>& before, const std::vector<uint16_t>& after) {
+    std::vector<size_t> resent;
+    for (size_t i = 0; i < before.size(); ++i) {
+        if (after[i] != before[i]) {
+            resent.push_back(i);
+        }
+    }
+    return resent;
+}
+
+// test concurrent login of several simulated devices; only sessions that lapsed, failed or are about to expire are logged in again
+TEST(SpeedwireInverterSimulatorTest, LoginConcurrently) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireSocketFactory::getInstance(host);
+
+    SpeedwireInverterSimulator simulator(host);
+    ASSERT_EQ(simulator.open({ "127.0.0.6", "127.0.0.7" }, 4, 378, 3000000100u), 2);
+    const std::vector<SpeedwireDevice> devices = simulator.getDevices();
+    ASSERT_EQ(devices.size(), 4);
+
+    std::atomic<bool> stop(false);
+    std::thread thread([&]() { while (!stop) { simulator.run(10); } });
+
+    SpeedwireAuthentication authentication(host, devices);
+    const Credentials credentials(UserCode::USER, "0000");
+
+    // all devices are logged in at once
+    ASSERT_EQ(authentication.loginConcurrently(credentials, 2000), 4);
+    ASSERT_EQ(authentication.getSessions().size(), 4);
+    for (auto& device : devices) {
+        ASSERT_TRUE(authentication.isAuthenticated(device.deviceAddress));
+    }
+    ASSERT_EQ(authentication.getTokenRepository().size(), 0);
+
+    // valid sessions are not logged in again
+    std::vector<uint16_t> packet_ids = getPacketIDs(authentication, devices);
+    ASSERT_EQ(authentication.sendLoginRequests(credentials), 0);
+    ASSERT_EQ(authentication.loginConcurrently(credentials, 2000), 4);
+    ASSERT_EQ(getResent(packet_ids, getPacketIDs(authentication, devices)), std::vector<size_t>());
+
+    // devices that replied with error code 0x0017 are handed over by the token repository and logged in again
+    authentication.getTokenRepository().setNeedsLogin(devices[1].deviceAddress);
+    authentication.getTokenRepository().setNeedsLogin(devices[2].deviceAddress);
+    packet_ids = getPacketIDs(authentication, devices);
+    ASSERT_EQ(authentication.loginConcurrently(credentials, 2000), 4);
+    ASSERT_EQ(getResent(packet_ids, getPacketIDs(authentication, devices)), std::vector<size_t>({ 1, 2 }));
+    ASSERT_TRUE(authentication.getTokenRepository().needs_login_devices.empty());
+    ASSERT_FALSE(authentication.getTokenRepository().needs_login);
+
+    // an invalidated session that fails to log in is reported as failed and logged in again by the next call
+    authentication.invalidateSession(devices[3].deviceAddress);
+    packet_ids = getPacketIDs(authentication, devices);
+    ASSERT_EQ(authentication.loginConcurrently(Credentials(UserCode::USER, "9999"), 2000), 3);
+    ASSERT_EQ(getResent(packet_ids, getPacketIDs(authentication, devices)), std::vector<size_t>({ 3 }));
+    ASSERT_EQ(authentication.getSessions()[3].state, SpeedwireAuthentication::SessionState::FAILED);
+    ASSERT_EQ(authentication.getSessions()[3].error_code, 0x0100);
+    packet_ids = getPacketIDs(authentication, devices);
+    ASSERT_EQ(authentication.loginConcurrently(credentials, 2000), 4);
+    ASSERT_EQ(getResent(packet_ids, getPacketIDs(authentication, devices)), std::vector<size_t>({ 3 }));
+
+    // sessions expiring within the renew margin are renewed
+    packet_ids = getPacketIDs(authentication, devices);
+    const int renew_margin_in_ms = (SpeedwireAuthentication::session_timeout_in_s + 60) * 1000;
+    ASSERT_EQ(authentication.loginConcurrently(credentials, 2000, renew_margin_in_ms), 4);
+    ASSERT_EQ(getResent(packet_ids, getPacketIDs(authentication, devices)), std::vector<size_t>({ 0, 1, 2, 3 }));
+    ASSERT_EQ(authentication.getTokenRepository().size(), 0);
+
+    stop = true;
+    thread.join();
+    ASSERT_EQ(simulator.getNumberOfRequests(), 4u + 2u + 1u + 1u + 4u);
+    ASSERT_EQ(simulator.getNumberOfDroppedRequests(), 0u);
+}
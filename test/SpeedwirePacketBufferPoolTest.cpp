@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <SpeedwirePacketBufferPool.hpp>
+
+using namespace libspeedwire;
+
+// test allocation until the pool is exhausted
+TEST(SpeedwirePacketBufferPoolTest, Allocate) {
+    SpeedwirePacketBufferPool pool(3);
+    ASSERT_EQ(pool.getNumberOfBuffers(), 3);
+    ASSERT_EQ(pool.getNumberOfFreeBuffers(), 3);
+    {
+        SpeedwirePacketHandle h1 = pool.allocate();
+        SpeedwirePacketHandle h2 = pool.allocate();
+        SpeedwirePacketHandle h3 = pool.allocate();
+        SpeedwirePacketHandle h4 = pool.allocate();
+        ASSERT_TRUE(h1.isValid());
+        ASSERT_TRUE(h2.isValid());
+        ASSERT_TRUE(h3.isValid());
+        ASSERT_FALSE(h4.isValid());
+        ASSERT_NE(h1.getData(), h2.getData());
+        ASSERT_NE(h2.getData(), h3.getData());
+        ASSERT_EQ(pool.getNumberOfFreeBuffers(), 0);
+    }
+    ASSERT_EQ(pool.getNumberOfFreeBuffers(), 3);
+}
+
+// test reference counting by copy and move operations
+TEST(SpeedwirePacketBufferPoolTest, ReferenceCounting) {
+    SpeedwirePacketBufferPool pool(2);
+
+    SpeedwirePacketHandle h1 = pool.allocate();
+    h1.setSize(42);
+    ASSERT_EQ(h1.getReferenceCount(), 1);
+
+    SpeedwirePacketHandle h2(h1);
+    ASSERT_EQ(h1.getReferenceCount(), 2);
+    ASSERT_EQ(h2.getData(), h1.getData());
+    ASSERT_EQ(h2.getSize(), 42);
+
+    SpeedwirePacketHandle h3;
+    ASSERT_FALSE(h3.isValid());
+    h3 = h2;
+    ASSERT_EQ(h1.getReferenceCount(), 3);
+
+    SpeedwirePacketHandle h4(std::move(h3));
+    ASSERT_FALSE(h3.isValid());
+    ASSERT_EQ(h1.getReferenceCount(), 3);
+
+    h1.reset();
+    h2.reset();
+    ASSERT_EQ(h4.getReferenceCount(), 1);
+    ASSERT_EQ(pool.getNumberOfFreeBuffers(), 1);
+
+    h4 = pool.allocate();   // releases the last reference to the first buffer
+    ASSERT_EQ(pool.getNumberOfFreeBuffers(), 1);
+    h4.reset();
+    ASSERT_EQ(pool.getNumberOfFreeBuffers(), 2);
+}
+
+// test the header view on the packet data
+TEST(SpeedwirePacketBufferPoolTest, Header) {
+    SpeedwirePacketBufferPool pool(1);
+    SpeedwirePacketHandle h = pool.allocate();
+    ASSERT_EQ(h.getCapacity(), SpeedwirePacketBuffer::max_packet_size);
+
+    SpeedwireHeader header(h.getData(), (unsigned long)h.getCapacity());
+    header.setDefaultHeader(1, 20, 0x6069);
+    h.setSize(32);
+
+    SpeedwireHeader view = h.getHeader();
+    ASSERT_EQ(view.getPacketPointer(), h.getData());
+    ASSERT_TRUE(view.isSMAPacket());
+}
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <SpeedwireEmeterProtocol.hpp>
+#include <SpeedwirePacketRecorder.hpp>
+#include <SpeedwireReplayDispatcher.hpp>
+
+using namespace libspeedwire;
+
+// receiver keeping the last received packet
+class LastPacketReceiver : public EmeterPacketReceiverBase {
+public:
+    int count;
+    SpeedwirePacketHandle last;
+    LastPacketReceiver(LocalHost& host) : EmeterPacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) {}
+    virtual void receivePacket(SpeedwirePacketHandle& packet) { ++count; last = packet; }
+};
+
+// record an emeter packet with the given serial number and arrival time
+static void recordPacket(SpeedwirePacketRecorder& recorder, SpeedwirePacketBufferPool& pool, const uint32_t serial, const uint64_t arrival_time_in_ns) {
+    SpeedwirePacketHandle packet = pool.allocate();
+    memset(packet.getData(), 0, 128);
+    SpeedwireHeader header(packet.getData(), 128);
+    header.setDefaultHeader(1, 64, SpeedwireData2Packet::sma_emeter_protocol_id);
+    SpeedwireEmeterProtocol emeter(header);
+    emeter.setSusyID(349);
+    emeter.setSerialNumber(serial);
+    packet.setSize(4 + 8 + 4 + 64 + 4);
+    packet.setArrivalTimeInNs(arrival_time_in_ns);
+    struct sockaddr_in& src = (struct sockaddr_in&)packet.getSrcStorage();
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_port = htons(9522);
+    src.sin_addr.s_addr = htonl(0xc0a80a0b);
+    recorder.receivePacket(packet);
+}
+
+// test recording packets and replaying them through the receiver interfaces
+TEST(SpeedwirePacketRecorderTest, RecordAndReplay) {
+    LocalHost& host = LocalHost::getInstance();
+    const char* filename = "speedwire_recorder_test.cap";
+    remove(filename);
+
+    // record two emeter packets and one invalid packet
+    SpeedwirePacketBufferPool pool(4);
+    SpeedwirePacketRecorder recorder(host);
+    ASSERT_TRUE(recorder.open(filename));
+    for (uint32_t i = 0; i < 3; ++i) {
+        SpeedwirePacketHandle packet = pool.allocate();
+        memset(packet.getData(), 0, 128);
+        SpeedwireHeader header(packet.getData(), 128);
+        header.setDefaultHeader(1, 64, SpeedwireData2Packet::sma_emeter_protocol_id);
+        SpeedwireEmeterProtocol emeter(header);
+        emeter.setSusyID(349);
+        emeter.setSerialNumber(1901234567 + i);
+        if (i == 1) {
+            packet.getData()[0] = 'X';
+        }
+        packet.setSize(4 + 8 + 4 + 64 + 4);
+        packet.setArrivalTimeInNs(1000000000ull * (i + 1));
+        struct sockaddr_in& src = (struct sockaddr_in&)packet.getSrcStorage();
+        memset(&src, 0, sizeof(src));
+        src.sin_family = AF_INET;
+        src.sin_port = htons(9522);
+        src.sin_addr.s_addr = htonl(0xc0a80a0b + i);
+        recorder.receivePacket(packet);
+    }
+    recorder.close();
+    ASSERT_EQ(recorder.getNumberOfRecords(), 3);
+    ASSERT_EQ(recorder.getNumberOfErrors(), 0);
+
+    // replay them as fast as possible, twice
+    SpeedwireReplayDispatcher replay(host);
+    LastPacketReceiver receiver(host);
+    replay.registerReceiver(receiver);
+    ASSERT_TRUE(replay.open(filename));
+    ASSERT_EQ(replay.replay(2), 2);
+    ASSERT_EQ(replay.replay(10), 1);
+    ASSERT_EQ(replay.replay(10), 0);
+    ASSERT_TRUE(replay.rewind());
+    ASSERT_EQ(replay.replay(10), 3);
+    replay.close();
+
+    ASSERT_EQ(replay.getNumberOfReplayedPackets(), 6);
+    ASSERT_EQ(replay.getNumberOfDroppedPackets(SpeedwireReceiveDispatcher::DropReason::BAD_SIGNATURE), 2);
+    ASSERT_EQ(receiver.count, 4);
+    ASSERT_EQ(receiver.last.getArrivalTimeInNs(), 3000000000ull);
+    ASSERT_EQ(receiver.last.getSize(), 4 + 8 + 4 + 64 + 4);
+    const struct sockaddr_in& src = (const struct sockaddr_in&)receiver.last.getSrc();
+    ASSERT_EQ(src.sin_family, AF_INET);
+    ASSERT_EQ(ntohs(src.sin_port), 9522);
+    ASSERT_EQ(ntohl(src.sin_addr.s_addr), 0xc0a80a0b + 2);
+    SpeedwireHeader header = receiver.last.getHeader();
+    SpeedwireEmeterProtocol emeter(header);
+    ASSERT_EQ(emeter.getSerialNumber(), 1901234567 + 2);
+    receiver.last.reset();
+
+    remove(filename);
+}
+
+// test that records appended by several threads to the same recorder are not interleaved
+TEST(SpeedwirePacketRecorderTest, ConcurrentRecording) {
+    LocalHost& host = LocalHost::getInstance();
+    const char* filename = "speedwire_recorder_concurrent_test.cap";
+    remove(filename);
+
+    SpeedwirePacketRecorder recorder(host);
+    ASSERT_TRUE(recorder.open(filename));
+    const int num_threads = 4;
+    const int num_packets = 500;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.push_back(std::thread([&recorder, t, num_packets]() {
+            SpeedwirePacketBufferPool pool(2);
+            for (int i = 0; i < num_packets; ++i) {
+                recordPacket(recorder, pool, 1901234567 + t, 1000000ull * (i + 1));
+            }
+        }));
+    }
+    for (auto& thread : threads) thread.join();
+    recorder.close();
+    ASSERT_EQ(recorder.getNumberOfRecords(), (uint64_t)(num_threads * num_packets));
+    ASSERT_EQ(recorder.getNumberOfErrors(), 0);
+
+    SpeedwireReplayDispatcher replay(host);
+    LastPacketReceiver receiver(host);
+    replay.registerReceiver(receiver);
+    ASSERT_TRUE(replay.open(filename));
+    ASSERT_EQ(replay.replay(10 * num_threads * num_packets), num_threads * num_packets);
+    replay.close();
+    ASSERT_EQ(replay.getNumberOfDroppedPackets(), 0);
+    ASSERT_EQ(receiver.count, num_threads * num_packets);
+    receiver.last.reset();
+
+    remove(filename);
+}
+
+// test that packets are replayed at the recorded pace
+TEST(SpeedwirePacketRecorderTest, RecordedPace) {
+    LocalHost& host = LocalHost::getInstance();
+    const char* filename = "speedwire_recorder_pace_test.cap";
+    remove(filename);
+
+    SpeedwirePacketBufferPool pool(2);
+    SpeedwirePacketRecorder recorder(host);
+    ASSERT_TRUE(recorder.open(filename));
+    for (uint32_t i = 0; i < 3; ++i) {
+        recordPacket(recorder, pool, 1901234567, 1000000000ull + 50000000ull * i);
+    }
+    recorder.close();
+
+    SpeedwireReplayDispatcher replay(host, SpeedwireReplayDispatcher::Pace::RECORDED);
+    LastPacketReceiver receiver(host);
+    replay.registerReceiver(receiver);
+    ASSERT_TRUE(replay.open(filename));
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ASSERT_EQ(replay.replay(10), 3);
+    const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+    replay.close();
+    ASSERT_GE(elapsed, std::chrono::milliseconds(100));
+    ASSERT_LT(elapsed, std::chrono::milliseconds(1000));
+    ASSERT_EQ(receiver.count, 3);
+    receiver.last.reset();
+
+    remove(filename);
+}
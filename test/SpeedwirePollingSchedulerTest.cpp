@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <SpeedwirePollingScheduler.hpp>
+
+using namespace libspeedwire;
+
+// scheduler recording the sent queries instead of sending them, and exposing the poll method taking an explicit time
+class TestScheduler : public SpeedwirePollingScheduler {
+public:
+    std::vector<Command> sent;
+    uint16_t packet_id;
+
+    TestScheduler(SpeedwireCommand& command) : SpeedwirePollingScheduler(command, 500, 4000), packet_id(0x8000) {}
+
+    int poll(const uint64_t now) { return SpeedwirePollingScheduler::poll(now); }
+
+    // complete all in-flight queries by removing their tokens, as done by the reply receiver
+    void completeAll(void) { command.getTokenRepository().clear(); }
+
+protected:
+    virtual SpeedwireCommandTokenIndex sendQueryRequest(const SpeedwireDevice& peer, const PollingTask& task) {
+        sent.push_back(task.command);
+        return command.getTokenRepository().add(peer.deviceAddress.susyID, peer.deviceAddress.serialNumber, ++packet_id, "192.168.1.10", task.command);
+    }
+};
+
+// test deadline ordering, device limits and backoff
+TEST(SpeedwirePollingSchedulerTest, Schedule) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireDevice peer;
+    peer.deviceAddress.susyID = 0x0179;
+    peer.deviceAddress.serialNumber = 1901234567;
+    SpeedwireCommand command(host, std::vector<SpeedwireDevice>());
+
+    TestScheduler scheduler(command);
+    scheduler.addDevice(peer, 1, 100);
+    scheduler.addTask(peer, Command::AC_QUERY, 0x00464000, 0x004642FF, 1000);
+    scheduler.addTask(peer, Command::ENERGY_QUERY, 0x00260100, 0x002622FF, 60000);
+
+    // both tasks are due; the in-flight limit admits one query
+    const uint64_t t0 = 1700000000000ull;
+    ASSERT_EQ(scheduler.poll(t0), 1);
+    ASSERT_EQ(scheduler.sent.back(), Command::AC_QUERY);
+    ASSERT_EQ(scheduler.poll(t0 + 10), 0);
+
+    // the reply completes the query; the minimum gap holds back the next one
+    scheduler.completeAll();
+    ASSERT_EQ(scheduler.poll(t0 + 50), 0);
+    ASSERT_EQ(scheduler.getNumberOfCompletedQueries(), 1);
+    ASSERT_EQ(scheduler.getNextDeadline(), t0 + 100);
+    ASSERT_EQ(scheduler.poll(t0 + 100), 1);
+    ASSERT_EQ(scheduler.sent.back(), Command::ENERGY_QUERY);
+    scheduler.completeAll();
+
+    // the ac query is due again after its interval
+    ASSERT_EQ(scheduler.poll(t0 + 999), 0);
+    ASSERT_EQ(scheduler.poll(t0 + 1000), 1);
+    ASSERT_EQ(scheduler.sent.back(), Command::AC_QUERY);
+
+    // no reply: it times out and the next query is delayed by 2 * interval
+    ASSERT_EQ(scheduler.poll(t0 + 1499), 0);
+    ASSERT_EQ(scheduler.poll(t0 + 1500), 0);
+    ASSERT_EQ(scheduler.getNumberOfTimeouts(), 1);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+    ASSERT_EQ(scheduler.getNextDeadline(), t0 + 3500);
+    ASSERT_EQ(scheduler.poll(t0 + 3499), 0);
+    ASSERT_EQ(scheduler.poll(t0 + 3500), 1);
+
+    // a second timeout doubles the delay, limited to the maximum backoff
+    ASSERT_EQ(scheduler.poll(t0 + 4000), 0);
+    ASSERT_EQ(scheduler.getNextDeadline(), t0 + 8000);
+    ASSERT_EQ(scheduler.poll(t0 + 8000), 1);
+    ASSERT_EQ(scheduler.poll(t0 + 8500), 0);
+    ASSERT_EQ(scheduler.getNextDeadline(), t0 + 12500);
+
+    // a reply resets the backoff
+    ASSERT_EQ(scheduler.poll(t0 + 12500), 1);
+    scheduler.completeAll();
+    ASSERT_EQ(scheduler.poll(t0 + 12600), 0);
+    ASSERT_EQ(scheduler.getNextDeadline(), t0 + 13500);
+    ASSERT_EQ(scheduler.getNumberOfSentQueries(), 6);
+
+    scheduler.clear();
+    ASSERT_EQ(scheduler.getNextDeadline(), UINT64_MAX);
+}
@@ -0,0 +1,229 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <AddressConversion.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireQueryEngine.hpp>
+
+using namespace libspeedwire;
+
+// engine recording the sent queries instead of sending them, and exposing the poll method taking an explicit time
+class TestEngine : public SpeedwireQueryEngine {
+public:
+    std::vector<std::pair<SpeedwireCommand::QueryRequest, uint16_t>> sent;  // queries with their packet ids
+    uint16_t packet_id;
+    bool fail_sends;                                                        // true to fail all sends, as for an unresolvable device address
+
+    TestEngine(SpeedwireCommand& command, SpeedwireQueryHandler& handler) :
+        SpeedwireQueryEngine(LocalHost::getInstance(), command, handler, 2, 1000, 1), packet_id(0x8000), fail_sends(false) {}
+
+    int poll(const uint64_t now) { return SpeedwireQueryEngine::poll(now); }
+
+protected:
+    virtual std::vector<SpeedwireCommandTokenIndex> sendQueryRequests(const std::vector<SpeedwireCommand::QueryRequest>& requests) {
+        std::vector<SpeedwireCommandTokenIndex> tokens;
+        for (auto& request : requests) {
+            if (fail_sends) {
+                tokens.push_back(-1);
+                continue;
+            }
+            ++packet_id;
+            sent.push_back(std::make_pair(request, packet_id));
+            tokens.push_back(command.getTokenRepository().add(request.peer->deviceAddress.susyID, request.peer->deviceAddress.serialNumber, packet_id, "192.168.1.10", request.command));
+        }
+        return tokens;
+    }
+};
+
+// handler recording completions and failures; it optionally submits new queries or cancels all queries on failures
+class TestHandler : public SpeedwireQueryHandler {
+public:
+    std::vector<uint32_t> completed;            // first register ids of completed queries
+    std::vector<uint16_t> failed;               // error codes of failed queries
+    std::vector<Failure> failures;              // reasons of failed queries
+    std::vector<uint32_t> failed_registers;     // first register ids of failed queries
+    SpeedwireQueryEngine* engine = NULL;
+    std::vector<SpeedwireDevice>* resubmit_devices = NULL;
+    bool cancel_on_failure = false;
+
+    virtual void queryCompleted(const SpeedwireCommand::QueryRequest& query, SpeedwireHeader& reply, struct sockaddr& src) {
+        completed.push_back(query.first_register);
+    }
+    virtual void queryFailed(const SpeedwireCommand::QueryRequest& query, const Failure failure, const uint16_t error_code) {
+        failed.push_back(error_code);
+        failures.push_back(failure);
+        failed_registers.push_back(query.first_register);
+        if (resubmit_devices != NULL) {
+            for (auto& device : *resubmit_devices) {
+                engine->submit(device, query.command, query.first_register, query.last_register);
+            }
+        }
+        if (cancel_on_failure == true) {
+            engine->cancel();
+        }
+    }
+};
+
+// inject a reply to the given query into the engine
+static void reply(SpeedwireQueryEngine& engine, const SpeedwireDevice& device, const uint16_t packet_id, const uint16_t error_code) {
+    uint8_t buff[SpeedwireCommand::query_request_size + 12];
+    memset(buff, 0, sizeof(buff));
+    SpeedwireHeader header(buff, sizeof(buff));
+    header.setDefaultHeader(1, (uint16_t)(sizeof(buff) - 20), SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireData2Packet(header).setControl(0xa0);
+    SpeedwireInverterProtocol inverter(header);
+    inverter.setDstSusyID(SpeedwireAddress::getLocalAddress().susyID);
+    inverter.setDstSerialNumber(SpeedwireAddress::getLocalAddress().serialNumber);
+    inverter.setSrcSusyID(device.deviceAddress.susyID);
+    inverter.setSrcSerialNumber(device.deviceAddress.serialNumber);
+    inverter.setErrorCode(error_code);
+    inverter.setPacketID(packet_id);
+    inverter.setCommandID(Command::AC_QUERY | Command::QUERY_RESPONSE);
+
+    struct sockaddr_in src;
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_port = htons(SpeedwireSocket::speedwire_port_9522);
+    src.sin_addr = AddressConversion::toInAddress("192.168.1.10");
+    engine.receive(header, AddressConversion::toSockAddr(src));
+}
+
+static SpeedwireDevice makeDevice(const uint32_t serial) {
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 0x0179;
+    device.deviceAddress.serialNumber = serial;
+    device.deviceIpAddress = "192.168.1.10";
+    return device;
+}
+
+// test the window limit, reply matching and the error code path
+TEST(SpeedwireQueryEngineTest, WindowAndReplies) {
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestHandler handler;
+    TestEngine engine(command, handler);
+    SpeedwireDevice device = makeDevice(1901234567);
+    SpeedwireDevice other = makeDevice(1901234568);
+    for (uint32_t i = 0; i < 5; ++i) {
+        engine.submit(device, Command::AC_QUERY, 0x00464000 + i, 0x004642FF);
+    }
+
+    // the window admits two queries
+    const uint64_t t0 = 1700000000000ull;
+    ASSERT_EQ(engine.poll(t0), 2);
+    ASSERT_EQ(engine.poll(t0 + 10), 0);
+    ASSERT_EQ(engine.getNumberOfInFlightQueries(), 2);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 3);
+
+    // replies with a wrong packet id or from another device are ignored
+    reply(engine, device, engine.packet_id + 1, 0);
+    reply(engine, other, engine.sent[0].second, 0);
+    ASSERT_EQ(handler.completed.size(), 0);
+
+    // replies are matched out of order; the packet id bit 15 is not echoed by all devices
+    reply(engine, device, engine.sent[1].second & 0x7fff, 0);
+    reply(engine, device, engine.sent[0].second, 0);
+    ASSERT_EQ(handler.completed, std::vector<uint32_t>({ 0x00464001, 0x00464000 }));
+    ASSERT_EQ(engine.getNumberOfCompletedQueries(), 2);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+
+    // a duplicate reply is ignored
+    reply(engine, device, engine.sent[0].second, 0);
+    ASSERT_EQ(handler.completed.size(), 2);
+
+    // the window admits the next two queries
+    ASSERT_EQ(engine.poll(t0 + 20), 2);
+    ASSERT_EQ(engine.sent[2].first.first_register, 0x00464002);
+
+    // a not authenticated reply fails the query and marks the device for login
+    reply(engine, device, engine.sent[2].second, 0x0017);
+    ASSERT_EQ(handler.failed, std::vector<uint16_t>({ 0x0017 }));
+    ASSERT_EQ(engine.getNumberOfFailedQueries(), 1);
+    ASSERT_TRUE(command.getTokenRepository().needs_login);
+    ASSERT_EQ(command.getTokenRepository().needs_login_devices.size(), 1);
+    ASSERT_EQ(engine.getNumberOfInFlightQueries(), 1);
+}
+
+// test timeouts, retries and handlers submitting or cancelling queries from the failure callback
+TEST(SpeedwireQueryEngineTest, TimeoutAndRetry) {
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestHandler handler;
+    TestEngine engine(command, handler);
+    handler.engine = &engine;
+    SpeedwireDevice device = makeDevice(1901234567);
+    engine.submit(device, Command::AC_QUERY, 0x00464000, 0x004642FF);
+    engine.submit(device, Command::DC_QUERY, 0x00251E00, 0x00251EFF);
+
+    // the first timeout retries both queries with new packet ids
+    const uint64_t t0 = 1700000000000ull;
+    ASSERT_EQ(engine.poll(t0), 2);
+    ASSERT_EQ(engine.poll(t0 + 999), 0);
+    ASSERT_EQ(engine.poll(t0 + 1000), 2);
+    ASSERT_EQ(engine.getNumberOfRetries(), 2);
+    ASSERT_EQ(handler.failed.size(), 0);
+    ASSERT_EQ(engine.sent.size(), 4);
+    ASSERT_EQ(command.getTokenRepository().size(), 2);
+
+    // a reply to the retransmission completes the query; the stale packet id is not matched
+    reply(engine, device, engine.sent[0].second, 0);
+    ASSERT_EQ(handler.completed.size(), 0);
+    reply(engine, device, engine.sent[2].second, 0);
+    ASSERT_EQ(handler.completed.size(), 1);
+
+    // the second timeout fails the query; the handler submits to many new devices, reallocating the device queues
+    std::vector<SpeedwireDevice> new_devices;
+    for (uint32_t i = 0; i < 64; ++i) {
+        new_devices.push_back(makeDevice(1900000000 + i));
+    }
+    handler.resubmit_devices = &new_devices;
+    ASSERT_EQ(engine.poll(t0 + 2000), 64);
+    ASSERT_EQ(handler.failed, std::vector<uint16_t>({ 0 }));
+    ASSERT_EQ(engine.getNumberOfFailedQueries(), 1);
+    ASSERT_EQ(engine.getNumberOfInFlightQueries(), 64);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 0);
+
+    // all of them time out twice; the handler cancels everything on the first failure, but each failure is delivered
+    handler.resubmit_devices = NULL;
+    handler.cancel_on_failure = true;
+    ASSERT_EQ(engine.poll(t0 + 3000), 64);
+    ASSERT_EQ(engine.getNumberOfRetries(), 2 + 64);
+    ASSERT_EQ(engine.poll(t0 + 4000), 0);
+    ASSERT_EQ(handler.failed.size(), 1 + 64);
+    ASSERT_EQ(engine.getNumberOfInFlightQueries(), 0);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 0);
+    ASSERT_EQ(command.getTokenRepository().size(), 0);
+}
+
+// test that queries which cannot be sent are retried in order and finally fail
+TEST(SpeedwireQueryEngineTest, SendFailure) {
+    SpeedwireCommand command(LocalHost::getInstance(), std::vector<SpeedwireDevice>());
+    TestHandler handler;
+    TestEngine engine(command, handler);
+    SpeedwireDevice device = makeDevice(1901234567);
+    for (uint32_t i = 0; i < 3; ++i) {
+        engine.submit(device, Command::AC_QUERY, 0x00464000 + i, 0x004642FF);
+    }
+
+    // the first send failure counts as a retry; the queries stay in front of the queue
+    const uint64_t t0 = 1700000000000ull;
+    engine.fail_sends = true;
+    ASSERT_EQ(engine.poll(t0), 0);
+    ASSERT_EQ(engine.getNumberOfRetries(), 2);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 3);
+    ASSERT_EQ(handler.failed.size(), 0);
+
+    // the second send failure exhausts the retries of the first two queries
+    ASSERT_EQ(engine.poll(t0 + 1), 0);
+    ASSERT_EQ(handler.failed_registers, std::vector<uint32_t>({ 0x00464000, 0x00464001 }));
+    ASSERT_EQ(handler.failures[0], SpeedwireQueryHandler::Failure::SEND_ERROR);
+    ASSERT_EQ(handler.failures[1], SpeedwireQueryHandler::Failure::SEND_ERROR);
+    ASSERT_EQ(handler.failed, std::vector<uint16_t>({ 0, 0 }));
+    ASSERT_EQ(engine.getNumberOfFailedQueries(), 2);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 1);
+
+    // the third query is sent once sending works again
+    engine.fail_sends = false;
+    ASSERT_EQ(engine.poll(t0 + 2), 1);
+    ASSERT_EQ(engine.sent.size(), 1);
+    ASSERT_EQ(engine.sent[0].first.first_register, 0x00464002);
+    ASSERT_EQ(engine.getNumberOfPendingQueries(), 0);
+    ASSERT_EQ(command.getTokenRepository().size(), 1);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <SpeedwireByteEncoding.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireQueryPlanner.hpp>
+
+using namespace libspeedwire;
+
+static SpeedwireDevice createDevice(void) {
+    SpeedwireDevice device;
+    device.deviceAddress.susyID = 0x0179;
+    device.deviceAddress.serialNumber = 1901234567;
+    return device;
+}
+
+static SpeedwireDataMap createDataMap(void) {
+    SpeedwireDataMap map;
+    map.add(SpeedwireData::InverterPowerL1);        // 0x00464000
+    map.add(SpeedwireData::InverterPowerL2);        // 0x00464100
+    map.add(SpeedwireData::InverterPowerL3);        // 0x00464200
+    map.add(SpeedwireData::InverterVoltageL1);      // 0x00464800
+    map.add(SpeedwireData::InverterPowerMPP1);      // 0x00251E00 connector 1
+    map.add(SpeedwireData::InverterPowerMPP2);      // 0x00251E00 connector 2
+    return map;
+}
+
+// test merging of adjacent registers and splitting at gaps
+TEST(SpeedwireQueryPlannerTest, Merge) {
+    SpeedwireDevice device = createDevice();
+    SpeedwireDataMap map = createDataMap();
+
+    SpeedwireQueryPlanner planner;
+    planner.add(device, map);
+    const std::vector<SpeedwireQueryPlanner::PlannedQuery>& plan = planner.getPlannedQueries();
+    ASSERT_EQ(plan.size(), 3);
+    ASSERT_EQ(plan[0].command, Command::AC_QUERY);
+    ASSERT_EQ(plan[0].first_register, 0x00464000);
+    ASSERT_EQ(plan[0].last_register,  0x004642FF);
+    ASSERT_EQ(plan[0].estimated_reply_size, 3 * 28);
+    ASSERT_EQ(plan[1].first_register, 0x00464800);
+    ASSERT_EQ(plan[1].last_register,  0x004648FF);
+    ASSERT_EQ(plan[2].command, Command::DC_QUERY);
+    ASSERT_EQ(plan[2].first_register, 0x00251E00);
+    ASSERT_EQ(plan[2].last_register,  0x00251EFF);
+    ASSERT_EQ(plan[2].estimated_reply_size, 2 * 28);
+
+    std::vector<SpeedwireCommand::QueryRequest> requests = planner.getQueryRequests();
+    ASSERT_EQ(requests.size(), 3);
+    ASSERT_EQ(requests[1].peer, &device);
+    ASSERT_EQ(requests[1].first_register, 0x00464800);
+
+    // allow gaps of up to 5 unrequested registers
+    SpeedwireQueryPlanner gap_planner(SpeedwireQueryPlanner::default_max_reply_size, 5);
+    gap_planner.add(device, map);
+    ASSERT_EQ(gap_planner.getPlannedQueries().size(), 2);
+    ASSERT_EQ(gap_planner.getPlannedQueries()[0].first_register, 0x00464000);
+    ASSERT_EQ(gap_planner.getPlannedQueries()[0].last_register,  0x004648FF);
+    ASSERT_EQ(gap_planner.getPlannedQueries()[0].estimated_reply_size, 9 * 28);
+
+    // limit the reply size to two registers
+    SpeedwireQueryPlanner size_planner(2 * 28, 5);
+    size_planner.add(device, map);
+    ASSERT_EQ(size_planner.getPlannedQueries().size(), 4);
+    ASSERT_EQ(size_planner.getPlannedQueries()[0].last_register, 0x004641FF);
+    ASSERT_EQ(size_planner.getPlannedQueries()[1].first_register, 0x00464200);
+    ASSERT_EQ(size_planner.getPlannedQueries()[1].last_register,  0x004642FF);
+
+    planner.clear();
+    ASSERT_EQ(planner.getPlannedQueries().size(), 0);
+}
+
+// test demultiplexing of a merged reply into the individual data entries
+TEST(SpeedwireQueryPlannerTest, Demultiplex) {
+    SpeedwireDevice device = createDevice();
+    SpeedwireDataMap map = createDataMap();
+    SpeedwireQueryPlanner planner;
+    planner.add(device, map);
+
+    // reply to the ac query 0x00464000 ... 0x004642FF: protocol header, 34 bytes inverter header and three elements of 28 bytes each
+    uint8_t buff[256];
+    memset(buff, 0, sizeof(buff));
+    SpeedwireHeader header(buff, sizeof(buff));
+    header.setDefaultHeader(1, 4 + 34 + 3 * 28, SpeedwireData2Packet::sma_inverter_protocol_id);
+    SpeedwireInverterProtocol inverter(header);
+    inverter.setSrcSusyID(device.deviceAddress.susyID);
+    inverter.setSrcSerialNumber(device.deviceAddress.serialNumber);
+    inverter.setPacketID(0x8001);
+    inverter.setCommandID(Command::AC_QUERY | Command::QUERY_RESPONSE);
+    inverter.setFirstRegisterID(0);
+    inverter.setLastRegisterID(2);
+    for (uint32_t i = 0; i < 3; ++i) {
+        inverter.setDataUint32(i * 28 + 0, 0x40000001 | ((0x4640 + i) << 8));  // type signed32, register, connector 1
+        inverter.setDataUint32(i * 28 + 4, 1600000000);                         // timestamp
+        for (uint32_t j = 0; j < 5; ++j) {
+            inverter.setDataUint32(i * 28 + 8 + 4 * j, 100 * (i + 1));
+        }
+    }
+    ASSERT_EQ(planner.demultiplex(header), 3);
+    ASSERT_EQ(map[SpeedwireData::InverterPowerL1.toKey()].time, 1600000000);
+    ASSERT_EQ(map[SpeedwireData::InverterPowerL2.toKey()].measurementValues.getNumberOfElements(), 1);
+    ASSERT_EQ(map[SpeedwireData::InverterVoltageL1.toKey()].measurementValues.getNumberOfElements(), 0);
+
+    // reply from an unknown device
+    inverter.setSrcSerialNumber(12345);
+    ASSERT_EQ(planner.demultiplex(header), -1);
+}
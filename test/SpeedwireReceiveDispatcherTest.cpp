@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <SpeedwireEmeterProtocol.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireReceiveDispatcher.hpp>
+#include <SpeedwireThreadedReceiveDispatcher.hpp>
+#include <SpeedwireShardedReceiveDispatcher.hpp>
+
+#if defined(__linux__)
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+using namespace libspeedwire;
+
+// dispatcher exposing dispatchPacket() to pass packets without sockets
+class TestDispatcher : public SpeedwireReceiveDispatcher {
+public:
+    TestDispatcher(LocalHost& host) : SpeedwireReceiveDispatcher(host, 4) {}
+    DropReason reason;
+    int dispatch(const uint8_t* data, const int size) {
+        SpeedwirePacketHandle packet = packet_pool.allocate();
+        memcpy(packet.getData(), data, size);
+        packet.setSize(size);
+        reason = DropReason::NUMBER_OF_REASONS;
+        return dispatchPacket(packet, reason);
+    }
+};
+
+// receivers counting their packets
+class CountingReceiver : public SpeedwirePacketReceiverBase {
+public:
+    int count;
+    CountingReceiver(LocalHost& host) : SpeedwirePacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) { ++count; }
+};
+
+class CountingEmeterReceiver : public EmeterPacketReceiverBase {
+public:
+    int count;
+    CountingEmeterReceiver(LocalHost& host) : EmeterPacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) { ++count; }
+};
+
+class CountingExtendedEmeterReceiver : public ExtendedEmeterPacketReceiverBase {
+public:
+    int count;
+    CountingExtendedEmeterReceiver(LocalHost& host) : ExtendedEmeterPacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) { ++count; }
+};
+
+class CountingDiscoveryReceiver : public DiscoveryPacketReceiverBase {
+public:
+    int count;
+    CountingDiscoveryReceiver(LocalHost& host) : DiscoveryPacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) { ++count; }
+};
+
+// assemble an emeter packet with the given protocol id and serial number
+static int assembleEmeterPacket(uint8_t* buff, const uint16_t protocol_id, const uint32_t serial) {
+    memset(buff, 0, 128);
+    SpeedwireHeader header(buff, 128);
+    header.setDefaultHeader(1, 64, protocol_id);
+    SpeedwireEmeterProtocol emeter(header);
+    emeter.setSusyID(349);
+    emeter.setSerialNumber(serial);
+    return 4 + 8 + 4 + 64 + 4;
+}
+
+// test routing of packets by protocol id and device
+TEST(SpeedwireReceiveDispatcherTest, Routing) {
+    LocalHost& host = LocalHost::getInstance();
+    TestDispatcher dispatcher(host);
+    CountingReceiver any(host);
+    CountingEmeterReceiver emeter(host);
+    CountingExtendedEmeterReceiver extended(host);
+    CountingReceiver device(host);
+    CountingDiscoveryReceiver discovery(host);
+    dispatcher.registerReceiver(any);
+    dispatcher.registerReceiver(emeter);
+    dispatcher.registerReceiver(extended);
+    dispatcher.registerReceiver(device, SpeedwireData2Packet::sma_emeter_protocol_id, 349, 1901234567);
+    dispatcher.registerReceiver(discovery);
+
+    uint8_t packet[128];
+    int size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    ASSERT_EQ(dispatcher.dispatch(packet, size), 1);
+    size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234568);
+    ASSERT_EQ(dispatcher.dispatch(packet, size), 1);
+    size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_extended_emeter_protocol_id, 1901234567);
+    ASSERT_EQ(dispatcher.dispatch(packet, size), 1);
+    const uint8_t discovery_request[] = { 0x53, 0x4d, 0x41, 0x00, 0x00, 0x04, 0x02, 0xa0, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
+    ASSERT_EQ(dispatcher.dispatch(discovery_request, sizeof(discovery_request)), 0);
+
+    ASSERT_EQ(any.count, 4);
+    ASSERT_EQ(emeter.count, 3);
+    ASSERT_EQ(extended.count, 1);
+    ASSERT_EQ(device.count, 1);
+    ASSERT_EQ(discovery.count, 4);
+}
+
+// test routing of many protocol ids, such that the route hash table grows and probes colliding slots
+TEST(SpeedwireReceiveDispatcherTest, RoutingManyProtocols) {
+    LocalHost& host = LocalHost::getInstance();
+    TestDispatcher dispatcher(host);
+    std::vector<CountingReceiver> receivers(40, CountingReceiver(host));
+    for (size_t i = 0; i < receivers.size(); ++i) {
+        dispatcher.registerReceiver(receivers[i], (uint16_t)(0x7000 + 16 * i));
+    }
+
+    uint8_t packet[128];
+    for (size_t i = 0; i < receivers.size(); ++i) {
+        int size = assembleEmeterPacket(packet, (uint16_t)(0x7000 + 16 * i), 1901234567);
+        ASSERT_EQ(dispatcher.dispatch(packet, size), 0);
+        size = assembleEmeterPacket(packet, (uint16_t)(0x7001 + 16 * i), 1901234567);
+        ASSERT_EQ(dispatcher.dispatch(packet, size), -1);
+        ASSERT_EQ(dispatcher.reason, SpeedwireReceiveDispatcher::DropReason::UNKNOWN_PROTOCOL);
+    }
+    for (auto& receiver : receivers) {
+        ASSERT_EQ(receiver.count, 1);
+    }
+}
+
+// test drop reasons of invalid packets
+TEST(SpeedwireReceiveDispatcherTest, DropReasons) {
+    LocalHost& host = LocalHost::getInstance();
+    TestDispatcher dispatcher(host);
+    CountingReceiver any(host);
+    dispatcher.registerReceiver(any);
+
+    static uint8_t packet[SpeedwireReceiveDispatcher::max_udp_packet_size];
+    int size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    packet[0] = 'X';
+    ASSERT_EQ(dispatcher.dispatch(packet, size), -1);
+    ASSERT_EQ(dispatcher.reason, SpeedwireReceiveDispatcher::DropReason::BAD_SIGNATURE);
+
+    // a packet of an unknown protocol is only dropped if there is no receiver for all packets
+    size = assembleEmeterPacket(packet, 0x1234, 1901234567);
+    ASSERT_EQ(dispatcher.dispatch(packet, size), 0);
+    ASSERT_EQ(dispatcher.reason, SpeedwireReceiveDispatcher::DropReason::NUMBER_OF_REASONS);
+    ASSERT_EQ(any.count, 1);
+    TestDispatcher unsubscribed(host);
+    ASSERT_EQ(unsubscribed.dispatch(packet, size), -1);
+    ASSERT_EQ(unsubscribed.reason, SpeedwireReceiveDispatcher::DropReason::UNKNOWN_PROTOCOL);
+
+    memset(packet, 0, 128);
+    SpeedwireHeader header(packet, 128);
+    header.setDefaultHeader(1, 64, SpeedwireData2Packet::sma_inverter_protocol_id);
+    packet[4 + 8 + 4 + 2] = 3;      // long words mismatching the length field
+    size = 4 + 8 + 4 + 64 + 4;
+    ASSERT_EQ(dispatcher.dispatch(packet, size), -1);
+    ASSERT_EQ(dispatcher.reason, SpeedwireReceiveDispatcher::DropReason::BAD_LENGTH);
+
+    ASSERT_EQ(dispatcher.dispatch(packet, (int)SpeedwireReceiveDispatcher::max_udp_packet_size), -1);
+    ASSERT_EQ(dispatcher.reason, SpeedwireReceiveDispatcher::DropReason::BUFFER_OVERFLOW);
+
+    // a valid packet is still dispatched after invalid packets
+    size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    ASSERT_EQ(dispatcher.dispatch(packet, size), 1);
+    ASSERT_EQ(any.count, 2);
+}
+
+#if defined(__linux__)
+// receiver counting its packets slowly, such that packet buffers run out
+class SlowReceiver : public SpeedwirePacketReceiverBase {
+public:
+    std::atomic<int> count;
+    SlowReceiver(LocalHost& host) : SpeedwirePacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ++count;
+    }
+};
+
+// test that a blocking reader waits for free packet buffers without losing packets
+TEST(SpeedwireReceiveDispatcherTest, ThreadedBlockOverflow) {
+    LocalHost& host = LocalHost::getInstance();
+    SpeedwireSocket socket(host);
+    ASSERT_GE(socket.openSocket("127.0.0.4", false, 9524), 0);
+
+    SpeedwireThreadedReceiveDispatcher dispatcher(host, 2, 1, SpeedwireThreadedReceiveDispatcher::OverflowPolicy::BLOCK);
+    SlowReceiver receiver(host);
+    dispatcher.registerReceiver(receiver);
+    ASSERT_TRUE(dispatcher.start(std::vector<SpeedwireSocket>(1, socket)));
+
+    int tx = (int)::socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    ASSERT_GE(tx, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9524);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.4");
+    uint8_t packet[128];
+    const int size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    const int num_packets = 50;
+    for (int i = 0; i < num_packets; ++i) {
+        ASSERT_EQ(sendto(tx, packet, size, 0, (struct sockaddr*)&addr, sizeof(addr)), size);
+    }
+    for (int i = 0; i < 500 && receiver.count < num_packets; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    dispatcher.stop();
+    ::close(tx);
+    socket.closeSocket();
+
+    ASSERT_EQ(receiver.count, num_packets);
+    ASSERT_EQ(dispatcher.getNumberOfReceivedPackets(), (uint64_t)num_packets);
+    ASSERT_EQ(dispatcher.getNumberOfDroppedPackets(), 0u);
+}
+
+// socket factory opening a group of sharded sockets on a loopback address instead of the speedwire port of each interface
+class LoopbackShardedSocketFactory : public SpeedwireSocketFactory {
+public:
+    bool opened;
+    LoopbackShardedSocketFactory(LocalHost& host, const std::string& local_ip, const uint16_t port, const unsigned int shards) :
+        SpeedwireSocketFactory(host, SocketStrategy::ONE_UNICAST_SOCKET_FOR_EACH_INTERFACE) {
+        number_of_shards = shards;
+        opened = openShardedSocketsForSingleInterface(local_ip, port);
+    }
+};
+
+// sharded dispatcher exposing the ids of its shard threads
+class TestShardedDispatcher : public SpeedwireShardedReceiveDispatcher {
+public:
+    TestShardedDispatcher(LocalHost& host, SpeedwireSocketFactory& factory) : SpeedwireShardedReceiveDispatcher(host, factory, 16) {}
+    std::thread::id getThreadId(const unsigned int shard) const { return shards[shard]->thread.get_id(); }
+    size_t getNumberOfSockets(const unsigned int shard) const { return shards[shard]->sockets.size(); }
+};
+
+// receiver recording the threads it is called from and the source addresses of its packets
+class ShardReceiver : public EmeterPacketReceiverBase {
+public:
+    std::atomic<int> count;
+    std::set<std::thread::id> threads;
+    std::set<uint32_t> sources;
+    ShardReceiver(LocalHost& host) : EmeterPacketReceiverBase(host), count(0) {}
+    virtual void receive(SpeedwireHeader& packet, struct sockaddr& src) {
+        threads.insert(std::this_thread::get_id());
+        sources.insert(ntohl(((struct sockaddr_in&)src).sin_addr.s_addr));
+        ++count;
+    }
+};
+
+// send packets to the given destination from a socket bound to the given source address
+static void sendFrom(const char* src_ip, const char* dst_ip, const uint16_t port, const int num_packets) {
+    int tx = (int)::socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    ASSERT_GE(tx, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(src_ip);
+    ASSERT_EQ(bind(tx, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(dst_ip);
+    uint8_t packet[128];
+    const int size = assembleEmeterPacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    for (int i = 0; i < num_packets; ++i) {
+        ASSERT_EQ(sendto(tx, packet, size, 0, (struct sockaddr*)&addr, sizeof(addr)), size);
+    }
+    ::close(tx);
+}
+
+// test that sharded sockets are opened and that the packets of each source address reach the thread of their shard
+TEST(SpeedwireReceiveDispatcherTest, ShardedDispatch) {
+    LocalHost& host = LocalHost::getInstance();
+    LoopbackShardedSocketFactory factory(host, "127.0.0.9", 9526, 2);
+    ASSERT_TRUE(factory.opened);
+    ASSERT_EQ(factory.getNumberOfShards(), 2u);
+    ASSERT_EQ(factory.getShardRecvSockets(0).size(), 1u);
+    ASSERT_EQ(factory.getShardRecvSockets(1).size(), 1u);
+    ASSERT_NE(factory.getShardRecvSockets(0)[0].getSocketFd(), factory.getShardRecvSockets(1)[0].getSocketFd());
+
+    TestShardedDispatcher dispatcher(host, factory);
+    ASSERT_EQ(dispatcher.getNumberOfShards(), 2u);
+    ASSERT_EQ(dispatcher.getNumberOfSockets(0), 1u);
+    ASSERT_EQ(dispatcher.getNumberOfSockets(1), 1u);
+    ShardReceiver receiver0(host), receiver1(host);
+    dispatcher.getShardDispatcher(0).registerReceiver(receiver0);
+    dispatcher.getShardDispatcher(1).registerReceiver(receiver1);
+    ASSERT_TRUE(dispatcher.start());
+    ASSERT_FALSE(dispatcher.start());
+    const std::thread::id thread0 = dispatcher.getThreadId(0);
+    const std::thread::id thread1 = dispatcher.getThreadId(1);
+    ASSERT_NE(thread0, thread1);
+
+    // the reuseport hash folds the upper half of the source address onto the lower half; .12 maps to shard 0, .13 to shard 1
+    const int num_packets = 20;
+    sendFrom("127.0.0.12", "127.0.0.9", 9526, num_packets);
+    sendFrom("127.0.0.13", "127.0.0.9", 9526, num_packets);
+    for (int i = 0; i < 500 && receiver0.count + receiver1.count < 2 * num_packets; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    dispatcher.stop();
+    ASSERT_FALSE(dispatcher.isRunning());
+
+    ASSERT_EQ(receiver0.count, num_packets);
+    ASSERT_EQ(receiver1.count, num_packets);
+    ASSERT_EQ(dispatcher.getNumberOfReceivedPackets(0), (uint64_t)num_packets);
+    ASSERT_EQ(dispatcher.getNumberOfReceivedPackets(1), (uint64_t)num_packets);
+    ASSERT_EQ(receiver0.threads, std::set<std::thread::id>({ thread0 }));
+    ASSERT_EQ(receiver1.threads, std::set<std::thread::id>({ thread1 }));
+    ASSERT_EQ(receiver0.sources, std::set<uint32_t>({ 0x7f00000c }));
+    ASSERT_EQ(receiver1.sources, std::set<uint32_t>({ 0x7f00000d }));
+}
+#endif
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <SpeedwireHeader.hpp>
+#include <SpeedwireData2Packet.hpp>
+#include <SpeedwireEmeterProtocol.hpp>
+#include <SpeedwireInverterProtocol.hpp>
+#include <SpeedwireSocketFilter.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+using namespace libspeedwire;
+
+// assemble an emeter or inverter packet with the given protocol id and source serial number
+static unsigned long assemblePacket(uint8_t* buff, const uint16_t protocol_id, const uint32_t serial) {
+    memset(buff, 0, 128);
+    SpeedwireHeader header(buff, 128);
+    header.setDefaultHeader(1, 64, protocol_id);
+    if (SpeedwireData2Packet::isInverterProtocolID(protocol_id)) {
+        SpeedwireInverterProtocol inverter(header);
+        inverter.setSrcSusyID(0x1234);
+        inverter.setSrcSerialNumber(serial);
+    }
+    else if (SpeedwireData2Packet::isEmeterProtocolID(protocol_id) || SpeedwireData2Packet::isExtendedEmeterProtocolID(protocol_id)) {
+        SpeedwireEmeterProtocol emeter(header);
+        emeter.setSusyID(0x1234);
+        emeter.setSerialNumber(serial);
+    }
+    return 4 + 8 + 4 + 64 + 4;
+}
+
+// test the structure of the compiled program
+TEST(SpeedwireSocketFilterTest, Compile) {
+    std::vector<SpeedwireSocketFilter::Instruction> program;
+
+    SpeedwireSocketFilter any;
+    ASSERT_TRUE(any.compile(program));
+    ASSERT_EQ(program.size(), 7);
+
+    SpeedwireSocketFilter filter = SpeedwireSocketFilter::getDefaultFilter();
+    ASSERT_EQ(filter.getProtocolIDs().size(), 4);
+    ASSERT_TRUE(filter.compile(program));
+    ASSERT_EQ(program.back().code, 0x06);
+    ASSERT_EQ(program.back().k, 0);
+
+    // the filter is too large for forward jumps of at most 255 instructions
+    for (uint32_t serial = 1; serial <= 300; ++serial) {
+        filter.addSerialNumber(serial);
+    }
+    ASSERT_FALSE(filter.compile(program));
+}
+
+// test the structure of the compiled reuseport program
+TEST(SpeedwireSocketFilterTest, CompileReusePortHash) {
+    std::vector<SpeedwireSocketFilter::Instruction> program;
+    ASSERT_FALSE(SpeedwireSocketFilter::compileReusePortHash(program, false, 0));
+    ASSERT_TRUE(SpeedwireSocketFilter::compileReusePortHash(program, false, 4));
+    ASSERT_EQ(program.size(), 6);
+    ASSERT_EQ(program[4].k, 4);
+    ASSERT_EQ(program.back().code, 0x16);
+}
+
+#if defined(__linux__)
+// test the filter attached to a loopback udp socket
+TEST(SpeedwireSocketFilterTest, Attach) {
+    int rx = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    int tx = (int)socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    ASSERT_GE(rx, 0);
+    ASSERT_GE(tx, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(rx, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    socklen_t addrlen = sizeof(addr);
+    ASSERT_EQ(getsockname(rx, (struct sockaddr*)&addr, &addrlen), 0);
+
+    SpeedwireSocketFilter filter;
+    filter.addProtocolID(SpeedwireData2Packet::sma_emeter_protocol_id);
+    filter.addProtocolID(SpeedwireData2Packet::sma_inverter_protocol_id);
+    filter.addSerialNumber(1901234567);
+    ASSERT_EQ(filter.attach(rx), 0);
+
+    // send packets and return whether they passed the filter
+    auto passes = [&](const uint8_t* packet, const unsigned long size) {
+        uint8_t buff[256];
+        EXPECT_EQ(sendto(tx, (const char*)packet, size, 0, (struct sockaddr*)&addr, sizeof(addr)), (ssize_t)size);
+        usleep(10000);
+        return recv(rx, (char*)buff, sizeof(buff), MSG_DONTWAIT) == (ssize_t)size;
+    };
+    uint8_t packet[128];
+    unsigned long size = assemblePacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234567);
+    ASSERT_TRUE(passes(packet, size));
+    size = assemblePacket(packet, SpeedwireData2Packet::sma_inverter_protocol_id, 1901234567);
+    ASSERT_TRUE(passes(packet, size));
+    size = assemblePacket(packet, SpeedwireData2Packet::sma_emeter_protocol_id, 1901234568);
+    ASSERT_FALSE(passes(packet, size));
+    size = assemblePacket(packet, SpeedwireData2Packet::sma_extended_emeter_protocol_id, 1901234567);
+    ASSERT_FALSE(passes(packet, size));
+    packet[0] = 'X';
+    ASSERT_FALSE(passes(packet, size));
+
+    // discovery request packet
+    const uint8_t discovery[] = { 0x53, 0x4d, 0x41, 0x00, 0x00, 0x04, 0x02, 0xa0, 0xff, 0xff, 0xff, 0xff, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00 };
+    ASSERT_TRUE(passes(discovery, sizeof(discovery)));
+    filter.setAcceptDiscoveryPackets(false);
+    ASSERT_EQ(filter.attach(rx), 0);
+    ASSERT_FALSE(passes(discovery, sizeof(discovery)));
+
+    ASSERT_EQ(SpeedwireSocketFilter::detach(rx), 0);
+    ASSERT_TRUE(passes(discovery, sizeof(discovery)));
+    close(rx);
+    close(tx);
+}
+#endif
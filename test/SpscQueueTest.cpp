@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <SpscQueue.hpp>
+#include <MpmcQueue.hpp>
+
+using namespace libspeedwire;
+
+// test capacity rounding
+TEST(SpscQueueTest, Capacity) {
+    SpscQueue<int> q1(1);
+    SpscQueue<int> q3(3);
+    SpscQueue<int> q8(8);
+    ASSERT_EQ(q1.getMaximumNumberOfElements(), 2);
+    ASSERT_EQ(q3.getMaximumNumberOfElements(), 4);
+    ASSERT_EQ(q8.getMaximumNumberOfElements(), 8);
+    ASSERT_TRUE(q8.isEmpty());
+}
+
+// test push and pop from a single thread
+TEST(SpscQueueTest, PushPop) {
+    SpscQueue<int> q(4);
+    int value = -1;
+
+    ASSERT_FALSE(q.pop(value));
+    ASSERT_EQ(value, -1);
+
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q.push(i));
+        ASSERT_EQ(q.getNumberOfElements(), i + 1);
+    }
+    ASSERT_FALSE(q.push(4));    // full
+
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(q.pop(value));
+        ASSERT_EQ(value, i);
+    }
+    ASSERT_FALSE(q.pop(value)); // empty
+    ASSERT_TRUE(q.isEmpty());
+
+    // wrap around
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(q.push(i));
+        ASSERT_TRUE(q.pop(value));
+        ASSERT_EQ(value, i);
+    }
+}
+
+// test element order with a producer and a consumer thread
+TEST(SpscQueueTest, ProducerConsumer) {
+    SpscQueue<unsigned> q(16);
+    const unsigned n = 10000;
+
+    std::thread producer([&q, n]() {
+        for (unsigned i = 0; i < n; ) {
+            if (q.push(i)) ++i;
+            else std::this_thread::yield();
+        }
+    });
+
+    unsigned expected = 0;
+    while (expected < n) {
+        unsigned value;
+        if (q.pop(value)) {
+            ASSERT_EQ(value, expected);
+            ++expected;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    ASSERT_TRUE(q.isEmpty());
+}
+
+// test that no element is lost or duplicated with several producer and consumer threads
+TEST(MpmcQueueTest, ProducersConsumers) {
+    MpmcQueue<unsigned> q(16);
+    const unsigned n = 10000;
+    const unsigned num_producers = 4;
+    const unsigned num_consumers = 4;
+    std::atomic<unsigned> popped(0);
+
+    std::vector<std::thread> producers;
+    for (unsigned p = 0; p < num_producers; ++p) {
+        producers.push_back(std::thread([&q, n, p]() {
+            for (unsigned i = 0; i < n; ) {
+                if (q.push(p * n + i)) ++i;
+                else std::this_thread::yield();
+            }
+        }));
+    }
+
+    // each consumer must see the elements of each producer in push order
+    std::vector<std::vector<unsigned>> received(num_consumers);
+    std::vector<int> ordered(num_consumers, 1);   // no vector<bool>, its elements share memory locations
+    std::vector<std::thread> consumers;
+    for (unsigned c = 0; c < num_consumers; ++c) {
+        consumers.push_back(std::thread([&, c]() {
+            std::vector<unsigned> last(num_producers, 0);
+            std::vector<bool> first(num_producers, true);
+            while (popped < num_producers * n) {
+                unsigned value;
+                if (q.pop(value)) {
+                    ++popped;
+                    unsigned p = value / n;
+                    if (first[p] == false && value <= last[p]) {
+                        ordered[c] = 0;
+                    }
+                    first[p] = false;
+                    last[p] = value;
+                    received[c].push_back(value);
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+    for (auto& producer : producers) producer.join();
+    for (auto& consumer : consumers) consumer.join();
+    ASSERT_EQ(q.getNumberOfElements(), 0u);
+
+    std::vector<unsigned> all;
+    for (unsigned c = 0; c < num_consumers; ++c) {
+        ASSERT_EQ(ordered[c], 1);
+        all.insert(all.end(), received[c].begin(), received[c].end());
+    }
+    std::sort(all.begin(), all.end());
+    ASSERT_EQ(all.size(), (size_t)(num_producers * n));
+    for (unsigned i = 0; i < num_producers * n; ++i) {
+        ASSERT_EQ(all[i], i);
+    }
+}
@@ -0,0 +1,93 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <Logger.hpp>
+#include <LocalHost.hpp>
+#include <SpeedwireEmeterSimulator.hpp>
+using namespace libspeedwire;
+
+static Logger logger("speedwire_emeter_simulator");
+
+class LogListener : public ILogListener {
+public:
+    virtual ~LogListener() {}
+    virtual void log_msg(const std::string& msg, const LogLevel& level) { fprintf(stdout, "%s", msg.c_str()); }
+    virtual void log_msg_w(const std::wstring& msg, const LogLevel& level) { fprintf(stdout, "%ls", msg.c_str()); }
+};
+
+static void usage(const char* name) {
+    printf("usage: %s [options]\n", name);
+    printf("  -i <ip>       local ip address of the sending interface (default 127.0.0.1)\n");
+    printf("  -d <ip>       multicast or unicast destination address (default 239.12.255.254)\n");
+    printf("  -n <num>      number of virtual emeters (default 1)\n");
+    printf("  -u <susyid>   susy id of the virtual emeters, e.g. 349 emeter, 372 home manager (default 349)\n");
+    printf("  -s <serial>   serial number of the first virtual emeter (default 1900000000)\n");
+    printf("  -r <rate>     packets per second and emeter, 1 to 1000 (default 1)\n");
+    printf("  -t <seconds>  run time in seconds (default 0, i.e. forever)\n");
+}
+
+int main(int argc, char** argv) {
+    std::string interface_address = "127.0.0.1";
+    std::string destination = "239.12.255.254";
+    unsigned long num_devices = 1;
+    unsigned long susy_id = 349;
+    unsigned long serial_number = 1900000000ul;
+    double rate = 1.0;
+    unsigned long run_time_in_s = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* option = argv[i];
+        if (strcmp(option, "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        }
+        if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        switch (option[1]) {
+        case 'i': interface_address = value;                 break;
+        case 'd': destination       = value;                 break;
+        case 'n': num_devices       = strtoul(value, NULL, 0); break;
+        case 'u': susy_id           = strtoul(value, NULL, 0); break;
+        case 's': serial_number     = strtoul(value, NULL, 0); break;
+        case 'r': rate              = strtod(value, NULL);     break;
+        case 't': run_time_in_s     = strtoul(value, NULL, 0); break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    if (rate < 1.0 || rate > 1000.0 || num_devices == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LogListener log_listener;
+    Logger::setLogListener(&log_listener, LogLevel::LOG_INFO_0 | LogLevel::LOG_WARNING | LogLevel::LOG_ERROR);
+
+    LocalHost& localhost = LocalHost::getInstance();
+    SpeedwireEmeterSimulator simulator(localhost);
+    simulator.setRate(rate);
+    if (simulator.open(interface_address, destination, num_devices, (uint16_t)susy_id, (uint32_t)serial_number) < 0) {
+        return 1;
+    }
+
+    const uint64_t start_time = LocalHost::getTickCountInMs();
+    uint64_t stats_time = start_time;
+    uint64_t stats_packets = 0;
+    while (run_time_in_s == 0 || LocalHost::getTickCountInMs() - start_time < run_time_in_s * 1000) {
+        if (simulator.run(100) < 0) {
+            return 1;
+        }
+        const uint64_t now = LocalHost::getTickCountInMs();
+        if (now - stats_time >= 5000) {
+            const uint64_t packets = simulator.getNumberOfPackets();
+            logger.print(LogLevel::LOG_INFO_0, "packets %llu (%.0f/s)  send errors %llu",
+                (unsigned long long)packets, (packets - stats_packets) * 1000.0 / (now - stats_time), (unsigned long long)simulator.getNumberOfSendErrors());
+            stats_time = now;
+            stats_packets = packets;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <Logger.hpp>
+#include <LocalHost.hpp>
+#include <SpeedwireInverterSimulator.hpp>
+using namespace libspeedwire;
+
+static Logger logger("speedwire_inverter_simulator");
+
+class LogListener : public ILogListener {
+public:
+    virtual ~LogListener() {}
+    virtual void log_msg(const std::string& msg, const LogLevel& level) { fprintf(stdout, "%s", msg.c_str()); }
+    virtual void log_msg_w(const std::wstring& msg, const LogLevel& level) { fprintf(stdout, "%ls", msg.c_str()); }
+};
+
+static void usage(const char* name) {
+    printf("usage: %s [options]\n", name);
+    printf("  -a <ip>       local ip address to listen on; repeat for more sockets (default 127.0.0.2)\n");
+    printf("  -n <num>      number of virtual devices (default 1)\n");
+    printf("  -u <susyid>   susy id of the virtual devices (default 378)\n");
+    printf("  -s <serial>   serial number of the first virtual device (default 3000000000)\n");
+    printf("  -l <ms>       reply latency in ms (default 0)\n");
+    printf("  -j <ms>       maximum random reply jitter in ms (default 0)\n");
+    printf("  -p <percent>  request loss rate in percent (default 0)\n");
+    printf("  -f <num>      maximum number of elements per reply fragment (default 0, i.e. fill packets)\n");
+    printf("  -w <password> user password; -w - disables the login requirement (default 0000)\n");
+    printf("  -t <seconds>  run time in seconds (default 0, i.e. forever)\n");
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> addresses;
+    unsigned long num_devices = 1;
+    unsigned long susy_id = 378;
+    unsigned long serial_number = 3000000000ul;
+    unsigned long latency = 0;
+    unsigned long jitter = 0;
+    double loss_percent = 0.0;
+    unsigned long max_elements = 0;
+    std::string password = "0000";
+    unsigned long run_time_in_s = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* option = argv[i];
+        if (strcmp(option, "-h") == 0) {
+            usage(argv[0]);
+            return 0;
+        }
+        if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' || i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char* value = argv[++i];
+        switch (option[1]) {
+        case 'a': addresses.push_back(value); break;
+        case 'n': num_devices   = strtoul(value, NULL, 0); break;
+        case 'u': susy_id       = strtoul(value, NULL, 0); break;
+        case 's': serial_number = strtoul(value, NULL, 0); break;
+        case 'l': latency       = strtoul(value, NULL, 0); break;
+        case 'j': jitter        = strtoul(value, NULL, 0); break;
+        case 'p': loss_percent  = strtod(value, NULL);     break;
+        case 'f': max_elements  = strtoul(value, NULL, 0); break;
+        case 'w': password      = value;                   break;
+        case 't': run_time_in_s = strtoul(value, NULL, 0); break;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+    LogListener log_listener;
+    Logger::setLogListener(&log_listener, LogLevel::LOG_INFO_0 | LogLevel::LOG_WARNING | LogLevel::LOG_ERROR);
+
+    if (addresses.size() == 0) {
+        addresses.push_back("127.0.0.2");
+    }
+
+    LocalHost& localhost = LocalHost::getInstance();
+    SpeedwireInverterSimulator simulator(localhost);
+    CredentialsMap credentials;
+    credentials.add(UserCode::USER, (password != "-" ? password : ""));
+    simulator.setCredentials(credentials);
+    simulator.setRequireLogin(password != "-");
+    simulator.setLatency((uint32_t)latency, (uint32_t)jitter);
+    simulator.setLossRate(loss_percent / 100.0);
+    simulator.setMaxElementsPerFragment(max_elements);
+
+    if (simulator.open(addresses, num_devices, (uint16_t)susy_id, (uint32_t)serial_number) < 0) {
+        return 1;
+    }
+    for (auto& device : simulator.getDevices()) {
+        logger.print(LogLevel::LOG_INFO_1, "%s", device.toString().c_str());
+    }
+
+    const uint64_t start_time = LocalHost::getTickCountInMs();
+    uint64_t stats_time = start_time;
+    uint64_t stats_requests = 0;
+    while (run_time_in_s == 0 || LocalHost::getTickCountInMs() - start_time < run_time_in_s * 1000) {
+        if (simulator.run(100) < 0) {
+            return 1;
+        }
+        const uint64_t now = LocalHost::getTickCountInMs();
+        if (now - stats_time >= 5000) {
+            const uint64_t requests = simulator.getNumberOfRequests();
+            logger.print(LogLevel::LOG_INFO_0, "requests %llu (%.0f/s)  replies %llu  dropped %llu",
+                (unsigned long long)requests, (requests - stats_requests) * 1000.0 / (now - stats_time),
+                (unsigned long long)simulator.getNumberOfReplies(), (unsigned long long)simulator.getNumberOfDroppedRequests());
+            stats_time = now;
+            stats_requests = requests;
+        }
+    }
+    return 0;
+}